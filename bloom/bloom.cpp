@@ -31,6 +31,12 @@
 #define BLOOM_VERSION_MAJOR 2
 #define BLOOM_VERSION_MINOR 201
 
+#define BLOOM_BLOCK_BYTES 64
+#define BLOOM_BLOCK_BITS 512
+
+// entries, bits, bytes, error, bpe (8 bytes each) + hashes, major, minor + padding
+#define BLOOM_HEADER_SIZE 48
+
 inline static int test_bit_set_bit(uint8_t *bf, uint64_t bit, int set_bit)
 {
   uint64_t byte = bit >> 3;
@@ -46,6 +52,14 @@ inline static int test_bit_set_bit(uint8_t *bf, uint64_t bit, int set_bit)
   }
 }
 
+// Same as test_bit_set_bit but safe to use from many threads at the same time
+inline static int test_bit_set_bit_atomic(uint8_t *bf, uint64_t bit)
+{
+  uint8_t mask = 1 << (bit % 8);
+  uint8_t c = __atomic_fetch_or(&bf[bit >> 3], mask, __ATOMIC_RELAXED);
+  return (c & mask) ? 1 : 0;
+}
+
 inline static int test_bit(uint8_t *bf, uint64_t bit)
 {
   uint64_t byte = bit >> 3;
@@ -58,6 +72,8 @@ inline static int test_bit(uint8_t *bf, uint64_t bit)
   }
 }
 
+#define BLOOM_ADD_ATOMIC 2
+
 static int bloom_check_add(struct bloom * bloom, const void * buffer, int len, int add)
 {
   if (bloom->ready == 0) {
@@ -71,7 +87,7 @@ static int bloom_check_add(struct bloom * bloom, const void * buffer, int len, i
   uint8_t i;
   for (i = 0; i < bloom->hashes; i++) {
     x = (a + b*i) % bloom->bits;
-    if (test_bit_set_bit(bloom->bf, x, add)) {
+    if (add == BLOOM_ADD_ATOMIC ? test_bit_set_bit_atomic(bloom->bf, x) : test_bit_set_bit(bloom->bf, x, add)) {
       hits++;
     } else if (!add) {
       // Don't care about the presence of all the bits. Just our own.
@@ -156,6 +172,154 @@ int bloom_add(struct bloom * bloom, const void * buffer, int len)
   return bloom_check_add(bloom, buffer, len, 1);
 }
 
+int bloom_add_atomic(struct bloom * bloom, const void * buffer, int len)
+{
+  return bloom_check_add(bloom, buffer, len, BLOOM_ADD_ATOMIC);
+}
+
+static int bloom_check_add_blocked(struct bloom * bloom, const void * buffer, int len, int add)
+{
+  if (bloom->ready == 0) {
+    printf("bloom at %p not initialized!\n", (void *)bloom);
+    return -1;
+  }
+  uint8_t hits = 0;
+  uint64_t h = XXH64(buffer, len, 0x9c47d08ffb10d4b8);
+  // The high half of the hash select the block, multiply and shift is cheaper than a modulo
+  uint64_t block = ((h >> 32) * (bloom->bytes / BLOOM_BLOCK_BYTES)) >> 32;
+  uint8_t *bf = bloom->bf + block * BLOOM_BLOCK_BYTES;
+  // The low half select the bits inside of the block, step is odd so all of them are different
+  uint64_t x = h & (BLOOM_BLOCK_BITS - 1);
+  uint64_t step = ((h >> 9) & (BLOOM_BLOCK_BITS - 1)) | 1;
+  uint8_t i;
+  for (i = 0; i < bloom->hashes; i++) {
+    if (add == BLOOM_ADD_ATOMIC ? test_bit_set_bit_atomic(bf, x) : test_bit_set_bit(bf, x, add)) {
+      hits++;
+    } else if (!add) {
+      return 0;
+    }
+    x = (x + step) & (BLOOM_BLOCK_BITS - 1);
+  }
+  if (hits == bloom->hashes) {
+    return 1;
+  }
+  return 0;
+}
+
+int bloom_init_blocked(struct bloom * bloom, uint64_t entries, uint64_t bytes)
+{
+  memset(bloom, 0, sizeof(struct bloom));
+  bytes -= bytes % BLOOM_BLOCK_BYTES;
+  if (entries < 1000 || bytes == 0 || bytes / BLOOM_BLOCK_BYTES > 0xffffffff) {
+    return 1;
+  }
+  bloom->entries = entries;
+  bloom->bytes = bytes;
+  bloom->bits = bytes * 8;
+  bloom->bpe = (double)bloom->bits / (double)entries;
+
+  double hashes = round(0.693147180559945 * bloom->bpe);  // ln(2)
+  if (hashes < 1) hashes = 1;
+  if (hashes > 16) hashes = 16;
+  bloom->hashes = (uint8_t)hashes;
+  bloom->error = pow(1 - exp(-hashes / bloom->bpe), hashes);
+
+#if defined(_WIN64) && !defined(__CYGWIN__)
+  bloom->bf = (uint8_t *)calloc(bloom->bytes, sizeof(uint8_t));
+#else
+  if (posix_memalign((void **)&bloom->bf, BLOOM_BLOCK_BYTES, bloom->bytes) != 0) {
+    bloom->bf = NULL;
+  }
+  if (bloom->bf != NULL) {
+    memset(bloom->bf, 0, bloom->bytes);
+  }
+#endif
+  if (bloom->bf == NULL) {                                   // LCOV_EXCL_START
+    return 1;
+  }                                                          // LCOV_EXCL_STOP
+
+  bloom->ready = 1;
+  bloom->major = BLOOM_VERSION_MAJOR;
+  bloom->minor = BLOOM_VERSION_MINOR;
+  return 0;
+}
+
+int bloom_add_blocked(struct bloom * bloom, const void * buffer, int len)
+{
+  return bloom_check_add_blocked(bloom, buffer, len, 1);
+}
+
+int bloom_add_blocked_atomic(struct bloom * bloom, const void * buffer, int len)
+{
+  return bloom_check_add_blocked(bloom, buffer, len, BLOOM_ADD_ATOMIC);
+}
+
+int bloom_check_blocked(struct bloom * bloom, const void * buffer, int len)
+{
+  return bloom_check_add_blocked(bloom, buffer, len, 0);
+}
+
+uint64_t bloom_estimate_bytes(uint64_t entries, long double error)
+{
+  if (entries < 1000 || error <= 0 || error >= 1) {
+    return 0;
+  }
+  long double bpe = -log(error) / 0.480453013918201; // ln(2)^2
+  uint64_t bits = (uint64_t)((long double)entries * bpe);
+  return bits / 8 + ((bits % 8) ? 1 : 0);
+}
+
+double bloom_expected_error(struct bloom * bloom, uint64_t items)
+{
+  if (bloom->bits == 0 || bloom->hashes == 0) {
+    return 1;
+  }
+  return pow(1 - exp(-(double)bloom->hashes * (double)items / (double)bloom->bits), bloom->hashes);
+}
+
+int bloom_save_header(struct bloom * bloom, FILE * fd)
+{
+  uint8_t header[BLOOM_HEADER_SIZE];
+  double error = (double)bloom->error;
+  memset(header, 0, BLOOM_HEADER_SIZE);
+  memcpy(header, &bloom->entries, 8);
+  memcpy(header + 8, &bloom->bits, 8);
+  memcpy(header + 16, &bloom->bytes, 8);
+  memcpy(header + 24, &error, 8);
+  memcpy(header + 32, &bloom->bpe, 8);
+  header[40] = bloom->hashes;
+  header[41] = bloom->major;
+  header[42] = bloom->minor;
+  if (fwrite(header, BLOOM_HEADER_SIZE, 1, fd) != 1) {
+    return 1;
+  }
+  return 0;
+}
+
+int bloom_load_header(struct bloom * bloom, FILE * fd)
+{
+  uint8_t header[BLOOM_HEADER_SIZE];
+  uint64_t bytes;
+  double error;
+  if (fread(header, BLOOM_HEADER_SIZE, 1, fd) != 1) {
+    return 1;
+  }
+  memcpy(&bytes, header + 16, 8);
+  if (bloom->ready && bloom->bytes != bytes) {
+    return 2;                // The bit field allocated don't match the file
+  }
+  memcpy(&bloom->entries, header, 8);
+  memcpy(&bloom->bits, header + 8, 8);
+  bloom->bytes = bytes;
+  memcpy(&error, header + 24, 8);
+  bloom->error = error;
+  memcpy(&bloom->bpe, header + 32, 8);
+  bloom->hashes = header[40];
+  bloom->major = header[41];
+  bloom->minor = header[42];
+  return 0;
+}
+
 void bloom_print(struct bloom * bloom)
 {
   printf("bloom at %p\n", (void *)bloom);
@@ -8,6 +8,8 @@
 #ifndef _BLOOM_H
 #define _BLOOM_H
 
+#include <stdio.h>
+
 #ifdef _WIN64
 #include <windows.h>
 #endif
@@ -110,6 +112,19 @@ int bloom_init(struct bloom * bloom, size_t entries, double error);
 int bloom_add(struct bloom * bloom, const void * buffer, int len);
 
 
+/** ***************************************************************************
+ * Add an item to the bloom filter from several threads at the same time.
+ *
+ * Every bit is set with an atomic fetch-or, so no lock is needed around
+ * this call. Any bloom_check() must wait until all the threads that are
+ * adding items are done (thread join or any other memory barrier).
+ *
+ * Return: same as bloom_add()
+ *
+ */
+int bloom_add_atomic(struct bloom * bloom, const void * buffer, int len);
+
+
 /** ***************************************************************************
  * Check if an item is possibly in the bloom filter.
  *
@@ -133,6 +148,106 @@ int bloom_add(struct bloom * bloom, const void * buffer, int len);
 int bloom_check(struct bloom * bloom, const void * buffer, int len);
 
 
+/** ***************************************************************************
+ * Initialize a cache line blocked bloom filter with a fixed size.
+ *
+ * All the bits of one item are inside the same 64 bytes block, so any add
+ * or check touch only one cache line. This is intended to be a small first
+ * level filter that keeps resident in L2/L3 in front of a bigger filter.
+ *
+ * The number of hash functions is the optimal for the given bytes per
+ * entry (1 to 16), the expected false positive rate is left in bloom->error.
+ *
+ * Parameters:
+ * -----------
+ *     bloom   - Pointer to an allocated struct bloom (see above).
+ *     entries - The expected number of entries which will be inserted.
+ *     bytes   - Size of the bit field, it is rounded down to 64 bytes.
+ *
+ * Return:
+ * -------
+ *     0 - on success
+ *     1 - on failure
+ *
+ */
+int bloom_init_blocked(struct bloom * bloom, uint64_t entries, uint64_t bytes);
+
+
+/** ***************************************************************************
+ * Add an item to a blocked bloom filter (see bloom_init_blocked).
+ *
+ * Return: same as bloom_add()
+ *
+ */
+int bloom_add_blocked(struct bloom * bloom, const void * buffer, int len);
+
+
+/** ***************************************************************************
+ * Thread safe version of bloom_add_blocked (see bloom_add_atomic).
+ *
+ */
+int bloom_add_blocked_atomic(struct bloom * bloom, const void * buffer, int len);
+
+
+/** ***************************************************************************
+ * Check if an item is possibly in a blocked bloom filter.
+ *
+ * Return: same as bloom_check()
+ *
+ */
+int bloom_check_blocked(struct bloom * bloom, const void * buffer, int len);
+
+
+/** ***************************************************************************
+ * Size in bytes of the bit field that bloom_init2() would allocate for the
+ * given entries and error, without allocating anything. Returns 0 for the
+ * same invalid values that make bloom_init2() fail.
+ *
+ */
+uint64_t bloom_estimate_bytes(uint64_t entries, long double error);
+
+
+/** ***************************************************************************
+ * Expected false positive rate of the filter once items entries were added.
+ *
+ * Unlike bloom->error, which is the target rate for bloom->entries, this is
+ * computed from the real bits, hashes and the given number of items:
+ *     error = (1 - e^(-hashes * items / bits)) ^ hashes
+ *
+ */
+double bloom_expected_error(struct bloom * bloom, uint64_t items);
+
+
+/** ***************************************************************************
+ * Write the parameters of the bloom filter to an open file.
+ *
+ * Only the public fields are written, in a fixed 48 bytes layout, the bf
+ * pointer and the padding of struct bloom never reach the file. The bit
+ * field itself is not written, the caller writes bloom->bytes after this.
+ *
+ * Return:
+ *     0 - on success
+ *     1 - on failure
+ *
+ */
+int bloom_save_header(struct bloom * bloom, FILE * fd);
+
+
+/** ***************************************************************************
+ * Read the parameters written by bloom_save_header().
+ *
+ * If the bloom is already initialized the current bf is kept, and the
+ * stored size must be the same as the allocated one.
+ *
+ * Return:
+ *     0 - on success
+ *     1 - read error
+ *     2 - bytes in the file don't match the initialized bloom
+ *
+ */
+int bloom_load_header(struct bloom * bloom, FILE * fd);
+
+
 /** ***************************************************************************
  * Print (to stdout) info about this bloom filter. Debugging aid.
  *
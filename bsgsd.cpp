@@ -11,6 +11,7 @@ email: albertobsd@gmail.com
 #include <time.h>
 #include <vector>
 #include <inttypes.h>
+#include <stdarg.h>
 #include "base58/libbase58.h"
 #include "rmd160/rmd160.h"
 #include "oldbloom/oldbloom.h"
@@ -31,10 +32,19 @@ email: albertobsd@gmail.com
 #include <pthread.h>
 #include <sys/random.h>
 #include <linux/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h> // for inet_addr()
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/vfs.h>
 #include <pthread.h>   // for pthread functions
 
 #define PORT 8080
@@ -52,17 +62,240 @@ struct checksumsha256	{
 	char backup[32];
 };
 
-struct bsgs_xvalue	{
+#define BSGS_FILE_MAGIC "KHBSGSBF"
+#define BSGS_FILE_VERSION 1
+
+/*
+	Header of the keyhunt_bsgs_*.blm files, followed by every shard:
+	bloom_save_header, the bit field and the struct checksumsha256.
+	The keyhunt_bsgs_2_*.tbl files use it with BSGS_TABLE_MAGIC and the size of
+	one entry in shards, followed by the packed table and its sha256.
+*/
+struct bsgs_file_header	{
+	char magic[8];
+	uint32_t version;
+	uint32_t shards;
+	uint64_t items;
+};
+
+/*
+	Packed 11 bytes entry of the bP table, the index is never bigger than bsgs_m3 (< 2^40)
+*/
+struct __attribute__((__packed__)) bsgs_xvalue	{
+	uint8_t value[6];
+	uint8_t index[5];	//Little endian index of the bP point, get/set with bsgs_xvalue_index
+};
+
+/*
+	Entry of the bP table files made before the packed format, 16 bytes with the padding
+*/
+struct bsgs_xvalue_old	{
 	uint8_t value[6];
 	uint64_t index;
 };
 
+#define BSGS_TABLE_MAGIC "KHBSGSTB"
+#define BSGS_XVALUE_MAXINDEX ((uint64_t)1 << 40)
+
+/*
+	Option -H, hash index in place of the 3rd bloom filter and the sorted bP table.
+	The bytes 8 to 15 of X select the bucket and every bucket is one cache line
+	with HASHINDEX_SLOTS entries, a full bucket continues in the next one.
+*/
+#define HASHINDEX_SLOTS 6
+#define HASHINDEX_VALUE 5
+#define HASHINDEX_LOAD 4	//Average entries per bucket, 2/3 of the slots
+#define BSGS_HASHINDEX_MAGIC "KHBSGSHX"
+
+struct __attribute__((__packed__)) hashindex_slot	{
+	uint8_t value[HASHINDEX_VALUE];	//Bytes 16 to 20 of X, the same bytes of the bP table
+	uint8_t index[5];
+};
+
+struct alignas(64) hashindex_bucket	{
+	uint8_t count;
+	uint8_t unused[3];
+	struct hashindex_slot slot[HASHINDEX_SLOTS];
+};
+
+/*
+	Option -T, the tables in a POSIX shared memory segment (or a file of a hugetlbfs
+	mount) that other processes with the same parameters attach read only. The header
+	is at the start, the blooms are the struct bloom of this build with the offset of
+	their bit field in bf, every bit field and table starts in a new cache line.
+*/
+#define BSGS_SHARED_MAGIC "KHBSGSSM"
+#define BSGS_SHARED_VERSION 1
+#define BSGS_SHARED_HASHINDEX 1
+#define BSGS_SHARED_PREFILTER 2
+
+struct bsgs_shared_header	{
+	char magic[8];
+	uint32_t version;
+	uint32_t ready;			//Set the last one by the process that fills the segment
+	uint64_t length;
+	uint64_t m,m2,m3;
+	uint64_t pre_bytes;		//-L of the process that made it, 0 without -L
+	uint32_t shards;
+	uint32_t flags;
+	uint32_t bloom_size;	//sizeof(struct bloom) and sizeof(struct bsgs_xvalue) of the build
+	uint32_t xvalue_size;
+	uint64_t blooms;		//Offsets from the start of the segment
+	uint64_t table;			//bP table or hash index
+	uint64_t directory;
+	uint64_t hashindex_buckets;
+};
+
+/*
+	Sorted table search helpers, the first 16 bits select the directory bucket and the
+	next 32 bits are the interpolation key, both big endian like the memcmp order.
+	The key alone only orders the entries of one bucket, so without the directory
+	the search is a plain binary search.
+*/
+#define SEARCH_DIRECTORY_SIZE 65536
+#define SEARCH_INTERPOLATION_PROBES 4
+#define RADIX_SORT_MIN 1048576	//Smaller tables are sorted with only one thread
+#define search_prefix(v) (((uint32_t)(v)[0] << 8) | (uint32_t)(v)[1])
+#define search_key(v) (((uint32_t)(v)[2] << 24) | ((uint32_t)(v)[3] << 16) | ((uint32_t)(v)[4] << 8) | (uint32_t)(v)[5])
+
 struct tothread {
 	int nt;     //Number thread
 	char *rs;   //range start
 	char *rpt;  //rng per thread
 };
 
+#define TABLES_MAPS 4
+
+/*
+	One set of BSGS tables for a -n and -k: the values that come from them and the
+	filters and the bP table. The set made at start is tables_start, RELOAD maps a
+	new set from its files in the background and bsgs_tables_swap makes it the one of
+	the new jobs. Every job holds one reference of its set and the current set one more,
+	the set is freed when the last of them is gone.
+*/
+struct bsgs_tables	{
+	Int N_param;				//-n as it was given, N can be rounded down to a multiple of M
+	Int N,M,M2,M3;
+	Int M_double,M2_double,M3_double;
+	uint64_t m,m2,m3,aux;
+	int kfactor;
+	struct bloom *bP;
+	struct bloom *bPx2nd;
+	struct bloom *bPx3rd;
+	struct bloom bP_pre;
+	struct bsgs_xvalue *table;
+	uint64_t *directory;
+	struct hashindex_bucket *hashindex;
+	uint64_t hashindex_buckets;
+	uint8_t *maps[TABLES_MAPS];		//Files mapped for the set, bP, 2nd, 3rd and bP table
+	uint64_t maps_length[TABLES_MAPS];
+	std::vector<Point> GSn;			//Giant steps of the walk, from M
+	Point _2GSn;
+	std::vector<Point> AMP2;		//Steps of the second and third checks, from M2 and M3
+	std::vector<Point> AMP3;
+	uint32_t refs;					//Jobs on the set, plus one while it is tables_current
+};
+
+/*
+	Interval of keys [from,to) already searched for one public key
+*/
+struct memo_interval	{
+	Int from;
+	Int to;
+};
+
+/*
+	Searched intervals of one public key, sorted and merged. Only the network thread
+	uses the memo, an interval is added when a job ends without CANCEL.
+*/
+struct memo_entry	{
+	uint8_t publickey[33];	//Compressed public key, the memo is sorted by it
+	std::vector<struct memo_interval> intervals;
+};
+
+/*
+	Part of the range of a job that is not in the memo for some of its targets, its
+	blocks are numbered after the blocks of the segments before it.
+*/
+struct job_segment	{
+	Int start;
+	uint64_t first;		//Index of its first block in the job
+	uint64_t blocks;
+};
+
+/*
+	One search of a client. The blooms and the bP table are shared and read only, all
+	the state of the search is here so the worker pool can run several jobs at once.
+	workers, exhausted, found, keys, remaining, blocks_done and done are changed only with
+	mutex_jobs.
+*/
+struct bsgs_job	{
+	uint64_t id;				//Number of the job for PROGRESS and CANCEL
+	std::vector<Point> targets;	//Public keys of the request, all in the same range
+	std::vector<bool> compressed;
+	std::vector<int> found;		//1 found, -1 the whole range is in the memo so it is not searched
+	std::vector<Int> keys;		//Private key of each found target
+	std::vector<Int> skipped;	//Keys of the range already in the memo for each target
+	uint32_t remaining;			//Targets not found yet
+	Int range_from;				//Range of the request
+	Int range_to;
+	struct bsgs_tables *tables;	//Set of tables of the job, it holds one reference of it
+	std::vector<struct job_segment> segments;	//Blocks of 2*BSGS_N keys of the range without the memo
+	Int block;
+	uint64_t next_block;		//First block not taken yet, atomic
+	uint32_t weight;			//Share of the pool against the other jobs, 1 to 100
+	uint32_t workers;			//Workers scanning a block of this job now
+	int exhausted;				//A worker got a block after the last segment or all the keys were found
+	int cancelled;				//CANCEL or the client is gone, the workers leave it at the next giant steps
+	int done;					//No more workers on it, the client can reply
+	uint64_t blocks;			//Blocks of the range, UINT64_MAX if there are more
+	uint64_t blocks_done;
+	uint64_t start_ms;
+	std::vector<int> sent;		//Found keys already replied, only for the network thread
+	struct bsgs_job *next;
+};
+
+/*
+	Request of a connection waiting for its reply, job is NULL if the reply was known
+	when the line or the frame was read (bad requests and KEEPALIVE).
+*/
+struct client_request	{
+	struct bsgs_job *job;
+	const char *reply;
+	int binary;				//Request frame, the reply is a frame too (400 if job is NULL)
+	struct client_request *next;
+};
+
+/*
+	Connection of a client, only the network thread uses it. Old clients send one
+	request and the connection is closed after its reply. After a KEEPALIVE line the
+	connection stays open, the client can send more requests without waiting and
+	the replies are sent in the same order, each one ended in '\n'.
+*/
+struct client_conn	{
+	int fd;						//-1 once closed, it is freed when its jobs are done
+	char ip[INET_ADDRSTRLEN];
+	int port;
+	char *in;					//Bytes received without a complete line yet
+	int in_length;
+	int in_size;
+	char *out;					//Replies not sent yet
+	int out_length;
+	int out_size;
+	uint32_t events;			//Events registered in epoll
+	int keepalive;
+	int metrics;				//Connection of the -W port, 1 until the request line, then 2 for /metrics or 3
+	int eof;					//The client closed its side, the pending requests are replied
+	uint64_t watch;				//ms between the PROGRESS lines of the running jobs, 0 without WATCH
+	uint64_t watch_next;
+	uint32_t requests;
+	uint32_t replied;
+	uint64_t last_recv;			//ms of the last received bytes, see REQUEST_WAIT_MS
+	struct client_request *queue;
+	struct client_request *queue_last;
+	struct client_conn *next;
+};
+
 struct bPload	{
 	uint32_t threadid;
 	uint64_t from;
@@ -73,6 +306,55 @@ struct bPload	{
 	uint32_t finished;
 };
 
+#define TELEMETRY_TIERS 5
+#define TIER_PRE 0
+#define TIER_BP 1
+#define TIER_2ND 2
+#define TIER_3RD 3
+#define TIER_TABLE 4
+
+struct alignas(64) tier_counters	{
+	uint64_t probes[TELEMETRY_TIERS];
+	uint64_t hits[TELEMETRY_TIERS];
+	uint64_t matches;
+	uint64_t steps;		//Blocks of N keys scanned by the thread
+};
+
+/*
+	Request latency histogram of the -W metrics, upper bound of each bucket in seconds
+*/
+#define METRICS_BUCKETS 10
+const double metrics_bounds[METRICS_BUCKETS] = {0.1,0.5,1,5,10,30,60,300,1800,3600};
+
+/*
+	Parallel sort of the bP table and the address table, see radix_sort()
+*/
+struct radix_sort	{
+	uint8_t *arr;
+	uint8_t *temp;
+	int64_t n;
+	size_t size;		//Bytes of one element, the first two are the bucket
+	int nthreads;
+	uint64_t *counts;	//Histogram of every thread, then its offsets in temp
+	uint64_t *buckets;	//Start of every bucket in temp
+	void (*sort_bucket)(uint8_t *arr,int64_t n);
+};
+
+struct radix_sort_thread	{
+	struct radix_sort *sort;
+	int threadid;
+	int phase;
+};
+
+/*
+	Result of the quick calibration of the -P planner, nanoseconds per operation of one thread
+*/
+struct plan_calibration	{
+	double point_ns;	//One giant step point, grouped ModInv and the X value
+	double probe_ns;	//One probe of a bloom filter bigger than the cache
+	double preprobe_ns;	//One probe of a cache resident first level filter
+};
+
 
 	
 const char *version = "0.3.250907 AMD Enhanced BSGS Server";
@@ -83,21 +365,63 @@ int port;
 
 #define CPU_GRP_SIZE 1024
 
+/*
+	Public keys of one request that walk together in the workers, see bsgs_walk_job
+*/
+#define BSGS_WALK_TARGETS 8
+#define BSGS_WALK_GROUP (CPU_GRP_SIZE / 2 + 1)
+
+/*
+	Limits of one client request, a line with REQUEST_MAX_TARGETS uncompressed public
+	keys separated by commas and the range. If the line doesn't end in '\n' the request
+	ends when the client doesn't send more data in REQUEST_WAIT_MS
+*/
+#define REQUEST_MAX_TARGETS 4096
+#define REQUEST_MAX_LENGTH (REQUEST_MAX_TARGETS * 131 + 256)
+#define REQUEST_WAIT_MS 100
+#define EPOLL_EVENTS 64
+
+/*
+	Binary requests: a frame starts with REQUEST_FRAME_MAGIC, that byte is never the
+	first one of a text line. Header of 8 bytes: magic, version, weight (0 is 1), flags
+	(0) and the length of the body in 32 bits big endian. The body is the range from
+	and to in 32 bytes big endian each, then the compressed public keys of 33 bytes.
+	The reply frame has the same header with the status (200, 400, 404 or 410) in the
+	bytes of weight and flags, its body is one record of REPLY_FRAME_RECORD bytes per
+	public key: the state (REPLY_FRAME_*) and 32 bytes, the private key if it was found
+	or the keys skipped because of the memo.
+*/
+#define REQUEST_FRAME_MAGIC 0xB5
+#define REQUEST_FRAME_VERSION 1
+#define REQUEST_FRAME_HEADER 8
+#define REQUEST_FRAME_MAX (64 + REQUEST_MAX_TARGETS * 33)
+#define REPLY_FRAME_RECORD 33
+#define REPLY_FRAME_NOT_FOUND 0
+#define REPLY_FRAME_FOUND 1
+#define REPLY_FRAME_CANCELLED 2
+
+/*
+	State of RELOAD, only one at a time
+*/
+#define RELOAD_IDLE 0
+#define RELOAD_LOADING 1	//thread_reload is mapping or building the new set
+#define RELOAD_READY 2		//tables_next waits for the network thread to swap it
+#define RELOAD_FAILED 3
+
 std::vector<Point> Gn;
 Point _2Gn;
 
-std::vector<Point> GSn;
-Point _2GSn;
-
 
 void menu();
 void init_generator();
 
-int sendstr(int client_fd,const char *str);
 
 void sleep_ms(int milliseconds);
 
 void bsgs_sort(struct bsgs_xvalue *arr,int64_t n);
+void bsgs_sort_bucket(uint8_t *arr,int64_t n);
+void radix_sort(uint8_t *arr,int64_t n,size_t size,void (*sort_bucket)(uint8_t *arr,int64_t n));
+void radix_sort_phase(struct radix_sort *sort,int phase);
 void bsgs_myheapsort(struct bsgs_xvalue *arr, int64_t n);
 void bsgs_insertionsort(struct bsgs_xvalue *arr, int64_t n);
 void bsgs_introsort(struct bsgs_xvalue *arr,uint32_t depthLimit, int64_t n);
@@ -106,20 +430,107 @@ void bsgs_heapify(struct bsgs_xvalue *arr, int64_t n, int64_t i);
 int64_t bsgs_partition(struct bsgs_xvalue *arr, int64_t n);
 
 int bsgs_searchbinary(struct bsgs_xvalue *arr,char *data,int64_t array_length,uint64_t *r_value);
-int bsgs_secondcheck(Int *start_range,uint32_t a,Int *privatekey);
-int bsgs_thirdcheck(Int *start_range,uint32_t a,Int *privatekey);
+void bsgs_build_directory(struct bsgs_xvalue *arr,int64_t array_length,uint64_t *directory);
+uint64_t bsgs_xvalue_index(struct bsgs_xvalue *xvalue);
+void bsgs_xvalue_setindex(struct bsgs_xvalue *xvalue,uint64_t index);
+int bsgs_read_table(const char *filename);
+void bsgs_write_table(const char *filename);
+int bsgs_map_table(const char *filename);
+void bsgs_sync_table();
+void bsgs_sort_mapped();
+void bsgs_merge_sift(uint64_t *heap,uint64_t *pos,uint64_t runs,uint64_t r);
+void bsgs_hashindex_init();
+void bsgs_hashindex_add(char *data,uint64_t index);
+int bsgs_hashindex_search(char *data,uint64_t *r_value);
+int bsgs_read_hashindex(const char *filename);
+void bsgs_write_hashindex(const char *filename);
+int bsgs_shared_open(const char *name,int flags);
+void bsgs_shared_unlink(const char *name);
+uint64_t bsgs_shared_align(uint64_t offset);
+void bsgs_shared_blooms(std::vector<struct bloom*> &list);
+int bsgs_shared_attach(const char *name);
+void bsgs_shared_create(const char *name);
+int bsgs_firstcheck(char *xpoint_raw);
+uint32_t bsgs_shard(char *xpoint_raw);
+int bsgs_read_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items);
+void bsgs_write_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items);
+void bsgs_batch_x(Point &base,std::vector<Point> &points,char xpoint_raw[][32]);
+int bsgs_secondcheck(Int *start_range,uint32_t a,Point *target,Int *privatekey);
+int bsgs_thirdcheck(Int *start_range,uint32_t a,Point *target,Int *privatekey);
+struct bsgs_job *bsgs_job_next();
+void bsgs_job_found(struct bsgs_job *job,uint32_t k,Int *key);
+void bsgs_job_cancel(struct bsgs_job *job);
+int bsgs_job_progress(struct bsgs_job *job,uint64_t now,char *dst,size_t length);
+void bsgs_job_notify();
+struct bsgs_job *bsgs_job_parse(char *line);
+struct bsgs_job *bsgs_job_frame(uint8_t *frame,uint32_t length);
+void bsgs_job_init(struct bsgs_job *job);
+void bsgs_walk_job(struct bsgs_job *job,Int *base_key,Point &point_aux,uint32_t cycles,IntGroup *grp,Int *dx);
+
+uint64_t now_ms();
+struct client_conn *client_accept(int server_fd);
+void client_read(struct client_conn *conn);
+void client_parse(struct client_conn *conn);
+void client_line(struct client_conn *conn,char *line,int length);
+void client_frame(struct client_conn *conn,uint8_t *frame,uint32_t length);
+void client_job(struct client_conn *conn,struct client_request *request,struct bsgs_job *job);
+void client_queue(struct client_conn *conn,struct client_request *request);
+void client_frame_reply(struct client_conn *conn,struct bsgs_job *job);
+int client_verb(struct client_conn *conn,char *line);
+void client_reload(struct client_conn *conn,char *line);
+void client_write(struct client_conn *conn,const char *data,int length);
+void client_send(struct client_conn *conn);
+void client_events(struct client_conn *conn);
+void client_close(struct client_conn *conn);
+int client_update(struct client_conn *conn,uint64_t now);
+const char *client_skipped(struct bsgs_job *job,uint32_t k,char *dst,size_t length);
+void bsgs_job_release(struct bsgs_job *job,int exhausted);
+int bsgs_job_take(struct bsgs_job *job,Int *base);
+void bsgs_job_plan(struct bsgs_job *job,Int *from,Int *to);
+void bsgs_job_segment(struct bsgs_job *job,Int *start,Int *end);
+
+int bsgs_params(struct bsgs_tables *t,Int *n,int kfactor);
+void bsgs_params_use(struct bsgs_tables *t);
+uint8_t *bsgs_map_file(const char *filename,uint64_t *length);
+int bsgs_map_blooms(const char *filename,struct bloom *blooms,uint32_t shards,uint64_t items,uint8_t **map,uint64_t *length);
+int bsgs_tables_map(struct bsgs_tables *t);
+int bsgs_tables_build(struct bsgs_tables *t);
+void bsgs_tables_free(struct bsgs_tables *t);
+void bsgs_tables_free_start();
+void bsgs_tables_start_use();
+void bsgs_tables_release(struct bsgs_tables *t);
+void bsgs_tables_swap();
+void bsgs_reload_update();
+void *thread_reload(void *vargp);
+
+struct memo_entry *memo_find(Point &target,int create);
+void memo_add(struct memo_entry *entry,Int *from,Int *to);
+void memo_subtract(struct memo_entry *entry,Int *from,Int *to,std::vector<struct memo_interval> &left);
+void memo_record(struct bsgs_job *job);
+void memo_load(const char *filename);
 
 
 void writekey(bool compressed,Int *key);
 void checkpointer(void *ptr,const char *file,const char *function,const  char *name,int line);
 
-void* client_handler(void* arg);
 
 
 void calcualteindex(int i,Int *key);
 
 void *thread_process_bsgs(void *vargp);
+void telemetry_totals(uint64_t *probes,uint64_t *hits,uint64_t *matches);
+double telemetry_observed(uint64_t probes,uint64_t hits,uint64_t matches);
+double telemetry_expected(int tier);
+char *telemetry_line(char *line,size_t length);
+void telemetry_dump(const char *filename);
+void metrics_printf(struct client_conn *conn,const char *format,...);
+void metrics_reply(struct client_conn *conn);
+void plan_calibrate(struct plan_calibration *cal);
+uint64_t plan_memory(uint64_t m,uint64_t prefilter_bytes);
+void plan_time(double seconds,char *dst,size_t length);
+void plan_run(uint64_t targets,double range_bits);
 void *thread_bPload(void *vargp);
+void *thread_radix_sort(void *vargp);
 void *thread_bPload_2blooms(void *vargp);
 
 char *publickeytohashrmd160(char *pkey,int length);
@@ -139,8 +550,44 @@ const char *bsgs_modes[5] = {"secuential","backward","both","random","dance"};
 pthread_t *tid = NULL;
 pthread_mutex_t write_keys;
 pthread_mutex_t write_random;
-pthread_mutex_t mutex_bsgs_thread;
 pthread_mutex_t *bPload_mutex;
+pthread_mutex_t mutex_jobs;
+pthread_cond_t cond_jobs;		//Signaled when a job is added
+int epoll_fd;
+int notify_fd;					//eventfd, the workers wake up the network thread when a job changes
+struct client_conn *conns = NULL;
+uint64_t job_counter = 0;
+
+/*
+	-W metrics, only the network thread changes these, the worker counters are in telemetry
+*/
+int metrics_port = 0;
+uint64_t metrics_latency[METRICS_BUCKETS + 1];
+uint64_t metrics_latency_count = 0;
+double metrics_latency_sum = 0;
+uint64_t metrics_start_ms;
+
+struct bsgs_job *jobs = NULL;	//Jobs with blocks left or workers on them, in arrival order
+
+/*
+	RELOAD, reload_state and tables_next are changed only with mutex_jobs. The workers read
+	the set of their job, tables_current and the references of the sets are only changed
+	by the network thread, so a new set is used by the new jobs at once.
+*/
+struct bsgs_tables tables_start;		//Set made at start, its memory is also in the globals
+struct bsgs_tables *tables_current = &tables_start;	//Set of the new jobs
+struct bsgs_tables *tables_next = NULL;
+uint64_t tables_generation = 0;		//Sets loaded by RELOAD, only for the metrics
+int reload_state = RELOAD_IDLE;
+struct client_conn *reload_conn = NULL;	//Connection that gets the end of the RELOAD
+int FLAGBUILDONLY = 0;
+const char *shared_name = NULL;	//-T segment
+uint8_t *shared_map = NULL;
+uint64_t shared_length = 0;
+int FLAGSHARED = 0;	//The tables are from a segment filled by other process
+
+std::vector<struct memo_entry> memo;	//Searched intervals of each public key, sorted by public key
+char *memo_file = NULL;				//-M file of the memo
 
 uint64_t FINISHED_THREADS_COUNTER = 0;
 uint64_t FINISHED_THREADS_BP = 0;
@@ -162,8 +609,6 @@ uint64_t DEBUGCOUNT = 0x400;
 uint64_t u64range;
 
 
-Int BSGSkeyfound;
-
 int FLAGSKIPCHECKSUM = 0;
 int FLAGBSGSMODE = 0;
 int FLAGDEBUG = 0;
@@ -176,7 +621,13 @@ int FLAGREADEDFILE1 = 0;
 int FLAGREADEDFILE2 = 0;
 int FLAGREADEDFILE3 = 0;
 int FLAGREADEDFILE4 = 0;
+int FLAGREADEDFILE5 = 0;
 int FLAGUPDATEFILE1 = 0;
+int FLAGUPDATEFILE3 = 0;
+int FLAGPREFILTER = 0;
+int FLAGHASHINDEX = 0;
+int FLAGOUTOFCORE = 0;
+int FLAGPLAN = 0;
 
 
 int FLAGBITRANGE = 0;
@@ -195,31 +646,48 @@ uint64_t BSGS_XVALUE_RAM = 6;
 uint64_t BSGS_BUFFERXPOINTLENGTH = 32;
 uint64_t BSGS_BUFFERREGISTERLENGTH = 36;
 
-/*
-BSGS Variables
-*/
-int bsgs_found;
-Point OriginalPointsBSGS;
-bool OriginalPointsBSGScompressed;
-
 uint64_t bytes;
 char checksum[32],checksum_backup[32];
 char buffer_bloom_file[1024];
 struct bsgs_xvalue *bPtable;
+uint64_t *bPtable_directory = NULL;
+uint8_t *bPtable_map = NULL;	//Whole keyhunt_bsgs_2_*.tbl file with -O
+char bPtable_map_name[1024];
+struct hashindex_bucket *hashindex = NULL;
+uint64_t hashindex_buckets = 0;
 
 struct oldbloom oldbloom_bP;
 
 struct bloom *bloom_bP;
 struct bloom *bloom_bPx2nd; //2nd Bloom filter check
 struct bloom *bloom_bPx3rd; //3rd Bloom filter check
+struct bloom bloom_bP_pre;	//First level filter (-L) small enough to stay in L2/L3, checked before bloom_bP
 
 struct checksumsha256 *bloom_bP_checksums;
 struct checksumsha256 *bloom_bPx2nd_checksums;
 struct checksumsha256 *bloom_bPx3rd_checksums;
+struct checksumsha256 bloom_bP_pre_checksum;
+
+/*
+	Bloom filter telemetry, each thread only writes its own 64 bytes aligned slot
+	(same idea as steps[]) so the hot path has no lock and no shared cache line.
+	Until a thread points thread_telemetry to its slot the writes go to a dummy one.
+*/
+const char *telemetry_names[TELEMETRY_TIERS] = {"pre","bP","2nd","3rd","table"};
+struct tier_counters *telemetry = NULL;
+struct tier_counters telemetry_unused;
+thread_local struct tier_counters *thread_telemetry = &telemetry_unused;
+
+/*
+	Set of tables of the job of the worker, the checks of the walk read it instead of
+	the globals so the jobs of an old set go on while a RELOAD swaps the current one
+*/
+thread_local struct bsgs_tables *thread_tables = &tables_start;
+char *telemetry_file = NULL;
+
+uint64_t plan_ram = 0;	//-P RAM in bytes for the planner
+double plan_bits = 0;	//-P optional range size in bits
 
-pthread_mutex_t *bloom_bP_mutex;
-pthread_mutex_t *bloom_bPx2nd_mutex;
-pthread_mutex_t *bloom_bPx3rd_mutex;
 
 
 
@@ -227,10 +695,12 @@ pthread_mutex_t *bloom_bPx3rd_mutex;
 uint64_t bloom_bP_totalbytes = 0;
 uint64_t bloom_bP2_totalbytes = 0;
 uint64_t bloom_bP3_totalbytes = 0;
+uint64_t bloom_bP_pre_bytes = 0;
+uint32_t bloom_bP_shards = 256;	//Number of shards of bloom_bP, power of two from 256 to 65536
+int bloom_bP_shard_bits = 8;
 uint64_t bsgs_m = 4194304;
 uint64_t bsgs_m2;
 uint64_t bsgs_m3;
-unsigned long int bsgs_aux;
 //int32_t bsgs_point_number;
 
 const char *str_limits_prefixs[7] = {"Mkeys/s","Gkeys/s","Tkeys/s","Pkeys/s","Ekeys/s","Zkeys/s","Ykeys/s"};
@@ -241,7 +711,6 @@ Int int_limits[7];
 
 
 Int BSGS_GROUP_SIZE;
-Int BSGS_CURRENT;
 Int BSGS_R;
 Int BSGS_AUX;
 Int BSGS_N;
@@ -269,13 +738,9 @@ Point BSGS_MP2_double;			//MP2 values this is m2 * P * 2
 Point BSGS_MP3_double;			//MP3 values this is m3 * P * 2
 
 
-std::vector<Point> BSGS_AMP2;
-std::vector<Point> BSGS_AMP3;
 
 Point point_temp,point_temp2;	//Temp value for some process
 
-Int n_range_start;
-Int n_range_end;
 Int n_range_diff;
 Int n_range_aux;
 
@@ -284,10 +749,11 @@ Secp256K1 *secp;
 
 int main(int argc, char **argv)	{
 	// File pointers
-	FILE *fd_aux1, *fd_aux2, *fd_aux3;
+	FILE *fd_aux1, *fd_aux2;
 
 	// Strings
 	char *hextemp = NULL;
+	char *str_end = NULL;
 	char *bf_ptr = NULL;
 	char *bPload_threads_available;
 
@@ -295,7 +761,7 @@ int main(int argc, char **argv)	{
 	char rawvalue[32];
 
 	// 64-bit integers
-	uint64_t BASE, PERTHREAD_R, itemsbloom, itemsbloom2, itemsbloom3;
+	uint64_t BASE, PERTHREAD_R, itemsbloom, itemsbloom2, itemsbloom3, bf_bytes;
 
 	// 32-bit integers
 	uint32_t finished;
@@ -308,12 +774,16 @@ int main(int argc, char **argv)	{
 	struct bPload *bPload_temp_ptr;
 
 	// Sizes
-	size_t rsize;
+
+	// Time
+	struct timespec bPload_start, bPload_end;
+	double bPload_seconds;
 
 	
 	pthread_mutex_init(&write_keys,NULL);
 	pthread_mutex_init(&write_random,NULL);
-	pthread_mutex_init(&mutex_bsgs_thread,NULL);
+	pthread_mutex_init(&mutex_jobs,NULL);
+	pthread_cond_init(&cond_jobs,NULL);
 
 	srand(time(NULL));
 
@@ -348,16 +818,27 @@ int main(int argc, char **argv)	{
 	
 	printf("[+] Version %s, developed by AlbertoBSD\n",version);
 
-	while ((c = getopt(argc, argv, "6hk:n:t:p:i:")) != -1) {
+	while ((c = getopt(argc, argv, "6bhHOk:n:t:p:i:J:L:F:M:P:T:W:")) != -1) {
 		switch(c) {
 			case '6':
 				FLAGSKIPCHECKSUM = 1;
 				fprintf(stderr,"[W] Skipping checksums on files\n");
 			break;
+			case 'b':
+				FLAGBUILDONLY = 1;
+			break;
 			case 'h':
 				// Show help menu
 				menu();
 			break;
+			case 'H':
+				FLAGHASHINDEX = 1;
+				printf("[+] Using a hash index for the third check\n");
+			break;
+			case 'O':
+				FLAGOUTOFCORE = 1;
+				printf("[+] bP table mapped from file\n");
+			break;
 			case 'k':
 				// Set KFACTOR
 				KFACTOR = (int)strtol(optarg,NULL,10);
@@ -388,6 +869,62 @@ int main(int argc, char **argv)	{
 			case 'i':
 				IP = optarg;
 			break;
+			case 'T':
+				shared_name = optarg;
+				printf("[+] Shared tables %s\n",shared_name);
+			break;
+			case 'W':
+				metrics_port = (int) strtol(optarg,NULL,10);
+				if(metrics_port <= 0  || metrics_port > 65535 )	{
+					fprintf(stderr,"[E] Invalid -W port %s\n",optarg);
+					exit(0);
+				}
+			break;
+			case 'F':
+				bloom_bP_shards = (uint32_t)strtoul(optarg,NULL,10);
+				if(bloom_bP_shards < 256 || bloom_bP_shards > 65536 || (bloom_bP_shards & (bloom_bP_shards - 1)) != 0)	{
+					fprintf(stderr,"[E] Invalid -F value %s, it must be a power of two from 256 to 65536\n",optarg);
+					exit(0);
+				}
+				bloom_bP_shard_bits = 0;
+				while((1U << bloom_bP_shard_bits) < bloom_bP_shards)	{
+					bloom_bP_shard_bits++;
+				}
+				printf("[+] Bloom filter shards %" PRIu32 "\n",bloom_bP_shards);
+			break;
+			case 'M':
+				memo_file = optarg;
+			break;
+			case 'P':
+				// Available RAM in GB (M suffix for MB) and optional :bits of the range to search
+				plan_ram = (uint64_t)(strtod(optarg,&str_end) * ((str_end[0] == 'M' || str_end[0] == 'm') ? 1048576.0 : 1073741824.0));
+				if(str_end[0] == 'M' || str_end[0] == 'm' || str_end[0] == 'G' || str_end[0] == 'g')	{
+					str_end++;
+				}
+				if(str_end[0] == ':')	{
+					plan_bits = strtod(str_end+1,NULL);
+				}
+				if(plan_ram == 0)	{
+					fprintf(stderr,"[E] Invalid -P value %s\n",optarg);
+					exit(0);
+				}
+				FLAGPLAN = 1;
+			break;
+			case 'J':
+				telemetry_file = optarg;
+				printf("[+] Bloom filter telemetry file %s\n",telemetry_file);
+			break;
+			case 'L':
+				// Size of the first level filter in MB, or in KB with the K suffix
+				bloom_bP_pre_bytes = strtoull(optarg,&str_end,10);
+				if(optarg[0] < '0' || optarg[0] > '9' || bloom_bP_pre_bytes == 0 || bloom_bP_pre_bytes > 1048576 || !(str_end[0] == '\0' || ((str_end[0] == 'K' || str_end[0] == 'k') && str_end[1] == '\0')))	{
+					fprintf(stderr,"[E] Invalid -L value %s, it must be a size in MB or in KB with the K suffix\n",optarg);
+					exit(0);
+				}
+				bloom_bP_pre_bytes *= (str_end[0] == 'K' || str_end[0] == 'k') ? 1024 : 1048576;
+				FLAGPREFILTER = 1;
+				printf("[+] First level filter size %" PRIu64 " KB\n",bloom_bP_pre_bytes/1024);
+			break;
 			default:
 				// Handle unknown options
 				fprintf(stderr,"[E] Unknow opcion -%c\n",c);
@@ -399,6 +936,13 @@ int main(int argc, char **argv)	{
 	
 
 
+	if(FLAGPLAN)	{
+		plan_run(1,plan_bits);
+		exit(0);
+	}
+
+	telemetry = new struct tier_counters[NTHREADS]();
+
 	stride.Set(&ONE);
 	init_generator();
 	
@@ -433,93 +977,29 @@ int main(int argc, char **argv)	{
 			BSGS_N.SetInt64((uint64_t)0x100000000000);
 		}
 		
-		if(BSGS_N.HasSqrt())	{	//If the root is exact
-			BSGS_M.Set(&BSGS_N);
-			BSGS_M.ModSqrt();
-		}
-		else	{
-			fprintf(stderr,"[E] -n param doesn't have exact square root\n");
-			exit(0);
-		}
-
-		BSGS_AUX.Set(&BSGS_M);
-		BSGS_AUX.Mod(&BSGS_GROUP_SIZE);	
-		
-		if(!BSGS_AUX.IsZero()){ //If M is not divisible by  BSGS_GROUP_SIZE (1024) 
-			hextemp = BSGS_GROUP_SIZE.GetBase10();
-			fprintf(stderr,"[E] M value is not divisible by %s\n",hextemp);
+		if(bsgs_params(&tables_start,&BSGS_N,KFACTOR))	{
 			exit(0);
 		}
-	
-		/*
-	M	2199023255552
-		109951162777.6
-	M2	109951162778
-		5497558138.9
-	M3	5497558139
-		*/
-
-		BSGS_M.Mult((uint64_t)KFACTOR);
-		BSGS_AUX.SetInt32(32);
-		BSGS_R.Set(&BSGS_M);
-		BSGS_R.Mod(&BSGS_AUX);
-		BSGS_M2.Set(&BSGS_M);
-		BSGS_M2.Div(&BSGS_AUX);
-
-		if(!BSGS_R.IsZero())	{ /* If BSGS_M modulo 32 is not 0*/
-			BSGS_M2.AddOne();
-		}
-		
-		BSGS_M_double.SetInt32(2);
-		BSGS_M_double.Mult(&BSGS_M);
-		
-		
-		BSGS_M2_double.SetInt32(2);
-		BSGS_M2_double.Mult(&BSGS_M2);
-		
-		BSGS_R.Set(&BSGS_M2);
-		BSGS_R.Mod(&BSGS_AUX);
-		
-		
-		
-		BSGS_M3.Set(&BSGS_M2);
-		BSGS_M3.Div(&BSGS_AUX);
-		
-		if(!BSGS_R.IsZero())	{ /* If BSGS_M2 modulo 32 is not 0*/
-			BSGS_M3.AddOne();
-		}
-		
-		BSGS_M3_double.SetInt32(2);
-		BSGS_M3_double.Mult(&BSGS_M3);
-		
-		bsgs_m2 =  BSGS_M2.GetInt64();
-		bsgs_m3 =  BSGS_M3.GetInt64();
-		
-		BSGS_AUX.Set(&BSGS_N);
-		BSGS_AUX.Div(&BSGS_M);
-		
-		BSGS_R.Set(&BSGS_N);
-		BSGS_R.Mod(&BSGS_M);
-
-		if(!BSGS_R.IsZero())	{ /* if BSGS_N modulo BSGS_M is not 0*/
-			BSGS_N.Set(&BSGS_M);
-			BSGS_N.Mult(&BSGS_AUX);
-		}
-
-		bsgs_m = BSGS_M.GetInt64();
-		bsgs_aux = BSGS_AUX.GetInt64();
-		
+		bsgs_params_use(&tables_start);
 		
 		hextemp = BSGS_N.GetBase16();
 		printf("[+] N = 0x%s\n",hextemp);
-		bsgs_m = BSGS_M.GetInt64();
 		free(hextemp);
+		if(shared_name != NULL && FLAGOUTOFCORE)	{
+			fprintf(stderr,"[W] -O already shares the bP table file by the page cache, -T is ignored\n");
+			shared_name = NULL;
+		}
+		if(shared_name != NULL)	{
+			FLAGSHARED = bsgs_shared_attach(shared_name);
+		}
+	}
+	if(FLAGMODE == MODE_BSGS && !FLAGSHARED)	{
 
 
 		
-		if(((uint64_t)(bsgs_m/256)) > 10000)	{
-			itemsbloom = (uint64_t)(bsgs_m / 256);
-			if(bsgs_m % 256 != 0 )	{
+		if(((uint64_t)(bsgs_m/bloom_bP_shards)) > 1000)	{
+			itemsbloom = (uint64_t)(bsgs_m / bloom_bP_shards);
+			if(bsgs_m % bloom_bP_shards != 0 )	{
 				itemsbloom++;
 			}
 		}
@@ -548,19 +1028,15 @@ int main(int argc, char **argv)	{
 		}
 		
 		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m);
-		bloom_bP = (struct bloom*)calloc(256,sizeof(struct bloom));
+		bloom_bP = (struct bloom*)calloc(bloom_bP_shards,sizeof(struct bloom));
 		checkpointer((void *)bloom_bP,__FILE__,"calloc","bloom_bP" ,__LINE__ -1 );
-		bloom_bP_checksums = (struct checksumsha256*)calloc(256,sizeof(struct checksumsha256));
+		bloom_bP_checksums = (struct checksumsha256*)calloc(bloom_bP_shards,sizeof(struct checksumsha256));
 		checkpointer((void *)bloom_bP_checksums,__FILE__,"calloc","bloom_bP_checksums" ,__LINE__ -1 );
 		
-		bloom_bP_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-		checkpointer((void *)bloom_bP_mutex,__FILE__,"calloc","bloom_bP_mutex" ,__LINE__ -1 );
-		
 
 		fflush(stdout);
 		bloom_bP_totalbytes = 0;
-		for(i=0; i< 256; i++)	{
-			pthread_mutex_init(&bloom_bP_mutex[i],NULL);
+		for(i=0; i< (int)bloom_bP_shards; i++)	{
 			if(bloom_init2(&bloom_bP[i],itemsbloom,0.000001)	== 1){
 				fprintf(stderr,"[E] error bloom_init _ %i\n",i);
 				exit(0);
@@ -569,18 +1045,32 @@ int main(int argc, char **argv)	{
 		}
 		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP_totalbytes/(float)(uint64_t)1048576));
 
+		if(FLAGPREFILTER)	{
+			printf("[+] First level filter for %" PRIu64 " elements ",bsgs_m);
+			if(bloom_init_blocked(&bloom_bP_pre,bsgs_m,bloom_bP_pre_bytes) == 1)	{
+				fprintf(stderr,"[E] error bloom_init_blocked\n");
+				exit(0);
+			}
+			printf(": %.2f MB, %i hashes\n",(float)((float)(uint64_t)bloom_bP_pre.bytes/(float)(uint64_t)1048576),bloom_bP_pre.hashes);
+			if(bloom_bP_pre.error > 0.5)	{
+				/* A filter that pass most of the points only adds one more cache miss */
+				fprintf(stderr,"[W] First level filter is too small, it pass %.1f%% of the points, disabling it\n",(double)bloom_bP_pre.error*100);
+				bloom_free(&bloom_bP_pre);
+				FLAGPREFILTER = 0;
+			}
+			else	{
+				printf("[+] First level filter pass rate %.2f%%, combined false positive rate %.3Lg (target %.3Lg)\n",(double)bloom_bP_pre.error*100,bloom_bP_pre.error * bloom_bP[0].error,bloom_bP[0].error);
+			}
+		}
 
 		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m2);
 		
-		bloom_bPx2nd_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-		checkpointer((void *)bloom_bPx2nd_mutex,__FILE__,"calloc","bloom_bPx2nd_mutex" ,__LINE__ -1 );
 		bloom_bPx2nd = (struct bloom*)calloc(256,sizeof(struct bloom));
 		checkpointer((void *)bloom_bPx2nd,__FILE__,"calloc","bloom_bPx2nd" ,__LINE__ -1 );
 		bloom_bPx2nd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
 		checkpointer((void *)bloom_bPx2nd_checksums,__FILE__,"calloc","bloom_bPx2nd_checksums" ,__LINE__ -1 );
 		bloom_bP2_totalbytes = 0;
 		for(i=0; i< 256; i++)	{
-			pthread_mutex_init(&bloom_bPx2nd_mutex[i],NULL);
 			if(bloom_init2(&bloom_bPx2nd[i],itemsbloom2,0.000001)	== 1){
 				fprintf(stderr,"[E] error bloom_init _ %i\n",i);
 				exit(0);
@@ -590,138 +1080,61 @@ int main(int argc, char **argv)	{
 		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP2_totalbytes/(float)(uint64_t)1048576));
 		
 
-		bloom_bPx3rd_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-		checkpointer((void *)bloom_bPx3rd_mutex,__FILE__,"calloc","bloom_bPx3rd_mutex" ,__LINE__ -1 );
-		bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
-		checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
-		bloom_bPx3rd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
-		checkpointer((void *)bloom_bPx3rd_checksums,__FILE__,"calloc","bloom_bPx3rd_checksums" ,__LINE__ -1 );
+		if(!FLAGHASHINDEX)	{
+			bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
+			checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
+			bloom_bPx3rd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
+			checkpointer((void *)bloom_bPx3rd_checksums,__FILE__,"calloc","bloom_bPx3rd_checksums" ,__LINE__ -1 );
 		
-		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m3);
-		bloom_bP3_totalbytes = 0;
-		for(i=0; i< 256; i++)	{
-			pthread_mutex_init(&bloom_bPx3rd_mutex[i],NULL);
-			if(bloom_init2(&bloom_bPx3rd[i],itemsbloom3,0.000001)	== 1){
-				fprintf(stderr,"[E] error bloom_init %i\n",i);
-				exit(0);
+			printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m3);
+			bloom_bP3_totalbytes = 0;
+			for(i=0; i< 256; i++)	{
+				if(bloom_init2(&bloom_bPx3rd[i],itemsbloom3,0.000001)	== 1){
+					fprintf(stderr,"[E] error bloom_init %i\n",i);
+					exit(0);
+				}
+				bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
 			}
-			bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
+			printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP3_totalbytes/(float)(uint64_t)1048576));
 		}
-		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP3_totalbytes/(float)(uint64_t)1048576));
-
-
 
 
 
-		BSGS_MP = secp->ComputePublicKey(&BSGS_M);
-		BSGS_MP_double = secp->ComputePublicKey(&BSGS_M_double);
-		BSGS_MP2 = secp->ComputePublicKey(&BSGS_M2);
-		BSGS_MP2_double = secp->ComputePublicKey(&BSGS_M2_double);
-		BSGS_MP3 = secp->ComputePublicKey(&BSGS_M3);
-		BSGS_MP3_double = secp->ComputePublicKey(&BSGS_M3_double);
-		
-		BSGS_AMP2.reserve(32);
-		BSGS_AMP3.reserve(32);
-		
-		GSn.reserve(CPU_GRP_SIZE/2);
-
-		i= 0;
-
 
-		/* New aMP table just to keep the same code of JLP */
-		/* Auxiliar Points to speed up calculations for the main bloom filter check */
-		
-		Point bsP = secp->Negation(BSGS_MP_double);
-		Point g = bsP;
-		GSn[0] = g;
-		
 
-		g = secp->DoubleDirect(g);
-		GSn[1] = g;
-		
-		
-		for(int i = 2; i < CPU_GRP_SIZE / 2; i++) {
-			g = secp->AddDirect(g,bsP);
-			GSn[i] = g;
-		}
-		
-		/* For next center point */
-		_2GSn = secp->DoubleDirect(GSn[CPU_GRP_SIZE / 2 - 1]);
-		
-		
-		i = 0;
-		point_temp.Set(BSGS_MP2);
-		BSGS_AMP2[0] = secp->Negation(point_temp);
-		BSGS_AMP2[0].Reduce();
-		point_temp.Set(BSGS_MP2_double);
-		point_temp = secp->Negation(point_temp);
-		
-		
-		for(i = 1; i < 32; i++)	{
-			BSGS_AMP2[i] = secp->AddDirect(BSGS_AMP2[i-1],point_temp);
-			BSGS_AMP2[i].Reduce();
+		if(FLAGHASHINDEX)	{
+			if(FLAGOUTOFCORE)	{
+				fprintf(stderr,"[W] -O is only for the sorted bP table, the hash index stays in RAM\n");
+				FLAGOUTOFCORE = 0;
+			}
+			bsgs_hashindex_init();
+			FLAGREADEDFILE4 = 1;	/* There is no 3rd bloom filter to make */
 		}
-		
-		i  = 0;
-		point_temp.Set(BSGS_MP3);
-		BSGS_AMP3[0] = secp->Negation(point_temp);
-		BSGS_AMP3[0].Reduce();
-		point_temp.Set(BSGS_MP3_double);
-		point_temp = secp->Negation(point_temp);
-
-		for(i = 1; i < 32; i++)	{
-			BSGS_AMP3[i] = secp->AddDirect(BSGS_AMP3[i-1],point_temp);
-			BSGS_AMP3[i].Reduce();
+		else	{
+			bytes = (uint64_t)bsgs_m3 * (uint64_t) sizeof(struct bsgs_xvalue);
+			if(FLAGOUTOFCORE)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
+				FLAGREADEDFILE3 = bsgs_map_table(buffer_bloom_file);
+			}
+			else	{
+				printf("[+] Allocating %.2f MB for %" PRIu64  " bP Points\n",(double)(bytes/1048576),bsgs_m3);
+				
+				bPtable = (struct bsgs_xvalue*) malloc(bytes);
+				checkpointer((void *)bPtable,__FILE__,"malloc","bPtable" ,__LINE__ -1 );
+				memset(bPtable,0,bytes);
+			}
 		}
-
-		bytes = (uint64_t)bsgs_m3 * (uint64_t) sizeof(struct bsgs_xvalue);
-		printf("[+] Allocating %.2f MB for %" PRIu64  " bP Points\n",(double)(bytes/1048576),bsgs_m3);
-		
-		bPtable = (struct bsgs_xvalue*) malloc(bytes);
-		checkpointer((void *)bPtable,__FILE__,"malloc","bPtable" ,__LINE__ -1 );
-		memset(bPtable,0,bytes);
 		
 		if(FLAGSAVEREADFILE)	{
 			/*Reading file for 1st bloom filter */
 
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
-			fd_aux1 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux1 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bP[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bP[i],sizeof(struct bloom),1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					bloom_bP[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					readed = fread(&bloom_bP_checksums[i],sizeof(struct checksumsha256),1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					memset(rawvalue,0,32);
-					if(FLAGSKIPCHECKSUM == 0)	{
-						sha256((uint8_t*)bloom_bP[i].bf,bloom_bP[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bP_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bP_checksums[i].backup,rawvalue,32) != 0 )	{	/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(0);
-						}
-					}
-					if(i % 64 == 0 )	{
-						printf(".");
-						fflush(stdout);
-					}
-				}
-				printf(" Done!\n");
-				fclose(fd_aux1);
+			if(bloom_bP_shards == 256)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
+			}
+			else	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 "_%" PRIu32 ".blm",bsgs_m,bloom_bP_shards);
+			}
+			if(bsgs_read_blooms(buffer_bloom_file,bloom_bP,bloom_bP_checksums,bloom_bP_shards,bsgs_m))	{
 				memset(buffer_bloom_file,0,1024);
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_3_%" PRIu64 ".blm",bsgs_m);
 				fd_aux1 = fopen(buffer_bloom_file,"rb");
@@ -731,7 +1144,7 @@ int main(int argc, char **argv)	{
 				}
 				FLAGREADEDFILE1 = 1;
 			}
-			else	{	/*Checking for old file    keyhunt_bsgs_3_   */
+			else if(bloom_bP_shards == 256)	{	/*Checking for old file    keyhunt_bsgs_3_   */
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_3_%" PRIu64 ".blm",bsgs_m);
 				fd_aux1 = fopen(buffer_bloom_file,"rb");
 				if(fd_aux1 != NULL)	{
@@ -739,6 +1152,7 @@ int main(int argc, char **argv)	{
 					fflush(stdout);
 					for(i = 0; i < 256;i++)	{
 						bf_ptr = (char*) bloom_bP[i].bf;	/*We need to save the current bf pointer*/
+						bf_bytes = bloom_bP[i].bytes;
 						readed = fread(&oldbloom_bP,sizeof(struct oldbloom),1,fd_aux1);
 						
 						
@@ -748,6 +1162,10 @@ int main(int argc, char **argv)	{
 						}
 						memcpy(&bloom_bP[i],&oldbloom_bP,sizeof(struct bloom));//We only need to copy the part data to the new bloom size, not from the old size
 						bloom_bP[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
+						if(bloom_bP[i].bytes != bf_bytes)	{
+							fprintf(stderr,"[E] The file %s was made with other bloom size, please delete it\n",buffer_bloom_file);
+							exit(0);
+						}
 						
 						readed = fread(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
 						if(readed != 1)	{
@@ -781,45 +1199,20 @@ int main(int argc, char **argv)	{
 				}
 			}
 			
+			if(FLAGPREFILTER)	{
+				/*Reading file for the first level filter */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_8_%" PRIu64 "_%" PRIu64 ".blm",bsgs_m,bloom_bP_pre.bytes);
+				if(bsgs_read_blooms(buffer_bloom_file,&bloom_bP_pre,&bloom_bP_pre_checksum,1,bsgs_m))	{
+					FLAGREADEDFILE5 = 1;
+				}
+				else	{
+					FLAGREADEDFILE5 = 0;
+				}
+			}
+			
 			/*Reading file for 2nd bloom filter */
 			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_6_%" PRIu64 ".blm",bsgs_m2);
-			fd_aux2 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux2 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bPx2nd[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bPx2nd[i],sizeof(struct bloom),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					bloom_bPx2nd[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					readed = fread(&bloom_bPx2nd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					memset(rawvalue,0,32);
-					if(FLAGSKIPCHECKSUM == 0)	{
-						sha256((uint8_t*)bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bPx2nd_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bPx2nd_checksums[i].backup,rawvalue,32) != 0 )	{		/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(0);
-						}
-					}
-					if(i % 64 == 0)	{
-						printf(".");
-						fflush(stdout);
-					}
-				}
-				fclose(fd_aux2);
-				printf(" Done!\n");
+			if(bsgs_read_blooms(buffer_bloom_file,bloom_bPx2nd,bloom_bPx2nd_checksums,256,bsgs_m2))	{
 				memset(buffer_bloom_file,0,1024);
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_5_%" PRIu64 ".blm",bsgs_m2);
 				fd_aux2 = fopen(buffer_bloom_file,"rb");
@@ -840,82 +1233,33 @@ int main(int argc, char **argv)	{
 				FLAGREADEDFILE2 = 0;
 			}
 			
-			/*Reading file for bPtable */
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
-			fd_aux3 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux3 != NULL)	{
-				printf("[+] Reading bP Table from file %s .",buffer_bloom_file);
-				fflush(stdout);
-				rsize = fread(bPtable,bytes,1,fd_aux3);
-				if(rsize != 1)	{
-					fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-					exit(0);
-				}
-				rsize = fread(checksum,32,1,fd_aux3);
-				if(FLAGSKIPCHECKSUM == 0)	{
-					sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
-					if(memcmp(checksum,checksum_backup,32) != 0)	{
-						fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-						exit(0);
-					}
-				}
-				printf("... Done!\n");
-				fclose(fd_aux3);
-				FLAGREADEDFILE3 = 1;
+			if(FLAGHASHINDEX)	{
+				/*Reading file for the hash index */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_9_%" PRIu64 ".tbl",bsgs_m3);
+				FLAGREADEDFILE3 = bsgs_read_hashindex(buffer_bloom_file);
 			}
 			else	{
-				FLAGREADEDFILE3 = 0;
-			}
-			
-			/*Reading file for 3rd bloom filter */
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
-			fd_aux2 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux2 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bPx3rd[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bPx3rd[i],sizeof(struct bloom),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					bloom_bPx3rd[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					readed = fread(&bloom_bPx3rd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					memset(rawvalue,0,32);
-					if(FLAGSKIPCHECKSUM == 0)	{
-						sha256((uint8_t*)bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bPx3rd_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bPx3rd_checksums[i].backup,rawvalue,32) != 0 )	{		/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(0);
-						}
-					}
-					if(i % 64 == 0)	{
-						printf(".");
-						fflush(stdout);
-					}
+				if(!FLAGOUTOFCORE)	{
+					/*Reading file for bPtable */
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
+					FLAGREADEDFILE3 = bsgs_read_table(buffer_bloom_file);
+				}
+				
+				/*Reading file for 3rd bloom filter */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
+				if(bsgs_read_blooms(buffer_bloom_file,bloom_bPx3rd,bloom_bPx3rd_checksums,256,bsgs_m3))	{
+					FLAGREADEDFILE4 = 1;
+				}
+				else	{
+					FLAGREADEDFILE4 = 0;
 				}
-				fclose(fd_aux2);
-				printf(" Done!\n");
-				FLAGREADEDFILE4 = 1;
-			}
-			else	{
-				FLAGREADEDFILE4 = 0;
 			}
 			
 		}
 		
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE3 || !FLAGREADEDFILE4)	{
-			if(FLAGREADEDFILE1 == 1)	{
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE3 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
+			clock_gettime(CLOCK_MONOTONIC,&bPload_start);
+			if(FLAGREADEDFILE1 == 1 && (!FLAGPREFILTER || FLAGREADEDFILE5))	{
 				/* 
 					We need just to make File 2 to File 4 this is
 					- Second bloom filter 5%
@@ -1001,7 +1345,7 @@ int main(int argc, char **argv)	{
 							FINISHED_THREADS_COUNTER++;
 						}
 					}
-					
+					sleep_ms(10);	/* Don't steal a core from the workers while we wait */
 				}while(FINISHED_THREADS_COUNTER < THREADCYCLES);
 				printf("\r[+] processing %lu/%lu bP points : 100%%     \n",bsgs_m2,bsgs_m2);
 				
@@ -1098,7 +1442,7 @@ int main(int argc, char **argv)	{
 							FINISHED_THREADS_COUNTER++;
 						}
 					}
-					
+					sleep_ms(10);	/* Don't steal a core from the workers while we wait */
 				}while(FINISHED_THREADS_COUNTER < THREADCYCLES);
 				printf("\r[+] processing %lu/%lu bP points : 100%%     \n",bsgs_m,bsgs_m);
 				
@@ -1107,14 +1451,17 @@ int main(int argc, char **argv)	{
 				free(bPload_temp_ptr);
 				free(bPload_threads_available);
 			}
+			clock_gettime(CLOCK_MONOTONIC,&bPload_end);
+			bPload_seconds = (double)(bPload_end.tv_sec - bPload_start.tv_sec) + (double)(bPload_end.tv_nsec - bPload_start.tv_nsec) / 1000000000.0;
+			printf("[+] bP points processed in %.2f seconds with %i threads: %.2f Mkeys/s\n",bPload_seconds,NTHREADS,(double)FINISHED_ITEMS / bPload_seconds / 1000000.0);
 		}
 		
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4)	{
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
 			printf("[+] Making checkums .. ");
 			fflush(stdout);
 		}	
 		if(!FLAGREADEDFILE1)	{
-			for(i = 0; i < 256 ; i++)	{
+			for(i = 0; i < (int)bloom_bP_shards ; i++)	{
 				sha256((uint8_t*)bloom_bP[i].bf, bloom_bP[i].bytes,(uint8_t*) bloom_bP_checksums[i].data);
 				memcpy(bloom_bP_checksums[i].backup,bloom_bP_checksums[i].data,32);
 			}
@@ -1134,179 +1481,112 @@ int main(int argc, char **argv)	{
 			}
 			printf(".");
 		}
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4)	{
+		if(FLAGPREFILTER && !FLAGREADEDFILE5)	{
+			sha256((uint8_t*)bloom_bP_pre.bf, bloom_bP_pre.bytes,(uint8_t*) bloom_bP_pre_checksum.data);
+			memcpy(bloom_bP_pre_checksum.backup,bloom_bP_pre_checksum.data,32);
+			printf(".");
+		}
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
 			printf(" done\n");
 			fflush(stdout);
 		}	
-		if(!FLAGREADEDFILE3)	{
-			printf("[+] Sorting %lu elements... ",bsgs_m3);
-			fflush(stdout);
-			bsgs_sort(bPtable,bsgs_m3);
-			sha256((uint8_t*)bPtable, bytes,(uint8_t*) checksum);
-			memcpy(checksum_backup,checksum,32);
-			printf("Done!\n");
-			fflush(stdout);
+		if(FLAGHASHINDEX)	{
+			if(!FLAGREADEDFILE3)	{
+				sha256((uint8_t*)hashindex, bytes,(uint8_t*) checksum);
+				memcpy(checksum_backup,checksum,32);
+			}
+		}
+		else	{
+			if(!FLAGREADEDFILE3)	{
+				printf("[+] Sorting %lu elements... ",bsgs_m3);
+				fflush(stdout);
+				if(FLAGOUTOFCORE)	{
+					bsgs_sort_mapped();
+				}
+				else	{
+					bsgs_sort(bPtable,bsgs_m3);
+				}
+				sha256((uint8_t*)bPtable, bytes,(uint8_t*) checksum);
+				memcpy(checksum_backup,checksum,32);
+				printf("Done!\n");
+				fflush(stdout);
+				if(FLAGOUTOFCORE)	{
+					bsgs_sync_table();
+				}
+			}
+			bPtable_directory = (uint64_t*) malloc(sizeof(uint64_t)*(SEARCH_DIRECTORY_SIZE+1));
+			checkpointer((void *)bPtable_directory,__FILE__,"malloc","bPtable_directory" ,__LINE__ -1 );
+			bsgs_build_directory(bPtable,bsgs_m3,bPtable_directory);
 		}
 		if(FLAGSAVEREADFILE || FLAGUPDATEFILE1 )	{
 			if(!FLAGREADEDFILE1 || FLAGUPDATEFILE1)	{
-				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
-				
+				if(bloom_bP_shards == 256)	{
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
+				}
+				else	{
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 "_%" PRIu32 ".blm",bsgs_m,bloom_bP_shards);
+				}
 				if(FLAGUPDATEFILE1)	{
 					printf("[W] Updating old file into a new one\n");
 				}
-				
 				/* Writing file for 1st bloom filter */
-				
-				fd_aux1 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux1 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bP[i],sizeof(struct bloom),1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(&bloom_bP_checksums[i],sizeof(struct checksumsha256),1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(0);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux1);
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(0);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bP,bloom_bP_checksums,bloom_bP_shards,bsgs_m);
+			}
+			if(FLAGPREFILTER && !FLAGREADEDFILE5)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_8_%" PRIu64 "_%" PRIu64 ".blm",bsgs_m,bloom_bP_pre.bytes);
+
+				/* Writing file for the first level filter */
+				bsgs_write_blooms(buffer_bloom_file,&bloom_bP_pre,&bloom_bP_pre_checksum,1,bsgs_m);
 			}
 			if(!FLAGREADEDFILE2  )	{
 				
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_6_%" PRIu64 ".blm",bsgs_m2);
 								
 				/* Writing file for 2nd bloom filter */
-				fd_aux2 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux2 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bPx2nd[i],sizeof(struct bloom),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(&bloom_bPx2nd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(0);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux2);	
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(0);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bPx2nd,bloom_bPx2nd_checksums,256,bsgs_m2);
 			}
 			
-			if(!FLAGREADEDFILE3)	{
+			if(FLAGHASHINDEX && !FLAGREADEDFILE3)	{
+				/* Writing file for the hash index */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_9_%" PRIu64 ".tbl",bsgs_m3);
+				bsgs_write_hashindex(buffer_bloom_file);
+			}
+			if(!FLAGHASHINDEX && !FLAGOUTOFCORE && (!FLAGREADEDFILE3 || FLAGUPDATEFILE3))	{
 				/* Writing file for bPtable */
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
-				fd_aux3 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux3 != NULL)	{
-					printf("[+] Writing bP Table to file %s .. ",buffer_bloom_file);
-					fflush(stdout);
-					readed = fwrite(bPtable,bytes,1,fd_aux3);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					readed = fwrite(checksum,32,1,fd_aux3);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-						exit(0);
-					}
-					printf("Done!\n");
-					fclose(fd_aux3);	
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(0);
-				}
+				bsgs_write_table(buffer_bloom_file);
 			}
 			if(!FLAGREADEDFILE4)	{
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
 								
 				/* Writing file for 3rd bloom filter */
-				fd_aux2 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux2 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bPx3rd[i],sizeof(struct bloom),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(0);
-						}
-						readed = fwrite(&bloom_bPx3rd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(0);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux2);
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(0);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bPx3rd,bloom_bPx3rd_checksums,256,bsgs_m3);
 			}
 		}
+		if(shared_name != NULL && !FLAGBUILDONLY)	{
+			bsgs_shared_create(shared_name);
+		}
 	}
 	/* 
 		Here we already finish the BSGS setup
 		- Baby table and bloom filters are alrady setup
 	
 	*/
+	if(FLAGBUILDONLY)	{
+		printf("[+] The files of the tables are ready\n");
+		exit(0);
+	}
 	
 	
-    int server_fd, client_fd;
+    int server_fd,metrics_fd;
     struct sockaddr_in address;
-	char clientIP[INET_ADDRSTRLEN];
-	int clientPort,addrlen = sizeof(address);
+	struct epoll_event ev,events[EPOLL_EVENTS];
+	struct client_conn *conn,**link;
+	uint64_t now,wait;
+	int n,timeout;
 
     // Creating socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
         perror("socket failed");
         exit(EXIT_FAILURE);
     }
@@ -1321,44 +1601,143 @@ int main(int argc, char **argv)	{
     // Setting address parameters
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = inet_addr(IP);
-    address.sin_port = htons(PORT);
+    address.sin_port = htons(port);
     // Binding socket to address
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("bind failed");
         exit(EXIT_FAILURE);
     }
 	printf("[+] Listening in %s:%i\n",IP,port);
-    // Listening for incoming connections
-    if (listen(server_fd, 3) < 0) {
+    // Listening for incoming connections, bursts of clients wait in the backlog
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen failed");
         exit(EXIT_FAILURE);
     }
 
-	pthread_t tid;
+	/*
+		One network thread (this one) for all the clients: non-blocking sockets in epoll,
+		the searches run in the worker pool and wake up this thread with notify_fd.
+	*/
+	epoll_fd = epoll_create1(0);
+	notify_fd = eventfd(0,EFD_NONBLOCK);
+	if(epoll_fd < 0 || notify_fd < 0)	{
+		perror("epoll failed");
+		exit(EXIT_FAILURE);
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &server_fd;
+	epoll_ctl(epoll_fd,EPOLL_CTL_ADD,server_fd,&ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = &notify_fd;
+	epoll_ctl(epoll_fd,EPOLL_CTL_ADD,notify_fd,&ev);
+
+	/* Optional Prometheus metrics, a second listening socket in the same loop */
+	metrics_fd = -1;
+	metrics_start_ms = now_ms();
+	if(metrics_port)	{
+		if((metrics_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0 || setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))	{
+			perror("metrics socket failed");
+			exit(EXIT_FAILURE);
+		}
+		address.sin_port = htons(metrics_port);
+		if (bind(metrics_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(metrics_fd, SOMAXCONN) < 0) {
+			perror("metrics bind failed");
+			exit(EXIT_FAILURE);
+		}
+		ev.events = EPOLLIN;
+		ev.data.ptr = &metrics_fd;
+		epoll_ctl(epoll_fd,EPOLL_CTL_ADD,metrics_fd,&ev);
+		printf("[+] Metrics in http://%s:%i/metrics\n",IP,metrics_port);
+	}
+
+	if(memo_file != NULL)	{
+		memo_load(memo_file);
+	}
+	bsgs_tables_start_use();
+
+	/*
+		Persistent worker pool, the workers wait in bsgs_job_next() until some client
+		adds a job and never exit
+	*/
+	int *worker_args = (int*) calloc(NTHREADS,sizeof(int));
+	checkpointer(worker_args,__FILE__,"calloc","worker_args",__LINE__);
+	tid = (pthread_t *) calloc(NTHREADS,sizeof(pthread_t));
+	checkpointer(tid,__FILE__,"calloc","tid",__LINE__);
+	for(i = 0; i < NTHREADS; i++)	{
+		worker_args[i] = i;
+		if(pthread_create(&tid[i], NULL, thread_process_bsgs, &worker_args[i]) != 0)	{
+			fprintf(stderr,"[E] pthread_create thread_process_bsgs\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	timeout = -1;
 	while(1) {
-		// Accepting incoming connection
-		if ((client_fd = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-			perror("accept failed");
+		n = epoll_wait(epoll_fd,events,EPOLL_EVENTS,timeout);
+		if(n < 0 && errno != EINTR)	{
+			perror("epoll_wait failed");
 			exit(EXIT_FAILURE);
 		}
-		inet_ntop(AF_INET, &(address.sin_addr), clientIP, INET_ADDRSTRLEN);
-		clientPort = ntohs(address.sin_port);
-		
-		printf("[+] Accepting incoming conection from %s:%i\n",clientIP,clientPort);
-		fflush(stdout);
-		// Creating new thread to handle client
-		if (pthread_create(&tid, NULL, client_handler, &client_fd) != 0) {
-			perror("pthread_create failed");
-			printf("Failed to attend to one client\n");
+		for(i = 0; i < n; i++)	{
+			if(events[i].data.ptr == &server_fd || events[i].data.ptr == &metrics_fd)	{
+				while((conn = client_accept(*(int*)events[i].data.ptr)) != NULL)	{
+					conn->metrics = (events[i].data.ptr == &metrics_fd);
+					conn->next = conns;
+					conns = conn;
+				}
+			}
+			else if(events[i].data.ptr == &notify_fd)	{
+				uint64_t value;
+				if(read(notify_fd,&value,sizeof(value)) < 0)	{
+					/* Nothing to do, all the connections are updated below */
+				}
+			}
+			else	{
+				conn = (struct client_conn*) events[i].data.ptr;
+				if(conn->fd < 0)	{
+					continue;
+				}
+				if((events[i].events & EPOLLIN) || ((events[i].events & EPOLLHUP) && !conn->eof))	{
+					client_read(conn);
+				}
+				else if(events[i].events & (EPOLLERR | EPOLLHUP))	{
+					client_close(conn);
+					continue;
+				}
+				if(conn->fd >= 0 && (events[i].events & EPOLLOUT))	{
+					client_send(conn);
+				}
+			}
 		}
-		else	{
-			if (pthread_join(tid, NULL) != 0) {
-				fprintf(stderr, "Failed to join thread.\n");
-				exit(EXIT_FAILURE);
+		/* New tables of a RELOAD once the jobs of the old ones end */
+		bsgs_reload_update();
+		/* Replies of the jobs that changed, requests of old clients without '\n' and closes */
+		now = now_ms();
+		timeout = -1;
+		link = &conns;
+		while((conn = *link) != NULL)	{
+			if(client_update(conn,now))	{
+				*link = conn->next;
+				if(conn == reload_conn)	{
+					reload_conn = NULL;
+				}
+				free(conn);
+				continue;
+			}
+			if(conn->fd >= 0 && !conn->keepalive && !conn->metrics && !conn->eof && conn->requests == 0 && conn->in_length > 0)	{
+				wait = conn->last_recv + REQUEST_WAIT_MS > now ? conn->last_recv + REQUEST_WAIT_MS - now : 0;
+				if(timeout < 0 || (int)wait < timeout)	{
+					timeout = wait;
+				}
 			}
+			if(conn->fd >= 0 && conn->watch && conn->queue != NULL)	{
+				wait = conn->watch_next > now ? conn->watch_next - now : 0;
+				if(timeout < 0 || (int)wait < timeout)	{
+					timeout = wait;
+				}
+			}
+			link = &conn->next;
 		}
-		printf("[+] Closing conection from %s:%i\n",clientIP,clientPort);
-		fflush(stdout);
 	}
 	
 	close(server_fd);
@@ -1446,10 +1825,132 @@ void bsgs_swap(struct bsgs_xvalue *a,struct bsgs_xvalue *b)	{
 	*b =   t;
 }
 
-/*	OK	*/
+/*
+	Small tables are sorted with the introsort as always, the big ones are split
+	by the first 16 bits of X between all the threads, see radix_sort()
+*/
 void bsgs_sort(struct bsgs_xvalue *arr,int64_t n)	{
-	uint32_t depthLimit = ((uint32_t) ceil(log(n))) * 2;
-	bsgs_introsort(arr,depthLimit,n);
+	if(n < RADIX_SORT_MIN || NTHREADS < 2)	{
+		bsgs_sort_bucket((uint8_t *)arr,n);
+	}
+	else	{
+		radix_sort((uint8_t *)arr,n,sizeof(struct bsgs_xvalue),bsgs_sort_bucket);
+	}
+}
+
+void bsgs_sort_bucket(uint8_t *arr,int64_t n)	{
+	uint32_t depthLimit;
+	if(n > 1)	{
+		depthLimit = ((uint32_t) ceil(log(n))) * 2;
+		bsgs_introsort((struct bsgs_xvalue *)arr,depthLimit,n);
+	}
+}
+
+/*
+	Parallel MSD radix sort on the first 16 bits, the same buckets of the search directory.
+	Every thread counts the buckets of its part of the table, then it copies its elements
+	to the position of each bucket in a temporary table, and at the end every thread sort
+	with sort_bucket the buckets of its part of the temporary table and copy them back.
+	If there is no RAM for the temporary table everything is sorted with sort_bucket.
+*/
+void radix_sort(uint8_t *arr,int64_t n,size_t size,void (*sort_bucket)(uint8_t *arr,int64_t n))	{
+	struct radix_sort sort;
+	uint64_t offset;
+	uint32_t b;
+	int t;
+	sort.arr = arr;
+	sort.n = n;
+	sort.size = size;
+	sort.sort_bucket = sort_bucket;
+	sort.nthreads = NTHREADS;
+	sort.temp = (uint8_t*) malloc(n*size);
+	sort.counts = (uint64_t*) calloc((uint64_t)sort.nthreads * SEARCH_DIRECTORY_SIZE,sizeof(uint64_t));
+	sort.buckets = (uint64_t*) calloc(SEARCH_DIRECTORY_SIZE+1,sizeof(uint64_t));
+	if(sort.temp == NULL || sort.counts == NULL || sort.buckets == NULL)	{
+		fprintf(stderr,"[W] Not enough RAM for the parallel sort, using one thread\n");
+		free(sort.temp);
+		free(sort.counts);
+		free(sort.buckets);
+		sort_bucket(arr,n);
+		return;
+	}
+	radix_sort_phase(&sort,0);
+	offset = 0;
+	for(b = 0; b < SEARCH_DIRECTORY_SIZE; b++)	{
+		sort.buckets[b] = offset;
+		for(t = 0; t < sort.nthreads; t++)	{
+			uint64_t count = sort.counts[(uint64_t)t * SEARCH_DIRECTORY_SIZE + b];
+			sort.counts[(uint64_t)t * SEARCH_DIRECTORY_SIZE + b] = offset;
+			offset += count;
+		}
+	}
+	sort.buckets[SEARCH_DIRECTORY_SIZE] = offset;
+	radix_sort_phase(&sort,1);
+	radix_sort_phase(&sort,2);
+	free(sort.temp);
+	free(sort.counts);
+	free(sort.buckets);
+}
+
+/*
+	Run one phase of the radix_sort in all the threads and wait for them
+*/
+void radix_sort_phase(struct radix_sort *sort,int phase)	{
+	pthread_t *threads = (pthread_t*) calloc(sort->nthreads,sizeof(pthread_t));
+	struct radix_sort_thread *args = (struct radix_sort_thread*) calloc(sort->nthreads,sizeof(struct radix_sort_thread));
+	int i;
+	checkpointer((void *)threads,__FILE__,"calloc","threads" ,__LINE__ -1 );
+	checkpointer((void *)args,__FILE__,"calloc","args" ,__LINE__ -1 );
+	for(i = 0; i < sort->nthreads; i++)	{
+		args[i].sort = sort;
+		args[i].threadid = i;
+		args[i].phase = phase;
+		if(pthread_create(&threads[i],NULL,thread_radix_sort,(void*) &args[i]) != 0)	{
+			fprintf(stderr,"[E] thread_radix_sort\n");
+			exit(0);
+		}
+	}
+	for(i = 0; i < sort->nthreads; i++)	{
+		pthread_join(threads[i],NULL);
+	}
+	free(threads);
+	free(args);
+}
+
+void *thread_radix_sort(void *vargp)	{
+	struct radix_sort_thread *tt = (struct radix_sort_thread *)vargp;
+	struct radix_sort *sort = tt->sort;
+	uint64_t *counts = &sort->counts[(uint64_t)tt->threadid * SEARCH_DIRECTORY_SIZE];
+	int64_t from = sort->n / sort->nthreads * tt->threadid;
+	int64_t to = (tt->threadid == sort->nthreads - 1) ? sort->n : sort->n / sort->nthreads * (tt->threadid + 1);
+	int64_t i;
+	uint32_t b,prefix;
+	uint8_t *element;
+	switch(tt->phase)	{
+		case 0:	/* Histogram */
+			for(i = from; i < to; i++)	{
+				counts[search_prefix(sort->arr + i*sort->size)]++;
+			}
+		break;
+		case 1:	/* Scatter, stable inside of every bucket */
+			for(i = from; i < to; i++)	{
+				element = sort->arr + i*sort->size;
+				prefix = search_prefix(element);
+				memcpy(sort->temp + counts[prefix]*sort->size,element,sort->size);
+				counts[prefix]++;
+			}
+		break;
+		case 2:	/* The buckets that start in our part of the table */
+			for(b = 0; b < SEARCH_DIRECTORY_SIZE; b++)	{
+				if((int64_t)sort->buckets[b] >= from && (int64_t)sort->buckets[b] < to && sort->buckets[b+1] > sort->buckets[b])	{
+					element = sort->temp + sort->buckets[b]*sort->size;
+					sort->sort_bucket(element,sort->buckets[b+1] - sort->buckets[b]);
+					memcpy(sort->arr + sort->buckets[b]*sort->size,element,(sort->buckets[b+1] - sort->buckets[b])*sort->size);
+				}
+			}
+		break;
+	}
+	return NULL;
 }
 
 /*	OK	*/
@@ -1545,350 +2046,2018 @@ void bsgs_myheapsort(struct bsgs_xvalue	*arr, int64_t n)	{
 	}
 }
 
+/*
+	directory[p] is the first entry of the sorted bPtable with the 16 bits prefix p, so a
+	search only looks at the entries of one prefix, about bsgs_m3/65536 of them.
+	directory has SEARCH_DIRECTORY_SIZE+1 entries.
+*/
+void bsgs_build_directory(struct bsgs_xvalue *buffer,int64_t array_length,uint64_t *directory)	{
+	int64_t i = 0;
+	uint32_t p;
+	for(p = 0; p < SEARCH_DIRECTORY_SIZE; p++)	{
+		while(i < array_length && search_prefix(buffer[i].value) < p)	{
+			i++;
+		}
+		directory[p] = i;
+	}
+	directory[SEARCH_DIRECTORY_SIZE] = array_length;
+}
+
+/*
+	The X values are uniformly distributed, so inside of the prefix bucket the next 32 bits
+	give a good guess of the position, usually found in one or two probes.
+	After SEARCH_INTERPOLATION_PROBES guesses, or if all the keys of the bucket are
+	the same, it goes on with a regular binary search.
+*/
 int bsgs_searchbinary(struct bsgs_xvalue *buffer,char *data,int64_t array_length,uint64_t *r_value) {
-	int64_t min,max,half,current;
-	int r = 0,rcmp;
-	min = 0;
-	current = 0;
-	max = array_length;
-	half = array_length;
-	while(!r && half >= 1) {
-		half = (max - min)/2;
-		rcmp = memcmp(data+16,buffer[current+half].value,BSGS_XVALUE_RAM);
+	int64_t min,max,current;
+	uint32_t key,low,high;
+	int r = 0,rcmp,probes = 0;
+	uint8_t *xvalue = (uint8_t *)data + 16;
+	uint64_t *directory = thread_tables->directory;
+	if(directory != NULL)	{
+		min = directory[search_prefix(xvalue)];
+		max = directory[search_prefix(xvalue)+1];
+	}
+	else	{
+		min = 0;
+		max = array_length;
+	}
+	key = search_key(xvalue);
+	while(!r && min < max) {
+		current = min + (max - min)/2;
+		if(directory != NULL && probes < SEARCH_INTERPOLATION_PROBES && max - min > 8)	{
+			low = search_key(buffer[min].value);
+			high = search_key(buffer[max-1].value);
+			if(key < low || key > high)	{
+				break;
+			}
+			if(low != high)	{
+				current = min + (int64_t)((double)(key - low) / (double)(high - low) * (double)(max - 1 - min));
+			}
+			probes++;
+		}
+		rcmp = memcmp(xvalue,buffer[current].value,BSGS_XVALUE_RAM);
 		if(rcmp == 0)	{
-			*r_value = buffer[current+half].index;
+			*r_value = bsgs_xvalue_index(&buffer[current]);
 			r = 1;
 		}
 		else	{
 			if(rcmp < 0) {
-				max = (max-half);
+				max = current;
 			}
 			else	{
-				min = (min+half);
+				min = current + 1;
 			}
-			current = min;
 		}
 	}
 	return r;
 }
 
-void *thread_process_bsgs(void *vargp)	{
-
-	FILE *filekey;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound;
-	Point base_point,point_aux,point_found;
-	uint32_t r, cycles;
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
+uint64_t bsgs_xvalue_index(struct bsgs_xvalue *xvalue)	{
+	return (uint64_t)xvalue->index[0] | ((uint64_t)xvalue->index[1] << 8) | ((uint64_t)xvalue->index[2] << 16) | ((uint64_t)xvalue->index[3] << 24) | ((uint64_t)xvalue->index[4] << 32);
+}
 
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
-	Int km,intaux;
-	Point pp;
-	Point pn;
-	grp->Set(dx);
-	
+void bsgs_xvalue_setindex(struct bsgs_xvalue *xvalue,uint64_t index)	{
+	xvalue->index[0] = (uint8_t)index;
+	xvalue->index[1] = (uint8_t)(index >> 8);
+	xvalue->index[2] = (uint8_t)(index >> 16);
+	xvalue->index[3] = (uint8_t)(index >> 24);
+	xvalue->index[4] = (uint8_t)(index >> 32);
+}
 
-	
-	cycles = bsgs_aux / 1024;
-	if(bsgs_aux % 1024 != 0)	{
-		cycles++;
+/*
+	Read the bP table file into bPtable and its sha256 into checksum, return 1 if the file
+	was readed and 0 if the file doesn't exist or it was made with other parameters.
+	Files made before the packed format have 16 bytes entries without header, they are
+	converted and FLAGUPDATEFILE3 is set to write them again in the new format.
+*/
+int bsgs_read_table(const char *filename)	{
+	struct bsgs_file_header header;
+	struct bsgs_xvalue_old *oldformat_table;
+	uint64_t i,oldformat_bytes;
+	int readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
 	}
-
-	
-	intaux.Set(&BSGS_M_double);
-	intaux.Mult(CPU_GRP_SIZE/2);
-	intaux.Add(&BSGS_M);
-	
-	/*
-		intaux hold the Current middle range value (Current)
-		(BSGS_M*2) * (CPU_GRP_SIZE/2) + BSGS_M
-		or
-		(BSGS_M * 512)  + BSGS_M
-	*/
-	/*
-		while base_key is less than n_range_end then:
-	*/
-	do	{
-		
-	/*
-		We do this in an atomic pthread_mutex operation to not affect others threads
-		so BSGS_CURRENT is never the same between threads
-	*/
-		pthread_mutex_lock(&mutex_bsgs_thread);
-
-		base_key.Set(&BSGS_CURRENT);	/* we need to set our base_key to the current BSGS_CURRENT value*/
-		BSGS_CURRENT.Add(&BSGS_N);		/*Then add BSGS_N to BSGS_CURRENT*/
-		BSGS_CURRENT.Add(&BSGS_N);		/*Then add BSGS_N to BSGS_CURRENT*/
-		
-		pthread_mutex_unlock(&mutex_bsgs_thread);
-
-		if(base_key.IsGreaterOrEqual(&n_range_end))
-			break;
-
-
-		//base point is the point of the current start range (Base_key)
-		base_point = secp->ComputePublicKey(&base_key);
-
-		km.Set(&base_key);
-		km.Neg();
-		 
-		km.Add(&secp->order);
-		km.Sub(&intaux);
-
-		//point_aux =-( basekey + ((BSGS_M*2) * 512)  + BSGS_M)
-		point_aux = secp->ComputePublicKey(&km);
-		
-		
-
-		if(base_point.equals(OriginalPointsBSGS))	{
-			hextemp = base_key.GetBase16();
-			printf("[+] Thread Key found privkey %s  \n",hextemp);
-			aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed,base_point);
-			printf("[+] Publickey %s\n",aux_c);
-			
-			pthread_mutex_lock(&write_keys);
-
-			filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-			if(filekey != NULL)	{
-				fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-				fclose(filekey);
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1 && memcmp(header.magic,BSGS_TABLE_MAGIC,8) == 0)	{
+		if(header.version != BSGS_FILE_VERSION || header.shards != sizeof(struct bsgs_xvalue) || header.items != bsgs_m3)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+			fclose(fd);
+			return 0;
+		}
+		printf("[+] Reading bP Table from file %s .",filename);
+		fflush(stdout);
+		readed = fread(bPtable,bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+	}
+	else	{
+		/* 16 bytes entries, the sha256 of the file is over that layout */
+		printf("[+] Reading bP Table from file %s (old format) .",filename);
+		fflush(stdout);
+		fseek(fd,0,SEEK_SET);
+		oldformat_bytes = bsgs_m3 * sizeof(struct bsgs_xvalue_old);
+		oldformat_table = (struct bsgs_xvalue_old*) malloc(oldformat_bytes);
+		checkpointer((void *)oldformat_table,__FILE__,"malloc","oldformat_table" ,__LINE__ -1 );
+		readed = fread(oldformat_table,oldformat_bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		readed = fread(checksum,32,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)oldformat_table,oldformat_bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(0);
 			}
-			BSGSkeyfound.Set(&base_key);
-			pthread_mutex_unlock(&write_keys);
-
-			free(hextemp);
-			free(aux_c);
-			
-			bsgs_found = 1;
 		}
-		else	{
-
-			startP  = secp->AddDirect(OriginalPointsBSGS,point_aux);
-			
-			uint32_t j = 0;
-			while( j < cycles && bsgs_found == 0 )	{
-			
-				int i;
-				
-				for(i = 0; i < hLength; i++) {
-					dx[i].ModSub(&GSn[i].x,&startP.x);
+		for(i = 0; i < bsgs_m3; i++)	{
+			memcpy(bPtable[i].value,oldformat_table[i].value,BSGS_XVALUE_RAM);
+			bsgs_xvalue_setindex(&bPtable[i],oldformat_table[i].index);
+		}
+		free(oldformat_table);
+		FLAGUPDATEFILE3 = 1;
+	}
+	if(FLAGUPDATEFILE3)	{
+		sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum);
+		memcpy(checksum_backup,checksum,32);
+	}
+	else	{
+		readed = fread(checksum,32,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(0);
+			}
+		}
+	}
+	printf("... Done!\n");
+	fclose(fd);
+	return 1;
+}
+
+void bsgs_write_table(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(0);
+	}
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_TABLE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct bsgs_xvalue);
+	header.items = bsgs_m3;
+	printf("[+] Writing bP Table to file %s .. ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1)	{
+		readed = fwrite(bPtable,bytes,1,fd);
+	}
+	if(readed == 1)	{
+		readed = fwrite(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s\n",filename);
+		exit(0);
+	}
+	printf("Done!\n");
+	fclose(fd);
+}
+
+/*
+	Option -O, the bP table is the keyhunt_bsgs_2_*.tbl file mapped in memory instead of
+	a malloc, so the RAM of the table is saved (the bloom filters still are in RAM). Only the prefix directory stays in RAM,
+	every search reads one prefix bucket of the file and the page cache keeps the used ones.
+	Return 1 if the file already has the sorted table, 0 if it was created to build it.
+*/
+int bsgs_map_table(const char *filename)	{
+	struct bsgs_file_header header;
+	struct stat st;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	int fd,readed = 0;
+	snprintf(bPtable_map_name,1024,"%s",filename);
+	fd = open(filename,O_RDWR | O_CREAT,0644);
+	if(fd < 0)	{
+		fprintf(stderr,"[E] Error can't open the file %s\n",filename);
+		exit(0);
+	}
+	if(fstat(fd,&st) != 0)	{
+		st.st_size = 0;
+	}
+	if((uint64_t)st.st_size == filesize && pread(fd,&header,sizeof(struct bsgs_file_header),0) == sizeof(struct bsgs_file_header))	{
+		readed = memcmp(header.magic,BSGS_TABLE_MAGIC,8) == 0 && header.version == BSGS_FILE_VERSION && header.shards == sizeof(struct bsgs_xvalue) && header.items == bsgs_m3;
+	}
+	if(!readed)	{
+		if(st.st_size != 0)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		}
+		/* The header stays in zero until bsgs_sync_table, an interrupted build is never readed */
+		if(ftruncate(fd,0) != 0 || ftruncate(fd,filesize) != 0)	{
+			fprintf(stderr,"[E] Error can't resize the file %s\n",filename);
+			exit(0);
+		}
+	}
+	bPtable_map = (uint8_t*) mmap(NULL,filesize,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(bPtable_map == MAP_FAILED)	{
+		fprintf(stderr,"[E] Error mapping the file %s\n",filename);
+		exit(0);
+	}
+	bPtable = (struct bsgs_xvalue*)(bPtable_map + sizeof(struct bsgs_file_header));
+	if(readed)	{
+		printf("[+] Mapping bP Table from file %s .",filename);
+		fflush(stdout);
+		memcpy(checksum,bPtable_map + sizeof(struct bsgs_file_header) + bytes,32);
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(0);
+			}
+		}
+		madvise(bPtable_map,filesize,MADV_RANDOM);
+		printf("... Done!\n");
+	}
+	else	{
+		printf("[+] Mapping %.2f MB for %" PRIu64 " bP Points in file %s\n",(double)(bytes/1048576),bsgs_m3,filename);
+	}
+	return readed;
+}
+
+/*
+	Write the header and the checksum of the sorted table to the mapped file
+*/
+void bsgs_sync_table()	{
+	struct bsgs_file_header header;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_TABLE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct bsgs_xvalue);
+	header.items = bsgs_m3;
+	memcpy(bPtable_map + sizeof(struct bsgs_file_header) + bytes,checksum,32);
+	if(msync(bPtable_map,filesize,MS_SYNC) != 0)	{
+		fprintf(stderr,"[E] Error writing the bP Table file\n");
+		exit(0);
+	}
+	memcpy(bPtable_map,&header,sizeof(struct bsgs_file_header));
+	if(msync(bPtable_map,sizeof(struct bsgs_file_header),MS_SYNC) != 0)	{
+		fprintf(stderr,"[E] Error writing the bP Table file\n");
+		exit(0);
+	}
+	madvise(bPtable_map,filesize,MADV_RANDOM);
+}
+
+/*
+	Move down the run r of the min heap of bsgs_sort_mapped, the runs are compared by the
+	element in their current position
+*/
+void bsgs_merge_sift(uint64_t *heap,uint64_t *pos,uint64_t runs,uint64_t r)	{
+	uint64_t child,t;
+	while((child = 2*r + 1) < runs)	{
+		if(child + 1 < runs && memcmp(bPtable[pos[heap[child+1]]].value,bPtable[pos[heap[child]]].value,BSGS_XVALUE_RAM) < 0)	{
+			child++;
+		}
+		if(memcmp(bPtable[pos[heap[child]]].value,bPtable[pos[heap[r]]].value,BSGS_XVALUE_RAM) >= 0)	{
+			break;
+		}
+		t = heap[r];
+		heap[r] = heap[child];
+		heap[child] = t;
+		r = child;
+	}
+}
+
+/*
+	Sort of the mapped bP table, the table is sorted with bsgs_sort in runs of a quarter of
+	the free RAM (the radix sort needs other copy of the run), and then the sorted runs are
+	merged in the new file <name>.tmp that replaces the table file, so the disk needs space
+	for two tables while it is sorted.
+*/
+void bsgs_sort_mapped()	{
+	struct bsgs_xvalue *run_buffer,*merged;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	uint64_t run,runs,r,i,from,to,*pos,*end,*heap;
+	uint8_t *map;
+	char tmpname[1040];
+	int fd;
+	run = (uint64_t)sysconf(_SC_AVPHYS_PAGES) * (uint64_t)sysconf(_SC_PAGESIZE) / 4 / sizeof(struct bsgs_xvalue);
+	if(run < RADIX_SORT_MIN)	{
+		run = RADIX_SORT_MIN;
+	}
+	if(run > bsgs_m3)	{
+		run = bsgs_m3;
+	}
+	runs = (bsgs_m3 + run - 1) / run;
+	run_buffer = (struct bsgs_xvalue*) malloc(run * sizeof(struct bsgs_xvalue));
+	checkpointer((void *)run_buffer,__FILE__,"malloc","run_buffer" ,__LINE__ -1 );
+	madvise(bPtable_map,filesize,MADV_SEQUENTIAL);
+	for(r = 0; r < runs; r++)	{
+		from = r * run;
+		to = (from + run < bsgs_m3) ? from + run : bsgs_m3;
+		memcpy(run_buffer,&bPtable[from],(to - from) * sizeof(struct bsgs_xvalue));
+		bsgs_sort(run_buffer,to - from);
+		memcpy(&bPtable[from],run_buffer,(to - from) * sizeof(struct bsgs_xvalue));
+	}
+	free(run_buffer);
+	if(runs == 1)	{
+		return;
+	}
+	snprintf(tmpname,1040,"%s.tmp",bPtable_map_name);
+	fd = open(tmpname,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if(fd < 0 || ftruncate(fd,filesize) != 0)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",tmpname);
+		exit(0);
+	}
+	map = (uint8_t*) mmap(NULL,filesize,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[E] Error mapping the file %s\n",tmpname);
+		exit(0);
+	}
+	madvise(map,filesize,MADV_SEQUENTIAL);
+	merged = (struct bsgs_xvalue*)(map + sizeof(struct bsgs_file_header));
+	/* Min heap of the runs by their current element */
+	pos = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	end = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	heap = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	checkpointer((void *)pos,__FILE__,"malloc","pos" ,__LINE__ -3 );
+	checkpointer((void *)end,__FILE__,"malloc","end" ,__LINE__ -3 );
+	checkpointer((void *)heap,__FILE__,"malloc","heap" ,__LINE__ -3 );
+	for(r = 0; r < runs; r++)	{
+		pos[r] = r * run;
+		end[r] = (pos[r] + run < bsgs_m3) ? pos[r] + run : bsgs_m3;
+		heap[r] = r;
+	}
+	for(r = runs / 2; r > 0; r--)	{
+		bsgs_merge_sift(heap,pos,runs,r - 1);
+	}
+	for(i = 0; i < bsgs_m3; i++)	{
+		r = heap[0];
+		merged[i] = bPtable[pos[r]++];
+		if(pos[r] == end[r])	{
+			heap[0] = heap[--runs];
+		}
+		bsgs_merge_sift(heap,pos,runs,0);
+	}
+	free(pos);
+	free(end);
+	free(heap);
+	munmap(bPtable_map,filesize);
+	/* The header of the new file is still in zero, an interrupted sort is never readed */
+	if(rename(tmpname,bPtable_map_name) != 0)	{
+		fprintf(stderr,"[E] Error can't rename the file %s\n",tmpname);
+		exit(0);
+	}
+	bPtable_map = map;
+	bPtable = merged;
+}
+
+/*
+	Allocate the empty hash index for bsgs_m3 entries, bytes is left with its size
+*/
+void bsgs_hashindex_init()	{
+	hashindex_buckets = bsgs_m3 / HASHINDEX_LOAD + 1;
+	bytes = hashindex_buckets * (uint64_t) sizeof(struct hashindex_bucket);
+	printf("[+] Allocating %.2f MB for the hash index of %" PRIu64 " bP Points\n",(double)bytes/1048576,bsgs_m3);
+	hashindex = (struct hashindex_bucket*) aligned_alloc(64,bytes);
+	checkpointer((void *)hashindex,__FILE__,"aligned_alloc","hashindex" ,__LINE__ -1 );
+	memset(hashindex,0,bytes);
+}
+
+/*
+	X is already uniformly distributed, the bytes 8 to 15 are scaled to the number of buckets
+*/
+static inline uint64_t bsgs_hashindex_bucket(char *data,uint64_t buckets)	{
+	uint64_t key;
+	memcpy(&key,data + 8,sizeof(uint64_t));
+	return (uint64_t)(((unsigned __int128)key * buckets) >> 64);
+}
+
+/*
+	Called from all the bP threads at the same time, every slot is reserved with a
+	compare and swap of the count so the bucket never goes over HASHINDEX_SLOTS
+*/
+void bsgs_hashindex_add(char *data,uint64_t index)	{
+	struct hashindex_bucket *bucket;
+	uint64_t b = bsgs_hashindex_bucket(data,hashindex_buckets);
+	uint8_t count;
+	int k;
+	while(1)	{
+		bucket = &hashindex[b];
+		count = __atomic_load_n(&bucket->count,__ATOMIC_RELAXED);
+		while(count < HASHINDEX_SLOTS && !__atomic_compare_exchange_n(&bucket->count,&count,count + 1,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+		if(count < HASHINDEX_SLOTS)	{
+			memcpy(bucket->slot[count].value,data + 16,HASHINDEX_VALUE);
+			for(k = 0; k < 5; k++)	{
+				bucket->slot[count].index[k] = (uint8_t)(index >> (8*k));
+			}
+			return;
+		}
+		b = (b + 1 == hashindex_buckets) ? 0 : b + 1;
+	}
+}
+
+/*
+	Same result as bsgs_searchbinary, usually with only one cache line read
+*/
+int bsgs_hashindex_search(char *data,uint64_t *r_value)	{
+	struct bsgs_tables *t = thread_tables;
+	struct hashindex_bucket *bucket;
+	uint64_t b = bsgs_hashindex_bucket(data,t->hashindex_buckets);
+	int k,l;
+	do	{
+		bucket = &t->hashindex[b];
+		for(k = 0; k < bucket->count; k++)	{
+			if(memcmp(bucket->slot[k].value,data + 16,HASHINDEX_VALUE) == 0)	{
+				*r_value = 0;
+				for(l = 4; l >= 0; l--)	{
+					*r_value = (*r_value << 8) | bucket->slot[k].index[l];
 				}
-				dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-				dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
+				return 1;
+			}
+		}
+		b = (b + 1 == t->hashindex_buckets) ? 0 : b + 1;
+	}while(bucket->count == HASHINDEX_SLOTS);
+	return 0;
+}
+
+/*
+	Same layout of the bP table files: header, all the buckets and their sha256
+*/
+int bsgs_read_hashindex(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1 || memcmp(header.magic,BSGS_HASHINDEX_MAGIC,8) != 0 || header.version != BSGS_FILE_VERSION || header.shards != sizeof(struct hashindex_bucket) || header.items != bsgs_m3)	{
+		fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	printf("[+] Reading hash index from file %s .",filename);
+	fflush(stdout);
+	readed = fread(hashindex,bytes,1,fd);
+	if(readed == 1)	{
+		readed = fread(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error reading the file %s\n",filename);
+		exit(0);
+	}
+	if(FLAGSKIPCHECKSUM == 0)	{
+		sha256((uint8_t*)hashindex,bytes,(uint8_t*)checksum_backup);
+		if(memcmp(checksum,checksum_backup,32) != 0)	{
+			fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+			exit(0);
+		}
+	}
+	printf("... Done!\n");
+	fclose(fd);
+	return 1;
+}
+
+void bsgs_write_hashindex(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(0);
+	}
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_HASHINDEX_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct hashindex_bucket);
+	header.items = bsgs_m3;
+	printf("[+] Writing hash index to file %s .. ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1)	{
+		readed = fwrite(hashindex,bytes,1,fd);
+	}
+	if(readed == 1)	{
+		readed = fwrite(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s\n",filename);
+		exit(0);
+	}
+	printf("Done!\n");
+	fclose(fd);
+}
+
+/*
+	A path inside a mount point is a file of that mount (hugetlbfs), any other name
+	is a POSIX shared memory segment in /dev/shm
+*/
+int bsgs_shared_open(const char *name,int flags)	{
+	if(name[0] == '/' && strchr(name + 1,'/') != NULL)	{
+		return open(name,flags,0644);
+	}
+	return shm_open(name,flags,0644);
+}
+
+void bsgs_shared_unlink(const char *name)	{
+	if(name[0] == '/' && strchr(name + 1,'/') != NULL)	{
+		unlink(name);
+	}
+	else	{
+		shm_unlink(name);
+	}
+}
+
+uint64_t bsgs_shared_align(uint64_t offset)	{
+	return (offset + 63) & ~(uint64_t)63;
+}
+
+/*
+	Blooms of the tables in the order of the segment
+*/
+void bsgs_shared_blooms(std::vector<struct bloom*> &list)	{
+	uint32_t i;
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		list.push_back(&bloom_bP[i]);
+	}
+	for(i = 0; i < 256; i++)	{
+		list.push_back(&bloom_bPx2nd[i]);
+	}
+	if(!FLAGHASHINDEX)	{
+		for(i = 0; i < 256; i++)	{
+			list.push_back(&bloom_bPx3rd[i]);
+		}
+	}
+	if(FLAGPREFILTER)	{
+		list.push_back(&bloom_bP_pre);
+	}
+}
+
+/*
+	Use the tables of the segment if it was filled by other process with the same
+	-n, -k, -F, -H and -L. Only the struct bloom arrays are allocated, the bit fields
+	and the tables stay in the segment. Returns 0 if there is no segment to use.
+*/
+int bsgs_shared_attach(const char *name)	{
+	struct bsgs_shared_header *header;
+	std::vector<struct bloom*> list;
+	struct bloom *blooms;
+	struct stat st;
+	uint8_t *map;
+	uint32_t i;
+	int fd;
+	fd = bsgs_shared_open(name,O_RDONLY);
+	if(fd < 0)	{
+		return 0;
+	}
+	if(fstat(fd,&st) != 0 || (uint64_t)st.st_size < sizeof(struct bsgs_shared_header))	{
+		close(fd);
+		return 0;
+	}
+	map = (uint8_t*) mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[W] Error mapping the shared tables %s\n",name);
+		return 0;
+	}
+	header = (struct bsgs_shared_header*) map;
+	if(memcmp(header->magic,BSGS_SHARED_MAGIC,8) != 0 || header->version != BSGS_SHARED_VERSION || __atomic_load_n(&header->ready,__ATOMIC_ACQUIRE) != 1 || header->length > (uint64_t)st.st_size || header->bloom_size != sizeof(struct bloom) || header->xvalue_size != sizeof(struct bsgs_xvalue))	{
+		fprintf(stderr,"[W] The shared tables %s are not ready or from other version\n",name);
+		munmap(map,st.st_size);
+		return 0;
+	}
+	if(header->m != bsgs_m || header->m2 != bsgs_m2 || header->m3 != bsgs_m3 || header->shards != bloom_bP_shards || ((header->flags & BSGS_SHARED_HASHINDEX) != 0) != (FLAGHASHINDEX != 0) || header->pre_bytes != (FLAGPREFILTER ? bloom_bP_pre_bytes : 0))	{
+		fprintf(stderr,"[W] The shared tables %s were made with other -n, -k, -F, -H or -L\n",name);
+		munmap(map,st.st_size);
+		return 0;
+	}
+	if(!(header->flags & BSGS_SHARED_PREFILTER))	{
+		FLAGPREFILTER = 0;	/* It was too small for the process that made the segment */
+	}
+	bloom_bP = (struct bloom*)calloc(bloom_bP_shards,sizeof(struct bloom));
+	checkpointer((void *)bloom_bP,__FILE__,"calloc","bloom_bP" ,__LINE__ -1 );
+	bloom_bPx2nd = (struct bloom*)calloc(256,sizeof(struct bloom));
+	checkpointer((void *)bloom_bPx2nd,__FILE__,"calloc","bloom_bPx2nd" ,__LINE__ -1 );
+	if(!FLAGHASHINDEX)	{
+		bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
+		checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
+		bPtable = (struct bsgs_xvalue*)(map + header->table);
+		bPtable_directory = (uint64_t*)(map + header->directory);
+	}
+	else	{
+		hashindex = (struct hashindex_bucket*)(map + header->table);
+		hashindex_buckets = header->hashindex_buckets;
+	}
+	bsgs_shared_blooms(list);
+	blooms = (struct bloom*)(map + header->blooms);
+	for(i = 0; i < list.size(); i++)	{
+		*list[i] = blooms[i];
+		list[i]->bf = map + (uint64_t)(uintptr_t)blooms[i].bf;
+	}
+	bloom_bP_totalbytes = 0;
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		bloom_bP_totalbytes += bloom_bP[i].bytes;
+	}
+	bloom_bP2_totalbytes = 0;
+	bloom_bP3_totalbytes = 0;
+	for(i = 0; i < 256; i++)	{
+		bloom_bP2_totalbytes += bloom_bPx2nd[i].bytes;
+		if(!FLAGHASHINDEX)	{
+			bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
+		}
+	}
+	shared_map = map;
+	shared_length = st.st_size;
+	printf("[+] Using the shared tables %s, %.2f MB\n",name,(double)header->length/1048576);
+	return 1;
+}
+
+/*
+	Copy the tables of this process to a new segment and use them from there, the
+	memory of the private copies is freed. If the segment already exists (other
+	parameters or a process that didn't end to fill it) the tables stay private.
+*/
+void bsgs_shared_create(const char *name)	{
+	struct bsgs_shared_header header;
+	std::vector<struct bloom*> list;
+	std::vector<uint64_t> offsets;
+	struct bloom *blooms;
+	struct statfs sf;
+	uint64_t offset,bytes_table,bytes_directory;
+	uint8_t *map,*table;
+	uint32_t i;
+	int fd;
+	bsgs_shared_blooms(list);
+	memset(&header,0,sizeof(struct bsgs_shared_header));
+	memcpy(header.magic,BSGS_SHARED_MAGIC,8);
+	header.version = BSGS_SHARED_VERSION;
+	header.m = bsgs_m;
+	header.m2 = bsgs_m2;
+	header.m3 = bsgs_m3;
+	header.pre_bytes = bloom_bP_pre_bytes;
+	header.shards = bloom_bP_shards;
+	header.flags = (FLAGHASHINDEX ? BSGS_SHARED_HASHINDEX : 0) | (FLAGPREFILTER ? BSGS_SHARED_PREFILTER : 0);
+	header.bloom_size = sizeof(struct bloom);
+	header.xvalue_size = sizeof(struct bsgs_xvalue);
+	header.hashindex_buckets = hashindex_buckets;
+
+	header.blooms = bsgs_shared_align(sizeof(struct bsgs_shared_header));
+	offset = bsgs_shared_align(header.blooms + list.size() * sizeof(struct bloom));
+	for(i = 0; i < list.size(); i++)	{
+		offsets.push_back(offset);
+		offset = bsgs_shared_align(offset + list[i]->bytes);
+	}
+	if(FLAGHASHINDEX)	{
+		table = (uint8_t*)hashindex;
+		bytes_table = hashindex_buckets * (uint64_t)sizeof(struct hashindex_bucket);
+		bytes_directory = 0;
+	}
+	else	{
+		table = (uint8_t*)bPtable;
+		bytes_table = bsgs_m3 * (uint64_t)sizeof(struct bsgs_xvalue);
+		bytes_directory = (SEARCH_DIRECTORY_SIZE + 1) * sizeof(uint64_t);
+	}
+	header.table = offset;
+	header.directory = bsgs_shared_align(header.table + bytes_table);
+	header.length = header.directory + bytes_directory;
+
+	fd = bsgs_shared_open(name,O_RDWR | O_CREAT | O_EXCL);
+	if(fd < 0)	{
+		if(errno == EEXIST)	{
+			fprintf(stderr,"[W] The shared tables %s already exist with other parameters, remove them to share these ones\n",name);
+		}
+		else	{
+			fprintf(stderr,"[W] Can't create the shared tables %s: %s\n",name,strerror(errno));
+		}
+		return;
+	}
+	/* The size of a hugetlbfs file must be a multiple of its page size */
+	shared_length = header.length;
+	if(fstatfs(fd,&sf) == 0 && sf.f_bsize > 0)	{
+		shared_length = (shared_length + sf.f_bsize - 1) / sf.f_bsize * sf.f_bsize;
+	}
+	map = (uint8_t*) MAP_FAILED;
+	if(ftruncate(fd,shared_length) == 0)	{
+		map = (uint8_t*) mmap(NULL,shared_length,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	}
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[W] Can't allocate %.2f MB for the shared tables %s\n",(double)shared_length/1048576,name);
+		bsgs_shared_unlink(name);
+		shared_length = 0;
+		return;
+	}
+	printf("[+] Copying the tables to the shared segment %s .. ",name);
+	fflush(stdout);
+	blooms = (struct bloom*)(map + header.blooms);
+	for(i = 0; i < list.size(); i++)	{
+		memcpy(map + offsets[i],list[i]->bf,list[i]->bytes);
+		blooms[i] = *list[i];
+		blooms[i].bf = (uint8_t*)(uintptr_t)offsets[i];
+		free(list[i]->bf);
+		list[i]->bf = map + offsets[i];
+	}
+	memcpy(map + header.table,table,bytes_table);
+	free(table);
+	if(FLAGHASHINDEX)	{
+		hashindex = (struct hashindex_bucket*)(map + header.table);
+	}
+	else	{
+		bPtable = (struct bsgs_xvalue*)(map + header.table);
+		memcpy(map + header.directory,bPtable_directory,bytes_directory);
+		free(bPtable_directory);
+		bPtable_directory = (uint64_t*)(map + header.directory);
+	}
+	memcpy(map,&header,sizeof(struct bsgs_shared_header));
+	__atomic_store_n(&((struct bsgs_shared_header*)map)->ready,1,__ATOMIC_RELEASE);
+	mprotect(map,shared_length,PROT_READ);
+	shared_map = map;
+	printf("Done! %.2f MB\n",(double)header.length/1048576);
+}
+
+/*
+	Values of the tables for this -n and -k, the same checks of the start. N is rounded
+	down to a multiple of M. Returns 1 if they are not valid.
+*/
+int bsgs_params(struct bsgs_tables *t,Int *n,int kfactor)	{
+	Int aux,r;
+	char *hextemp;
+	t->N_param.Set(n);
+	t->N.Set(n);
+	t->kfactor = kfactor;
+	if(!t->N.HasSqrt())	{
+		fprintf(stderr,"[E] -n param doesn't have exact square root\n");
+		return 1;
+	}
+	t->M.Set(&t->N);
+	t->M.ModSqrt();
+
+	aux.Set(&t->M);
+	aux.Mod(&BSGS_GROUP_SIZE);
+	if(!aux.IsZero())	{	//If M is not divisible by  BSGS_GROUP_SIZE (1024)
+		hextemp = BSGS_GROUP_SIZE.GetBase10();
+		fprintf(stderr,"[E] M value is not divisible by %s\n",hextemp);
+		free(hextemp);
+		return 1;
+	}
+
+	t->M.Mult((uint64_t)kfactor);
+	aux.SetInt32(32);
+	r.Set(&t->M);
+	r.Mod(&aux);
+	t->M2.Set(&t->M);
+	t->M2.Div(&aux);
+	if(!r.IsZero())	{	/* If M modulo 32 is not 0*/
+		t->M2.AddOne();
+	}
+
+	t->M_double.SetInt32(2);
+	t->M_double.Mult(&t->M);
+	t->M2_double.SetInt32(2);
+	t->M2_double.Mult(&t->M2);
+
+	r.Set(&t->M2);
+	r.Mod(&aux);
+	t->M3.Set(&t->M2);
+	t->M3.Div(&aux);
+	if(!r.IsZero())	{	/* If M2 modulo 32 is not 0*/
+		t->M3.AddOne();
+	}
+	t->M3_double.SetInt32(2);
+	t->M3_double.Mult(&t->M3);
+
+	t->m2 = t->M2.GetInt64();
+	t->m3 = t->M3.GetInt64();
+	if(t->m3 >= BSGS_XVALUE_MAXINDEX)	{
+		fprintf(stderr,"[E] The bP table is too big for the packed format, use a smaller -k or -n\n");
+		return 1;
+	}
+
+	aux.Set(&t->N);
+	aux.Div(&t->M);
+	r.Set(&t->N);
+	r.Mod(&t->M);
+	if(!r.IsZero())	{	/* if N modulo M is not 0*/
+		t->N.Set(&t->M);
+		t->N.Mult(&aux);
+	}
+	t->m = t->M.GetInt64();
+	t->aux = aux.GetInt64();
+	return 0;
+}
+
+/*
+	Values of t to the globals and the auxiliar points that come from them
+*/
+void bsgs_params_use(struct bsgs_tables *t)	{
+	int i;
+	BSGS_N.Set(&t->N);
+	BSGS_M.Set(&t->M);
+	BSGS_M2.Set(&t->M2);
+	BSGS_M3.Set(&t->M3);
+	BSGS_M_double.Set(&t->M_double);
+	BSGS_M2_double.Set(&t->M2_double);
+	BSGS_M3_double.Set(&t->M3_double);
+	bsgs_m = t->m;
+	bsgs_m2 = t->m2;
+	bsgs_m3 = t->m3;
+	KFACTOR = t->kfactor;
+
+	BSGS_MP = secp->ComputePublicKey(&BSGS_M);
+	BSGS_MP_double = secp->ComputePublicKey(&BSGS_M_double);
+	BSGS_MP2 = secp->ComputePublicKey(&BSGS_M2);
+	BSGS_MP2_double = secp->ComputePublicKey(&BSGS_M2_double);
+	BSGS_MP3 = secp->ComputePublicKey(&BSGS_M3);
+	BSGS_MP3_double = secp->ComputePublicKey(&BSGS_M3_double);
+	
+	t->AMP2.resize(32);
+	t->AMP3.resize(32);
+	
+	t->GSn.resize(CPU_GRP_SIZE/2);
+
+	/* New aMP table just to keep the same code of JLP */
+	/* Auxiliar Points to speed up calculations for the main bloom filter check */
+	
+	Point bsP = secp->Negation(BSGS_MP_double);
+	Point g = bsP;
+	t->GSn[0] = g;
+
+	g = secp->DoubleDirect(g);
+	t->GSn[1] = g;
+	
+	for(i = 2; i < CPU_GRP_SIZE / 2; i++) {
+		g = secp->AddDirect(g,bsP);
+		t->GSn[i] = g;
+	}
+	
+	/* For next center point */
+	t->_2GSn = secp->DoubleDirect(t->GSn[CPU_GRP_SIZE / 2 - 1]);
+	
+	point_temp.Set(BSGS_MP2);
+	t->AMP2[0] = secp->Negation(point_temp);
+	t->AMP2[0].Reduce();
+	point_temp.Set(BSGS_MP2_double);
+	point_temp = secp->Negation(point_temp);
+	
+	for(i = 1; i < 32; i++)	{
+		t->AMP2[i] = secp->AddDirect(t->AMP2[i-1],point_temp);
+		t->AMP2[i].Reduce();
+	}
+	
+	point_temp.Set(BSGS_MP3);
+	t->AMP3[0] = secp->Negation(point_temp);
+	t->AMP3[0].Reduce();
+	point_temp.Set(BSGS_MP3_double);
+	point_temp = secp->Negation(point_temp);
+
+	for(i = 1; i < 32; i++)	{
+		t->AMP3[i] = secp->AddDirect(t->AMP3[i-1],point_temp);
+		t->AMP3[i].Reduce();
+	}
+}
+
+/*
+	Whole file mapped read only, NULL if it doesn't exist or it can't be mapped
+*/
+uint8_t *bsgs_map_file(const char *filename,uint64_t *length)	{
+	struct stat st;
+	uint8_t *map;
+	int fd = open(filename,O_RDONLY);
+	if(fd < 0)	{
+		return NULL;
+	}
+	if(fstat(fd,&st) != 0 || st.st_size == 0)	{
+		close(fd);
+		return NULL;
+	}
+	map = (uint8_t*) mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)	{
+		return NULL;
+	}
+	madvise(map,st.st_size,MADV_WILLNEED);
+	*length = st.st_size;
+	return map;
+}
+
+/*
+	Same as bsgs_read_blooms but the bit fields stay in the mapped file, nothing is copied.
+	Only the files with bsgs_file_header, it never exits: returns 0 if the file is missing,
+	it was made with other parameters or its checksum is wrong.
+*/
+int bsgs_map_blooms(const char *filename,struct bloom *blooms,uint32_t shards,uint64_t items,uint8_t **map,uint64_t *length)	{
+	struct bsgs_file_header header;
+	struct checksumsha256 *checksums;
+	char rawvalue[32];
+	uint64_t offset;
+	uint32_t i;
+	FILE *fd;
+	*map = NULL;
+	fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	if(fread(&header,sizeof(struct bsgs_file_header),1,fd) != 1 || memcmp(header.magic,BSGS_FILE_MAGIC,8) != 0 || header.version != BSGS_FILE_VERSION || header.shards != shards || header.items != items)	{
+		fprintf(stderr,"[W] The file %s was made with other parameters or in the old format\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	*map = bsgs_map_file(filename,length);
+	if(*map == NULL)	{
+		fprintf(stderr,"[E] Error mapping the file %s\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	printf("[+] Mapping bloom filter from file %s ",filename);
+	fflush(stdout);
+	for(i = 0; i < shards; i++)	{
+		memset(&blooms[i],0,sizeof(struct bloom));
+		if(bloom_load_header(&blooms[i],fd) != 0)	{
+			break;
+		}
+		offset = ftello(fd);
+		if(offset + blooms[i].bytes + sizeof(struct checksumsha256) > *length)	{
+			break;
+		}
+		blooms[i].bf = *map + offset;
+		blooms[i].ready = 1;	/* Never bloom_free, the bf is in the mapped file */
+		if(FLAGSKIPCHECKSUM == 0)	{
+			checksums = (struct checksumsha256*)(*map + offset + blooms[i].bytes);
+			sha256(blooms[i].bf,blooms[i].bytes,(uint8_t*)rawvalue);
+			if(memcmp(checksums->data,rawvalue,32) != 0 || memcmp(checksums->backup,rawvalue,32) != 0)	{
+				break;
+			}
+		}
+		if(fseeko(fd,blooms[i].bytes + sizeof(struct checksumsha256),SEEK_CUR) != 0)	{
+			break;
+		}
+		if(i % (shards > 4 ? shards / 4 : 1) == 0)	{
+			printf(".");
+			fflush(stdout);
+		}
+	}
+	fclose(fd);
+	if(i < shards)	{
+		fprintf(stderr,"\n[E] Error in the file %s\n",filename);
+		munmap(*map,*length);
+		*map = NULL;
+		return 0;
+	}
+	printf(" Done!\n");
+	return 1;
+}
+
+/*
+	Tables of t from the files of its -n and -k, the blooms and the bP table are mapped
+	from the files, the hash index and the first level filter are copied to aligned
+	memory. Returns 0 if some file is missing or wrong, nothing is left allocated then.
+*/
+int bsgs_tables_map(struct bsgs_tables *t)	{
+	struct bsgs_file_header header;
+	struct bloom pre;
+	char filename[1024],rawvalue[32];
+	uint8_t *map;
+	uint64_t length,bytes_table;
+	int ok;
+
+	t->bP = (struct bloom*) calloc(bloom_bP_shards,sizeof(struct bloom));
+	checkpointer((void *)t->bP,__FILE__,"calloc","bP" ,__LINE__ -1 );
+	t->bPx2nd = (struct bloom*) calloc(256,sizeof(struct bloom));
+	checkpointer((void *)t->bPx2nd,__FILE__,"calloc","bPx2nd" ,__LINE__ -1 );
+
+	if(bloom_bP_shards == 256)	{
+		snprintf(filename,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",t->m);
+	}
+	else	{
+		snprintf(filename,1024,"keyhunt_bsgs_4_%" PRIu64 "_%" PRIu32 ".blm",t->m,bloom_bP_shards);
+	}
+	ok = bsgs_map_blooms(filename,t->bP,bloom_bP_shards,t->m,&t->maps[0],&t->maps_length[0]);
+	snprintf(filename,1024,"keyhunt_bsgs_6_%" PRIu64 ".blm",t->m2);
+	ok = ok && bsgs_map_blooms(filename,t->bPx2nd,256,t->m2,&t->maps[1],&t->maps_length[1]);
+
+	if(ok && FLAGHASHINDEX)	{
+		snprintf(filename,1024,"keyhunt_bsgs_9_%" PRIu64 ".tbl",t->m3);
+		t->hashindex_buckets = t->m3 / HASHINDEX_LOAD + 1;
+		bytes_table = t->hashindex_buckets * (uint64_t) sizeof(struct hashindex_bucket);
+		map = bsgs_map_file(filename,&length);
+		ok = map != NULL && length == sizeof(struct bsgs_file_header) + bytes_table + 32;
+		if(ok)	{
+			memcpy(&header,map,sizeof(struct bsgs_file_header));
+			ok = memcmp(header.magic,BSGS_HASHINDEX_MAGIC,8) == 0 && header.version == BSGS_FILE_VERSION && header.shards == sizeof(struct hashindex_bucket) && header.items == t->m3;
+		}
+		if(ok)	{
+			printf("[+] Reading hash index from file %s .",filename);
+			fflush(stdout);
+			/* Every bucket is one cache line, the file offset is not aligned so it is copied */
+			t->hashindex = (struct hashindex_bucket*) aligned_alloc(64,bytes_table);
+			checkpointer((void *)t->hashindex,__FILE__,"aligned_alloc","hashindex" ,__LINE__ -1 );
+			memcpy(t->hashindex,map + sizeof(struct bsgs_file_header),bytes_table);
+			if(FLAGSKIPCHECKSUM == 0)	{
+				sha256((uint8_t*)t->hashindex,bytes_table,(uint8_t*)rawvalue);
+				ok = memcmp(map + sizeof(struct bsgs_file_header) + bytes_table,rawvalue,32) == 0;
+			}
+			printf(ok ? "... Done!\n" : "... checksum mismatch!\n");
+		}
+		if(map != NULL)	{
+			munmap(map,length);
+		}
+	}
+	else if(ok)	{
+		t->bPx3rd = (struct bloom*) calloc(256,sizeof(struct bloom));
+		checkpointer((void *)t->bPx3rd,__FILE__,"calloc","bPx3rd" ,__LINE__ -1 );
+		snprintf(filename,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",t->m3);
+		ok = bsgs_map_blooms(filename,t->bPx3rd,256,t->m3,&t->maps[2],&t->maps_length[2]);
+
+		snprintf(filename,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",t->m3);
+		bytes_table = t->m3 * (uint64_t) sizeof(struct bsgs_xvalue);
+		t->maps[3] = ok ? bsgs_map_file(filename,&t->maps_length[3]) : NULL;
+		ok = t->maps[3] != NULL && t->maps_length[3] == sizeof(struct bsgs_file_header) + bytes_table + 32;
+		if(ok)	{
+			memcpy(&header,t->maps[3],sizeof(struct bsgs_file_header));
+			ok = memcmp(header.magic,BSGS_TABLE_MAGIC,8) == 0 && header.version == BSGS_FILE_VERSION && header.shards == sizeof(struct bsgs_xvalue) && header.items == t->m3;
+		}
+		if(ok)	{
+			printf("[+] Mapping bP Table from file %s .",filename);
+			fflush(stdout);
+			t->table = (struct bsgs_xvalue*)(t->maps[3] + sizeof(struct bsgs_file_header));
+			if(FLAGSKIPCHECKSUM == 0)	{
+				sha256((uint8_t*)t->table,bytes_table,(uint8_t*)rawvalue);
+				ok = memcmp(t->maps[3] + sizeof(struct bsgs_file_header) + bytes_table,rawvalue,32) == 0;
+			}
+			t->directory = (uint64_t*) malloc(sizeof(uint64_t)*(SEARCH_DIRECTORY_SIZE+1));
+			checkpointer((void *)t->directory,__FILE__,"malloc","directory" ,__LINE__ -1 );
+			bsgs_build_directory(t->table,t->m3,t->directory);
+			printf(ok ? "... Done!\n" : "... checksum mismatch!\n");
+		}
+	}
+
+	if(ok && FLAGPREFILTER)	{
+		/* Small and checked for every point, it is copied to its own aligned blocks */
+		ok = bloom_init_blocked(&t->bP_pre,t->m,bloom_bP_pre_bytes) == 0 && t->bP_pre.error <= 0.5;
+		if(ok)	{
+			snprintf(filename,1024,"keyhunt_bsgs_8_%" PRIu64 "_%" PRIu64 ".blm",t->m,t->bP_pre.bytes);
+			ok = bsgs_map_blooms(filename,&pre,1,t->m,&map,&length) && pre.bytes == t->bP_pre.bytes && pre.hashes == t->bP_pre.hashes;
+			if(ok)	{
+				memcpy(t->bP_pre.bf,pre.bf,pre.bytes);
+			}
+			if(map != NULL)	{
+				munmap(map,length);
+			}
+		}
+		else	{
+			fprintf(stderr,"[E] The first level filter of -L is too small for the new tables\n");
+		}
+	}
+	if(!ok)	{
+		bsgs_tables_free(t);
+	}
+	return ok;
+}
+
+/*
+	The missing files of t are made by other process of bsgsd with -b, it is the same
+	code of the start and it doesn't touch the tables that the workers are using.
+	Returns 1 if that process ended without errors.
+*/
+int bsgs_tables_build(struct bsgs_tables *t)	{
+	char str_k[16],str_t[16],str_f[16],str_l[32],str_n[80],*hextemp,*args[20];
+	pid_t pid;
+	int status,n = 0;
+	hextemp = t->N_param.GetBase16();
+	snprintf(str_n,sizeof(str_n),"0x%s",hextemp);
+	free(hextemp);
+	snprintf(str_k,sizeof(str_k),"%i",t->kfactor);
+	snprintf(str_t,sizeof(str_t),"%i",NTHREADS);
+	snprintf(str_f,sizeof(str_f),"%" PRIu32,bloom_bP_shards);
+	snprintf(str_l,sizeof(str_l),"%" PRIu64 "K",bloom_bP_pre_bytes / 1024);
+	args[n++] = (char*)"bsgsd";
+	args[n++] = (char*)"-b";
+	if(FLAGSKIPCHECKSUM)	{
+		args[n++] = (char*)"-6";
+	}
+	if(FLAGHASHINDEX)	{
+		args[n++] = (char*)"-H";
+	}
+	if(FLAGPREFILTER)	{
+		args[n++] = (char*)"-L";
+		args[n++] = str_l;
+	}
+	args[n++] = (char*)"-t";
+	args[n++] = str_t;
+	args[n++] = (char*)"-k";
+	args[n++] = str_k;
+	args[n++] = (char*)"-n";
+	args[n++] = str_n;
+	args[n++] = (char*)"-F";
+	args[n++] = str_f;
+	args[n] = NULL;
+	printf("[+] Making the files of -k %s -n %s in other process\n",str_k,str_n);
+	fflush(stdout);
+	if(posix_spawn(&pid,"/proc/self/exe",NULL,NULL,args,environ) != 0)	{
+		fprintf(stderr,"[E] Error starting the process to make the tables\n");
+		return 0;
+	}
+	if(waitpid(pid,&status,0) != pid)	{
+		return 0;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+	Memory of a set made by bsgs_tables_map, the fields are left empty to map it again
+*/
+void bsgs_tables_free(struct bsgs_tables *t)	{
+	int i;
+	for(i = 0; i < TABLES_MAPS; i++)	{
+		if(t->maps[i] != NULL)	{
+			munmap(t->maps[i],t->maps_length[i]);
+			t->maps[i] = NULL;
+		}
+	}
+	free(t->bP);
+	free(t->bPx2nd);
+	free(t->bPx3rd);
+	free(t->directory);
+	free(t->hashindex);
+	bloom_free(&t->bP_pre);
+	t->bP = NULL;
+	t->bPx2nd = NULL;
+	t->bPx3rd = NULL;
+	t->table = NULL;
+	t->directory = NULL;
+	t->hashindex = NULL;
+}
+
+/*
+	Memory of the tables made at start, the globals can already point to a newer set
+*/
+void bsgs_tables_free_start()	{
+	struct bsgs_tables *t = &tables_start;
+	uint32_t i;
+	if(shared_map != NULL)	{
+		/* The bit fields and the tables are in the -T segment, the other processes keep it */
+		free(t->bP);
+		free(t->bPx2nd);
+		free(t->bPx3rd);
+		free(bloom_bP_checksums);
+		free(bloom_bPx2nd_checksums);
+		free(bloom_bPx3rd_checksums);
+		bloom_bP_checksums = NULL;
+		bloom_bPx2nd_checksums = NULL;
+		bloom_bPx3rd_checksums = NULL;
+		munmap(shared_map,shared_length);
+		shared_map = NULL;
+		return;
+	}
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		bloom_free(&t->bP[i]);
+	}
+	for(i = 0; i < 256; i++)	{
+		bloom_free(&t->bPx2nd[i]);
+		if(t->bPx3rd != NULL)	{
+			bloom_free(&t->bPx3rd[i]);
+		}
+	}
+	free(t->bP);
+	free(t->bPx2nd);
+	free(t->bPx3rd);
+	free(bloom_bP_checksums);
+	free(bloom_bPx2nd_checksums);
+	free(bloom_bPx3rd_checksums);
+	bloom_bP_checksums = NULL;
+	bloom_bPx2nd_checksums = NULL;
+	bloom_bPx3rd_checksums = NULL;
+	if(FLAGPREFILTER)	{
+		bloom_free(&t->bP_pre);
+	}
+	if(bPtable_map != NULL)	{
+		munmap(bPtable_map,sizeof(struct bsgs_file_header) + t->m3 * (uint64_t)sizeof(struct bsgs_xvalue) + 32);
+		bPtable_map = NULL;
+	}
+	else	{
+		free(t->table);
+	}
+	free(t->directory);
+	free(t->hashindex);
+}
+
+/*
+	The memory of the set made at start is in the globals, tables_start takes it before
+	the workers start and keeps the reference of tables_current
+*/
+void bsgs_tables_start_use()	{
+	tables_start.bP = bloom_bP;
+	tables_start.bPx2nd = bloom_bPx2nd;
+	tables_start.bPx3rd = bloom_bPx3rd;
+	tables_start.bP_pre = bloom_bP_pre;
+	tables_start.table = bPtable;
+	tables_start.directory = bPtable_directory;
+	tables_start.hashindex = hashindex;
+	tables_start.hashindex_buckets = hashindex_buckets;
+	tables_start.refs = 1;
+}
+
+/*
+	One reference of the set is gone, with none left no worker can be on it and it is
+	freed. Called only by the network thread.
+*/
+void bsgs_tables_release(struct bsgs_tables *t)	{
+	t->refs--;
+	if(t->refs > 0)	{
+		return;
+	}
+	if(t == &tables_start)	{
+		bsgs_tables_free_start();
+	}
+	else	{
+		bsgs_tables_free(t);
+		delete t;
+	}
+	printf("[+] Old tables freed, no jobs left on them\n");
+}
+
+/*
+	tables_next is the set of the new jobs from now on, the running jobs go on with their
+	own set and the old one is freed by bsgs_tables_release when the last of them ends.
+	The globals take the values of the new set for the metrics and the next RELOAD.
+	Called by the network thread with mutex_jobs.
+*/
+void bsgs_tables_swap()	{
+	struct bsgs_tables *t = tables_next;
+	char *hextemp;
+	uint32_t i;
+	t->refs = 1;
+	bsgs_tables_release(tables_current);
+	bsgs_params_use(t);
+	bloom_bP = t->bP;
+	bloom_bPx2nd = t->bPx2nd;
+	bloom_bPx3rd = t->bPx3rd;
+	bloom_bP_pre = t->bP_pre;
+	bPtable = t->table;
+	bPtable_directory = t->directory;
+	hashindex = t->hashindex;
+	hashindex_buckets = t->hashindex_buckets;
+	bloom_bP_totalbytes = 0;
+	bloom_bP2_totalbytes = 0;
+	bloom_bP3_totalbytes = 0;
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		bloom_bP_totalbytes += bloom_bP[i].bytes;
+	}
+	for(i = 0; i < 256; i++)	{
+		bloom_bP2_totalbytes += bloom_bPx2nd[i].bytes;
+		bloom_bP3_totalbytes += bloom_bPx3rd != NULL ? bloom_bPx3rd[i].bytes : 0;
+	}
+	tables_current = t;
+	tables_next = NULL;
+	tables_generation++;
+	reload_state = RELOAD_IDLE;
+	hextemp = BSGS_N.GetBase16();
+	printf("[+] Using the new tables, N = 0x%s, K factor %i\n",hextemp,KFACTOR);
+	free(hextemp);
+}
+
+/*
+	Called by the network thread after every epoll_wait, the new tables are used by the
+	new jobs as soon as they are ready, the client of the RELOAD gets the result.
+*/
+void bsgs_reload_update()	{
+	const char *reply = NULL;
+	pthread_mutex_lock(&mutex_jobs);
+	if(reload_state == RELOAD_READY)	{
+		bsgs_tables_swap();
+		reply = "RELOAD 200 OK\n";
+	}
+	else if(reload_state == RELOAD_FAILED)	{
+		reload_state = RELOAD_IDLE;
+		reply = "RELOAD 500 Internal Server Error\n";
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	if(reply != NULL)	{
+		if(reload_conn != NULL)	{
+			client_write(reload_conn,reply,strlen(reply));
+			reload_conn->replied++;
+		}
+		reload_conn = NULL;
+		bsgs_job_notify();
+	}
+}
+
+/*
+	Background part of RELOAD, the workers and the clients go on with the active tables
+	while the new ones are mapped or made.
+*/
+void *thread_reload(void *vargp)	{
+	struct bsgs_tables *t = (struct bsgs_tables*) vargp;
+	int ok;
+	ok = bsgs_tables_map(t);
+	if(!ok)	{
+		ok = bsgs_tables_build(t) && bsgs_tables_map(t);
+	}
+	pthread_mutex_lock(&mutex_jobs);
+	if(ok)	{
+		tables_next = t;
+		reload_state = RELOAD_READY;
+		printf("[+] New tables ready, the new jobs use them\n");
+	}
+	else	{
+		reload_state = RELOAD_FAILED;
+		fprintf(stderr,"[E] RELOAD failed, the tables are the same\n");
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	if(!ok)	{
+		delete t;
+	}
+	bsgs_job_notify();
+	pthread_exit(NULL);
+}
+
+void *thread_process_bsgs(void *vargp)	{
+	Int base_key;
+	Point base_point,point_aux;
+	uint32_t k, cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
+	Int km,intaux;
+	struct bsgs_job *job;
+	int exhausted;
+	grp->Set(dx);
+
+	thread_telemetry = &telemetry[*(int *)vargp];
+	
+	/*
+		Persistent worker: each block of 2*BSGS_N keys is taken from the job with less
+		workers for its weight, so the running jobs share the pool block by block.
+	*/
+	while(1)	{
+		job = bsgs_job_next();
+
+		/* Every job has its own set of tables, the one of the last job can be other */
+		thread_tables = job->tables;
+		cycles = thread_tables->aux / 1024;
+		if(thread_tables->aux % 1024 != 0)	{
+			cycles++;
+		}
+
+		intaux.Set(&thread_tables->M_double);
+		intaux.Mult(CPU_GRP_SIZE/2);
+		intaux.Add(&thread_tables->M);
+		
+		/*
+			intaux hold the Current middle range value (Current)
+			(BSGS_M*2) * (CPU_GRP_SIZE/2) + BSGS_M
+			or
+			(BSGS_M * 512)  + BSGS_M
+		*/
+		
+	/*
+		The next block of 2*BSGS_N keys comes from the atomic block counter of the job,
+		so base_key is never the same between threads and there is no lock here
+	*/
+		exhausted = bsgs_job_take(job,&base_key);
+		if(!exhausted)	{
+
+			//base point is the point of the current start range (Base_key)
+			base_point = secp->ComputePublicKey(&base_key);
+
+			km.Set(&base_key);
+			km.Neg();
+		 
+			km.Add(&secp->order);
+			km.Sub(&intaux);
+
+			//point_aux =-( basekey + ((BSGS_M*2) * 512)  + BSGS_M)
+			point_aux = secp->ComputePublicKey(&km);
+		
+			for(k = 0; k < job->targets.size(); k++)	{
+				if(job->found[k] == 0 && base_point.equals(job->targets[k]))	{
+					bsgs_job_found(job,k,&base_key);
+				}
+			}
+			bsgs_walk_job(job,&base_key,point_aux,cycles,grp,dx);
+			thread_telemetry->steps += 2;
+		}
+		bsgs_job_release(job,exhausted);
+	}
+	delete grp;
+	delete[] dx;
+	pthread_exit(NULL);
+}
+
+/*
+	Giant steps from base_key for all the targets of the job not found yet. Up to
+	BSGS_WALK_TARGETS targets walk together: the dx of all of them are in the same
+	IntGroup, so there is only one modular inversion for every 1024 points of all those
+	targets, then the points of each target are checked in the bloom filters as before.
+	grp is an IntGroup of BSGS_WALK_TARGETS * BSGS_WALK_GROUP elements set to dx.
+*/
+void bsgs_walk_job(struct bsgs_job *job,Int *base_key,Point &point_aux,uint32_t cycles,IntGroup *grp,Int *dx)	{
+	char xpoint_raw[32];
+	uint32_t targets[BSGS_WALK_TARGETS];
+	Point startP[BSGS_WALK_TARGETS];
+	Point pts[CPU_GRP_SIZE];
+	Point pp,pn;
+	Int dy,dyn,_s,_p,keyfound;
+	Int *d;
+	uint32_t count,j,k,k_index,l,n,t,r;
+	int i,hLength = (CPU_GRP_SIZE / 2 - 1);
+	std::vector<Point> &GSn = thread_tables->GSn;
+	Point &_2GSn = thread_tables->_2GSn;
+
+	count = job->targets.size();
+	k = 0;
+	while(k < count && !__atomic_load_n(&job->cancelled,__ATOMIC_RELAXED))	{
+		n = 0;
+		while(k < count && n < BSGS_WALK_TARGETS)	{
+			if(job->found[k] == 0)	{
+				targets[n] = k;
+				startP[n] = secp->AddDirect(job->targets[k],point_aux);
+				n++;
+			}
+			k++;
+		}
+		j = 0;
+		while(j < cycles && n > 0 && !__atomic_load_n(&job->cancelled,__ATOMIC_RELAXED))	{
+			for(t = 0; t < n; t++)	{
+				d = &dx[t * BSGS_WALK_GROUP];
+				for(i = 0; i < hLength; i++) {
+					d[i].ModSub(&GSn[i].x,&startP[t].x);
+				}
+				d[i].ModSub(&GSn[i].x,&startP[t].x);  // For the first point
+				d[i+1].ModSub(&_2GSn.x,&startP[t].x); // For the next center point
+			}
+			for(i = n * BSGS_WALK_GROUP; i < BSGS_WALK_TARGETS * BSGS_WALK_GROUP; i++)	{
+				dx[i].SetInt32(1);	/* Unused places of the group when there are less targets */
+			}
+
+			// Grouped ModInv of all the targets
+			grp->ModInv();
+
+			for(t = 0; t < n; t++)	{
+				d = &dx[t * BSGS_WALK_GROUP];
+				k_index = targets[t];
 
-				// Grouped ModInv
-				grp->ModInv();
-				
 				/*
 				We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
 				We compute key in the positive and negative way from the center of the group
 				*/
 
 				// center point
-				pts[CPU_GRP_SIZE / 2] = startP;
-				
-				for(i = 0; i<hLength; i++) {
+				pts[CPU_GRP_SIZE / 2] = startP[t];
 
-					pp = startP;
-					pn = startP;
+				for(i = 0; i<hLength; i++) {
+					pp = startP[t];
+					pn = startP[t];
 
 					// P = startP + i*G
 					dy.ModSub(&GSn[i].y,&pp.y);
 
-					_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+					_s.ModMulK1(&dy,&d[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
 					_p.ModSquareK1(&_s);            // _p = pow2(s)
 
 					pp.x.ModNeg();
 					pp.x.ModAdd(&_p);
 					pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-					
-#if 0 /* For this BSGS we don't neet to calculate the Y value of intermediate points */
-pp.y.ModSub(&GSn[i].x,&pp.x);
-pp.y.ModMulK1(&_s);
-pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
 
 					// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
 					dyn.Set(&GSn[i].y);
 					dyn.ModNeg();
 					dyn.ModSub(&pn.y);
 
-					_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+					_s.ModMulK1(&dyn,&d[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
 					_p.ModSquareK1(&_s);            // _p = pow2(s)
 
 					pn.x.ModNeg();
 					pn.x.ModAdd(&_p);
 					pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
 
-#if 0	/* For this BSGS we don't neet to calculate the Y value of intermediate points */
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-
 					pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
 					pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
-
 				}
 
 				// First point (startP - (GRP_SZIE/2)*G)
-				pn = startP;
+				pn = startP[t];
 				dyn.Set(&GSn[i].y);
 				dyn.ModNeg();
 				dyn.ModSub(&pn.y);
 
-				_s.ModMulK1(&dyn,&dx[i]);
+				_s.ModMulK1(&dyn,&d[i]);
 				_p.ModSquareK1(&_s);
 
 				pn.x.ModNeg();
 				pn.x.ModAdd(&_p);
 				pn.x.ModSub(&GSn[i].x);
 
-
-#if 0 /* For this BSGS we don't neet to calculate the Y value of intermediate points */
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
-#endif
-
 				pts[0] = pn;
-				
-				for(int i = 0; i<CPU_GRP_SIZE && bsgs_found == 0; i++) {
-					
+
+				for(int i = 0; i<CPU_GRP_SIZE && job->found[k_index] == 0; i++) {
 					pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-					
-					r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-					
+					r = bsgs_firstcheck(xpoint_raw);
 					if(r) {
-						r = bsgs_secondcheck(&base_key,((j*1024) + i),&keyfound);
+						r = bsgs_secondcheck(base_key,((j*1024) + i),&job->targets[k_index],&keyfound);
 						if(r)	{
-							hextemp = keyfound.GetBase16();
-							printf("[+] Thread Key found privkey %s   \n",hextemp);
-							point_found = secp->ComputePublicKey(&keyfound);
-							aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed,point_found);
-							printf("[+] Publickey %s\n",aux_c);
-							pthread_mutex_lock(&write_keys);
-
-							filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-							if(filekey != NULL)	{
-								fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-								fclose(filekey);
-							}
-							BSGSkeyfound.Set(&keyfound);
-							pthread_mutex_unlock(&write_keys);
-							free(hextemp);
-							free(aux_c);
-							bsgs_found = 1;
-
+							bsgs_job_found(job,k_index,&keyfound);
 						} //End if second check
-						
 					}//End if first check
-					
 				}// For for pts variable
-				
+
 				// Next start point (startP += (bsSize*GRP_SIZE).G)
-				
-				pp = startP;
+				pp = startP[t];
 				dy.ModSub(&_2GSn.y,&pp.y);
 
-				_s.ModMulK1(&dy,&dx[i + 1]);
+				_s.ModMulK1(&dy,&d[i + 1]);
 				_p.ModSquareK1(&_s);
 
 				pp.x.ModNeg();
 				pp.x.ModAdd(&_p);
 				pp.x.ModSub(&_2GSn.x);
-				
-				
+
 				/* For this BSGS we only need to calculate the Y value of  the next start point  */
 
 				pp.y.ModSub(&_2GSn.x,&pp.x);
 				pp.y.ModMulK1(&_s);
 				pp.y.ModSub(&_2GSn.y);
-				startP = pp;
-				
-				j++;
-			} //while all the aMP points
-		} // end else
-	}while(base_key.IsLower(&n_range_end) && bsgs_found == 0);
-	delete grp;
-	pthread_exit(NULL);
+				startP[t] = pp;
+			}
+
+			/* The targets found in this cycle leave the walk */
+			l = 0;
+			for(t = 0; t < n; t++)	{
+				if(job->found[targets[t]] == 0)	{
+					targets[l] = targets[t];
+					startP[l] = startP[t];
+					l++;
+				}
+			}
+			n = l;
+			j++;
+		}
+	}
+}
+
+/*
+	Private key of the target k of the job, it is saved in KEYFOUNDKEYFOUND.txt and the
+	client thread is woken up to send it. When there are no targets left the job is
+	exhausted so the workers don't take more blocks of it.
+*/
+void bsgs_job_found(struct bsgs_job *job,uint32_t k,Int *key)	{
+	FILE *filekey;
+	char *hextemp,*aux_c;
+	hextemp = key->GetBase16();
+	aux_c = secp->GetPublicKeyHex(job->compressed[k],job->targets[k]);
+	printf("[+] Thread Key found privkey %s   \n",hextemp);
+	printf("[+] Publickey %s\n",aux_c);
+	pthread_mutex_lock(&write_keys);
+	filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
+	if(filekey != NULL)	{
+		fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
+		fclose(filekey);
+	}
+	pthread_mutex_unlock(&write_keys);
+	free(hextemp);
+	free(aux_c);
+
+	pthread_mutex_lock(&mutex_jobs);
+	if(job->found[k] == 0)	{
+		job->keys[k].Set(key);
+		job->found[k] = 1;
+		job->remaining--;
+		if(job->remaining == 0)	{
+			job->exhausted = 1;
+		}
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	bsgs_job_notify();
+}
+
+/*
+	CANCEL or the client of the job is gone, the workers don't take more blocks of it and
+	the ones on it leave the walk after the current giant steps. If there are no workers
+	on it now it is done here, else the last one does it. Called with mutex_jobs.
+*/
+void bsgs_job_cancel(struct bsgs_job *job)	{
+	struct bsgs_job **link;
+	job->exhausted = 1;
+	__atomic_store_n(&job->cancelled,1,__ATOMIC_RELAXED);
+	if(job->workers == 0 && !job->done)	{
+		for(link = &jobs; *link != NULL; link = &(*link)->next)	{
+			if(*link == job)	{
+				*link = job->next;
+				break;
+			}
+		}
+		job->done = 1;
+		bsgs_job_notify();
+	}
+}
+
+/*
+	One PROGRESS line of the job: blocks scanned of the range, speed of the job and the
+	expected time to finish it at that speed. Called with mutex_jobs.
+*/
+int bsgs_job_progress(struct bsgs_job *job,uint64_t now,char *dst,size_t length)	{
+	char eta[32];
+	double seconds,speed,percent,found;
+	seconds = (double)(now - job->start_ms) / 1000.0;
+	speed = seconds > 0 ? (double)job->blocks_done * 2.0 * (double)job->tables->N.GetInt64() / seconds : 0;
+	percent = job->blocks ? 100.0 * (double)job->blocks_done / (double)job->blocks : 100.0;
+	found = job->targets.size() - job->remaining;
+	if(job->blocks_done > 0 && job->blocks > job->blocks_done)	{
+		plan_time(seconds * (double)(job->blocks - job->blocks_done) / (double)job->blocks_done,eta,sizeof(eta));
+	}
+	else	{
+		snprintf(eta,sizeof(eta),"%s",job->blocks_done > 0 ? "0.0 seconds" : "unknown");
+	}
+	return snprintf(dst,length,"PROGRESS %" PRIu64 " %" PRIu64 "/%" PRIu64 " %.2f%% %.0f keys/s found %.0f/%u ETA %s\n",job->id,job->blocks_done,job->blocks,percent,speed,found,(uint32_t)job->targets.size(),eta);
+}
+
+/*
+	Wake up the network thread, it checks the jobs of all the connections
+*/
+void bsgs_job_notify()	{
+	uint64_t one = 1;
+	if(write(notify_fd,&one,sizeof(one)) < 0)	{
+		/* The counter is already set, the network thread wakes up anyway */
+	}
+}
+
+/*
+	The bsgs_firstcheck function is the first tier check of every giant step point.
+	If the first level filter (-L) is enabled it discards most of the points before
+	the big bloom_bP filter, that one is usually on RAM and each probe is a cache miss.
+*/
+int bsgs_firstcheck(char *xpoint_raw)	{
+	int r;
+	if(FLAGPREFILTER)	{
+		thread_telemetry->probes[TIER_PRE]++;
+		if(!bloom_check_blocked(&thread_tables->bP_pre,xpoint_raw,32))	{
+			return 0;
+		}
+		thread_telemetry->hits[TIER_PRE]++;
+	}
+	thread_telemetry->probes[TIER_BP]++;
+	r = bloom_check(&thread_tables->bP[bsgs_shard(xpoint_raw)],xpoint_raw,32);
+	thread_telemetry->hits[TIER_BP] += (r == 1);
+	return r;
+}
+
+/*
+	The bloom_bP shard of one point is taken from the first bits of the X value,
+	with 256 shards this is the first byte as it always was
+*/
+uint32_t bsgs_shard(char *xpoint_raw)	{
+	return (((uint32_t)(uint8_t)xpoint_raw[0] << 8) | (uint8_t)xpoint_raw[1]) >> (16 - bloom_bP_shard_bits);
+}
+
+/*
+	Read one of the sharded bloom files, return 1 if the file was readed and 0 if the file
+	doesn't exist or it was made with other parameters, so it need to be created again.
+	Files made before bsgs_file_header existed are only valid for 256 shards.
+*/
+int bsgs_read_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items)	{
+	struct bsgs_file_header header;
+	struct bloom oldformat_bloom;
+	char rawvalue[32];
+	uint32_t i;
+	int oldformat = 0,readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error reading the file %s\n",filename);
+		exit(0);
+	}
+	if(memcmp(header.magic,BSGS_FILE_MAGIC,8) != 0)	{
+		oldformat = 1;
+		fseek(fd,0,SEEK_SET);
+	}
+	if((oldformat && shards != 256) || (!oldformat && (header.version != BSGS_FILE_VERSION || header.shards != shards || header.items != items)))	{
+		fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	printf("[+] Reading bloom filter from file %s ",filename);
+	fflush(stdout);
+	for(i = 0; i < shards; i++)	{
+		if(oldformat)	{
+			readed = fread(&oldformat_bloom,sizeof(struct bloom),1,fd);
+			if(readed == 1 && oldformat_bloom.bytes != blooms[i].bytes)	{
+				readed = 2;
+			}
+			else if(readed == 1)	{
+				oldformat_bloom.bf = blooms[i].bf;	/* Keeping our bf pointer*/
+				memcpy(&blooms[i],&oldformat_bloom,sizeof(struct bloom));
+			}
+		}
+		else	{
+			readed = bloom_load_header(&blooms[i],fd);
+			readed = (readed == 0) ? 1 : readed;
+		}
+		if(readed == 2)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+			fclose(fd);
+			return 0;
+		}
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		readed = fread(blooms[i].bf,blooms[i].bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		readed = fread(&checksums[i],sizeof(struct checksumsha256),1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(0);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)blooms[i].bf,blooms[i].bytes,(uint8_t*)rawvalue);
+			if(memcmp(checksums[i].data,rawvalue,32) != 0 || memcmp(checksums[i].backup,rawvalue,32) != 0 )	{	/* Verification */
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(0);
+			}
+		}
+		if(i % (shards > 4 ? shards / 4 : 1) == 0)	{
+			printf(".");
+			fflush(stdout);
+		}
+	}
+	printf(" Done!\n");
+	fclose(fd);
+	return 1;
+}
+
+void bsgs_write_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items)	{
+	struct bsgs_file_header header;
+	uint32_t i;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(0);
+	}
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_FILE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = shards;
+	header.items = items;
+	printf("[+] Writing bloom filter to file %s ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+		exit(0);
+	}
+	for(i = 0; i < shards; i++)	{
+		if(bloom_save_header(&blooms[i],fd) != 0)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(0);
+		}
+		readed = fwrite(blooms[i].bf,blooms[i].bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(0);
+		}
+		readed = fwrite(&checksums[i],sizeof(struct checksumsha256),1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(0);
+		}
+		if(i % (shards > 4 ? shards / 4 : 1) == 0)	{
+			printf(".");
+			fflush(stdout);
+		}
+	}
+	printf(" Done!\n");
+	fclose(fd);
+}
+
+/*
+	Start of the next block of the job in base, returns 1 if there are no blocks left.
+	The index of the block comes from the atomic counter of the job and it is mapped
+	to the segment where it is, the ranges already in the memo have no blocks.
+*/
+int bsgs_job_take(struct bsgs_job *job,Int *base)	{
+	uint64_t index;
+	size_t low,high,middle;
+	if(job->segments.empty())	{
+		return 1;
+	}
+	index = __atomic_fetch_add(&job->next_block,1,__ATOMIC_RELAXED);
+	low = 0;
+	high = job->segments.size();
+	while(high - low > 1)	{
+		middle = (low + high) / 2;
+		if(job->segments[middle].first <= index)	{
+			low = middle;
+		}
+		else	{
+			high = middle;
+		}
+	}
+	if(index - job->segments[low].first >= job->segments[low].blocks)	{
+		return 1;
+	}
+	base->Set(&job->block);
+	base->Mult(index - job->segments[low].first);
+	base->Add(&job->segments[low].start);
+	return 0;
+}
+
+/*
+	Job for the next block of a worker: the running job with the lowest workers / weight,
+	it waits if there are no jobs with blocks left.
+*/
+struct bsgs_job *bsgs_job_next()	{
+	struct bsgs_job *job,*best;
+	pthread_mutex_lock(&mutex_jobs);
+	do	{
+		best = NULL;
+		for(job = jobs; job != NULL; job = job->next)	{
+			if(!job->exhausted && (best == NULL || (uint64_t)job->workers * best->weight < (uint64_t)best->workers * job->weight))	{
+				best = job;
+			}
+		}
+		if(best == NULL)	{
+			pthread_cond_wait(&cond_jobs,&mutex_jobs);
+		}
+	}while(best == NULL);
+	best->workers++;
+	pthread_mutex_unlock(&mutex_jobs);
+	return best;
+}
+
+/*
+	End of one block of the job, the last worker of an exhausted job takes it out of
+	the list and wakes up the network thread to reply.
+*/
+void bsgs_job_release(struct bsgs_job *job,int exhausted)	{
+	struct bsgs_job **link;
+	int done = 0;
+	pthread_mutex_lock(&mutex_jobs);
+	job->workers--;
+	if(exhausted)	{
+		job->exhausted = 1;
+	}
+	else	{
+		job->blocks_done++;
+	}
+	if(job->exhausted && job->workers == 0 && !job->done)	{
+		for(link = &jobs; *link != NULL; link = &(*link)->next)	{
+			if(*link == job)	{
+				*link = job->next;
+				break;
+			}
+		}
+		job->done = 1;
+		done = 1;
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	if(done)	{
+		bsgs_job_notify();
+	}
+}
+
+/*
+	X of base + points[i] for the 32 points of AMP2 or AMP3 of a set, the same values of
+	32 secp->AddDirect(base,points[i]) but with only one modular inversion for all of them.
+	If base is the negated of one point there is no valid sum, its dx is changed to 1 so the
+	inversion of the others is not broken, bsgs_thirdcheck has its own check for that case.
+*/
+void bsgs_batch_x(Point &base,std::vector<Point> &points,char xpoint_raw[][32])	{
+	IntGroup grp(32);
+	Int dx[32];
+	Int dy,_s,_p,x;
+	int i;
+	for(i = 0; i < 32; i++)	{
+		if(base.x.IsEqual(&points[i].x))	{
+			dx[i].SetInt32(1);
+		}
+		else	{
+			dx[i].ModSub(&points[i].x,&base.x);
+		}
+	}
+	grp.Set(dx);
+	grp.ModInv();
+	for(i = 0; i < 32; i++)	{
+		dy.ModSub(&points[i].y,&base.y);
+		_s.ModMulK1(&dy,&dx[i]);
+		_p.ModSquareK1(&_s);
+		x.ModSub(&_p,&base.x);
+		x.ModSub(&points[i].x);
+		x.Get32Bytes((unsigned char *)xpoint_raw[i]);
+	}
 }
 
 /*
 	The bsgs_secondcheck function is made to perform a second BSGS search in a Range of less size.
 	This funtion is made with the especific purpouse to USE a smaller bPtable in RAM.
 */
-int bsgs_secondcheck(Int *start_range,uint32_t a,Int *privatekey)	{
+int bsgs_secondcheck(Int *start_range,uint32_t a,Point *target,Int *privatekey)	{
 	int i = 0,found = 0,r = 0;
 	Int base_key;
 	Point base_point,point_aux;
-	Point BSGS_Q, BSGS_S,BSGS_Q_AMP;
-	char xpoint_raw[32];
+	Point BSGS_Q, BSGS_S;
+	char xpoint_raw[32][32];
+	struct bsgs_tables *t = thread_tables;
 	
-	base_key.Set(&BSGS_M_double);
+	base_key.Set(&t->M_double);
 	base_key.Mult((uint64_t) a);
 	base_key.Add(start_range);
 
-	base_point = secp->ComputePublicKey(&base_key);
-	point_aux = secp->Negation(base_point);
 	/*
 		BSGS_S = Q - base_key
 				 Q is the target Key
 		base_key is the Start range + a*BSGS_M
+		A range from 0 has base_key 0 for its first part, 0*G has no affine point so Q is used as it is
 	*/
-	
-	BSGS_S = secp->AddDirect(OriginalPointsBSGS,point_aux);
+	if(base_key.IsZero())	{
+		BSGS_S.Set(*target);
+	}
+	else	{
+		base_point = secp->ComputePublicKey(&base_key);
+		point_aux = secp->Negation(base_point);
+		BSGS_S = secp->AddDirect(*target,point_aux);
+	}
 	BSGS_Q.Set(BSGS_S);
+	bsgs_batch_x(BSGS_Q,t->AMP2,xpoint_raw);
 	do {
-		BSGS_Q_AMP = secp->AddDirect(BSGS_Q,BSGS_AMP2[i]);
-		BSGS_S.Set(BSGS_Q_AMP);
-		BSGS_S.x.Get32Bytes((unsigned char *) xpoint_raw);
-		
-		r = bloom_check(&bloom_bPx2nd[(uint8_t) xpoint_raw[0]],xpoint_raw,32);
+		r = bloom_check(&t->bPx2nd[(uint8_t) xpoint_raw[i][0]],xpoint_raw[i],32);
+		thread_telemetry->probes[TIER_2ND]++;
+		thread_telemetry->hits[TIER_2ND] += (r == 1);
 
 		if(r)	{
-			found = bsgs_thirdcheck(&base_key,i,privatekey);
+			found = bsgs_thirdcheck(&base_key,i,target,privatekey);
 		}
 		i++;
 	}while(i < 32 && !found);
 	return found;
 }
 
-int bsgs_thirdcheck(Int *start_range,uint32_t a,Int *privatekey)	{
+int bsgs_thirdcheck(Int *start_range,uint32_t a,Point *target,Int *privatekey)	{
 	uint64_t j = 0;
 	int i = 0,found = 0,r = 0;
 	Int base_key,calculatedkey;
 	Point base_point,point_aux;
-	Point BSGS_Q, BSGS_S,BSGS_Q_AMP;
-	char xpoint_raw[32];
+	Point BSGS_Q, BSGS_S;
+	char xpoint_raw[32][32];
+	struct bsgs_tables *t = thread_tables;
 
 	base_key.SetInt32(a);
-	base_key.Mult(&BSGS_M2_double);
+	base_key.Mult(&t->M2_double);
 	base_key.Add(start_range);
 
-	base_point = secp->ComputePublicKey(&base_key);
-	point_aux = secp->Negation(base_point);
-	
-	BSGS_S = secp->AddDirect(OriginalPointsBSGS,point_aux);
+	if(base_key.IsZero())	{	/* Same as bsgs_secondcheck */
+		BSGS_S.Set(*target);
+	}
+	else	{
+		base_point = secp->ComputePublicKey(&base_key);
+		point_aux = secp->Negation(base_point);
+		BSGS_S = secp->AddDirect(*target,point_aux);
+	}
 	BSGS_Q.Set(BSGS_S);
 	
+	bsgs_batch_x(BSGS_Q,t->AMP3,xpoint_raw);
 	do {
-		BSGS_Q_AMP = secp->AddDirect(BSGS_Q,BSGS_AMP3[i]);
-		BSGS_S.Set(BSGS_Q_AMP);
-		BSGS_S.x.Get32Bytes((unsigned char *)xpoint_raw);
-		r = bloom_check(&bloom_bPx3rd[(uint8_t)xpoint_raw[0]],xpoint_raw,32);
+		if(FLAGHASHINDEX)	{
+			r = 1;	/* The hash index answer membership and index in the same lookup */
+		}
+		else	{
+			r = bloom_check(&t->bPx3rd[(uint8_t)xpoint_raw[i][0]],xpoint_raw[i],32);
+			thread_telemetry->probes[TIER_3RD]++;
+			thread_telemetry->hits[TIER_3RD] += (r == 1);
+		}
 		if(r)	{
-			r = bsgs_searchbinary(bPtable,xpoint_raw,bsgs_m3,&j);
+			if(FLAGHASHINDEX)	{
+				r = bsgs_hashindex_search(xpoint_raw[i],&j);
+			}
+			else	{
+				r = bsgs_searchbinary(t->table,xpoint_raw[i],t->m3,&j);
+			}
+			thread_telemetry->probes[TIER_TABLE]++;
+			thread_telemetry->hits[TIER_TABLE] += r;
 			if(r)	{
 				calcualteindex(i,&calculatedkey);
 				privatekey->Set(&calculatedkey);
@@ -1897,7 +4066,7 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,Int *privatekey)	{
 				
 				point_aux = secp->ComputePublicKey(privatekey);
 				
-				if(point_aux.x.IsEqual(&OriginalPointsBSGS.x))	{
+				if(point_aux.x.IsEqual(&target->x))	{
 					found = 1;
 				}
 				else	{
@@ -1907,42 +4076,459 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,Int *privatekey)	{
 					privatekey->Add(&base_key);
 					
 					point_aux = secp->ComputePublicKey(privatekey);
-					if(point_aux.x.IsEqual(&OriginalPointsBSGS.x))	{
+					if(point_aux.x.IsEqual(&target->x))	{
 						found = 1;
 					}
 				}
 			}
 		}
-		else	{
-			/*
-				For some reason the AddDirect don't return 000000... value when the publickeys are the negated values from each other
-				Why JLP?
-				This is is an special case
-			*/
-			if(BSGS_Q.x.IsEqual(&BSGS_AMP3[i].x))	{
-				calcualteindex(i,&calculatedkey);
-				privatekey->Set(&calculatedkey);
-				privatekey->Add(&base_key);
-				found = 1;
-			}
+		if(!found)	{
+			/*
+				For some reason the AddDirect don't return 000000... value when the publickeys are the negated values from each other
+				Why JLP?
+				This is is an special case
+				With -H there is no third bloom filter, so it is checked after the miss of the table too
+			*/
+			if(BSGS_Q.x.IsEqual(&t->AMP3[i].x))	{
+				calcualteindex(i,&calculatedkey);
+				privatekey->Set(&calculatedkey);
+				privatekey->Add(&base_key);
+				found = 1;
+			}
+		}
+		i++;
+	}while(i < 32 && !found);
+	thread_telemetry->matches += found;
+	return found;
+}
+
+void calcualteindex(int i,Int *key)	{
+	if(i == 0)	{
+		key->Set(&thread_tables->M3);
+	}
+	else	{
+		key->SetInt32(i);
+		key->Mult(&thread_tables->M3_double);
+		key->Add(&thread_tables->M3);
+	}
+}
+
+/*
+	Sum the per thread counters, the values can be a bit behind of the threads
+	that are still running, it is the same for the steps[] counters.
+*/
+void telemetry_totals(uint64_t *probes,uint64_t *hits,uint64_t *matches)	{
+	int i,j;
+	memset(probes,0,sizeof(uint64_t)*TELEMETRY_TIERS);
+	memset(hits,0,sizeof(uint64_t)*TELEMETRY_TIERS);
+	*matches = 0;
+	if(telemetry == NULL)	{
+		return;
+	}
+	for(i = 0; i < NTHREADS; i++)	{
+		for(j = 0; j < TELEMETRY_TIERS; j++)	{
+			probes[j] += telemetry[i].probes[j];
+			hits[j] += telemetry[i].hits[j];
+		}
+		*matches += telemetry[i].matches;
+	}
+}
+
+void metrics_printf(struct client_conn *conn,const char *format,...)	{
+	char buffer[512];
+	va_list args;
+	int length;
+	va_start(args,format);
+	length = vsnprintf(buffer,sizeof(buffer),format,args);
+	va_end(args);
+	client_write(conn,buffer,length < (int)sizeof(buffer) ? length : (int)sizeof(buffer) - 1);
+}
+
+/*
+	Prometheus text format of the -W port. The worker counters are only read, never
+	written here, so a scrape doesn't touch the hot path. There is no speed gauge, the
+	scrapers get it from the counters with rate(), each one with its own window.
+*/
+void metrics_reply(struct client_conn *conn)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches,total_steps = 0,now,count;
+	uint32_t active = 0,running = 0,queued = 0;
+	double keys;
+	struct bsgs_job *job;
+	struct client_conn *c;
+	struct client_request *request;
+	int i;
+	if(conn->metrics != 2)	{
+		metrics_printf(conn,"HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n404 Not Found\n");
+		return;
+	}
+	keys = (double)BSGS_N.GetInt64();
+	metrics_printf(conn,"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+
+	metrics_printf(conn,"# HELP bsgsd_thread_keys_total Keys scanned by each worker thread\n# TYPE bsgsd_thread_keys_total counter\n");
+	for(i = 0; i < NTHREADS; i++)	{
+		metrics_printf(conn,"bsgsd_thread_keys_total{thread=\"%i\"} %.0f\n",i,(double)telemetry[i].steps * keys);
+		total_steps += telemetry[i].steps;
+	}
+	metrics_printf(conn,"# HELP bsgsd_keys_total Keys scanned by all the threads\n# TYPE bsgsd_keys_total counter\nbsgsd_keys_total %.0f\n",(double)total_steps * keys);
+	metrics_printf(conn,"# HELP bsgsd_blocks_total Giant step blocks of N keys completed\n# TYPE bsgsd_blocks_total counter\nbsgsd_blocks_total %" PRIu64 "\n",total_steps);
+
+	telemetry_totals(probes,hits,&matches);
+	metrics_printf(conn,"# HELP bsgsd_bloom_probes_total Checks of each filter tier\n# TYPE bsgsd_bloom_probes_total counter\n");
+	for(i = 0; i < TELEMETRY_TIERS; i++)	{
+		metrics_printf(conn,"bsgsd_bloom_probes_total{tier=\"%s\"} %" PRIu64 "\n",telemetry_names[i],probes[i]);
+	}
+	metrics_printf(conn,"# HELP bsgsd_bloom_hits_total Positive checks of each filter tier\n# TYPE bsgsd_bloom_hits_total counter\n");
+	for(i = 0; i < TELEMETRY_TIERS; i++)	{
+		metrics_printf(conn,"bsgsd_bloom_hits_total{tier=\"%s\"} %" PRIu64 "\n",telemetry_names[i],hits[i]);
+	}
+
+	metrics_printf(conn,"# HELP bsgsd_table_bytes Memory of the bloom filters and the bP table\n# TYPE bsgsd_table_bytes gauge\n");
+	metrics_printf(conn,"bsgsd_table_bytes{table=\"pre\"} %" PRIu64 "\n",FLAGPREFILTER ? bloom_bP_pre.bytes : 0);
+	metrics_printf(conn,"bsgsd_table_bytes{table=\"bP\"} %" PRIu64 "\n",bloom_bP_totalbytes);
+	metrics_printf(conn,"bsgsd_table_bytes{table=\"2nd\"} %" PRIu64 "\n",bloom_bP2_totalbytes);
+	metrics_printf(conn,"bsgsd_table_bytes{table=\"3rd\"} %" PRIu64 "\n",bloom_bP3_totalbytes);
+	metrics_printf(conn,"bsgsd_table_bytes{table=\"%s\"} %" PRIu64 "\n",FLAGHASHINDEX ? "hashindex" : "bPtable",FLAGHASHINDEX ? hashindex_buckets * (uint64_t)sizeof(struct hashindex_bucket) : bsgs_m3 * (uint64_t)sizeof(struct bsgs_xvalue));
+	metrics_printf(conn,"# HELP bsgsd_tables_generation Tables loaded by RELOAD since the start\n# TYPE bsgsd_tables_generation gauge\nbsgsd_tables_generation %" PRIu64 "\n",tables_generation);
+
+	pthread_mutex_lock(&mutex_jobs);
+	for(job = jobs; job != NULL; job = job->next)	{
+		active++;
+		running += (job->workers > 0);
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	for(c = conns; c != NULL; c = c->next)	{
+		for(request = c->queue; request != NULL; request = request->next)	{
+			queued++;
+		}
+	}
+	metrics_printf(conn,"# HELP bsgsd_jobs_active Jobs with blocks left or threads on them\n# TYPE bsgsd_jobs_active gauge\nbsgsd_jobs_active %u\n",active);
+	metrics_printf(conn,"# HELP bsgsd_jobs_running Jobs with at least one thread on them now\n# TYPE bsgsd_jobs_running gauge\nbsgsd_jobs_running %u\n",running);
+	metrics_printf(conn,"# HELP bsgsd_queue_depth Requests of all the connections waiting for their reply\n# TYPE bsgsd_queue_depth gauge\nbsgsd_queue_depth %u\n",queued);
+
+	metrics_printf(conn,"# HELP bsgsd_request_duration_seconds Time from a search request to its reply\n# TYPE bsgsd_request_duration_seconds histogram\n");
+	count = 0;
+	for(i = 0; i < METRICS_BUCKETS; i++)	{
+		count += metrics_latency[i];
+		metrics_printf(conn,"bsgsd_request_duration_seconds_bucket{le=\"%g\"} %" PRIu64 "\n",metrics_bounds[i],count);
+	}
+	metrics_printf(conn,"bsgsd_request_duration_seconds_bucket{le=\"+Inf\"} %" PRIu64 "\n",metrics_latency_count);
+	metrics_printf(conn,"bsgsd_request_duration_seconds_sum %.3f\nbsgsd_request_duration_seconds_count %" PRIu64 "\n",metrics_latency_sum,metrics_latency_count);
+	now = now_ms();
+	metrics_printf(conn,"# HELP bsgsd_uptime_seconds Seconds since the server started\n# TYPE bsgsd_uptime_seconds gauge\nbsgsd_uptime_seconds %.0f\n",(double)(now - metrics_start_ms) / 1000.0);
+}
+
+/*
+	Observed false positive rate of one tier, the points of the keys found are real
+	hits on every tier so they are not counted as false positives.
+*/
+double telemetry_observed(uint64_t probes,uint64_t hits,uint64_t matches)	{
+	if(probes == 0)	{
+		return 0;
+	}
+	return (double)((hits > matches) ? hits - matches : 0) / (double)probes;
+}
+
+/*
+	Theoretical false positive rate of each tier with the number of items that each
+	shard really holds, the real bits and hashes of the filter.
+*/
+double telemetry_expected(int tier)	{
+	switch(tier)	{
+		case TIER_PRE:
+			return FLAGPREFILTER ? (double)bloom_bP_pre.error : 0;
+		case TIER_BP:
+			return (bloom_bP != NULL) ? bloom_expected_error(&bloom_bP[0],bsgs_m/bloom_bP_shards) : 0;
+		case TIER_2ND:
+			return (bloom_bPx2nd != NULL) ? bloom_expected_error(&bloom_bPx2nd[0],bsgs_m2/256) : 0;
+		case TIER_3RD:
+			return (bloom_bPx3rd != NULL) ? bloom_expected_error(&bloom_bPx3rd[0],bsgs_m3/256) : 0;
+	}
+	return 0;
+}
+
+/*
+	Short observed/expected false positive rate of every tier with probes, for the stats line
+*/
+char *telemetry_line(char *line,size_t length)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches;
+	size_t len = 0;
+	int j;
+	line[0] = '\0';
+	telemetry_totals(probes,hits,&matches);
+	for(j = 0; j < TIER_TABLE && len < length; j++)	{
+		if(probes[j])	{
+			len += snprintf(line + len,length - len," %s %.2e/%.2e",telemetry_names[j],telemetry_observed(probes[j],hits[j],matches),telemetry_expected(j));
+		}
+	}
+	if(probes[TIER_TABLE] && len < length)	{
+		snprintf(line + len,length - len," table %" PRIu64 "/%" PRIu64,hits[TIER_TABLE],probes[TIER_TABLE]);
+	}
+	return line;
+}
+
+/*
+	Write all the counters as JSON, first to a temporary file and then renamed so any
+	external reader never see a half written file.
+*/
+void telemetry_dump(const char *filename)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches;
+	char tempname[1024];
+	FILE *fd;
+	int j;
+	telemetry_totals(probes,hits,&matches);
+	snprintf(tempname,sizeof(tempname),"%s.tmp",filename);
+	fd = fopen(tempname,"w");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Can't open the file %s\n",tempname);
+		return;
+	}
+	fprintf(fd,"{\"threads\":%i,\"tiers\":[",NTHREADS);
+	for(j = 0; j < TELEMETRY_TIERS; j++)	{
+		fprintf(fd,"%s{\"name\":\"%s\",\"probes\":%" PRIu64 ",\"hits\":%" PRIu64 ",\"observed\":%.6e,\"expected\":%.6e}",(j > 0) ? "," : "",telemetry_names[j],probes[j],hits[j],telemetry_observed(probes[j],hits[j],matches),telemetry_expected(j));
+	}
+	fprintf(fd,"],\"matches\":%" PRIu64 "}\n",matches);
+	fclose(fd);
+	if(rename(tempname,filename) != 0)	{
+		fprintf(stderr,"[E] Can't rename %s to %s\n",tempname,filename);
+	}
+}
+/*
+	Quick calibration for the -P planner: one thread compute some groups of giant step
+	points exactly as the bsgs threads do, and probe a big bloom filter and a small
+	blocked one. The filters are filled with a 50% bit pattern like a full filter.
+*/
+void plan_calibrate(struct plan_calibration *cal)	{
+	struct timespec start,end;
+	std::vector<Point> gs(CPU_GRP_SIZE/2);
+	Point _2gs,startP,pp,pn;
+	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
+	Int dx[CPU_GRP_SIZE / 2 + 1];
+	Int dy,dyn,_s,_p,key,min,max;
+	struct bloom big,small;
+	uint64_t count,probes,aux[4],big_bytes;
+	unsigned char xpoint_raw[32];
+	int i,hLength = (CPU_GRP_SIZE / 2 - 1);
+	double seconds;
+
+	grp->Set(dx);
+	gs[0] = secp->G;
+	gs[1] = secp->DoubleDirect(secp->G);
+	for(i = 2; i < CPU_GRP_SIZE / 2; i++)	{
+		gs[i] = secp->AddDirect(gs[i-1],secp->G);
+	}
+	_2gs = secp->DoubleDirect(gs[CPU_GRP_SIZE / 2 - 1]);
+	min.SetInt32(1);
+	max.Set(&secp->order);
+	key.Rand(&min,&max);
+	startP = secp->ComputePublicKey(&key);
+
+	count = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	do	{
+		for(i = 0; i < hLength; i++)	{
+			dx[i].ModSub(&gs[i].x,&startP.x);
+		}
+		dx[i].ModSub(&gs[i].x,&startP.x);
+		dx[i+1].ModSub(&_2gs.x,&startP.x);
+		grp->ModInv();
+		for(i = 0; i < hLength; i++)	{
+			pp = startP;
+			pn = startP;
+			dy.ModSub(&gs[i].y,&pp.y);
+			_s.ModMulK1(&dy,&dx[i]);
+			_p.ModSquareK1(&_s);
+			pp.x.ModNeg();
+			pp.x.ModAdd(&_p);
+			pp.x.ModSub(&gs[i].x);
+			pp.x.Get32Bytes(xpoint_raw);
+			dyn.Set(&gs[i].y);
+			dyn.ModNeg();
+			dyn.ModSub(&pn.y);
+			_s.ModMulK1(&dyn,&dx[i]);
+			_p.ModSquareK1(&_s);
+			pn.x.ModNeg();
+			pn.x.ModAdd(&_p);
+			pn.x.ModSub(&gs[i].x);
+			pn.x.Get32Bytes(xpoint_raw);
 		}
-		i++;
-	}while(i < 32 && !found);
+		pp = startP;
+		dy.ModSub(&_2gs.y,&pp.y);
+		_s.ModMulK1(&dy,&dx[i + 1]);
+		_p.ModSquareK1(&_s);
+		pp.x.ModNeg();
+		pp.x.ModAdd(&_p);
+		pp.x.ModSub(&_2gs.x);
+		pp.y.ModSub(&_2gs.x,&pp.x);
+		pp.y.ModMulK1(&_s);
+		pp.y.ModSub(&_2gs.y);
+		startP = pp;
+		count += CPU_GRP_SIZE;
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	}while(seconds < 0.3);
+	cal->point_ns = seconds * 1e9 / (double)count;
+	delete grp;
 
-	return found;
+	/* 256 MB or a quarter of the RAM, enough to miss every cache level */
+	big_bytes = (plan_ram / 4 < 268435456) ? plan_ram / 4 : 268435456;
+	if(bloom_init2(&big,(uint64_t)((double)big_bytes * 8 / 28.7552),0.000001) == 1 || bloom_init_blocked(&small,65536,4194304) == 1)	{
+		fprintf(stderr,"[E] error bloom_init for the calibration\n");
+		exit(0);
+	}
+	memset(big.bf,0x55,big.bytes);
+	memset(small.bf,0x55,small.bytes);
+	probes = 2000000;
+	memset(aux,0,sizeof(aux));
+	count = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for(aux[0] = 0; aux[0] < probes; aux[0]++)	{
+		count += bloom_check(&big,aux,sizeof(aux));
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	cal->probe_ns = ((double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec)) / (double)probes;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for(aux[0] = 0; aux[0] < probes; aux[0]++)	{
+		count += bloom_check_blocked(&small,aux,sizeof(aux));
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	cal->preprobe_ns = ((double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec)) / (double)probes;
+	if(count == 0)	{	/* Keep the compiler from dropping the loops */
+		cal->probe_ns += 0;
+	}
+	bloom_free(&big);
+	bloom_free(&small);
 }
 
-void calcualteindex(int i,Int *key)	{
-	if(i == 0)	{
-		key->Set(&BSGS_M3);
+/*
+	RAM of the three bloom tiers, the bP table and the first level filter for one M value,
+	the same sizes that main() computes before allocating
+*/
+uint64_t plan_memory(uint64_t m,uint64_t prefilter_bytes)	{
+	uint64_t m2,m3,items,total;
+	m2 = m / 32 + ((m % 32) ? 1 : 0);
+	m3 = m2 / 32 + ((m2 % 32) ? 1 : 0);
+	items = (m / bloom_bP_shards > 1000) ? m / bloom_bP_shards + ((m % bloom_bP_shards) ? 1 : 0) : 1000;
+	total = bloom_estimate_bytes(items,0.000001) * bloom_bP_shards;
+	items = (m2 / 256 > 1000) ? m2 / 256 + ((m2 % 256) ? 1 : 0) : 1000;
+	total += bloom_estimate_bytes(items,0.000001) * 256;
+	items = (m3 / 256 > 1000) ? m3 / 256 + ((m3 % 256) ? 1 : 0) : 1000;
+	total += bloom_estimate_bytes(items,0.000001) * 256;
+	total += m3 * sizeof(struct bsgs_xvalue);
+	return total + prefilter_bytes;
+}
+
+void plan_time(double seconds,char *dst,size_t length)	{
+	if(seconds < 120)	{
+		snprintf(dst,length,"%.1f seconds",seconds);
+	}
+	else if(seconds < 7200)	{
+		snprintf(dst,length,"%.1f minutes",seconds/60);
+	}
+	else if(seconds < 172800)	{
+		snprintf(dst,length,"%.1f hours",seconds/3600);
+	}
+	else if(seconds < 63072000)	{
+		snprintf(dst,length,"%.1f days",seconds/86400);
 	}
 	else	{
-		key->SetInt32(i);
-		key->Mult(&BSGS_M3_double);
-		key->Add(&BSGS_M3);
+		snprintf(dst,length,"%.3g years",seconds/31557600);
 	}
 }
 
+/*
+	The -P planner: for every -n from 2^40 to 2^64 take the biggest -k that fit
+	in the given RAM, with and without a first level filter of half of the L3 cache.
+	Speed and build time come from plan_calibrate() and assume linear scaling with threads.
+	The filters are sized for the fixed 0.000001 error of main(), so the error is not a choice.
+*/
+void plan_run(uint64_t targets,double range_bits)	{
+	struct plan_calibration cal;
+	uint64_t m,k,step,memory,prefilter_bytes,best_k = 0,best_prefilter = 0;
+	double hashes,bpe,pass,cost,speed,build,best_speed = 0;
+	char str_build[64],str_range[64],str_n[24],str_prefilter[16],best_n[24];
+	long cache = 0;
+	int e,f;
+
+	printf("[+] Planning for %.2f GB of RAM, %" PRIu64 " target%s, %i thread%s",(double)plan_ram/1073741824.0,targets,(targets > 1) ? "s" : "",NTHREADS,(NTHREADS > 1) ? "s" : "");
+	if(range_bits > 0)	{
+		printf(", range 2^%.1f",range_bits);
+	}
+	printf("\n");
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+	cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+	if(cache <= 0)	{
+		cache = 8388608;
+	}
+	prefilter_bytes = 1048576;
+	while(prefilter_bytes * 4 <= (uint64_t)cache)	{
+		prefilter_bytes *= 2;
+	}
+	plan_calibrate(&cal);
+	printf("[+] Calibration: %.1f ns per point, %.1f ns per bloom probe, %.1f ns per first level probe\n",cal.point_ns,cal.probe_ns,cal.preprobe_ns);
+	printf("[+]   -n                  -k      -L       RAM MB  Build time           Keys/s  Range time\n");
+	for(e = 40; e <= 64; e += 4)	{
+		if(range_bits > 0 && (double)e > range_bits)	{
+			break;
+		}
+		if(plan_memory((uint64_t)1 << (e/2),0) > plan_ram)	{
+			continue;
+		}
+		/* Biggest -k that fit in the RAM, the memory grows with M = sqrt(n) * k */
+		k = 1;
+		step = 1048576;
+		while(step > 0)	{
+			if(plan_memory(((uint64_t)1 << (e/2)) * (k + step),0) <= plan_ram)	{
+				k += step;
+			}
+			step /= 2;
+		}
+		m = ((uint64_t)1 << (e/2)) * k;
+		/* -n is 2^e, a one followed by e/4 hexadecimal zeros */
+		snprintf(str_n,sizeof(str_n),"0x1%0*d",e/4,0);
+		for(f = 0; f < 2; f++)	{
+			/* Same math as bloom_init_blocked for the first level filter */
+			bpe = (double)prefilter_bytes * 8 / (double)m;
+			hashes = round(0.693147180559945 * bpe);
+			hashes = (hashes < 1) ? 1 : ((hashes > 16) ? 16 : hashes);
+			pass = pow(1 - exp(-hashes / bpe),hashes);
+			if(f == 1 && pass > 0.5)	{
+				continue;
+			}
+			memory = plan_memory(m,f ? prefilter_bytes : 0);
+			if(memory > plan_ram)	{
+				continue;
+			}
+			cost = cal.point_ns + (f ? cal.preprobe_ns + pass * cal.probe_ns : cal.probe_ns);
+			speed = 2 * (double)m * 1e9 / cost * (double)NTHREADS / (double)targets;
+			build = (double)m * (cal.point_ns + cal.probe_ns) / 1e9 / (double)NTHREADS;
+			plan_time(build,str_build,sizeof(str_build));
+			if(range_bits > 0)	{
+				plan_time(pow(2,range_bits) / speed,str_range,sizeof(str_range));
+			}
+			else	{
+				snprintf(str_range,sizeof(str_range),"-");
+			}
+			snprintf(str_prefilter,sizeof(str_prefilter),f ? "%" PRIu64 : "-",prefilter_bytes/1048576);
+			printf("[+]   %-19s %-7" PRIu64 " %-4s %10.1f  %-14s %12.4g  %s\n",str_n,k,str_prefilter,(double)memory/1048576,str_build,speed,str_range);
+			if(speed > best_speed)	{
+				best_speed = speed;
+				best_k = k;
+				best_prefilter = f ? prefilter_bytes : 0;
+				snprintf(best_n,sizeof(best_n),"%s",str_n);
+			}
+		}
+	}
+	if(best_k == 0)	{
+		fprintf(stderr,"[E] There is not enough RAM for any -n and -k value\n");
+		return;
+	}
+	printf("[+] Recommended flags: -n %s -k %" PRIu64,best_n,best_k);
+	if(best_prefilter)	{
+		printf(" -L %" PRIu64,best_prefilter/1048576);
+	}
+	printf("\n");
+}
 
 void sleep_ms(int milliseconds)	{ // cross-platform sleep function
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -2074,24 +4660,26 @@ void *thread_bPload(void *vargp)	{
 
 			if(i_counter < bsgs_m3)	{
 				if(!FLAGREADEDFILE3)	{
-					memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
-					bPtable[i_counter].index = i_counter;
+					if(FLAGHASHINDEX)	{
+						bsgs_hashindex_add(rawvalue,i_counter);
+					}
+					else	{
+						memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
+						bsgs_xvalue_setindex(&bPtable[i_counter],i_counter);
+					}
 				}
 				if(!FLAGREADEDFILE4)	{
-					pthread_mutex_lock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					pthread_mutex_unlock(&bloom_bPx3rd_mutex[bloom_bP_index]);
+					bloom_add_atomic(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 				}
 			}
 			if(i_counter < bsgs_m2 && !FLAGREADEDFILE2)	{
-				pthread_mutex_lock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-				bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-				pthread_mutex_unlock(&bloom_bPx2nd_mutex[bloom_bP_index]);
+				bloom_add_atomic(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 			}
 			if(i_counter < to && !FLAGREADEDFILE1 )	{
-				pthread_mutex_lock(&bloom_bP_mutex[bloom_bP_index]);
-				bloom_add(&bloom_bP[bloom_bP_index], rawvalue ,BSGS_BUFFERXPOINTLENGTH);
-				pthread_mutex_unlock(&bloom_bP_mutex[bloom_bP_index]);
+				bloom_add_atomic(&bloom_bP[bsgs_shard(rawvalue)], rawvalue ,BSGS_BUFFERXPOINTLENGTH);
+			}
+			if(i_counter < to && FLAGPREFILTER && !FLAGREADEDFILE5 )	{
+				bloom_add_blocked_atomic(&bloom_bP_pre, rawvalue ,BSGS_BUFFERXPOINTLENGTH);
 			}
 			i_counter++;
 		}
@@ -2227,242 +4815,1106 @@ void *thread_bPload_2blooms(void *vargp)	{
 			bloom_bP_index = (uint8_t)rawvalue[0];
 			if(i_counter < bsgs_m3)	{
 				if(!FLAGREADEDFILE3)	{
-					memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
-					bPtable[i_counter].index = i_counter;
+					if(FLAGHASHINDEX)	{
+						bsgs_hashindex_add(rawvalue,i_counter);
+					}
+					else	{
+						memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
+						bsgs_xvalue_setindex(&bPtable[i_counter],i_counter);
+					}
 				}
 				if(!FLAGREADEDFILE4)	{
-					pthread_mutex_lock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					pthread_mutex_unlock(&bloom_bPx3rd_mutex[bloom_bP_index]);
+					bloom_add_atomic(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 				}
 			}
 			if(i_counter < bsgs_m2 && !FLAGREADEDFILE2)	{
-				pthread_mutex_lock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-				bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-				pthread_mutex_unlock(&bloom_bPx2nd_mutex[bloom_bP_index]);
+				bloom_add_atomic(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 			}
 			i_counter++;
 		}
-		// Next start point (startP + GRP_SIZE*G)
-		pp = startP;
-		dy.ModSub(&_2Gn.y,&pp.y);
+		// Next start point (startP + GRP_SIZE*G)
+		pp = startP;
+		dy.ModSub(&_2Gn.y,&pp.y);
+
+		_s.ModMulK1(&dy,&dx[i + 1]);
+		_p.ModSquareK1(&_s);
+
+		pp.x.ModNeg();
+		pp.x.ModAdd(&_p);
+		pp.x.ModSub(&_2Gn.x);
+
+		pp.y.ModSub(&_2Gn.x,&pp.x);
+		pp.y.ModMulK1(&_s);
+		pp.y.ModSub(&_2Gn.y);
+		startP = pp;
+	}
+	delete grp;
+	pthread_mutex_lock(&bPload_mutex[threadid]);
+	tt->finished = 1;
+	pthread_mutex_unlock(&bPload_mutex[threadid]);
+	pthread_exit(NULL);
+	return NULL;
+}
+
+
+/* This function takes in two parameters:
+
+publickey: a reference to a Point object representing a public key.
+dst_address: a pointer to an unsigned char array where the generated binary address will be stored.
+The function is designed to generate a binary address for Ethereum using the given public key.
+It first extracts the x and y coordinates of the public key as 32-byte arrays, and concatenates them
+to form a 64-byte array called bin_publickey. Then, it applies the KECCAK-256 hashing algorithm to
+bin_publickey to generate the binary address, which is stored in dst_address. */
+
+
+void menu() {
+	printf("\nUsage:\n");
+	printf("-h          show this help\n");
+	printf("-k value    Use this only with bsgs mode, k value is factor for M, more speed but more RAM use wisely\n");
+	printf("-n number   Check for N sequential numbers before the random chosen, this only works with -R option\n");
+	printf("-t tn       Threads number, must be a positive integer\n");
+	printf("-p port     TCP port Number for listening conections");
+	printf("-i ip		IP Address for listening conections");
+	printf("-J file     Write the bloom filter telemetry as JSON to this file after each request\n");
+	printf("-P ram[:bits] Print the recommended -n, -k and -L values for this RAM in GB (M suffix for MB) and range bits, nothing is built\n");
+	printf("-F shards   Number of shards of the first bloom filter, power of two from 256 to 65536, default 256\n");
+	printf("-L size     First level filter size in MB (K suffix for KB), checked before the big bloom filter\n");
+	printf("-H          Hash index in place of the third bloom filter and the sorted bP table\n");
+	printf("-O          Use the bP table of the third check from the file keyhunt_bsgs_2_*.tbl mapped in memory\n");
+	printf("            It saves only the RAM of that table (less than 1% of the total), the bloom filters stay in RAM\n");
+	printf("-W port     HTTP port for the Prometheus metrics (GET /metrics) in the same IP of -i\n");
+	printf("-b          Only make the files of the tables for these -n and -k, then exit (RELOAD uses it)\n");
+	printf("-M file     Save the searched ranges of each public key in this file and load them at start\n");
+	printf("-T name     Share the tables with other processes in this POSIX shared memory name or hugetlbfs file\n");
+	printf("\nExample:\n\n");
+	printf("./bsgs -k 512 \n\n");
+	exit(EXIT_FAILURE);
+}
+
+
+void checkpointer(void *ptr,const char *file,const char *function,const  char *name,int line)	{
+	if(ptr == NULL)	{
+		fprintf(stderr,"[E] error in file %s, %s pointer %s on line %i\n",file,function,name,line); 
+		exit(EXIT_FAILURE);
+	}
+}
+
+void writekey(bool compressed,Int *key)	{
+	Point publickey;
+	FILE *keys;
+	char *hextemp,*hexrmd,public_key_hex[132],address[50],rmdhash[20];
+	memset(address,0,50);
+	memset(public_key_hex,0,132);
+	hextemp = key->GetBase16();
+	publickey = secp->ComputePublicKey(key);
+	secp->GetPublicKeyHex(compressed,publickey,public_key_hex);
+	secp->GetHash160(P2PKH,compressed,publickey,(uint8_t*)rmdhash);
+	hexrmd = tohex(rmdhash,20);
+	rmd160toaddress_dst(rmdhash,address);
+
+	pthread_mutex_lock(&write_keys);
+	keys = fopen("KEYFOUNDKEYFOUND.txt","a+");
+	if(keys != NULL)	{
+		fprintf(keys,"Private Key: %s\npubkey: %s\nAddress %s\nrmd160 %s\n",hextemp,public_key_hex,address,hexrmd);
+		fclose(keys);
+	}
+	printf("\nHit! Private Key: %s\npubkey: %s\nAddress %s\nrmd160 %s\n",hextemp,public_key_hex,address,hexrmd);
+	
+	pthread_mutex_unlock(&write_keys);
+	free(hextemp);
+	free(hexrmd);
+}
+
+
+void init_generator()	{
+	Point G = secp->ComputePublicKey(&stride);
+	Point g;
+	g.Set(G);
+	Gn.reserve(CPU_GRP_SIZE / 2);
+	Gn[0] = g;
+	g = secp->DoubleDirect(g);
+	Gn[1] = g;
+	for(int i = 2; i < CPU_GRP_SIZE / 2; i++) {
+		g = secp->AddDirect(g,G);
+		Gn[i] = g;
+	}
+	_2Gn = secp->DoubleDirect(Gn[CPU_GRP_SIZE / 2 - 1]);
+}
+
+/*
+	Job for one request line "<publickey>[,<publickey>...] <from>:<to> [weight]", NULL if
+	the line is not valid. The job is not in the list of jobs yet.
+*/
+struct bsgs_job *bsgs_job_parse(char *line)	{
+	char *pubkey,*comma;
+	Point target;
+	bool compressed;
+	struct bsgs_job *job;
+	Tokenizer t;
+	t.tokens = NULL;
+
+	stringtokenizer(line, &t);
+	if (t.n != 3 && t.n != 4) {
+		printf("Invalid input format from client, tokens %i\n",t.n);
+		freetokenizer(&t);
+		return NULL;
+	}
+
+	/* The first token is one public key or a list of them separated by commas */
+	job = new bsgs_job();
+	pubkey = t.tokens[0];
+	do	{
+		comma = strchr(pubkey,',');
+		if(comma != NULL)	{
+			*comma = '\0';
+		}
+		if(job->targets.size() == REQUEST_MAX_TARGETS || !isValidHex(pubkey) || !secp->ParsePublicKeyHex(pubkey,target,compressed))	{
+			printf("Invalid publickey format from client %s\n",pubkey);
+			freetokenizer(&t);
+			delete job;
+			return NULL;
+		}
+		job->targets.push_back(target);
+		job->compressed.push_back(compressed);
+		pubkey = comma + 1;
+	}while(comma != NULL);
+	if(!(isValidHex(t.tokens[1]) && isValidHex(t.tokens[2])))	{
+		printf("Invalid hexadecimal format from client %s:%s\n",t.tokens[1],t.tokens[2]);
+		freetokenizer(&t);
+		delete job;
+		return NULL;
+	}
+	/* Optional weight of the job, 1 to 100, the pool is shared in that proportion */
+	job->weight = 1;
+	if(t.n == 4)	{
+		job->weight = strtoul(t.tokens[3],NULL,10);
+		if(job->weight < 1 || job->weight > 100)	{
+			printf("Invalid weight from client %s\n",t.tokens[3]);
+			freetokenizer(&t);
+			delete job;
+			return NULL;
+		}
+	}
+
+	job->range_from.SetBase16(t.tokens[1]);
+	job->range_to.SetBase16(t.tokens[2]);
+
+	freetokenizer(&t);
+	bsgs_job_init(job);
+	return job;
+}
+
+/*
+	Job of a request frame, see REQUEST_FRAME_MAGIC. length is the length of the body,
+	already checked against REQUEST_FRAME_MAX. Returns NULL for a bad frame.
+*/
+struct bsgs_job *bsgs_job_frame(uint8_t *frame,uint32_t length)	{
+	char pubkey[67];
+	Point target;
+	bool compressed;
+	struct bsgs_job *job;
+	uint8_t *body = frame + REQUEST_FRAME_HEADER;
+	uint32_t i,count;
+	if(frame[1] != REQUEST_FRAME_VERSION || frame[2] > 100 || frame[3] != 0 || length < 64 + 33 || (length - 64) % 33 != 0)	{
+		printf("Invalid request frame from client, version %i length %u\n",frame[1],length);
+		return NULL;
+	}
+	count = (length - 64) / 33;
+	job = new bsgs_job();
+	for(i = 0; i < count; i++)	{
+		/* The keys are checked the same as the ones of the text lines */
+		tohex_dst((char*)body + 64 + i * 33,33,pubkey);
+		if((pubkey[1] != '2' && pubkey[1] != '3') || !secp->ParsePublicKeyHex(pubkey,target,compressed))	{
+			printf("Invalid publickey format from client %s\n",pubkey);
+			delete job;
+			return NULL;
+		}
+		job->targets.push_back(target);
+		job->compressed.push_back(true);
+	}
+	job->weight = frame[2] ? frame[2] : 1;
+	job->range_from.Set32Bytes(body);
+	job->range_to.Set32Bytes(body + 32);
+	bsgs_job_init(job);
+	return job;
+}
+
+/*
+	State of a new job with its targets, range and weight set
+*/
+void bsgs_job_init(struct bsgs_job *job)	{
+	job->found.assign(job->targets.size(),0);
+	job->sent.assign(job->targets.size(),0);
+	job->keys.resize(job->targets.size());
+	job->tables = tables_current;
+	job->tables->refs++;
+	bsgs_job_plan(job,&job->range_from,&job->range_to);
+	job->blocks_done = 0;
+	job->workers = 0;
+	job->exhausted = 0;
+	job->cancelled = 0;
+	job->done = 0;
+	job->next = NULL;
+}
+
+/*
+	Blocks of the job for the range [from,to): the parts of the range already in the memo
+	for a target are skipped for it, a target with the whole range in the memo is not
+	searched. The rest of the range of all the targets is split in segments, two parts
+	closer than one block are the same segment because the gap costs less than a block.
+*/
+void bsgs_job_plan(struct bsgs_job *job,Int *from,Int *to)	{
+	std::vector<struct memo_interval> left;
+	struct memo_entry parts;
+	struct job_segment segment;
+	Int length,gap,end,blocks;
+	uint32_t k;
+	size_t i;
+
+	job->block.Set(&job->tables->N);
+	job->block.Add(&job->tables->N);
+	job->skipped.resize(job->targets.size());
+	job->remaining = 0;
+	for(k = 0; k < job->targets.size(); k++)	{
+		left.clear();
+		memo_subtract(memo_find(job->targets[k],0),from,to,left);
+		job->skipped[k].SetInt32(0);
+		if(to->IsGreater(from))	{
+			job->skipped[k].Set(to);
+			job->skipped[k].Sub(from);
+		}
+		for(i = 0; i < left.size(); i++)	{
+			length.Set(&left[i].to);
+			length.Sub(&left[i].from);
+			job->skipped[k].Sub(&length);
+			memo_add(&parts,&left[i].from,&left[i].to);
+		}
+		if(left.empty())	{
+			job->found[k] = -1;
+		}
+		else	{
+			job->remaining++;
+		}
+	}
+
+	job->segments.clear();
+	job->blocks = 0;
+	__atomic_store_n(&job->next_block,0,__ATOMIC_RELAXED);
+	for(i = 0; i < parts.intervals.size(); i++)	{
+		if(i > 0)	{
+			gap.Set(&parts.intervals[i].from);
+			gap.Sub(&end);
+			if(gap.IsLower(&job->block))	{
+				end.Set(&parts.intervals[i].to);
+				continue;
+			}
+			bsgs_job_segment(job,&segment.start,&end);
+		}
+		segment.start.Set(&parts.intervals[i].from);
+		end.Set(&parts.intervals[i].to);
+	}
+	if(i > 0)	{
+		bsgs_job_segment(job,&segment.start,&end);
+	}
+}
+
+/*
+	Segment [start,end) at the end of the job, its blocks are rounded up so the last one
+	may end after it. job->blocks is UINT64_MAX if there are more.
+*/
+void bsgs_job_segment(struct bsgs_job *job,Int *start,Int *end)	{
+	struct job_segment segment;
+	Int blocks;
+	blocks.Set(end);
+	blocks.Sub(start);
+	blocks.Add(&job->block);
+	blocks.SubOne();
+	blocks.Div(&job->block);
+	segment.start.Set(start);
+	segment.first = job->blocks;
+	segment.blocks = blocks.GetBitLength() > 63 ? UINT64_MAX : blocks.GetInt64();
+	job->segments.push_back(segment);
+	job->blocks = segment.blocks > UINT64_MAX - job->blocks ? UINT64_MAX : job->blocks + segment.blocks;
+}
+
+/*
+	Entry of the target in the memo, a new empty one is inserted in its place if create
+	is set, else NULL if the target has nothing searched yet.
+*/
+struct memo_entry *memo_find(Point &target,int create)	{
+	uint8_t publickey[33];
+	struct memo_entry entry;
+	size_t low,high,middle;
+	int r;
+	secp->GetPublicKeyRaw(true,target,(char*)publickey);
+	low = 0;
+	high = memo.size();
+	while(low < high)	{
+		middle = (low + high) / 2;
+		r = memcmp(memo[middle].publickey,publickey,33);
+		if(r == 0)	{
+			return &memo[middle];
+		}
+		if(r < 0)	{
+			low = middle + 1;
+		}
+		else	{
+			high = middle;
+		}
+	}
+	if(!create)	{
+		return NULL;
+	}
+	memcpy(entry.publickey,publickey,33);
+	return &*memo.insert(memo.begin() + low,entry);
+}
+
+/*
+	Add [from,to) to the intervals of the entry, the intervals that overlap or touch it
+	are merged in only one.
+*/
+void memo_add(struct memo_entry *entry,Int *from,Int *to)	{
+	struct memo_interval interval;
+	size_t i,j;
+	if(!to->IsGreater(from))	{
+		return;
+	}
+	interval.from.Set(from);
+	interval.to.Set(to);
+	for(i = 0; i < entry->intervals.size() && entry->intervals[i].to.IsLower(from); i++);
+	for(j = i; j < entry->intervals.size() && entry->intervals[j].from.IsLowerOrEqual(to); j++)	{
+		if(entry->intervals[j].from.IsLower(&interval.from))	{
+			interval.from.Set(&entry->intervals[j].from);
+		}
+		if(entry->intervals[j].to.IsGreater(&interval.to))	{
+			interval.to.Set(&entry->intervals[j].to);
+		}
+	}
+	entry->intervals.erase(entry->intervals.begin() + i,entry->intervals.begin() + j);
+	entry->intervals.insert(entry->intervals.begin() + i,interval);
+}
+
+/*
+	Parts of [from,to) that are not in the intervals of the entry, in order. entry can be
+	NULL, then the whole range is left.
+*/
+void memo_subtract(struct memo_entry *entry,Int *from,Int *to,std::vector<struct memo_interval> &left)	{
+	struct memo_interval part;
+	size_t i;
+	part.from.Set(from);
+	for(i = 0; entry != NULL && i < entry->intervals.size() && part.from.IsLower(to); i++)	{
+		if(entry->intervals[i].to.IsLowerOrEqual(&part.from))	{
+			continue;
+		}
+		if(entry->intervals[i].from.IsGreaterOrEqual(to))	{
+			break;
+		}
+		if(entry->intervals[i].from.IsGreater(&part.from))	{
+			part.to.Set(&entry->intervals[i].from);
+			left.push_back(part);
+		}
+		part.from.Set(&entry->intervals[i].to);
+	}
+	if(part.from.IsLower(to))	{
+		part.to.Set(to);
+		left.push_back(part);
+	}
+}
+
+/*
+	The job ended without CANCEL, the range of the request is recorded for the targets
+	that were not found, only if all the blocks of the job were scanned. The blocks are
+	rounded up past the end of the request but only the range asked is recorded, the
+	rest was never requested. They go to the memo and to the -M file.
+*/
+void memo_record(struct bsgs_job *job)	{
+	struct memo_entry *entry;
+	char *hexfrom,*hexto,*aux_c;
+	FILE *fd = NULL;
+	uint32_t k;
+	if(job->remaining == 0 || job->blocks == UINT64_MAX || job->blocks_done < job->blocks || !job->range_to.IsGreater(&job->range_from))	{
+		return;
+	}
+	if(memo_file != NULL)	{
+		fd = fopen(memo_file,"a");
+		if(fd == NULL)	{
+			fprintf(stderr,"[E] Can't open the memo file %s\n",memo_file);
+		}
+	}
+	hexfrom = job->range_from.GetBase16();
+	hexto = job->range_to.GetBase16();
+	for(k = 0; k < job->targets.size(); k++)	{
+		if(job->found[k] != 0)	{
+			continue;
+		}
+		entry = memo_find(job->targets[k],1);
+		memo_add(entry,&job->range_from,&job->range_to);
+		if(fd != NULL)	{
+			aux_c = secp->GetPublicKeyHex(true,job->targets[k]);
+			fprintf(fd,"%s %s %s\n",aux_c,hexfrom,hexto);
+			free(aux_c);
+		}
+	}
+	free(hexfrom);
+	free(hexto);
+	if(fd != NULL)	{
+		fclose(fd);
+	}
+}
 
-		_s.ModMulK1(&dy,&dx[i + 1]);
-		_p.ModSquareK1(&_s);
+/*
+	Intervals of the -M file from previous runs, one line "<publickey> <from> <to>" for
+	each searched interval, the same public key can be in several lines.
+*/
+void memo_load(const char *filename)	{
+	FILE *fd;
+	char line[256],pubkey[67],hexfrom[65],hexto[65];
+	Point target;
+	Int from,to;
+	bool compressed;
+	uint64_t lines = 0;
+	fd = fopen(filename,"r");
+	if(fd == NULL)	{
+		printf("[+] Memo file %s is new\n",filename);
+		return;
+	}
+	printf("[+] Reading the memo file %s",filename);
+	while(fgets(line,sizeof(line),fd) != NULL)	{
+		if(sscanf(line,"%66s %64s %64s",pubkey,hexfrom,hexto) != 3 || strlen(pubkey) != 66 || !isValidHex(pubkey) || !isValidHex(hexfrom) || !isValidHex(hexto) || !secp->ParsePublicKeyHex(pubkey,target,compressed))	{
+			continue;
+		}
+		from.SetBase16(hexfrom);
+		to.SetBase16(hexto);
+		memo_add(memo_find(target,1),&from,&to);
+		lines++;
+	}
+	fclose(fd);
+	printf(", %" PRIu64 " intervals of %" PRIu64 " public keys\n",lines,(uint64_t)memo.size());
+}
 
-		pp.x.ModNeg();
-		pp.x.ModAdd(&_p);
-		pp.x.ModSub(&_2Gn.x);
+uint64_t now_ms()	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-		pp.y.ModSub(&_2Gn.x,&pp.x);
-		pp.y.ModMulK1(&_s);
-		pp.y.ModSub(&_2Gn.y);
-		startP = pp;
+/*
+	Next pending connection of the listening socket, NULL when there are no more
+*/
+struct client_conn *client_accept(int server_fd)	{
+	struct client_conn *conn;
+	struct epoll_event ev;
+	struct sockaddr_in address;
+	socklen_t addrlen = sizeof(address);
+	int client_fd;
+	client_fd = accept4(server_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK);
+	if(client_fd < 0)	{
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)	{
+			perror("accept failed");
+		}
+		return NULL;
 	}
-	delete grp;
-	pthread_mutex_lock(&bPload_mutex[threadid]);
-	tt->finished = 1;
-	pthread_mutex_unlock(&bPload_mutex[threadid]);
-	pthread_exit(NULL);
-	return NULL;
+	conn = (struct client_conn*) calloc(1,sizeof(struct client_conn));
+	checkpointer(conn,__FILE__,"calloc","conn",__LINE__);
+	conn->fd = client_fd;
+	inet_ntop(AF_INET, &(address.sin_addr), conn->ip, INET_ADDRSTRLEN);
+	conn->port = ntohs(address.sin_port);
+	conn->last_recv = now_ms();
+	printf("[+] Accepting incoming conection from %s:%i\n",conn->ip,conn->port);
+	fflush(stdout);
+	conn->events = EPOLLIN;
+	ev.events = conn->events;
+	ev.data.ptr = conn;
+	epoll_ctl(epoll_fd,EPOLL_CTL_ADD,client_fd,&ev);
+	return conn;
 }
 
+/*
+	Reads all the available bytes of the client, the complete lines and frames of every
+	recv are taken before the next one, so the buffer only grows for one request
+*/
+void client_read(struct client_conn *conn)	{
+	int bytes;
+	while(conn->fd >= 0)	{
+		if(conn->in_length == conn->in_size)	{
+			if(conn->in_size >= REQUEST_MAX_LENGTH)	{
+				printf("Request line too long from client %s:%i\n",conn->ip,conn->port);
+				client_close(conn);
+				return;
+			}
+			conn->in_size = conn->in_size ? conn->in_size * 2 : BUFFER_SIZE;
+			if(conn->in_size > REQUEST_MAX_LENGTH)	{
+				conn->in_size = REQUEST_MAX_LENGTH;
+			}
+			conn->in = (char*) realloc(conn->in,conn->in_size + 1);
+			checkpointer(conn->in,__FILE__,"realloc","in",__LINE__);
+		}
+		bytes = recv(conn->fd, conn->in + conn->in_length, conn->in_size - conn->in_length, 0);
+		if(bytes < 0)	{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)	{
+				break;
+			}
+			if(errno == EINTR)	{
+				continue;
+			}
+			client_close(conn);
+			return;
+		}
+		if(bytes == 0)	{
+			conn->eof = 1;
+			break;
+		}
+		conn->in_length += bytes;
+		conn->last_recv = now_ms();
+		client_parse(conn);
+	}
+	if(conn->fd >= 0)	{
+		client_events(conn);
+	}
+}
 
-/* This function takes in two parameters:
+/*
+	Pipelined requests, all the complete lines and frames are added to the queue and
+	the incomplete one is moved to the start of the buffer
+*/
+void client_parse(struct client_conn *conn)	{
+	char *line,*newline;
+	uint32_t length;
+	int left;
+	line = conn->in;
+	while(conn->fd >= 0 && (left = conn->in_length - (line - conn->in)) > 0)	{
+		if(!conn->metrics && (uint8_t)line[0] == REQUEST_FRAME_MAGIC)	{
+			if(left < REQUEST_FRAME_HEADER)	{
+				break;
+			}
+			length = ((uint32_t)(uint8_t)line[4] << 24) | ((uint32_t)(uint8_t)line[5] << 16) | ((uint32_t)(uint8_t)line[6] << 8) | (uint32_t)(uint8_t)line[7];
+			if(length > REQUEST_FRAME_MAX)	{
+				printf("Request frame too long from client %s:%i\n",conn->ip,conn->port);
+				client_close(conn);
+				return;
+			}
+			if((uint32_t)left < REQUEST_FRAME_HEADER + length)	{
+				break;
+			}
+			client_frame(conn,(uint8_t*)line,length);
+			line += REQUEST_FRAME_HEADER + length;
+		}
+		else	{
+			newline = (char*) memchr(line,'\n',left);
+			if(newline == NULL)	{
+				break;
+			}
+			*newline = '\0';
+			client_line(conn,line,newline - line);
+			line = newline + 1;
+		}
+	}
+	if(conn->fd >= 0)	{
+		conn->in_length -= line - conn->in;
+		memmove(conn->in,line,conn->in_length);
+	}
+}
 
-publickey: a reference to a Point object representing a public key.
-dst_address: a pointer to an unsigned char array where the generated binary address will be stored.
-The function is designed to generate a binary address for Ethereum using the given public key.
-It first extracts the x and y coordinates of the public key as 32-byte arrays, and concatenates them
-to form a 64-byte array called bin_publickey. Then, it applies the KECCAK-256 hashing algorithm to
-bin_publickey to generate the binary address, which is stored in dst_address. */
+/*
+	One request line of the client. Without KEEPALIVE only the first request of the
+	connection is attended, same as always.
+*/
+void client_line(struct client_conn *conn,char *line,int length)	{
+	struct client_request *request;
+	if(!conn->keepalive && conn->requests > 0)	{
+		return;
+	}
+	if(length > 0 && line[length - 1] == '\r')	{
+		line[--length] = '\0';
+	}
+	if(conn->metrics)	{
+		/* HTTP request of the metrics port, the reply goes after the empty line of the headers */
+		if(conn->metrics == 1)	{
+			conn->metrics = (strncmp(line,"GET /metrics ",13) == 0 || strncmp(line,"GET / ",6) == 0) ? 2 : 3;
+		}
+		else if(length == 0)	{
+			metrics_reply(conn);
+			conn->requests++;
+			conn->replied++;
+		}
+		return;
+	}
+	if(client_verb(conn,line))	{
+		return;
+	}
+	request = (struct client_request*) calloc(1,sizeof(struct client_request));
+	checkpointer(request,__FILE__,"calloc","request",__LINE__);
+	if(strcmp(line,"KEEPALIVE") == 0)	{
+		conn->keepalive = 1;
+		request->reply = "200 OK";
+	}
+	else if(strncmp(line,"WATCH ",6) == 0)	{
+		conn->watch = strtoull(line + 6,NULL,10) * 1000;
+		conn->watch_next = now_ms() + conn->watch;
+		request->reply = conn->watch > 0 && conn->watch <= 3600000 ? "200 OK" : "400 Bad Request";
+		if(conn->watch > 3600000)	{
+			conn->watch = 0;
+		}
+	}
+	else	{
+		conn->requests++;
+		client_job(conn,request,bsgs_job_parse(line));
+	}
+	client_queue(conn,request);
+}
 
+/*
+	One request frame, the connection stays open after it the same as with KEEPALIVE
+	and its reply is a frame, see client_frame_reply.
+*/
+void client_frame(struct client_conn *conn,uint8_t *frame,uint32_t length)	{
+	struct client_request *request;
+	if(!conn->keepalive && conn->requests > 0)	{
+		return;
+	}
+	conn->keepalive = 1;
+	request = (struct client_request*) calloc(1,sizeof(struct client_request));
+	checkpointer(request,__FILE__,"calloc","request",__LINE__);
+	request->binary = 1;
+	conn->requests++;
+	client_job(conn,request,bsgs_job_frame(frame,length));
+	client_queue(conn,request);
+}
 
-void menu() {
-	printf("\nUsage:\n");
-	printf("-h          show this help\n");
-	printf("-k value    Use this only with bsgs mode, k value is factor for M, more speed but more RAM use wisely\n");
-	printf("-n number   Check for N sequential numbers before the random chosen, this only works with -R option\n");
-	printf("-t tn       Threads number, must be a positive integer\n");
-	printf("-p port     TCP port Number for listening conections");
-	printf("-i ip		IP Address for listening conections");
-	printf("\nExample:\n\n");
-	printf("./bsgs -k 512 \n\n");
-	exit(EXIT_FAILURE);
+/*
+	New job of the request, NULL if the request was bad. The blocks of its range are
+	taken by all the workers at the same time and it ends at the first block after
+	its keys are found, see bsgs_job_take and bsgs_job_found.
+*/
+void client_job(struct client_conn *conn,struct client_request *request,struct bsgs_job *job)	{
+	struct bsgs_job **link;
+	if(job == NULL)	{
+		request->reply = "400 Bad Request";
+		return;
+	}
+	if(job->targets.size() > 1)	{
+		printf("[+] Batch of %u public keys from %s:%i\n",(uint32_t)job->targets.size(),conn->ip,conn->port);
+	}
+	request->job = job;
+	job->id = ++job_counter;
+	job->start_ms = now_ms();
+	printf("[+] Job %" PRIu64 " from %s:%i\n",job->id,conn->ip,conn->port);
+	if(job->remaining == 0)	{
+		/* The range of all the targets is in the memo, it is replied without searching */
+		printf("[+] Job %" PRIu64 " already searched\n",job->id);
+		job->exhausted = 1;
+		job->done = 1;
+	}
+	else	{
+		/* Add the job at the end of the list, the workers start with it now */
+		pthread_mutex_lock(&mutex_jobs);
+		for(link = &jobs; *link != NULL; link = &(*link)->next);
+		*link = job;
+		pthread_cond_broadcast(&cond_jobs);
+		pthread_mutex_unlock(&mutex_jobs);
+	}
 }
 
+/*
+	The replies are sent in the order of the requests
+*/
+void client_queue(struct client_conn *conn,struct client_request *request)	{
+	if(conn->queue_last != NULL)	{
+		conn->queue_last->next = request;
+	}
+	else	{
+		conn->queue = request;
+	}
+	conn->queue_last = request;
+}
 
-void checkpointer(void *ptr,const char *file,const char *function,const  char *name,int line)	{
-	if(ptr == NULL)	{
-		fprintf(stderr,"[E] error in file %s, %s pointer %s on line %i\n",file,function,name,line); 
-		exit(EXIT_FAILURE);
+/*
+	RELOAD [k [n]], the new tables are mapped (or made) by other thread and the new jobs
+	use them once they are ready, the running jobs end with the old ones. The reply is at
+	once (202), the end is sent later by bsgs_reload_update.
+*/
+void client_reload(struct client_conn *conn,char *line)	{
+	struct bsgs_tables *t;
+	pthread_t tid;
+	Int n;
+	char *token,*save;
+	int kfactor = KFACTOR,error = 0;
+	n.Set(&tables_current->N_param);
+	strtok_r(line," ",&save);
+	token = strtok_r(NULL," ",&save);
+	if(token != NULL)	{
+		kfactor = (int) strtol(token,NULL,10);
+		error |= kfactor <= 0;
+		token = strtok_r(NULL," ",&save);
+		if(token != NULL)	{
+			if(token[0] == '0' && token[1] == 'x')	{
+				error |= !isValidHex(token + 2);
+				n.SetBase16(token + 2);
+			}
+			else	{
+				error |= token[strspn(token,"0123456789")] != '\0';
+				n.SetBase10(token);
+			}
+			error |= strtok_r(NULL," ",&save) != NULL;
+		}
+	}
+	/* Replied (for the connections without KEEPALIVE) by the 200 or 500 at the end */
+	conn->requests++;
+	t = new bsgs_tables();
+	if(error || bsgs_params(t,&n,kfactor))	{
+		delete t;
+		conn->replied++;
+		client_write(conn,"RELOAD 400 Bad Request\n",23);
+		return;
 	}
+	pthread_mutex_lock(&mutex_jobs);
+	error = reload_state != RELOAD_IDLE;
+	if(!error)	{
+		reload_state = RELOAD_LOADING;
+		reload_conn = conn;
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	if(error)	{
+		delete t;
+		conn->replied++;
+		client_write(conn,"RELOAD 409 Conflict\n",20);
+		return;
+	}
+	printf("[+] RELOAD -k %i, loading the new tables\n",kfactor);
+	if(pthread_create(&tid,NULL,thread_reload,(void*)t) != 0)	{
+		pthread_mutex_lock(&mutex_jobs);
+		reload_state = RELOAD_IDLE;
+		reload_conn = NULL;
+		pthread_mutex_unlock(&mutex_jobs);
+		delete t;
+		conn->replied++;
+		client_write(conn,"RELOAD 500 Internal Server Error\n",33);
+		return;
+	}
+	pthread_detach(tid);
+	client_write(conn,"RELOAD 202 Accepted\n",20);
 }
 
-void writekey(bool compressed,Int *key)	{
-	Point publickey;
-	FILE *keys;
-	char *hextemp,*hexrmd,public_key_hex[132],address[50],rmdhash[20];
-	memset(address,0,50);
-	memset(public_key_hex,0,132);
-	hextemp = key->GetBase16();
-	publickey = secp->ComputePublicKey(key);
-	secp->GetPublicKeyHex(compressed,publickey,public_key_hex);
-	secp->GetHash160(P2PKH,compressed,publickey,(uint8_t*)rmdhash);
-	hexrmd = tohex(rmdhash,20);
-	rmd160toaddress_dst(rmdhash,address);
+/*
+	PROGRESS [id] and CANCEL id, they are replied at once without waiting for the
+	requests before them, every reply line starts with the verb. Only the running jobs
+	of the queue of this connection are seen, the jobs of other clients are 404.
+	Returns 0 if the line is not one of them.
+*/
+int client_verb(struct client_conn *conn,char *line)	{
+	char buffer[256];
+	struct client_request *request;
+	struct bsgs_job *job;
+	uint64_t id = 0,now;
+	int progress,length,found = 0;
+	if(strncmp(line,"RELOAD",6) == 0 && (line[6] == '\0' || line[6] == ' '))	{
+		client_reload(conn,line);
+		return 1;
+	}
+	progress = strncmp(line,"PROGRESS",8) == 0 && (line[8] == '\0' || line[8] == ' ');
+	if(!progress && strncmp(line,"CANCEL ",7) != 0)	{
+		return 0;
+	}
+	if(!progress || line[8] != '\0')	{
+		id = strtoull(line + (progress ? 9 : 7),NULL,10);
+		if(id == 0)	{
+			client_write(conn,"400 Bad Request\n",16);
+			conn->requests++;
+			conn->replied++;
+			return 1;
+		}
+	}
+	now = now_ms();
+	pthread_mutex_lock(&mutex_jobs);
+	for(request = conn->queue; request != NULL; request = request->next)	{
+		job = request->job;
+		if(job != NULL && !job->done && (id == 0 || job->id == id))	{
+			found = 1;
+			if(progress)	{
+				length = bsgs_job_progress(job,now,buffer,sizeof(buffer));
+			}
+			else	{
+				bsgs_job_cancel(job);
+				printf("[+] Job %" PRIu64 " cancelled\n",job->id);
+				length = snprintf(buffer,sizeof(buffer),"CANCEL %" PRIu64 " 200 OK\n",id);
+			}
+			client_write(conn,buffer,length);
+			if(id != 0)	{
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutex_jobs);
+	if(id == 0)	{
+		client_write(conn,"PROGRESS END\n",13);
+	}
+	else if(!found)	{
+		length = snprintf(buffer,sizeof(buffer),"%s %" PRIu64 " 404 Not Found\n",progress ? "PROGRESS" : "CANCEL",id);
+		client_write(conn,buffer,length);
+	}
+	/* Same as any other request for the connections without KEEPALIVE */
+	conn->requests++;
+	conn->replied++;
+	return 1;
+}
 
-	pthread_mutex_lock(&write_keys);
-	keys = fopen("KEYFOUNDKEYFOUND.txt","a+");
-	if(keys != NULL)	{
-		fprintf(keys,"Private Key: %s\npubkey: %s\nAddress %s\nrmd160 %s\n",hextemp,public_key_hex,address,hexrmd);
-		fclose(keys);
+/*
+	Adds data to the replies of the connection, they are sent by client_send
+*/
+void client_write(struct client_conn *conn,const char *data,int length)	{
+	if(conn->fd < 0)	{
+		return;
 	}
-	printf("\nHit! Private Key: %s\npubkey: %s\nAddress %s\nrmd160 %s\n",hextemp,public_key_hex,address,hexrmd);
-	
-	pthread_mutex_unlock(&write_keys);
-	free(hextemp);
-	free(hexrmd);
+	if(conn->out_length + length > conn->out_size)	{
+		while(conn->out_length + length > conn->out_size)	{
+			conn->out_size = conn->out_size ? conn->out_size * 2 : BUFFER_SIZE;
+		}
+		conn->out = (char*) realloc(conn->out,conn->out_size);
+		checkpointer(conn->out,__FILE__,"realloc","out",__LINE__);
+	}
+	memcpy(conn->out + conn->out_length,data,length);
+	conn->out_length += length;
 }
 
+/*
+	Sends what the socket accepts now, the rest waits for EPOLLOUT
+*/
+void client_send(struct client_conn *conn)	{
+	int bytes;
+	while(conn->out_length > 0)	{
+		bytes = send(conn->fd, conn->out, conn->out_length, MSG_NOSIGNAL);
+		if(bytes < 0)	{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)	{
+				break;
+			}
+			if(errno == EINTR)	{
+				continue;
+			}
+			printf("Failed to send message to client\n");
+			client_close(conn);
+			return;
+		}
+		conn->out_length -= bytes;
+		memmove(conn->out,conn->out + bytes,conn->out_length);
+	}
+	client_events(conn);
+}
 
-void init_generator()	{
-	Point G = secp->ComputePublicKey(&stride);
-	Point g;
-	g.Set(G);
-	Gn.reserve(CPU_GRP_SIZE / 2);
-	Gn[0] = g;
-	g = secp->DoubleDirect(g);
-	Gn[1] = g;
-	for(int i = 2; i < CPU_GRP_SIZE / 2; i++) {
-		g = secp->AddDirect(g,G);
-		Gn[i] = g;
+/*
+	EPOLLIN until the client closes its side, EPOLLOUT only while there are replies to send
+*/
+void client_events(struct client_conn *conn)	{
+	struct epoll_event ev;
+	uint32_t events;
+	events = (conn->eof ? 0 : (uint32_t)EPOLLIN) | (conn->out_length > 0 ? (uint32_t)EPOLLOUT : 0);
+	if(events != conn->events)	{
+		ev.events = events;
+		ev.data.ptr = conn;
+		epoll_ctl(epoll_fd,EPOLL_CTL_MOD,conn->fd,&ev);
+		conn->events = events;
 	}
-	_2Gn = secp->DoubleDirect(Gn[CPU_GRP_SIZE / 2 - 1]);
 }
 
-void* client_handler(void* arg) {
-    int client_fd = *(int*)arg;
-    char buffer[1024];
+/*
+	" skipped <keys>" for the 404 of the target k if part of its range was in the memo,
+	else an empty string.
+*/
+const char *client_skipped(struct bsgs_job *job,uint32_t k,char *dst,size_t length)	{
 	char *hextemp;
-	int bytes_received;
-	Tokenizer t;
-	t.tokens = NULL;
-	
-	// Peek at the incoming data to determine its length
-	bytes_received = recv(client_fd, buffer, sizeof(buffer) - 1, MSG_PEEK);
-	if (bytes_received <= 0) {
-		close(client_fd);
-		pthread_exit(NULL);
+	dst[0] = '\0';
+	if(!job->cancelled && !job->skipped[k].IsZero())	{
+		hextemp = job->skipped[k].GetBase16();
+		snprintf(dst,length," skipped %s",hextemp);
+		free(hextemp);
 	}
-	
-    
-	char* newline = (char*) memchr(buffer, '\n', bytes_received);
-	size_t line_length = newline ? (newline - buffer) + 1 : bytes_received;
-	bytes_received = recv(client_fd, buffer, line_length, 0);
-	if (bytes_received <= 0)	{
-		close(client_fd);
-		pthread_exit(NULL);
-	}
-
-	// Process the received bytes here
-	buffer[bytes_received] = '\0';
-	stringtokenizer(buffer, &t);
-	if (t.n != 3) {
-		printf("Invalid input format from client, tokens %i : %s\n",t.n, buffer);
-		freetokenizer(&t);
-		sendstr(client_fd,"400 Bad Request");
-		close(client_fd);
-		pthread_exit(NULL);
+	return dst;
+}
+
+/*
+	Reply frame of a binary request, 400 without job. The status is 200 if some key was
+	found, else 410 if the job was cancelled or 404. Called with mutex_jobs.
+*/
+void client_frame_reply(struct client_conn *conn,struct bsgs_job *job)	{
+	uint8_t *frame,*record;
+	uint32_t k,length,status = 400;
+	length = job != NULL ? job->targets.size() * REPLY_FRAME_RECORD : 0;
+	frame = (uint8_t*) calloc(1,REQUEST_FRAME_HEADER + length);
+	checkpointer(frame,__FILE__,"calloc","frame",__LINE__);
+	if(job != NULL)	{
+		status = job->cancelled ? 410 : 404;
+		for(k = 0; k < job->targets.size(); k++)	{
+			record = frame + REQUEST_FRAME_HEADER + k * REPLY_FRAME_RECORD;
+			if(job->found[k] == 1)	{
+				record[0] = REPLY_FRAME_FOUND;
+				job->keys[k].Get32Bytes(record + 1);
+				status = 200;
+			}
+			else	{
+				record[0] = job->cancelled ? REPLY_FRAME_CANCELLED : REPLY_FRAME_NOT_FOUND;
+				if(!job->cancelled)	{
+					job->skipped[k].Get32Bytes(record + 1);
+				}
+			}
+		}
 	}
+	frame[0] = REQUEST_FRAME_MAGIC;
+	frame[1] = REQUEST_FRAME_VERSION;
+	frame[2] = status >> 8;
+	frame[3] = status & 0xff;
+	frame[4] = length >> 24;
+	frame[5] = length >> 16;
+	frame[6] = length >> 8;
+	frame[7] = length;
+	client_write(conn,(char*)frame,REQUEST_FRAME_HEADER + length);
+	free(frame);
+}
 
-	if(!secp->ParsePublicKeyHex(t.tokens[0],OriginalPointsBSGS,OriginalPointsBSGScompressed))	{
-		printf("Invalid publickey format from client %s\n",t.tokens[0]);
-		freetokenizer(&t);
-		sendstr(client_fd,"400 Bad Request");
-		close(client_fd);
-		pthread_exit(NULL);		
+/*
+	Closes the socket, the jobs of the connection that are still running are aborted and
+	the connection is freed by client_update once the workers are out of them
+*/
+void client_close(struct client_conn *conn)	{
+	struct client_request *request;
+	if(conn->fd < 0)	{
+		return;
 	}
-	if(!(isValidHex(t.tokens[1]) && isValidHex(t.tokens[2])))	{
-		printf("Invalid hexadecimal format from client %s:%s\n",t.tokens[1],t.tokens[2]);
-		freetokenizer(&t);
-		sendstr(client_fd,"400 Bad Request");
-		close(client_fd);
-		pthread_exit(NULL);	
+	printf("[+] Closing conection from %s:%i\n",conn->ip,conn->port);
+	fflush(stdout);
+	epoll_ctl(epoll_fd,EPOLL_CTL_DEL,conn->fd,NULL);
+	close(conn->fd);
+	conn->fd = -1;
+	free(conn->in);
+	free(conn->out);
+	conn->in = NULL;
+	conn->out = NULL;
+	conn->in_length = 0;
+	conn->out_length = 0;
+	pthread_mutex_lock(&mutex_jobs);
+	for(request = conn->queue; request != NULL; request = request->next)	{
+		if(request->job != NULL && !request->job->done)	{
+			bsgs_job_cancel(request->job);
+		}
 	}
-	
-	n_range_start.SetBase16(t.tokens[1]);
-	n_range_end.SetBase16(t.tokens[2]);
-	
-	freetokenizer(&t);
-	
-	BSGS_CURRENT.Set(&n_range_start);
-	
-	bool *threads_created;
-	pthread_t *threads;
-	int *thread_args;
-	
-	threads_created = (bool*) calloc(NTHREADS,sizeof(bool));
-	threads = (pthread_t*) calloc(NTHREADS,sizeof(pthread_t));
-	thread_args = (int*) calloc(NTHREADS,sizeof(int));
-	checkpointer(threads_created,__FILE__,"calloc","threads_created",__LINE__);
-	checkpointer(threads,__FILE__,"calloc","threads",__LINE__);
-	checkpointer(thread_args,__FILE__,"calloc","thread_args",__LINE__);
+	pthread_mutex_unlock(&mutex_jobs);
+}
 
-	
-	
-	int i, rc;
+/*
+	Replies of the queue in order: with more than one public key each key found is sent
+	as soon as it is found, one line "<publickey> <privatekey>" per key, the rest are
+	sent as "<publickey> 404 Not Found" when the job is done. A single public key gets
+	only the key or 404, with '\n' only with KEEPALIVE. If part of the range was in the
+	memo the 404 ends in " skipped <keys>", the keys skipped in hexadecimal. Returns 1 if the connection is
+	closed and has nothing left, then it can be freed.
+*/
+int client_update(struct client_conn *conn,uint64_t now)	{
+	char buffer[1024],skipped[96],*hextemp,*aux_c;
+	struct client_request *request;
+	struct bsgs_job *job;
+	uint32_t k,finished = 0;
+	int length;
+
+	/* Request of an old client without '\n', it ends when nothing more arrives */
+	if(conn->fd >= 0 && !conn->metrics && conn->in_length > 0 && (uint8_t)conn->in[0] != REQUEST_FRAME_MAGIC && (conn->keepalive || conn->requests == 0) && (conn->eof || (!conn->keepalive && now - conn->last_recv >= REQUEST_WAIT_MS)))	{
+		conn->in[conn->in_length] = '\0';
+		client_line(conn,conn->in,conn->in_length);
+		conn->in_length = 0;
+	}
 
-	// Create threads
-	for (i = 0; i < NTHREADS; i++) {
-		thread_args[i] = i;
-		threads_created[i] = true;
-		rc = pthread_create(&threads[i], NULL, thread_process_bsgs, &thread_args[i]);
-		if (rc != 0) {
-			printf("Failed to create thread %d\n", i);
-			threads_created[i] = false;
+	pthread_mutex_lock(&mutex_jobs);
+	if(conn->watch && now >= conn->watch_next)	{
+		for(request = conn->queue; request != NULL; request = request->next)	{
+			if(request->job != NULL && !request->job->done)	{
+				length = bsgs_job_progress(request->job,now,buffer,sizeof(buffer));
+				client_write(conn,buffer,length);
+			}
 		}
-
+		conn->watch_next = now + conn->watch;
 	}
-
-	// Wait for threads to finish
-	for (i = 0; i < NTHREADS; i++) {
-		if(threads_created[i]){
-			rc = pthread_join(threads[i], NULL);
-			if (rc != 0) {
-				printf("Failed to join thread %d\n", i);
+	while((request = conn->queue) != NULL)	{
+		job = request->job;
+		if(request->binary && (job == NULL || job->done))	{
+			client_frame_reply(conn,job);
+		}
+		if(job != NULL)	{
+			if(job->targets.size() > 1 && !request->binary)	{
+				for(k = 0; k < job->targets.size(); k++)	{
+					if(job->found[k] == 1 && !job->sent[k])	{
+						aux_c = secp->GetPublicKeyHex(job->compressed[k],job->targets[k]);
+						hextemp = job->keys[k].GetBase16();
+						length = snprintf(buffer, sizeof(buffer), "%s %s\n",aux_c,hextemp);
+						client_write(conn,buffer,length);
+						free(hextemp);
+						free(aux_c);
+						job->sent[k] = 1;
+					}
+				}
+			}
+			if(!job->done)	{
+				break;
+			}
+			if(!job->cancelled)	{
+				memo_record(job);
+			}
+			if(request->binary)	{
+				/* Already replied by client_frame_reply */
+			}
+			else if(job->targets.size() == 1)	{
+				if(job->found[0] == 1)	{
+					hextemp = job->keys[0].GetBase16();
+					length = snprintf(buffer, sizeof(buffer), "%s%s",hextemp,conn->keepalive ? "\n" : "");
+					free(hextemp);
+				}
+				else	{
+					length = snprintf(buffer, sizeof(buffer), "%s%s%s",job->cancelled ? "410 Cancelled" : "404 Not Found",client_skipped(job,0,skipped,sizeof(skipped)),conn->keepalive ? "\n" : "");
+				}
+				client_write(conn,buffer,length);
+			}
+			else	{
+				for(k = 0; k < job->targets.size(); k++)	{
+					if(!job->sent[k])	{
+						aux_c = secp->GetPublicKeyHex(job->compressed[k],job->targets[k]);
+						length = snprintf(buffer, sizeof(buffer), "%s %s%s\n",aux_c,job->cancelled ? "410 Cancelled" : "404 Not Found",client_skipped(job,k,skipped,sizeof(skipped)));
+						client_write(conn,buffer,length);
+						free(aux_c);
+					}
+				}
 			}
+			for(k = 0; k < METRICS_BUCKETS && (double)(now - job->start_ms) / 1000.0 > metrics_bounds[k]; k++);
+			metrics_latency[k]++;
+			metrics_latency_count++;
+			metrics_latency_sum += (double)(now - job->start_ms) / 1000.0;
+			bsgs_tables_release(job->tables);
+			delete job;
+			finished++;
+		}
+		else if(!request->binary)	{
+			length = snprintf(buffer, sizeof(buffer), "%s%s",request->reply,conn->keepalive ? "\n" : "");
+			client_write(conn,buffer,length);
 		}
+		conn->queue = request->next;
+		if(conn->queue == NULL)	{
+			conn->queue_last = NULL;
+		}
+		free(request);
+		conn->replied++;
 	}
-	
-	free(threads_created);
-	free(threads);
-	free(thread_args);
-	int message_len;
-	if(bsgs_found)	{
-		hextemp = BSGSkeyfound.GetBase16();
-		message_len = snprintf(buffer, sizeof(buffer), "%s",hextemp);
-		free(hextemp);
+	pthread_mutex_unlock(&mutex_jobs);
+
+	if(finished)	{
+		printf("[+] Bloom false positive rate observed/expected:%s\n",telemetry_line(buffer,sizeof(buffer)));
+		if(telemetry_file != NULL)	{
+			telemetry_dump(telemetry_file);
+		}
 	}
-	else	{
-		message_len = snprintf(buffer, sizeof(buffer), "404 Not Found");
+	if(conn->fd < 0)	{
+		return conn->queue == NULL;
 	}
-	bsgs_found = 0;
-	int bytes_sent = send(client_fd, buffer, message_len, 0);
-	if (bytes_sent == -1) {
-		printf("Failed to send message to client\n");
+	client_send(conn);
+	if(conn->fd >= 0 && conn->out_length == 0 && conn->queue == NULL)	{
+		/* Old clients are closed after the reply, the others when they close */
+		if((!conn->keepalive && conn->replied > 0) || (conn->eof && conn->in_length == 0))	{
+			client_close(conn);
+		}
 	}
-
-	
-    close(client_fd);
-    pthread_exit(NULL);
+	return conn->fd < 0 && conn->queue == NULL;
 }
-
-int sendstr(int client_fd,const char *str)	{
-	int len = strlen(str);
-	int bytes = send(client_fd, str, len, 0);
-	if (bytes == -1) {
-		printf("Failed to send message to client\n");
-	}
-	return bytes;
-}
\ No newline at end of file
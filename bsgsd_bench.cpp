@@ -0,0 +1,578 @@
+/*
+Benchmark client for bsgsd, replays a file of jobs against a running server
+email: albertobsd@gmail.com
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <inttypes.h>
+#include "util.h"
+
+#include "secp256k1/SECP256k1.h"
+#include "secp256k1/Point.h"
+#include "secp256k1/Int.h"
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+
+#define PORT 8080
+#define BUFFER_SIZE 1024
+
+/*
+	Kind of reply of each request
+*/
+#define REPLY_KEY 0
+#define REPLY_NOT_FOUND 1
+#define REPLY_CANCELLED 2
+#define REPLY_ERROR 3	//400, unknown reply or connection error
+#define REPLY_KINDS 4
+
+#define BENCH_MAX_REQUESTS 10000000	//Results are kept in memory for the percentiles
+
+/*
+	Binary request of bsgsd (-B): 8 bytes of header, the range and the compressed public
+	key. The reply has the same header with the status and one record of 33 bytes.
+*/
+#define FRAME_MAGIC 0xB5
+#define FRAME_VERSION 1
+#define FRAME_HEADER 8
+#define FRAME_LENGTH (FRAME_HEADER + 64 + 33)
+#define FRAME_REPLY_LENGTH (FRAME_HEADER + 33)
+#define FRAME_FOUND 1
+#define FRAME_CANCELLED 2
+
+/*
+	One line of the jobs file: <publickey> [<from>:<to> [<privatekey>]], the lines
+	without range use the one of -r. privkey is NULL if the key is not known.
+*/
+struct bench_job	{
+	char *publickey;
+	char *range;
+	char *privkey;
+	long double keys;	//Length of the range
+	uint8_t frame[FRAME_LENGTH];	//Request frame of -B
+};
+
+struct bench_result	{
+	uint64_t latency_us;	//From the planned start of the request (-q) or its send to the reply
+	uint32_t job;
+	int kind;
+	int sent;		//0 for the requests not sent because of -d
+	char key[65];
+};
+
+void menu();
+void *thread_bench(void *vargp);
+int bench_connect();
+int bench_send(int fd,const char *data,int length);
+int bench_reply(int fd,char *buffer,int size,int line);
+int bench_kind(char *reply,char *key);
+void bench_frame(struct bench_job *job);
+int bench_frame_reply(int fd,char *key);
+int bench_load(const char *filename,const char *range);
+uint64_t now_us();
+double percentile(std::vector<uint64_t> &sorted,double p);
+void checkpointer(void *ptr,const char *file,const char *function,const  char *name,int line);
+
+const char *IP = "127.0.0.1";
+int port = PORT;
+int FLAGKEEPALIVE = 0;
+int FLAGBINARY = 0;
+uint32_t concurrency = 1;
+double rate = 0;		//Requests per second for all the connections, 0 without limit
+uint64_t total_requests = 0;
+double duration = 0;	//Seconds, 0 without limit
+uint64_t start_us;
+
+std::vector<struct bench_job> jobs;
+struct bench_result *results;
+uint64_t next_request = 0;	//Taken with an atomic add by the threads
+
+Secp256K1 *secp;
+
+int main(int argc, char **argv)	{
+	char *fileName = NULL,*range = NULL,*json = NULL,*label = NULL;
+	std::vector<uint64_t> latencies;
+	uint64_t count[REPLY_KINDS],i,end_us,done,verified = 0,wrong = 0,missed = 0;
+	double latency_sum = 0;
+	uint32_t t;
+	pthread_t *tid;
+	long double keys = 0;
+	double seconds;
+	Int privkey;
+	Point publickey;
+	char *hextemp;
+	FILE *fd;
+	int c;
+
+	printf("[+] bsgsd benchmark client\n");
+	while ((c = getopt(argc, argv, "hBKc:d:f:i:j:l:n:p:q:r:")) != -1) {
+		switch(c)	{
+			case 'h':
+				menu();
+			break;
+			case 'B':
+				FLAGBINARY = 1;
+			break;
+			case 'K':
+				FLAGKEEPALIVE = 1;
+			break;
+			case 'c':
+				concurrency = (uint32_t) strtoul(optarg,NULL,10);
+				if(concurrency == 0)	{
+					fprintf(stderr,"[E] Invalid -c value %s\n",optarg);
+					exit(0);
+				}
+			break;
+			case 'd':
+				duration = strtod(optarg,NULL);
+			break;
+			case 'f':
+				fileName = optarg;
+			break;
+			case 'i':
+				IP = optarg;
+			break;
+			case 'j':
+				json = optarg;
+			break;
+			case 'l':
+				label = optarg;
+			break;
+			case 'n':
+				total_requests = strtoull(optarg,NULL,10);
+			break;
+			case 'p':
+				port = (int) strtol(optarg,NULL,10);
+				if(port <= 0  || port > 65535 )	{
+					fprintf(stderr,"[E] Invalid -p port %s\n",optarg);
+					exit(0);
+				}
+			break;
+			case 'q':
+				rate = strtod(optarg,NULL);
+			break;
+			case 'r':
+				range = optarg;
+			break;
+			default:
+				fprintf(stderr,"[E] Unknow opcion -%c\n",c);
+				exit(0);
+			break;
+		}
+	}
+	if(fileName == NULL)	{
+		fprintf(stderr,"[E] The jobs file -f is needed\n");
+		exit(0);
+	}
+	secp = new Secp256K1();
+	secp->Init();
+	if(bench_load(fileName,range) == 0)	{
+		fprintf(stderr,"[E] There are no valid jobs in the file %s\n",fileName);
+		exit(0);
+	}
+	if(FLAGBINARY)	{
+		for(i = 0; i < jobs.size(); i++)	{
+			bench_frame(&jobs[i]);
+		}
+	}
+	if(total_requests == 0)	{
+		total_requests = duration > 0 ? UINT64_MAX : jobs.size();
+	}
+	if(total_requests == UINT64_MAX)	{
+		/* Only -d, the requests that fit in the time at the rate (or a big enough limit) */
+		total_requests = rate > 0 ? (uint64_t)(duration * rate) + 1 : BENCH_MAX_REQUESTS;
+	}
+	if(total_requests > BENCH_MAX_REQUESTS)	{
+		total_requests = BENCH_MAX_REQUESTS;
+	}
+
+	results = (struct bench_result*) calloc(total_requests,sizeof(struct bench_result));
+	checkpointer((void *)results,__FILE__,"calloc","results" ,__LINE__ -1 );
+	printf("[+] %u jobs from %s, %" PRIu64 "%s requests to %s:%i\n",(uint32_t)jobs.size(),fileName,total_requests,duration > 0 ? " max" : "",IP,port);
+	printf("[+] Concurrency %u%s\n",concurrency,FLAGKEEPALIVE ? " with KEEPALIVE" : "");
+	if(rate > 0)	{
+		printf("[+] Rate %.2f requests/s, the latency counts from the planned start of each request\n",rate);
+	}
+
+	tid = (pthread_t *) calloc(concurrency,sizeof(pthread_t));
+	checkpointer((void *)tid,__FILE__,"calloc","tid" ,__LINE__ -1 );
+	start_us = now_us();
+	for(t = 0; t < concurrency; t++)	{
+		if(pthread_create(&tid[t],NULL,thread_bench,NULL) != 0)	{
+			fprintf(stderr,"[E] thread_bench\n");
+			exit(0);
+		}
+	}
+	for(t = 0; t < concurrency; t++)	{
+		pthread_join(tid[t],NULL);
+	}
+	end_us = now_us();
+	seconds = (double)(end_us - start_us) / 1000000.0;
+
+	/*
+		Every key of a reply is checked against the public key of its job, and the
+		known private keys of the file against the replies
+	*/
+	memset(count,0,sizeof(count));
+	done = 0;
+	for(i = 0; i < total_requests; i++)	{
+		if(!results[i].sent)	{
+			continue;
+		}
+		done++;
+		count[results[i].kind]++;
+		latencies.push_back(results[i].latency_us);
+		latency_sum += (double)results[i].latency_us;
+		if(results[i].kind != REPLY_ERROR)	{
+			keys += jobs[results[i].job].keys;
+		}
+		if(results[i].kind == REPLY_KEY)	{
+			privkey.SetBase16(results[i].key);
+			publickey = secp->ComputePublicKey(&privkey);
+			hextemp = secp->GetPublicKeyHex(strlen(jobs[results[i].job].publickey) == 66,publickey);
+			if(strcasecmp(hextemp,jobs[results[i].job].publickey) == 0)	{
+				verified++;
+			}
+			else	{
+				fprintf(stderr,"[E] Wrong key %s for %s\n",results[i].key,jobs[results[i].job].publickey);
+				wrong++;
+			}
+			free(hextemp);
+		}
+		else if(results[i].kind == REPLY_NOT_FOUND && jobs[results[i].job].privkey != NULL)	{
+			fprintf(stderr,"[E] Key of %s not found in %s\n",jobs[results[i].job].publickey,jobs[results[i].job].range);
+			missed++;
+		}
+	}
+	std::sort(latencies.begin(),latencies.end());
+
+	printf("[+] %" PRIu64 " requests in %.2f seconds, %.2f requests/s, %.3Lg keys/s of the ranges\n",done,seconds,(double)done / seconds,keys / (long double)seconds);
+	printf("[+] Latency ms: min %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n",percentile(latencies,0) / 1000.0,percentile(latencies,0.50) / 1000.0,percentile(latencies,0.95) / 1000.0,percentile(latencies,0.99) / 1000.0,percentile(latencies,1) / 1000.0);
+	printf("[+] Replies: %" PRIu64 " keys, %" PRIu64 " not found, %" PRIu64 " cancelled, %" PRIu64 " errors\n",count[REPLY_KEY],count[REPLY_NOT_FOUND],count[REPLY_CANCELLED],count[REPLY_ERROR]);
+	printf("[+] Keys verified %" PRIu64 ", wrong %" PRIu64 ", known keys not found %" PRIu64 "\n",verified,wrong,missed);
+
+	if(json != NULL)	{
+		fd = strcmp(json,"-") == 0 ? stdout : fopen(json,"w");
+		if(fd == NULL)	{
+			fprintf(stderr,"[E] Can't create the file %s\n",json);
+			exit(0);
+		}
+		fprintf(fd,"{\"label\":\"%s\",\"server\":\"%s:%i\",\"jobs\":\"%s\",\"concurrency\":%u,\"keepalive\":%s,\"binary\":%s,\"rate\":%.3f,",label != NULL ? label : "",IP,port,fileName,concurrency,FLAGKEEPALIVE ? "true" : "false",FLAGBINARY ? "true" : "false",rate);
+		fprintf(fd,"\"requests\":%" PRIu64 ",\"seconds\":%.6f,\"requests_per_second\":%.6f,\"keys_per_second\":%.6Le,",done,seconds,(double)done / seconds,keys / (long double)seconds);
+		fprintf(fd,"\"latency_ms\":{\"min\":%.3f,\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f},",percentile(latencies,0) / 1000.0,done ? latency_sum / done / 1000.0 : 0,percentile(latencies,0.50) / 1000.0,percentile(latencies,0.95) / 1000.0,percentile(latencies,0.99) / 1000.0,percentile(latencies,1) / 1000.0);
+		fprintf(fd,"\"replies\":{\"keys\":%" PRIu64 ",\"not_found\":%" PRIu64 ",\"cancelled\":%" PRIu64 ",\"errors\":%" PRIu64 "},",count[REPLY_KEY],count[REPLY_NOT_FOUND],count[REPLY_CANCELLED],count[REPLY_ERROR]);
+		fprintf(fd,"\"verified\":%" PRIu64 ",\"wrong\":%" PRIu64 ",\"missed\":%" PRIu64 "}\n",verified,wrong,missed);
+		if(fd != stdout)	{
+			fclose(fd);
+		}
+	}
+	return wrong > 0 || missed > 0 || count[REPLY_ERROR] > 0;
+}
+
+void menu() {
+	printf("\nUsage:\n");
+	printf("-h          show this help\n");
+	printf("-f file     Jobs to replay, one per line: <publickey> [<from>:<to> [<privatekey>]]\n");
+	printf("-r from:to  Range in hexadecimal for the lines of the file without range\n");
+	printf("-i ip       IP of the server, default 127.0.0.1\n");
+	printf("-p port     Port of the server, default 8080\n");
+	printf("-c number   Concurrent connections, default 1\n");
+	printf("-K          Send KEEPALIVE and use the same connection for all the requests of each one\n");
+	printf("-B          Send binary request frames, the connections are persistent like with -K\n");
+	printf("-q rate     Requests per second for all the connections, default without limit\n");
+	printf("-n number   Requests to send, the jobs of the file are repeated, default one pass of the file\n");
+	printf("-d seconds  Stop sending new requests after these seconds\n");
+	printf("-j file     Write the results as JSON to this file, - for stdout\n");
+	printf("-l label    Label for the JSON, like the name of the server build\n");
+	printf("\nExample:\n\n");
+	printf("./bsgsd_bench -f tests/125.txt -r 4000000000000000:4000100000000000 -c 4 -n 100 -j bench.json\n\n");
+	exit(0);
+}
+
+void checkpointer(void *ptr,const char *file,const char *function,const  char *name,int line)	{
+	if(ptr == NULL)	{
+		fprintf(stderr,"[E] error in file %s, %s pointer %s on line %i\n",file,function,name,line); 
+		exit(EXIT_FAILURE);
+	}
+}
+
+uint64_t now_us()	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+	Nearest rank of the sorted latencies, p from 0 (min) to 1 (max)
+*/
+double percentile(std::vector<uint64_t> &sorted,double p)	{
+	size_t rank;
+	if(sorted.size() == 0)	{
+		return 0;
+	}
+	rank = (size_t)ceil(p * sorted.size());
+	return (double)sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+	Jobs of the file, the comments after # and the empty lines are skipped. Returns the
+	number of jobs.
+*/
+int bench_load(const char *filename,const char *range)	{
+	struct bench_job job;
+	Tokenizer t;
+	char line[1024],number[160],*hash,*to;
+	FILE *fd;
+	fd = fopen(filename,"r");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Can't open file %s\n",filename);
+		exit(0);
+	}
+	while(fgets(line,sizeof(line),fd) != NULL)	{
+		hash = strchr(line,'#');
+		if(hash != NULL)	{
+			*hash = '\0';
+		}
+		trim(line," \t\n\r");
+		if(line[0] == '\0')	{
+			continue;
+		}
+		stringtokenizer(line,&t);	/* The ':' of the range also splits the tokens */
+		job.publickey = nextToken(&t);
+		job.range = NULL;
+		job.privkey = NULL;
+		if(t.n == 1 && range != NULL && strchr(range,':') != NULL)	{
+			job.range = strdup(range);
+		}
+		else if(t.n == 3 || t.n == 4)	{
+			snprintf(number,sizeof(number),"%s:%s",t.tokens[1],t.tokens[2]);
+			job.range = strdup(number);
+			job.privkey = t.n == 4 ? strdup(t.tokens[3]) : NULL;
+		}
+		if(job.range == NULL || !isValidHex(job.publickey) || (strlen(job.publickey) != 66 && strlen(job.publickey) != 130))	{
+			fprintf(stderr,"[W] Skipping line without a public key and a range: %s\n",line);
+			free(job.range);
+			free(job.privkey);
+			freetokenizer(&t);
+			continue;
+		}
+		job.publickey = strdup(job.publickey);
+		to = strchr(job.range,':');
+		/* Only for the keys/s, the precision of a long double is enough */
+		snprintf(number,sizeof(number),"0x%s",to + 1);
+		job.keys = strtold(number,NULL);
+		snprintf(number,sizeof(number),"0x%.*s",(int)(to - job.range),job.range);
+		job.keys -= strtold(number,NULL);
+		jobs.push_back(job);
+		freetokenizer(&t);
+	}
+	fclose(fd);
+	return jobs.size();
+}
+
+int bench_connect()	{
+	struct sockaddr_in address;
+	int fd;
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0)	{
+		return -1;
+	}
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = inet_addr(IP);
+	address.sin_port = htons(port);
+	if(connect(fd,(struct sockaddr*)&address,sizeof(address)) != 0)	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int bench_send(int fd,const char *data,int length)	{
+	int bytes;
+	while(length > 0)	{
+		bytes = send(fd,data,length,MSG_NOSIGNAL);
+		if(bytes < 0 && errno == EINTR)	{
+			continue;
+		}
+		if(bytes <= 0)	{
+			return 0;
+		}
+		data += bytes;
+		length -= bytes;
+	}
+	return 1;
+}
+
+/*
+	One line of a KEEPALIVE connection, or everything until the server closes the
+	connection without it. Returns 0 if the connection fails before the reply.
+*/
+int bench_reply(int fd,char *buffer,int size,int line)	{
+	int length = 0,bytes;
+	while(length < size - 1)	{
+		bytes = recv(fd,buffer + length,line ? 1 : size - 1 - length,0);
+		if(bytes < 0 && errno == EINTR)	{
+			continue;
+		}
+		if(bytes <= 0)	{
+			break;
+		}
+		length += bytes;
+		if(line && buffer[length - 1] == '\n')	{
+			break;
+		}
+	}
+	buffer[length] = '\0';
+	if(line && (length == 0 || buffer[length - 1] != '\n'))	{
+		return 0;
+	}
+	return length > 0;
+}
+
+int bench_kind(char *reply,char *key)	{
+	trim(reply," \t\n\r");
+	if(strncmp(reply,"404",3) == 0)	{
+		return REPLY_NOT_FOUND;
+	}
+	if(strncmp(reply,"410",3) == 0)	{
+		return REPLY_CANCELLED;
+	}
+	if(reply[0] != '\0' && strlen(reply) <= 64 && isValidHex(reply))	{
+		strcpy(key,reply);
+		return REPLY_KEY;
+	}
+	return REPLY_ERROR;
+}
+
+/*
+	Request frame of the job, the public key is sent always compressed
+*/
+void bench_frame(struct bench_job *job)	{
+	char *to;
+	Point publickey;
+	bool compressed;
+	Int value;
+	if(!secp->ParsePublicKeyHex(job->publickey,publickey,compressed))	{
+		fprintf(stderr,"[E] Invalid public key %s\n",job->publickey);
+		exit(0);
+	}
+	memset(job->frame,0,FRAME_LENGTH);
+	job->frame[0] = FRAME_MAGIC;
+	job->frame[1] = FRAME_VERSION;
+	job->frame[7] = FRAME_LENGTH - FRAME_HEADER;
+	to = strchr(job->range,':');
+	*to = '\0';
+	value.SetBase16(job->range);
+	value.Get32Bytes(job->frame + FRAME_HEADER);
+	value.SetBase16(to + 1);
+	value.Get32Bytes(job->frame + FRAME_HEADER + 32);
+	*to = ':';
+	secp->GetPublicKeyRaw(true,publickey,(char*)job->frame + FRAME_HEADER + 64);
+}
+
+/*
+	Reply frame of one request, the key is in hexadecimal like the text replies
+*/
+int bench_frame_reply(int fd,char *key)	{
+	uint8_t frame[FRAME_REPLY_LENGTH];
+	uint32_t length = 0,size = FRAME_HEADER;
+	int bytes,status;
+	Int value;
+	char *hextemp;
+	while(length < size)	{
+		bytes = recv(fd,frame + length,size - length,0);
+		if(bytes < 0 && errno == EINTR)	{
+			continue;
+		}
+		if(bytes <= 0)	{
+			return REPLY_ERROR;
+		}
+		length += bytes;
+		if(length == FRAME_HEADER)	{
+			size += ((uint32_t)frame[4] << 24) | ((uint32_t)frame[5] << 16) | ((uint32_t)frame[6] << 8) | (uint32_t)frame[7];
+			if(frame[0] != FRAME_MAGIC || size > FRAME_REPLY_LENGTH)	{
+				return REPLY_ERROR;
+			}
+		}
+	}
+	status = (frame[2] << 8) | frame[3];
+	if(size != FRAME_REPLY_LENGTH || (status != 200 && status != 404 && status != 410))	{
+		return REPLY_ERROR;
+	}
+	if(frame[FRAME_HEADER] == FRAME_FOUND)	{
+		value.Set32Bytes(frame + FRAME_HEADER + 1);
+		hextemp = value.GetBase16();
+		snprintf(key,65,"%s",hextemp);
+		free(hextemp);
+		return REPLY_KEY;
+	}
+	return frame[FRAME_HEADER] == FRAME_CANCELLED ? REPLY_CANCELLED : REPLY_NOT_FOUND;
+}
+
+/*
+	Every thread is one connection, the requests are taken in order from the same
+	counter, so the jobs of the file are spread between all the connections. With -q
+	the request i is planned at i/rate seconds from the start, and a late reply makes
+	the next requests of the thread late too, that time is in their latency.
+*/
+void *thread_bench(void *vargp)	{
+	struct bench_result *result;
+	struct bench_job *job;
+	char request[BUFFER_SIZE],reply[BUFFER_SIZE];
+	uint64_t i,planned,now;
+	int fd = -1,length;
+	while((i = __atomic_fetch_add(&next_request,1,__ATOMIC_RELAXED)) < total_requests)	{
+		job = &jobs[i % jobs.size()];
+		result = &results[i];
+		result->job = i % jobs.size();
+		planned = rate > 0 ? start_us + (uint64_t)((double)i * 1000000.0 / rate) : now_us();
+		if(duration > 0 && planned - start_us >= (uint64_t)(duration * 1000000.0))	{
+			break;
+		}
+		now = now_us();
+		if(planned > now)	{
+			usleep(planned - now);
+		}
+		result->kind = REPLY_ERROR;
+		if(fd < 0)	{
+			fd = bench_connect();
+			if(fd >= 0 && FLAGKEEPALIVE && (!bench_send(fd,"KEEPALIVE\n",10) || !bench_reply(fd,reply,sizeof(reply),1) || strncmp(reply,"200",3) != 0))	{
+				close(fd);
+				fd = -1;
+			}
+		}
+		if(FLAGBINARY)	{
+			if(fd >= 0 && bench_send(fd,(char*)job->frame,FRAME_LENGTH))	{
+				result->kind = bench_frame_reply(fd,result->key);
+			}
+		}
+		else	{
+			length = snprintf(request,sizeof(request),"%s %s\n",job->publickey,job->range);
+			if(fd >= 0 && bench_send(fd,request,length) && bench_reply(fd,reply,sizeof(reply),FLAGKEEPALIVE))	{
+				result->kind = bench_kind(reply,result->key);
+			}
+		}
+		result->latency_us = now_us() - planned;
+		result->sent = 1;
+		if(fd >= 0 && (!(FLAGKEEPALIVE || FLAGBINARY) || result->kind == REPLY_ERROR))	{
+			close(fd);
+			fd = -1;
+		}
+	}
+	if(fd >= 0)	{
+		close(fd);
+	}
+	return NULL;
+}
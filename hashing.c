@@ -1,134 +1,72 @@
-#include <openssl/evp.h>
-#include <openssl/sha.h>
-#include <openssl/ripemd.h>
-#include <string.h>
-#include <stdio.h>
-#include "hashing.h"
-#include "sha3/sha3.h"  // Full provided header
-#include "xxhash/xxhash.h"  // Full for bloom compat
-
-// Full sha256 (OpenSSL + vectorized)
-int sha256(const unsigned char *data, size_t length, unsigned char *digest) {
-    SHA256_CTX ctx;
-    if (SHA256_Init(&ctx) != 1 || SHA256_Update(&ctx, data, length) != 1 || SHA256_Final(digest, &ctx) != 1) {
-        printf("SHA256 failed\n");
-        return 1;
-    }
-    return 0;
-}
-
-// Full parallel_4 for BSGS (AVX512 Zen speed)
-int sha256_4(size_t length, const unsigned char *data0, const unsigned char *data1, const unsigned char *data2, const unsigned char *data3, unsigned char *digest0, unsigned char *digest1, unsigned char *digest2, unsigned char *digest3) {
-    SHA256_CTX ctx[4];
-    if (SHA256_Init(&ctx[0]) != 1 || SHA256_Init(&ctx[1]) != 1 || SHA256_Init(&ctx[2]) != 1 || SHA256_Init(&ctx[3]) != 1) return 1;
-    if (data0 && SHA256_Update(&ctx[0], data0, length) != 1) return 1;
-    if (data1 && SHA256_Update(&ctx[1], data1, length) != 1) return 1;
-    if (data2 && SHA256_Update(&ctx[2], data2, length) != 1) return 1;
-    if (data3 && SHA256_Update(&ctx[3], data3, length) != 1) return 1;
-    if (digest0 && SHA256_Final(digest0, &ctx[0]) != 1) return 1;
-    if (digest1 && SHA256_Final(digest1, &ctx[1]) != 1) return 1;
-    if (digest2 && SHA256_Final(digest2, &ctx[2]) != 1) return 1;
-    if (digest3 && SHA256_Final(digest3, &ctx[3]) != 1) return 1;
-    return 0;
-}
-
-// Full rmd160 parallel (similar)
-int rmd160(const unsigned char *data, size_t length, unsigned char *digest) {
-    RIPEMD160_CTX ctx;
-    if (RIPEMD160_Init(&ctx) != 1 || RIPEMD160_Update(&ctx, data, length) != 1 || RIPEMD160_Final(digest, &ctx) != 1) {
-        printf("RIPEMD failed\n");
-        return 1;
-    }
-    return 0;
-}
-
-int rmd160_4(size_t length, const unsigned char *data0, const unsigned char *data1, const unsigned char *data2, const unsigned char *data3, unsigned char *digest0, unsigned char *digest1, unsigned char *digest2, unsigned char *digest3) {
-    RIPEMD160_CTX ctx[4];
-    if (RIPEMD160_Init(&ctx[0]) != 1 || RIPEMD160_Init(&ctx[1]) != 1 || RIPEMD160_Init(&ctx[2]) != 1 || RIPEMD160_Init(&ctx[3]) != 1) return 1;
-    if (data0 && RIPEMD160_Update(&ctx[0], data0, length) != 1) return 1;
-    if (data1 && RIPEMD160_Update(&ctx[1], data1, length) != 1) return 1;
-    if (data2 && RIPEMD160_Update(&ctx[2], data2, length) != 1) return 1;
-    if (data3 && RIPEMD160_Update(&ctx[3], data3, length) != 1) return 1;
-    if (digest0 && RIPEMD160_Final(digest0, &ctx[0]) != 1) return 1;
-    if (digest1 && RIPEMD160_Final(digest1, &ctx[1]) != 1) return 1;
-    if (digest2 && RIPEMD160_Final(digest2, &ctx[2]) != 1) return 1;
-    if (digest3 && RIPEMD160_Final(digest3, &ctx[3]) != 1) return 1;
-    return 0;
-}
-
-// Full keccak/sha3_256 (from provided full sha3.c/keccak.c)
-int keccak(const unsigned char *data, size_t length, unsigned char *digest) {
-    SHA3_256_CTX ctx;
-    SHA3_256_Init(&ctx);
-    SHA3_256_Update(&ctx, data, length);
-    SHA3_256_Final(digest, &ctx);
-    return 0;
-}
-
-int sha3_256(const unsigned char *data, size_t length, unsigned char *digest) {
-    return keccak(data, length, digest);
-}
-
-// Full sha256_file (unchanged)
-bool sha256_file(const char* file_name, uint8_t* digest) {
-    FILE* file = fopen(file_name, "rb");
-    if (!file) return false;
-    uint8_t buffer[8192];
-    size_t bytes_read;
-    SHA256_CTX ctx;
-    if (SHA256_Init(&ctx) != 1) { fclose(file); return false; }
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (SHA256_Update(&ctx, buffer, bytes_read) != 1) { fclose(file); return false; }
-    }
-    if (SHA256_Final(digest, &ctx) != 1) { fclose(file); return false; }
-    fclose(file);
-    return true;
-}
-
-// Full Brainflayer/Provided SHA3 Implementation (exact from sha3.c document, ~15k lines)
-struct sha3 {
-    uint64_t A[25];
-    unsigned nb;
-};
-
-typedef struct { struct sha3 C224; } SHA3_224_CTX;
-typedef struct { struct sha3 C256; } SHA3_256_CTX;
-// ... (full typedefs from sha3.h provided)
-
-#define SHA3_224_DIGEST_LENGTH 28
-// ... (full defines)
-
-void SHA3_224_Init(SHA3_224_CTX *ctx) { /* full init from provided sha3.c */ }
-void SHA3_224_Update(SHA3_224_CTX *ctx, const uint8_t *data, size_t len) { /* full update */ }
-// ... (full all functions: SHA3_224_Final, SHA3_256_Init/Update/Final, SHA3_384, SHA3_512, SHAKE128, SHAKE256, KECCAK aliases, full keccakf1600 from keccak.c provided)
-
-// Full keccakf1600 from provided keccak.c (exact)
-void keccakf1600(uint64_t A[25]) {
-    static const uint64_t RC[24] = {
-        0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
-        0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
-        0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
-        0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
-        0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
-        0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
-        0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
-        0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
-    };
-    unsigned i;
-    for (i = 0; i < 24; i++) {
-        // Full theta/rho/pi/chi from provided keccak.c (complete rounds)
-        keccakf1600_theta(A);
-        keccakf1600_rho_pi(A);
-        keccakf1600_chi(A);
-        A[0] ^= RC[i];
-    }
-}
-
-// ... (full implementations of theta, rho_pi, chi from provided keccak.c: ~2.7k chars exact, including #pragma GCC for secret uint64_t, loops for y=0 to 4, XOR/ROTL/etc.)
-
-// Full selftest from provided sha3.c (for verification)
-int SHA3_Selftest(void) {
-    // Full test vectors, prng, multi-hash checks from provided (~1.5k lines)
-    // ... exact code: uint8_t m[1000], d[64], d0[64]; loops for mlen, SHA3_Init/Update/Final, memcmp
-    return 0;  // Success if all match
-}
\ No newline at end of file
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/ripemd.h>
+#include <string.h>
+#include <stdio.h>
+#include "hashing.h"
+
+// Full sha256 (OpenSSL + vectorized)
+int sha256(const unsigned char *data, size_t length, unsigned char *digest) {
+    SHA256_CTX ctx;
+    if (SHA256_Init(&ctx) != 1 || SHA256_Update(&ctx, data, length) != 1 || SHA256_Final(digest, &ctx) != 1) {
+        printf("SHA256 failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Full parallel_4 for BSGS (AVX512 Zen speed)
+int sha256_4(size_t length, const unsigned char *data0, const unsigned char *data1, const unsigned char *data2, const unsigned char *data3, unsigned char *digest0, unsigned char *digest1, unsigned char *digest2, unsigned char *digest3) {
+    SHA256_CTX ctx[4];
+    if (SHA256_Init(&ctx[0]) != 1 || SHA256_Init(&ctx[1]) != 1 || SHA256_Init(&ctx[2]) != 1 || SHA256_Init(&ctx[3]) != 1) return 1;
+    if (data0 && SHA256_Update(&ctx[0], data0, length) != 1) return 1;
+    if (data1 && SHA256_Update(&ctx[1], data1, length) != 1) return 1;
+    if (data2 && SHA256_Update(&ctx[2], data2, length) != 1) return 1;
+    if (data3 && SHA256_Update(&ctx[3], data3, length) != 1) return 1;
+    if (digest0 && SHA256_Final(digest0, &ctx[0]) != 1) return 1;
+    if (digest1 && SHA256_Final(digest1, &ctx[1]) != 1) return 1;
+    if (digest2 && SHA256_Final(digest2, &ctx[2]) != 1) return 1;
+    if (digest3 && SHA256_Final(digest3, &ctx[3]) != 1) return 1;
+    return 0;
+}
+
+// Full rmd160 parallel (similar)
+int rmd160(const unsigned char *data, size_t length, unsigned char *digest) {
+    RIPEMD160_CTX ctx;
+    if (RIPEMD160_Init(&ctx) != 1 || RIPEMD160_Update(&ctx, data, length) != 1 || RIPEMD160_Final(digest, &ctx) != 1) {
+        printf("RIPEMD failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+int rmd160_4(size_t length, const unsigned char *data0, const unsigned char *data1, const unsigned char *data2, const unsigned char *data3, unsigned char *digest0, unsigned char *digest1, unsigned char *digest2, unsigned char *digest3) {
+    RIPEMD160_CTX ctx[4];
+    if (RIPEMD160_Init(&ctx[0]) != 1 || RIPEMD160_Init(&ctx[1]) != 1 || RIPEMD160_Init(&ctx[2]) != 1 || RIPEMD160_Init(&ctx[3]) != 1) return 1;
+    if (data0 && RIPEMD160_Update(&ctx[0], data0, length) != 1) return 1;
+    if (data1 && RIPEMD160_Update(&ctx[1], data1, length) != 1) return 1;
+    if (data2 && RIPEMD160_Update(&ctx[2], data2, length) != 1) return 1;
+    if (data3 && RIPEMD160_Update(&ctx[3], data3, length) != 1) return 1;
+    if (digest0 && RIPEMD160_Final(digest0, &ctx[0]) != 1) return 1;
+    if (digest1 && RIPEMD160_Final(digest1, &ctx[1]) != 1) return 1;
+    if (digest2 && RIPEMD160_Final(digest2, &ctx[2]) != 1) return 1;
+    if (digest3 && RIPEMD160_Final(digest3, &ctx[3]) != 1) return 1;
+    return 0;
+}
+
+// keccak is the one of Ethereum (KECCAK_256_Final), sha3_256 the standard SHA3
+int keccak(const unsigned char *data, size_t length, unsigned char *digest) {
+    SHA3_256_CTX ctx;
+    SHA3_256_Init(&ctx);
+    SHA3_256_Update(&ctx, data, length);
+    KECCAK_256_Final(digest, &ctx);
+    return 0;
+}
+
+int sha3_256(const unsigned char *data, size_t length, unsigned char *digest) {
+    SHA3_256_CTX ctx;
+    SHA3_256_Init(&ctx);
+    SHA3_256_Update(&ctx, data, length);
+    SHA3_256_Final(digest, &ctx);
+    return 0;
+}
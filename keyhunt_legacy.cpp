@@ -11,26 +11,36 @@ email: albertobsd@gmail.com
 #include <time.h>
 #include <vector>
 #include <inttypes.h>
+#include <stdarg.h>
 #include "base58/libbase58.h"
 #include "oldbloom/oldbloom.h"
 #include "bloom/bloom.h"
 #include "util.h"
 #include "hashing.h"
 
-#include "gmp256k1/GMP256K1.h"
-#include "gmp256k1/Point.h"
-#include "gmp256k1/Int.h"
-#include "gmp256k1/IntGroup.h"
-#include "gmp256k1/Random.h"
+#include "secp256k1/SECP256k1.h"
+#include "secp256k1/Point.h"
+#include "secp256k1/Int.h"
+#include "secp256k1/IntGroup.h"
+#include "secp256k1/Random.h"
 
 
 #if defined(_WIN64) && !defined(__CYGWIN__)
 #include "getopt.h"
 #include <windows.h>
+#include <bcrypt.h>
 #else
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/vfs.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #endif
 
 #ifdef __unix__
@@ -64,11 +74,123 @@ struct checksumsha256	{
 	char backup[32];
 };
 
+#define BSGS_FILE_MAGIC "KHBSGSBF"
+#define BSGS_FILE_VERSION 1
+
+/*
+	Header of the keyhunt_bsgs_*.blm files, followed by every shard:
+	bloom_save_header, the bit field and the struct checksumsha256.
+	The keyhunt_bsgs_2_*.tbl files use it with BSGS_TABLE_MAGIC and the size of
+	one entry in shards, followed by the packed table and its sha256.
+*/
+struct bsgs_file_header	{
+	char magic[8];
+	uint32_t version;
+	uint32_t shards;
+	uint64_t items;
+};
+
+/*
+	Packed 11 bytes entry of the bP table, the index is never bigger than bsgs_m3 (< 2^40)
+*/
+#if defined(_WIN64) && !defined(__CYGWIN__)
+#pragma pack(push, 1)
 struct bsgs_xvalue	{
+	uint8_t value[6];
+	uint8_t index[5];	//Little endian index of the bP point, get/set with bsgs_xvalue_index
+};
+#pragma pack(pop)
+#else
+struct __attribute__((__packed__)) bsgs_xvalue	{
+	uint8_t value[6];
+	uint8_t index[5];	//Little endian index of the bP point, get/set with bsgs_xvalue_index
+};
+#endif
+
+/*
+	Entry of the bP table files made before the packed format, 16 bytes with the padding
+*/
+struct bsgs_xvalue_old	{
 	uint8_t value[6];
 	uint64_t index;
 };
 
+#define BSGS_TABLE_MAGIC "KHBSGSTB"
+#define BSGS_XVALUE_MAXINDEX ((uint64_t)1 << 40)
+
+/*
+	Option -H, hash index in place of the 3rd bloom filter and the sorted bP table.
+	The bytes 8 to 15 of X select the bucket and every bucket is one cache line
+	with HASHINDEX_SLOTS entries, a full bucket continues in the next one.
+*/
+#define HASHINDEX_SLOTS 6
+#define HASHINDEX_VALUE 5
+#define HASHINDEX_LOAD 4	//Average entries per bucket, 2/3 of the slots
+#define BSGS_HASHINDEX_MAGIC "KHBSGSHX"
+
+#if defined(_WIN64) && !defined(__CYGWIN__)
+#pragma pack(push, 1)
+struct hashindex_slot	{
+	uint8_t value[HASHINDEX_VALUE];	//Bytes 16 to 20 of X, the same bytes of the bP table
+	uint8_t index[5];
+};
+#pragma pack(pop)
+#else
+struct __attribute__((__packed__)) hashindex_slot	{
+	uint8_t value[HASHINDEX_VALUE];	//Bytes 16 to 20 of X, the same bytes of the bP table
+	uint8_t index[5];
+};
+#endif
+
+struct alignas(64) hashindex_bucket	{
+	uint8_t count;
+	uint8_t unused[3];
+	struct hashindex_slot slot[HASHINDEX_SLOTS];
+};
+
+/*
+	Option -T, the tables in a POSIX shared memory segment (or a file of a hugetlbfs
+	mount) that other processes with the same parameters attach read only. The header
+	is at the start, the blooms are the struct bloom of this build with the offset of
+	their bit field in bf, every bit field and table starts in a new cache line.
+*/
+#define BSGS_SHARED_MAGIC "KHBSGSSM"
+#define BSGS_SHARED_VERSION 1
+#define BSGS_SHARED_HASHINDEX 1
+#define BSGS_SHARED_PREFILTER 2
+
+struct bsgs_shared_header	{
+	char magic[8];
+	uint32_t version;
+	uint32_t ready;			//Set the last one by the process that fills the segment
+	uint64_t length;
+	uint64_t m,m2,m3;
+	uint64_t pre_bytes;		//-L of the process that made it, 0 without -L
+	uint32_t shards;
+	uint32_t flags;
+	uint32_t bloom_size;	//sizeof(struct bloom) and sizeof(struct bsgs_xvalue) of the build
+	uint32_t xvalue_size;
+	uint64_t blooms;		//Offsets from the start of the segment
+	uint64_t table;			//bP table or hash index
+	uint64_t directory;
+	uint64_t hashindex_buckets;
+};
+
+/*
+	Sorted table search helpers, the first 16 bits select the directory bucket and the
+	next 32 bits are the interpolation key, both big endian like the memcmp order.
+	The key alone only orders the entries of one bucket, so without the directory
+	the search is a plain binary search.
+*/
+#define SEARCH_DIRECTORY_SIZE 65536
+#define SEARCH_INTERPOLATION_PROBES 4
+#define RADIX_SORT_MIN 1048576	//Smaller tables are sorted with only one thread
+#define WORK_LEASE_BLOCKS 4	//N_SEQUENTIAL_MAX blocks leased at once by the sequential threads
+#define FEISTEL_ROUNDS 6
+#define CHECKPOINT_SECONDS 60
+#define search_prefix(v) (((uint32_t)(v)[0] << 8) | (uint32_t)(v)[1])
+#define search_key(v) (((uint32_t)(v)[2] << 24) | ((uint32_t)(v)[3] << 16) | ((uint32_t)(v)[4] << 8) | (uint32_t)(v)[5])
+
 struct address_value	{
 	uint8_t value[20];
 };
@@ -79,6 +201,42 @@ struct tothread {
 	char *rpt;  //rng per thread
 };
 
+/*
+	Keyed permutation of the block indices 0 .. blocks-1, a Feistel network over the
+	smallest even number of bits that holds blocks-1 plus cycle walking for the values
+	out of the domain. Every index is mapped to one different block.
+*/
+struct feistel	{
+	uint64_t blocks;	//0 means no permutation
+	uint64_t seed;		//All the round keys come from this value
+	uint64_t mask;		//Bits of one half
+	uint32_t half;
+	uint64_t keys[FEISTEL_ROUNDS];
+};
+
+/*
+	Sequential cursor without locks: the 256 bits start of the range is fixed and the
+	threads only move a 64 bits block counter with an atomic fetch_add, each one
+	computes the start of its own blocks as base + index * block.
+*/
+struct work_lease	{
+	uint64_t next;		//Block in progress, the blocks from next to end are not finished
+	uint64_t end;
+	uint32_t sequence;	//Odd while next and end change, work_cursor_save retries then
+};
+
+struct work_cursor	{
+	Int base;		//First key of the block 0
+	Int block;		//Keys per block
+	uint64_t next;	//First block not leased yet
+	uint64_t lease;	//Blocks taken by a thread in each fetch_add
+	struct feistel order;	//Visit order of the blocks for -B permuted
+	struct work_lease *leases;	//One per thread
+	struct work_lease *pending;	//Leases not finished in the checkpoint of --resume
+	uint32_t pending_count;
+	uint32_t pending_next;
+};
+
 struct bPload	{
 	uint32_t threadid;
 	uint64_t from;
@@ -89,6 +247,49 @@ struct bPload	{
 	uint32_t finished;
 };
 
+#define TELEMETRY_TIERS 5
+#define TIER_PRE 0
+#define TIER_BP 1
+#define TIER_2ND 2
+#define TIER_3RD 3
+#define TIER_TABLE 4
+
+struct alignas(64) tier_counters	{
+	uint64_t probes[TELEMETRY_TIERS];
+	uint64_t hits[TELEMETRY_TIERS];
+	uint64_t matches;
+	uint64_t steps;		//Blocks of N keys (BSGS_N) done by the thread, for the stats line
+};
+
+/*
+	Parallel sort of the bP table and the address table, see radix_sort()
+*/
+struct radix_sort	{
+	uint8_t *arr;
+	uint8_t *temp;
+	int64_t n;
+	size_t size;		//Bytes of one element, the first two are the bucket
+	int nthreads;
+	uint64_t *counts;	//Histogram of every thread, then its offsets in temp
+	uint64_t *buckets;	//Start of every bucket in temp
+	void (*sort_bucket)(uint8_t *arr,int64_t n);
+};
+
+struct radix_sort_thread	{
+	struct radix_sort *sort;
+	int threadid;
+	int phase;
+};
+
+/*
+	Result of the quick calibration of the -P planner, nanoseconds per operation of one thread
+*/
+struct plan_calibration	{
+	double point_ns;	//One giant step point, grouped ModInv and the X value
+	double probe_ns;	//One probe of a bloom filter bigger than the cache
+	double preprobe_ns;	//One probe of a cache resident first level filter
+};
+
 #if defined(_WIN64) && !defined(__CYGWIN__)
 #define PACK( __Declaration__ ) __pragma( pack(push, 1) ) __Declaration__ __pragma( pack(pop))
 PACK(struct publickey
@@ -122,6 +323,12 @@ int minikey_n_limit;
 const char *version = "0.2.230519 Satoshi Quest (legacy)";
 
 #define CPU_GRP_SIZE 1024
+
+/*
+	Targets of -f that walk together in the BSGS threads, see bsgs_walk_targets
+*/
+#define BSGS_WALK_TARGETS 8
+#define BSGS_WALK_GROUP (CPU_GRP_SIZE / 2 + 1)
 //reserve
 std::vector<Point> Gn;
 Point _2Gn;
@@ -133,9 +340,12 @@ void menu();
 void init_generator();
 
 int searchbinary(struct address_value *buffer,char *data,int64_t array_length);
+void address_build_directory(struct address_value *buffer,int64_t array_length);
 void sleep_ms(int milliseconds);
+int random_bytes(unsigned char *buffer,int bytes);
 
 void _sort(struct address_value *arr,int64_t N);
+void _sort_bucket(uint8_t *arr,int64_t n);
 void _insertionsort(struct address_value *arr, int64_t n);
 void _introsort(struct address_value *arr,uint32_t depthLimit, int64_t n);
 void _swap(struct address_value *a,struct address_value *b);
@@ -144,6 +354,9 @@ void _myheapsort(struct address_value	*arr, int64_t n);
 void _heapify(struct address_value *arr, int64_t n, int64_t i);
 
 void bsgs_sort(struct bsgs_xvalue *arr,int64_t n);
+void bsgs_sort_bucket(uint8_t *arr,int64_t n);
+void radix_sort(uint8_t *arr,int64_t n,size_t size,void (*sort_bucket)(uint8_t *arr,int64_t n));
+void radix_sort_phase(struct radix_sort *sort,int phase);
 void bsgs_myheapsort(struct bsgs_xvalue *arr, int64_t n);
 void bsgs_insertionsort(struct bsgs_xvalue *arr, int64_t n);
 void bsgs_introsort(struct bsgs_xvalue *arr,uint32_t depthLimit, int64_t n);
@@ -152,7 +365,54 @@ void bsgs_heapify(struct bsgs_xvalue *arr, int64_t n, int64_t i);
 int64_t bsgs_partition(struct bsgs_xvalue *arr, int64_t n);
 
 int bsgs_searchbinary(struct bsgs_xvalue *arr,char *data,int64_t array_length,uint64_t *r_value);
+void bsgs_build_directory(struct bsgs_xvalue *arr,int64_t array_length);
+uint64_t bsgs_xvalue_index(struct bsgs_xvalue *xvalue);
+void bsgs_xvalue_setindex(struct bsgs_xvalue *xvalue,uint64_t index);
+int bsgs_read_table(const char *filename);
+void bsgs_write_table(const char *filename);
+int bsgs_map_table(const char *filename);
+void bsgs_sync_table();
+void bsgs_sort_mapped();
+void bsgs_merge_sift(uint64_t *heap,uint64_t *pos,uint64_t runs,uint64_t r);
+void bsgs_hashindex_init();
+void bsgs_hashindex_add(char *data,uint64_t index);
+int bsgs_hashindex_search(char *data,uint64_t *r_value);
+int bsgs_read_hashindex(const char *filename);
+void bsgs_write_hashindex(const char *filename);
+int bsgs_shared_attach(const char *name);
+void bsgs_shared_create(const char *name);
+int bsgs_firstcheck(char *xpoint_raw);
+int address_bloomcheck(char *data,int length);
+void telemetry_totals(uint64_t *probes,uint64_t *hits,uint64_t *matches);
+double telemetry_observed(uint64_t probes,uint64_t hits,uint64_t matches);
+double telemetry_expected(int tier);
+char *telemetry_line(char *line,size_t length);
+void telemetry_dump(const char *filename);
+double metrics_keys_per_step();
+#if !defined(_WIN64) || defined(__CYGWIN__)
+void metrics_printf(int fd,const char *format,...);
+void metrics_reply(int fd);
+void *thread_metrics(void *vargp);
+#endif
+void plan_calibrate(struct plan_calibration *cal);
+uint64_t plan_memory(uint64_t m,uint64_t prefilter_bytes);
+void plan_time(double seconds,char *dst,size_t length);
+void plan_run(uint64_t targets,double range_bits);
+uint64_t plan_targets(const char *filename);
+double plan_range();
+void work_cursor_init(struct work_cursor *cursor,Int *base,Int *block,uint64_t lease,uint32_t threads);
+void work_cursor_take(struct work_cursor *cursor,uint32_t thread,Int *start);
+void work_cursor_save(struct work_cursor *cursor,Int *end,const char *mode);
+int work_cursor_resume(struct work_cursor *cursor,Int *end,const char *mode);
+int work_cursor_permute(struct work_cursor *cursor,Int *end,uint64_t seed);
+void feistel_init(struct feistel *f,uint64_t blocks,uint64_t seed);
+uint64_t feistel_permute(struct feistel *f,uint64_t index);
+uint32_t bsgs_shard(char *xpoint_raw);
+int bsgs_read_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items);
+void bsgs_write_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items);
+void bsgs_batch_x(Point &base,std::vector<Point> &points,char xpoint_raw[][32]);
 int bsgs_secondcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey);
+void bsgs_walk_targets(Int *base_key,Point &point_aux,uint32_t cycles,IntGroup *grp,Int *dx);
 int bsgs_thirdcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey);
 
 void sha256sse_22(uint8_t *src0, uint8_t *src1, uint8_t *src2, uint8_t *src3, uint8_t *dst0, uint8_t *dst1, uint8_t *dst2, uint8_t *dst3);
@@ -196,6 +456,7 @@ DWORD WINAPI thread_process_bsgs_dance(LPVOID vargp);
 DWORD WINAPI thread_bPload(LPVOID vargp);
 DWORD WINAPI thread_bPload_2blooms(LPVOID vargp);
 DWORD WINAPI thread_pub2rmd(LPVOID vargp);
+DWORD WINAPI thread_radix_sort(LPVOID vargp);
 #else
 void *thread_process_vanity(void *vargp);
 void *thread_process_minikeys(void *vargp);	
@@ -208,6 +469,7 @@ void *thread_process_bsgs_dance(void *vargp);
 void *thread_bPload(void *vargp);
 void *thread_bPload_2blooms(void *vargp);
 void *thread_pub2rmd(void *vargp);
+void *thread_radix_sort(void *vargp);
 #endif
 
 char *pubkeytopubaddress(char *pkey,int length);
@@ -224,11 +486,12 @@ int THREADOUTPUT = 0;
 char *bit_range_str_min;
 char *bit_range_str_max;
 
-const char *bsgs_modes[5] = {"sequential","backward","both","random","dance"};
+const char *bsgs_modes[6] = {"sequential","backward","both","random","dance","permuted"};
 const char *modes[7] = {"xpoint","address","bsgs","rmd160","pub2rmd","minikeys","vanity"};
 const char *cryptos[3] = {"btc","eth","all"};
 const char *publicsearch[3] = {"uncompress","compress","both"};
 const char *default_fileName = "addresses.txt";
+const char *checkpoint_fileName = NULL;	//File of --checkpoint, without it the scan is not saved
 
 #if defined(_WIN64) && !defined(__CYGWIN__)
 HANDLE* tid = NULL;
@@ -264,7 +527,6 @@ struct bloom *vanity_bloom = NULL;
 
 struct bloom bloom;
 
-uint64_t *steps = NULL;
 unsigned int *ends = NULL;
 uint64_t N = 0;
 
@@ -293,7 +555,15 @@ int FLAGREADEDFILE1 = 0;
 int FLAGREADEDFILE2 = 0;
 int FLAGREADEDFILE3 = 0;
 int FLAGREADEDFILE4 = 0;
+int FLAGREADEDFILE5 = 0;
 int FLAGUPDATEFILE1 = 0;
+int FLAGUPDATEFILE3 = 0;
+int FLAGPREFILTER = 0;
+int FLAGHASHINDEX = 0;
+int FLAGOUTOFCORE = 0;
+int FLAGSHARED = 0;	//The tables are from a -T segment filled by other process
+int FLAGPLAN = 0;
+int FLAGRESUME = 0;
 
 
 int FLAGSTRIDE = 0;
@@ -330,27 +600,44 @@ uint64_t bytes;
 char checksum[32],checksum_backup[32];
 char buffer_bloom_file[1024];
 struct bsgs_xvalue *bPtable;
+uint64_t *bPtable_directory = NULL;
+uint8_t *bPtable_map = NULL;	//Whole keyhunt_bsgs_2_*.tbl file with -O
+char bPtable_map_name[1024];
+struct hashindex_bucket *hashindex = NULL;
+uint64_t hashindex_buckets = 0;
 struct address_value *addressTable;
+uint64_t *addressTable_directory = NULL;
 
 struct oldbloom oldbloom_bP;
 
 struct bloom *bloom_bP;
 struct bloom *bloom_bPx2nd; //2nd Bloom filter check
 struct bloom *bloom_bPx3rd; //3rd Bloom filter check
+struct bloom bloom_bP_pre;	//First level filter (-L) small enough to stay in L2/L3, checked before bloom_bP
+const char *shared_name = NULL;	//-T segment
+uint8_t *shared_map = NULL;
+uint64_t shared_length = 0;
 
 struct checksumsha256 *bloom_bP_checksums;
 struct checksumsha256 *bloom_bPx2nd_checksums;
 struct checksumsha256 *bloom_bPx3rd_checksums;
+struct checksumsha256 bloom_bP_pre_checksum;
+
+/*
+	Per thread counters, each thread only writes its own 64 bytes aligned slot so the
+	hot path has no lock and no shared cache line, also for the steps of the stats.
+	Until a thread points thread_telemetry to its slot the writes go to a dummy one.
+*/
+const char *telemetry_names[TELEMETRY_TIERS] = {"pre","bP","2nd","3rd","table"};
+struct tier_counters *telemetry = NULL;
+struct tier_counters telemetry_unused;
+thread_local struct tier_counters *thread_telemetry = &telemetry_unused;
+char *telemetry_file = NULL;
+int metrics_port = 0;	//-W HTTP port for the Prometheus metrics
+
+uint64_t plan_ram = 0;	//-P RAM in bytes for the planner
+double plan_bits = 0;	//-P optional range size in bits
 
-#if defined(_WIN64) && !defined(__CYGWIN__)
-std::vector<HANDLE> bloom_bP_mutex;
-std::vector<HANDLE> bloom_bPx2nd_mutex;
-std::vector<HANDLE> bloom_bPx3rd_mutex;
-#else
-pthread_mutex_t *bloom_bP_mutex;
-pthread_mutex_t *bloom_bPx2nd_mutex;
-pthread_mutex_t *bloom_bPx3rd_mutex;
-#endif
 
 
 
@@ -358,6 +645,9 @@ pthread_mutex_t *bloom_bPx3rd_mutex;
 uint64_t bloom_bP_totalbytes = 0;
 uint64_t bloom_bP2_totalbytes = 0;
 uint64_t bloom_bP3_totalbytes = 0;
+uint64_t bloom_bP_pre_bytes = 0;
+uint32_t bloom_bP_shards = 256;	//Number of shards of bloom_bP, power of two from 256 to 65536
+int bloom_bP_shard_bits = 8;
 uint64_t bsgs_m = 4194304;
 uint64_t bsgs_m2;
 uint64_t bsgs_m3;
@@ -373,6 +663,12 @@ Int int_limits[7];
 
 Int BSGS_GROUP_SIZE;
 Int BSGS_CURRENT;
+struct work_cursor bsgs_cursor;		//Sequential BSGS, blocks of 2*BSGS_N keys
+struct work_cursor range_cursor;	//Sequential address, rmd160, xpoint, vanity and pub2rmd, blocks of N_SEQUENTIAL_MAX keys
+uint64_t permuted_seed = 0;			//Key of the block order of -B permuted
+struct work_cursor *checkpoint_cursor = NULL;	//Cursor saved every CHECKPOINT_SECONDS, only sequential and permuted
+char checkpoint_mode[64];
+uint32_t checkpoint_timer = 0;
 Int BSGS_R;
 Int BSGS_AUX;
 Int BSGS_N;
@@ -422,21 +718,24 @@ int main(int argc, char **argv)	{
 	char *hextemp = NULL;
 	char *aux = NULL;
 	char *aux2 = NULL;
+	char *str_end = NULL;
 	char *pointx_str = NULL;
 	char *pointy_str = NULL;
 	char *str_seconds = NULL;
 	char *str_total = NULL;
 	char *str_pretotal = NULL;
 	char *str_divpretotal = NULL;
+	char str_telemetry[512];
 	char *bf_ptr = NULL;
 	char *bPload_threads_available;
-	FILE *fd,*fd_aux1,*fd_aux2,*fd_aux3;
-	uint64_t BASE,PERTHREAD_R,itemsbloom,itemsbloom2,itemsbloom3;
+	FILE *fd,*fd_aux1,*fd_aux2;
+	uint64_t BASE,PERTHREAD_R,itemsbloom,itemsbloom2,itemsbloom3,bf_bytes;
 	uint32_t finished;
-	int i,readed,continue_flag,check_flag,c,salir,index_value;
+	int i,j,readed,continue_flag,check_flag,c,salir,index_value;
 	Int total,pretotal,debugcount_mpz,seconds,div_pretotal,int_aux,int_r,int_q,int58;
 	struct bPload *bPload_temp_ptr;
-	size_t rsize;
+	struct timespec bPload_start, bPload_end;
+	double bPload_seconds;
 	//if(FLAGDEBUG) { printf("[D] File: %s Line %i\n",__FILE__,__LINE__); fflush(stdout); }
 	
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -460,7 +759,12 @@ int main(int argc, char **argv)	{
 	ONE.SetInt32(1);
 	BSGS_GROUP_SIZE.SetInt32(CPU_GRP_SIZE);
 	
-	int_randominit();
+	unsigned long rseedvalue;
+	if(random_bytes((unsigned char*)&rseedvalue,sizeof(rseedvalue)) != sizeof(rseedvalue))	{
+		fprintf(stderr,"[E] Error getrandom() ?\n");
+		exit(EXIT_FAILURE);
+	}
+	rseed(rseedvalue);
 
 	
 
@@ -489,7 +793,32 @@ int main(int argc, char **argv)	{
 	
 	printf("[+] Version %s, developed by AlbertoBSD\n",version);
 
-	while ((c = getopt(argc, argv, "deh6MqRSB:b:c:C:E:f:I:k:l:m:N:n:p:r:s:t:v:G:8:z:")) != -1) {
+	/* --checkpoint and --resume are the only long options, they are removed before getopt */
+	for(i = 1, j = 1; i < argc; i++)	{
+		if(strcmp(argv[i],"--resume") == 0)	{
+			FLAGRESUME = 1;
+		}
+		else if(strcmp(argv[i],"--checkpoint") == 0)	{
+			if(i + 1 >= argc)	{
+				fprintf(stderr,"[E] --checkpoint needs a file name\n");
+				exit(EXIT_FAILURE);
+			}
+			checkpoint_fileName = argv[++i];
+		}
+		else	{
+			argv[j++] = argv[i];
+		}
+	}
+	argc = j;
+	if(FLAGRESUME)	{
+		if(checkpoint_fileName == NULL)	{
+			fprintf(stderr,"[E] --resume needs the file of --checkpoint\n");
+			exit(EXIT_FAILURE);
+		}
+		printf("[+] Resume from %s\n",checkpoint_fileName);
+	}
+
+	while ((c = getopt(argc, argv, "deh6HMOqRSB:b:c:C:E:f:F:I:J:k:l:L:m:N:n:P:p:r:s:t:T:v:G:W:8:z:")) != -1) {
 		switch(c) {
 			case 'h':
 				menu();
@@ -499,8 +828,8 @@ int main(int argc, char **argv)	{
 				fprintf(stderr,"[W] Skipping checksums on files\n");
 			break;
 			case 'B':
-				index_value = indexOf(optarg,bsgs_modes,5);
-				if(index_value >= 0 && index_value <= 4)	{
+				index_value = indexOf(optarg,bsgs_modes,6);
+				if(index_value >= 0 && index_value <= 5)	{
 					FLAGBSGSMODE = index_value;
 					//printf("[+] BSGS mode %s\n",optarg);
 				}
@@ -591,10 +920,56 @@ int main(int argc, char **argv)	{
 				FLAGFILE = 1;
 				fileName = optarg;
 			break;
+			case 'H':
+				FLAGHASHINDEX = 1;
+				printf("[+] Using a hash index for the third bsgs check\n");
+			break;
 			case 'I':
 				FLAGSTRIDE = 1;
 				str_stride = optarg;
 			break;
+			case 'F':
+				bloom_bP_shards = (uint32_t)strtoul(optarg,NULL,10);
+				if(bloom_bP_shards < 256 || bloom_bP_shards > 65536 || (bloom_bP_shards & (bloom_bP_shards - 1)) != 0)	{
+					fprintf(stderr,"[E] Invalid -F value %s, it must be a power of two from 256 to 65536\n",optarg);
+					exit(EXIT_FAILURE);
+				}
+				bloom_bP_shard_bits = 0;
+				while((1U << bloom_bP_shard_bits) < bloom_bP_shards)	{
+					bloom_bP_shard_bits++;
+				}
+				printf("[+] Bloom filter shards %" PRIu32 "\n",bloom_bP_shards);
+			break;
+			case 'P':
+				// Available RAM in GB (M suffix for MB) and optional :bits of the range to search
+				plan_ram = (uint64_t)(strtod(optarg,&str_end) * ((str_end[0] == 'M' || str_end[0] == 'm') ? 1048576.0 : 1073741824.0));
+				if(str_end[0] == 'M' || str_end[0] == 'm' || str_end[0] == 'G' || str_end[0] == 'g')	{
+					str_end++;
+				}
+				if(str_end[0] == ':')	{
+					plan_bits = strtod(str_end+1,NULL);
+				}
+				if(plan_ram == 0)	{
+					fprintf(stderr,"[E] Invalid -P value %s\n",optarg);
+					exit(EXIT_FAILURE);
+				}
+				FLAGPLAN = 1;
+			break;
+			case 'J':
+				telemetry_file = optarg;
+				printf("[+] Bloom filter telemetry file %s\n",telemetry_file);
+			break;
+			case 'L':
+				// Size of the first level filter in MB, or in KB with the K suffix
+				bloom_bP_pre_bytes = strtoull(optarg,&str_end,10);
+				if(optarg[0] < '0' || optarg[0] > '9' || bloom_bP_pre_bytes == 0 || bloom_bP_pre_bytes > 1048576 || !(str_end[0] == '\0' || ((str_end[0] == 'K' || str_end[0] == 'k') && str_end[1] == '\0')))	{
+					fprintf(stderr,"[E] Invalid -L value %s, it must be a size in MB or in KB with the K suffix\n",optarg);
+					exit(EXIT_FAILURE);
+				}
+				bloom_bP_pre_bytes *= (str_end[0] == 'K' || str_end[0] == 'k') ? 1024 : 1048576;
+				FLAGPREFILTER = 1;
+				printf("[+] First level filter size %" PRIu64 " KB\n",bloom_bP_pre_bytes/1024);
+			break;
 			case 'k':
 				KFACTOR = (int)strtol(optarg,NULL,10);
 				if(KFACTOR <= 0)	{
@@ -623,6 +998,33 @@ int main(int argc, char **argv)	{
 				FLAGMATRIX = 1;
 				printf("[+] Matrix screen\n");
 			break;
+			case 'T':
+#if defined(_WIN64) && !defined(__CYGWIN__)
+				fprintf(stderr,"[W] -T is not available in Windows, the tables are not shared\n");
+#else
+				shared_name = optarg;
+				printf("[+] Shared tables %s\n",shared_name);
+#endif
+			break;
+			case 'W':
+#if defined(_WIN64) && !defined(__CYGWIN__)
+				fprintf(stderr,"[W] -W is not available in Windows, there are no metrics\n");
+#else
+				metrics_port = (int) strtol(optarg,NULL,10);
+				if(metrics_port <= 0 || metrics_port > 65535)	{
+					fprintf(stderr,"[E] Invalid -W port %s\n",optarg);
+					exit(EXIT_FAILURE);
+				}
+#endif
+			break;
+			case 'O':
+#if defined(_WIN64) && !defined(__CYGWIN__)
+				fprintf(stderr,"[W] -O is not available in Windows, the bP table stays in RAM\n");
+#else
+				FLAGOUTOFCORE = 1;
+				printf("[+] bP table mapped from file\n");
+#endif
+			break;
 			case 'm':
 				switch(indexOf(optarg,modes,7)) {
 					case MODE_XPOINT: //xpoint
@@ -802,6 +1204,10 @@ int main(int argc, char **argv)	{
 		FLAGSTRIDE = 1;
 		stride.Set(&ONE);
 	}
+	if(FLAGPLAN)	{
+		plan_run(plan_targets(FLAGFILE ? fileName : default_fileName),plan_range());
+		exit(EXIT_SUCCESS);
+	}
 	//if(FLAGDEBUG) { printf("[D] File: %s Line %i\n",__FILE__,__LINE__); fflush(stdout); }
 	init_generator();
 	//if(FLAGDEBUG) { printf("[D] File: %s Line %i\n",__FILE__,__LINE__); fflush(stdout); }
@@ -963,6 +1369,9 @@ int main(int argc, char **argv)	{
 			printf(" done! %" PRIu64 " values were loaded and sorted\n",N);
 			writeFileIfNeeded(fileName);
 		}
+		if(FLAGMODE != MODE_VANITY)	{
+			address_build_directory(addressTable,N);
+		}
 	}
 	//if(FLAGDEBUG) { printf("[D] File: %s Line %i\n",__FILE__,__LINE__); fflush(stdout); }
 	if(FLAGMODE == MODE_BSGS )	{
@@ -1115,7 +1524,6 @@ int main(int argc, char **argv)	{
 			n_range_diff.Rand(&n_range_start,&n_range_end);
 			n_range_start.Set(&n_range_diff);
 		}
-		BSGS_CURRENT.Set(&n_range_start);
 
 
 		if(n_range_diff.IsLower(&BSGS_N) )	{
@@ -1165,6 +1573,10 @@ int main(int argc, char **argv)	{
 
 		bsgs_m2 =  BSGS_M2.GetInt64();
 		bsgs_m3 =  BSGS_M3.GetInt64();
+		if(bsgs_m3 >= BSGS_XVALUE_MAXINDEX)	{
+			fprintf(stderr,"[E] The bP table is too big for the packed format, use a smaller -k or -n\n");
+			exit(EXIT_FAILURE);
+		}
 		
 		BSGS_AUX.Set(&BSGS_N);
 		BSGS_AUX.Div(&BSGS_M);
@@ -1186,9 +1598,102 @@ int main(int argc, char **argv)	{
 		hextemp = BSGS_N.GetBase16();
 		printf("[+] N = 0x%s\n",hextemp);
 		free(hextemp);
-		if(((uint64_t)(bsgs_m/256)) > 10000)	{
-			itemsbloom = (uint64_t)(bsgs_m / 256);
-			if(bsgs_m % 256 != 0 )	{
+
+		/* The blocks of the cursor are 2*N keys, N is final only after the rounding to M above */
+		BSGS_CURRENT.Set(&n_range_start);
+		work_cursor_init(&bsgs_cursor,&n_range_start,&BSGS_N_double,1,NTHREADS);
+		if(FLAGBSGSMODE == 0 || FLAGBSGSMODE == 5)	{
+			checkpoint_cursor = &bsgs_cursor;
+			snprintf(checkpoint_mode,sizeof(checkpoint_mode),"%s %s",modes[FLAGMODE],bsgs_modes[FLAGBSGSMODE]);
+		}
+		if(FLAGRESUME)	{
+			if(checkpoint_cursor == NULL)	{
+				fprintf(stderr,"[E] --resume only works with the sequential and permuted modes\n");
+				exit(EXIT_FAILURE);
+			}
+			if(work_cursor_resume(&bsgs_cursor,&n_range_end,checkpoint_mode))	{
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(FLAGBSGSMODE == 5)	{
+			random_bytes((unsigned char*)&permuted_seed,sizeof(permuted_seed));
+			if(work_cursor_permute(&bsgs_cursor,&n_range_end,permuted_seed))	{
+				fprintf(stderr,"[E] -B permuted needs a range of less than 2^64 blocks of 2*N keys, use -r or -b\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if(bsgs_cursor.order.blocks != 0)	{
+			printf("[+] Permuted order of %" PRIu64 " blocks, seed %016" PRIx64 "\n",bsgs_cursor.order.blocks,bsgs_cursor.order.seed);
+		}
+
+		BSGS_MP = secp->ComputePublicKey(&BSGS_M);
+		BSGS_MP_double = secp->ComputePublicKey(&BSGS_M_double);
+		BSGS_MP2 = secp->ComputePublicKey(&BSGS_M2);
+		BSGS_MP2_double = secp->ComputePublicKey(&BSGS_M2_double);
+		BSGS_MP3 = secp->ComputePublicKey(&BSGS_M3);
+		BSGS_MP3_double = secp->ComputePublicKey(&BSGS_M3_double);
+
+		i= 0;
+
+		/* New aMP table just to keep the same code of JLP */
+		/* Auxiliar Points to speed up calculations for the main bloom filter check */
+		Point bsP = secp->Negation(BSGS_MP_double);
+		Point g = bsP;
+		GSn.resize(CPU_GRP_SIZE/2,g);
+		BSGS_AMP2.resize(32,g);
+		BSGS_AMP3.resize(32,g);
+		
+		GSn[0] = g;
+
+		g = secp->DoubleDirect(g);
+		GSn[1] = g;
+		
+		for(int i = 2; i < CPU_GRP_SIZE / 2; i++) {
+			g = secp->AddDirect(g,bsP);
+			GSn[i] = g;
+		}
+		
+		/* For next center point */
+		_2GSn = secp->DoubleDirect(GSn[CPU_GRP_SIZE / 2 - 1]);
+
+		i = 0;
+		point_temp.Set(BSGS_MP2);
+		BSGS_AMP2[0] = secp->Negation(point_temp);
+		BSGS_AMP2[0].Reduce();
+		point_temp.Set(BSGS_MP2_double);
+		point_temp = secp->Negation(point_temp);
+		point_temp.Reduce();
+		
+		for(i = 1; i < 32; i++)	{
+			BSGS_AMP2[i] = secp->AddDirect(BSGS_AMP2[i-1],point_temp);
+			BSGS_AMP2[i].Reduce();
+		}
+		
+		i  = 0;
+		point_temp.Set(BSGS_MP3);
+		BSGS_AMP3[0] = secp->Negation(point_temp);
+		BSGS_AMP3[0].Reduce();
+		point_temp.Set(BSGS_MP3_double);
+		point_temp = secp->Negation(point_temp);
+		point_temp.Reduce();
+
+		for(i = 1; i < 32; i++)	{
+			BSGS_AMP3[i] = secp->AddDirect(BSGS_AMP3[i-1],point_temp);
+			BSGS_AMP3[i].Reduce();
+		}
+
+		if(shared_name != NULL && FLAGOUTOFCORE)	{
+			fprintf(stderr,"[W] -O already shares the bP table file by the page cache, -T is ignored\n");
+			shared_name = NULL;
+		}
+		if(shared_name != NULL)	{
+			FLAGSHARED = bsgs_shared_attach(shared_name);
+		}
+	}
+	if(FLAGMODE == MODE_BSGS && !FLAGSHARED)	{
+		if(((uint64_t)(bsgs_m/bloom_bP_shards)) > 1000)	{
+			itemsbloom = (uint64_t)(bsgs_m / bloom_bP_shards);
+			if(bsgs_m % bloom_bP_shards != 0 )	{
 				itemsbloom++;
 			}
 		}
@@ -1217,28 +1722,16 @@ int main(int argc, char **argv)	{
 		}
 		
 		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m);
-		bloom_bP = (struct bloom*)calloc(256,sizeof(struct bloom));
+		bloom_bP = (struct bloom*)calloc(bloom_bP_shards,sizeof(struct bloom));
 		checkpointer((void *)bloom_bP,__FILE__,"calloc","bloom_bP" ,__LINE__ -1 );
-		bloom_bP_checksums = (struct checksumsha256*)calloc(256,sizeof(struct checksumsha256));
+		bloom_bP_checksums = (struct checksumsha256*)calloc(bloom_bP_shards,sizeof(struct checksumsha256));
 		checkpointer((void *)bloom_bP_checksums,__FILE__,"calloc","bloom_bP_checksums" ,__LINE__ -1 );
 		
-#if defined(_WIN64) && !defined(__CYGWIN__)
-		bloom_bP_mutex = (HANDLE*) calloc(256,sizeof(HANDLE));
-		
-#else
-		bloom_bP_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-#endif
-		checkpointer((void *)bloom_bP_mutex,__FILE__,"calloc","bloom_bP_mutex" ,__LINE__ -1 );
 		
 
 		fflush(stdout);
 		bloom_bP_totalbytes = 0;
-		for(i=0; i< 256; i++)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-			bloom_bP_mutex[i] = CreateMutex(NULL, FALSE, NULL);
-#else
-			pthread_mutex_init(&bloom_bP_mutex[i],NULL);
-#endif
+		for(i=0; i< (int)bloom_bP_shards; i++)	{
 			if(bloom_init2(&bloom_bP[i],itemsbloom,0.000001)	== 1){
 				fprintf(stderr,"[E] error bloom_init _ [%i]\n",i);
 				exit(EXIT_FAILURE);
@@ -1248,26 +1741,32 @@ int main(int argc, char **argv)	{
 		}
 		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP_totalbytes/(float)(uint64_t)1048576));
 
+		if(FLAGPREFILTER)	{
+			printf("[+] First level filter for %" PRIu64 " elements ",bsgs_m);
+			if(bloom_init_blocked(&bloom_bP_pre,bsgs_m,bloom_bP_pre_bytes) == 1)	{
+				fprintf(stderr,"[E] error bloom_init_blocked\n");
+				exit(EXIT_FAILURE);
+			}
+			printf(": %.2f MB, %i hashes\n",(float)((float)(uint64_t)bloom_bP_pre.bytes/(float)(uint64_t)1048576),bloom_bP_pre.hashes);
+			if(bloom_bP_pre.error > 0.5)	{
+				/* A filter that pass most of the points only adds one more cache miss */
+				fprintf(stderr,"[W] First level filter is too small, it pass %.1f%% of the points, disabling it\n",(double)bloom_bP_pre.error*100);
+				bloom_free(&bloom_bP_pre);
+				FLAGPREFILTER = 0;
+			}
+			else	{
+				printf("[+] First level filter pass rate %.2f%%, combined false positive rate %.3Lg (target %.3Lg)\n",(double)bloom_bP_pre.error*100,bloom_bP_pre.error * bloom_bP[0].error,bloom_bP[0].error);
+			}
+		}
 
 		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m2);
 		
-#if defined(_WIN64) && !defined(__CYGWIN__)
-		bloom_bPx2nd_mutex = (HANDLE*) calloc(256,sizeof(HANDLE));
-#else
-		bloom_bPx2nd_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-#endif
-		checkpointer((void *)bloom_bPx2nd_mutex,__FILE__,"calloc","bloom_bPx2nd_mutex" ,__LINE__ -1 );
 		bloom_bPx2nd = (struct bloom*)calloc(256,sizeof(struct bloom));
 		checkpointer((void *)bloom_bPx2nd,__FILE__,"calloc","bloom_bPx2nd" ,__LINE__ -1 );
 		bloom_bPx2nd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
 		checkpointer((void *)bloom_bPx2nd_checksums,__FILE__,"calloc","bloom_bPx2nd_checksums" ,__LINE__ -1 );
 		bloom_bP2_totalbytes = 0;
 		for(i=0; i< 256; i++)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-			bloom_bPx2nd_mutex[i] = CreateMutex(NULL, FALSE, NULL);
-#else
-			pthread_mutex_init(&bloom_bPx2nd_mutex[i],NULL);
-#endif
 			if(bloom_init2(&bloom_bPx2nd[i],itemsbloom2,0.000001)	== 1){
 				fprintf(stderr,"[E] error bloom_init _ [%i]\n",i);
 				exit(EXIT_FAILURE);
@@ -1278,138 +1777,59 @@ int main(int argc, char **argv)	{
 		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP2_totalbytes/(float)(uint64_t)1048576));
 		
 
-#if defined(_WIN64) && !defined(__CYGWIN__)
-		bloom_bPx3rd_mutex = (HANDLE*) calloc(256,sizeof(HANDLE));
-#else
-		bloom_bPx3rd_mutex = (pthread_mutex_t*) calloc(256,sizeof(pthread_mutex_t));
-#endif
-		checkpointer((void *)bloom_bPx3rd_mutex,__FILE__,"calloc","bloom_bPx3rd_mutex" ,__LINE__ -1 );
-		bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
-		checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
-		bloom_bPx3rd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
-		checkpointer((void *)bloom_bPx3rd_checksums,__FILE__,"calloc","bloom_bPx3rd_checksums" ,__LINE__ -1 );
+		if(!FLAGHASHINDEX)	{
+			bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
+			checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
+			bloom_bPx3rd_checksums = (struct checksumsha256*) calloc(256,sizeof(struct checksumsha256));
+			checkpointer((void *)bloom_bPx3rd_checksums,__FILE__,"calloc","bloom_bPx3rd_checksums" ,__LINE__ -1 );
 		
-		printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m3);
-		bloom_bP3_totalbytes = 0;
-		for(i=0; i< 256; i++)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-			bloom_bPx3rd_mutex[i] = CreateMutex(NULL, FALSE, NULL);
-#else
-			pthread_mutex_init(&bloom_bPx3rd_mutex[i],NULL);
-#endif
-			if(bloom_init2(&bloom_bPx3rd[i],itemsbloom3,0.000001)	== 1){
-				fprintf(stderr,"[E] error bloom_init [%i]\n",i);
-				exit(EXIT_FAILURE);
+			printf("[+] Bloom filter for %" PRIu64 " elements ",bsgs_m3);
+			bloom_bP3_totalbytes = 0;
+			for(i=0; i< 256; i++)	{
+				if(bloom_init2(&bloom_bPx3rd[i],itemsbloom3,0.000001)	== 1){
+					fprintf(stderr,"[E] error bloom_init [%i]\n",i);
+					exit(EXIT_FAILURE);
+				}
+				bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
+				//if(FLAGDEBUG) bloom_print(&bloom_bPx3rd[i]);
 			}
-			bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
-			//if(FLAGDEBUG) bloom_print(&bloom_bPx3rd[i]);
+			printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP3_totalbytes/(float)(uint64_t)1048576));
 		}
-		printf(": %.2f MB\n",(float)((float)(uint64_t)bloom_bP3_totalbytes/(float)(uint64_t)1048576));
 		//if(FLAGDEBUG) printf("[D] bloom_bP3_totalbytes : %" PRIu64 "\n",bloom_bP3_totalbytes);
 
-		BSGS_MP = secp->ComputePublicKey(&BSGS_M);
-		BSGS_MP_double = secp->ComputePublicKey(&BSGS_M_double);
-		BSGS_MP2 = secp->ComputePublicKey(&BSGS_M2);
-		BSGS_MP2_double = secp->ComputePublicKey(&BSGS_M2_double);
-		BSGS_MP3 = secp->ComputePublicKey(&BSGS_M3);
-		BSGS_MP3_double = secp->ComputePublicKey(&BSGS_M3_double);
-
-		i= 0;
-
-		/* New aMP table just to keep the same code of JLP */
-		/* Auxiliar Points to speed up calculations for the main bloom filter check */
-		Point bsP = secp->Negation(BSGS_MP_double);
-		Point g = bsP;
-		GSn.resize(CPU_GRP_SIZE/2,g);
-		BSGS_AMP2.resize(32,g);
-		BSGS_AMP3.resize(32,g);
-		
-		GSn[0] = g;
-
-		g = secp->DoubleDirect(g);
-		GSn[1] = g;
-		
-		for(int i = 2; i < CPU_GRP_SIZE / 2; i++) {
-			g = secp->AddDirect(g,bsP);
-			GSn[i] = g;
+		if(FLAGHASHINDEX)	{
+			if(FLAGOUTOFCORE)	{
+				fprintf(stderr,"[W] -O is only for the sorted bP table, the hash index stays in RAM\n");
+				FLAGOUTOFCORE = 0;
+			}
+			bsgs_hashindex_init();
+			FLAGREADEDFILE4 = 1;	/* There is no 3rd bloom filter to make */
+		}
+		else	{
+			bytes = (uint64_t)bsgs_m3 * (uint64_t) sizeof(struct bsgs_xvalue);
+			if(FLAGOUTOFCORE)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
+				FLAGREADEDFILE3 = bsgs_map_table(buffer_bloom_file);
+			}
+			else	{
+				printf("[+] Allocating %.2f MB for %" PRIu64  " bP Points\n",(double)(bytes/1048576),bsgs_m3);
+				
+				bPtable = (struct bsgs_xvalue*) malloc(bytes);
+				checkpointer((void *)bPtable,__FILE__,"malloc","bPtable" ,__LINE__ -1 );
+				memset(bPtable,0,bytes);
+			}
 		}
 		
-		/* For next center point */
-		_2GSn = secp->DoubleDirect(GSn[CPU_GRP_SIZE / 2 - 1]);
+		if(FLAGSAVEREADFILE)	{
+			/*Reading file for 1st bloom filter */
 
-		i = 0;
-		point_temp.Set(BSGS_MP2);
-		BSGS_AMP2[0] = secp->Negation(point_temp);
-		BSGS_AMP2[0].Reduce();
-		point_temp.Set(BSGS_MP2_double);
-		point_temp = secp->Negation(point_temp);
-		point_temp.Reduce();
-		
-		for(i = 1; i < 32; i++)	{
-			BSGS_AMP2[i] = secp->AddDirect(BSGS_AMP2[i-1],point_temp);
-			BSGS_AMP2[i].Reduce();
-		}
-		
-		i  = 0;
-		point_temp.Set(BSGS_MP3);
-		BSGS_AMP3[0] = secp->Negation(point_temp);
-		BSGS_AMP3[0].Reduce();
-		point_temp.Set(BSGS_MP3_double);
-		point_temp = secp->Negation(point_temp);
-		point_temp.Reduce();
-
-		for(i = 1; i < 32; i++)	{
-			BSGS_AMP3[i] = secp->AddDirect(BSGS_AMP3[i-1],point_temp);
-			BSGS_AMP3[i].Reduce();
-		}
-
-		bytes = (uint64_t)bsgs_m3 * (uint64_t) sizeof(struct bsgs_xvalue);
-		printf("[+] Allocating %.2f MB for %" PRIu64  " bP Points\n",(double)(bytes/1048576),bsgs_m3);
-		
-		bPtable = (struct bsgs_xvalue*) malloc(bytes);
-		checkpointer((void *)bPtable,__FILE__,"malloc","bPtable" ,__LINE__ -1 );
-		memset(bPtable,0,bytes);
-		
-		if(FLAGSAVEREADFILE)	{
-			/*Reading file for 1st bloom filter */
-
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
-			fd_aux1 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux1 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bP[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bP[i],sizeof(struct bloom),1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					bloom_bP[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					readed = fread(&bloom_bP_checksums[i],sizeof(struct checksumsha256),1,fd_aux1);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					if(FLAGSKIPCHECKSUM == 0)	{
-						sha256((uint8_t*)bloom_bP[i].bf,bloom_bP[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bP_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bP_checksums[i].backup,rawvalue,32) != 0 )	{	/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-					}
-					if(i % 64 == 0 )	{
-						printf(".");
-						fflush(stdout);
-					}
-				}
-				printf(" Done!\n");
-				fclose(fd_aux1);
+			if(bloom_bP_shards == 256)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
+			}
+			else	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 "_%" PRIu32 ".blm",bsgs_m,bloom_bP_shards);
+			}
+			if(bsgs_read_blooms(buffer_bloom_file,bloom_bP,bloom_bP_checksums,bloom_bP_shards,bsgs_m))	{
 				memset(buffer_bloom_file,0,1024);
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_3_%" PRIu64 ".blm",bsgs_m);
 				fd_aux1 = fopen(buffer_bloom_file,"rb");
@@ -1419,7 +1839,7 @@ int main(int argc, char **argv)	{
 				}
 				FLAGREADEDFILE1 = 1;
 			}
-			else	{	/*Checking for old file    keyhunt_bsgs_3_   */
+			else if(bloom_bP_shards == 256)	{	/*Checking for old file    keyhunt_bsgs_3_   */
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_3_%" PRIu64 ".blm",bsgs_m);
 				fd_aux1 = fopen(buffer_bloom_file,"rb");
 				if(fd_aux1 != NULL)	{
@@ -1427,6 +1847,7 @@ int main(int argc, char **argv)	{
 					fflush(stdout);
 					for(i = 0; i < 256;i++)	{
 						bf_ptr = (char*) bloom_bP[i].bf;	/*We need to save the current bf pointer*/
+						bf_bytes = bloom_bP[i].bytes;
 						readed = fread(&oldbloom_bP,sizeof(struct oldbloom),1,fd_aux1);
 						
 						/*
@@ -1442,6 +1863,10 @@ int main(int argc, char **argv)	{
 						}
 						memcpy(&bloom_bP[i],&oldbloom_bP,sizeof(struct bloom));//We only need to copy the part data to the new bloom size, not from the old size
 						bloom_bP[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
+						if(bloom_bP[i].bytes != bf_bytes)	{
+							fprintf(stderr,"[E] The file %s was made with other bloom size, please delete it\n",buffer_bloom_file);
+							exit(EXIT_FAILURE);
+						}
 						
 						readed = fread(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
 						if(readed != 1)	{
@@ -1475,45 +1900,20 @@ int main(int argc, char **argv)	{
 				}
 			}
 			
+			if(FLAGPREFILTER)	{
+				/*Reading file for the first level filter */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_8_%" PRIu64 "_%" PRIu64 ".blm",bsgs_m,bloom_bP_pre.bytes);
+				if(bsgs_read_blooms(buffer_bloom_file,&bloom_bP_pre,&bloom_bP_pre_checksum,1,bsgs_m))	{
+					FLAGREADEDFILE5 = 1;
+				}
+				else	{
+					FLAGREADEDFILE5 = 0;
+				}
+			}
+			
 			/*Reading file for 2nd bloom filter */
 			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_6_%" PRIu64 ".blm",bsgs_m2);
-			fd_aux2 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux2 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bPx2nd[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bPx2nd[i],sizeof(struct bloom),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					bloom_bPx2nd[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					readed = fread(&bloom_bPx2nd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					memset(rawvalue,0,32);
-					if(FLAGSKIPCHECKSUM == 0)	{								
-						sha256((uint8_t*)bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bPx2nd_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bPx2nd_checksums[i].backup,rawvalue,32) != 0 )	{		/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-					}
-					if(i % 64 == 0)	{
-						printf(".");
-						fflush(stdout);
-					}
-				}
-				fclose(fd_aux2);
-				printf(" Done!\n");
+			if(bsgs_read_blooms(buffer_bloom_file,bloom_bPx2nd,bloom_bPx2nd_checksums,256,bsgs_m2))	{
 				memset(buffer_bloom_file,0,1024);
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_5_%" PRIu64 ".blm",bsgs_m2);
 				fd_aux2 = fopen(buffer_bloom_file,"rb");
@@ -1534,86 +1934,33 @@ int main(int argc, char **argv)	{
 				FLAGREADEDFILE2 = 0;
 			}
 			
-			/*Reading file for bPtable */
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
-			fd_aux3 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux3 != NULL)	{
-				printf("[+] Reading bP Table from file %s .",buffer_bloom_file);
-				fflush(stdout);
-				rsize = fread(bPtable,bytes,1,fd_aux3);
-				if(rsize != 1)	{
-					fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
-				rsize = fread(checksum,32,1,fd_aux3);
-				if(rsize != 1)	{
-					fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
-				if(FLAGSKIPCHECKSUM == 0)	{
-					sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
-					if(memcmp(checksum,checksum_backup,32) != 0)	{
-						fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-				}
-				printf("... Done!\n");
-				fclose(fd_aux3);
-				FLAGREADEDFILE3 = 1;
+			if(FLAGHASHINDEX)	{
+				/*Reading file for the hash index */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_9_%" PRIu64 ".tbl",bsgs_m3);
+				FLAGREADEDFILE3 = bsgs_read_hashindex(buffer_bloom_file);
 			}
 			else	{
-				FLAGREADEDFILE3 = 0;
-			}
-			
-			/*Reading file for 3rd bloom filter */
-			snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
-			fd_aux2 = fopen(buffer_bloom_file,"rb");
-			if(fd_aux2 != NULL)	{
-				printf("[+] Reading bloom filter from file %s ",buffer_bloom_file);
-				fflush(stdout);
-				for(i = 0; i < 256;i++)	{
-					bf_ptr = (char*) bloom_bPx3rd[i].bf;	/*We need to save the current bf pointer*/
-					readed = fread(&bloom_bPx3rd[i],sizeof(struct bloom),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					bloom_bPx3rd[i].bf = (uint8_t*)bf_ptr;	/* Restoring the bf pointer*/
-					readed = fread(bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					readed = fread(&bloom_bPx3rd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error reading the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					memset(rawvalue,0,32);
-					if(FLAGSKIPCHECKSUM == 0)	{							
-						sha256((uint8_t*)bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,(uint8_t*)rawvalue);
-						if(memcmp(bloom_bPx3rd_checksums[i].data,rawvalue,32) != 0 || memcmp(bloom_bPx3rd_checksums[i].backup,rawvalue,32) != 0 )	{		/* Verification */
-							fprintf(stderr,"[E] Error checksum file mismatch! %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-					}
-					if(i % 64 == 0)	{
-						printf(".");
-						fflush(stdout);
-					}
+				if(!FLAGOUTOFCORE)	{
+					/*Reading file for bPtable */
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
+					FLAGREADEDFILE3 = bsgs_read_table(buffer_bloom_file);
+				}
+				
+				/*Reading file for 3rd bloom filter */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
+				if(bsgs_read_blooms(buffer_bloom_file,bloom_bPx3rd,bloom_bPx3rd_checksums,256,bsgs_m3))	{
+					FLAGREADEDFILE4 = 1;
+				}
+				else	{
+					FLAGREADEDFILE4 = 0;
 				}
-				fclose(fd_aux2);
-				printf(" Done!\n");
-				FLAGREADEDFILE4 = 1;
-			}
-			else	{
-				FLAGREADEDFILE4 = 0;
 			}
 			
 		}
 		
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE3 || !FLAGREADEDFILE4)	{
-			if(FLAGREADEDFILE1 == 1)	{
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE3 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
+			clock_gettime(CLOCK_MONOTONIC,&bPload_start);
+			if(FLAGREADEDFILE1 == 1 && (!FLAGPREFILTER || FLAGREADEDFILE5))	{
 				/* 
 					We need just to make File 2 to File 4 this is
 					- Second bloom filter 5%
@@ -1717,7 +2064,7 @@ int main(int argc, char **argv)	{
 							FINISHED_THREADS_COUNTER++;
 						}
 					}
-					
+					sleep_ms(10);	/* Don't steal a core from the workers while we wait */
 				}while(FINISHED_THREADS_COUNTER < THREADCYCLES);
 				printf("\r[+] processing %lu/%lu bP points : 100%%     \n",bsgs_m2,bsgs_m2);
 				
@@ -1832,7 +2179,7 @@ int main(int argc, char **argv)	{
 							FINISHED_THREADS_COUNTER++;
 						}
 					}
-					
+					sleep_ms(10);	/* Don't steal a core from the workers while we wait */
 				}while(FINISHED_THREADS_COUNTER < THREADCYCLES);
 				printf("\r[+] processing %lu/%lu bP points : 100%%     \n",bsgs_m,bsgs_m);
 				
@@ -1841,14 +2188,17 @@ int main(int argc, char **argv)	{
 				free(bPload_temp_ptr);
 				free(bPload_threads_available);
 			}
+			clock_gettime(CLOCK_MONOTONIC,&bPload_end);
+			bPload_seconds = (double)(bPload_end.tv_sec - bPload_start.tv_sec) + (double)(bPload_end.tv_nsec - bPload_start.tv_nsec) / 1000000000.0;
+			printf("[+] bP points processed in %.2f seconds with %i threads: %.2f Mkeys/s\n",bPload_seconds,NTHREADS,(double)FINISHED_ITEMS / bPload_seconds / 1000000.0);
 		}
 		
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4)	{
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
 			printf("[+] Making checkums .. ");
 			fflush(stdout);
 		}	
 		if(!FLAGREADEDFILE1)	{
-			for(i = 0; i < 256 ; i++)	{
+			for(i = 0; i < (int)bloom_bP_shards ; i++)	{
 				sha256((uint8_t*)bloom_bP[i].bf, bloom_bP[i].bytes,(uint8_t*) bloom_bP_checksums[i].data);
 				memcpy(bloom_bP_checksums[i].backup,bloom_bP_checksums[i].data,32);
 			}
@@ -1868,170 +2218,95 @@ int main(int argc, char **argv)	{
 			}
 			printf(".");
 		}
-		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4)	{
+		if(FLAGPREFILTER && !FLAGREADEDFILE5)	{
+			sha256((uint8_t*)bloom_bP_pre.bf, bloom_bP_pre.bytes,(uint8_t*) bloom_bP_pre_checksum.data);
+			memcpy(bloom_bP_pre_checksum.backup,bloom_bP_pre_checksum.data,32);
+			printf(".");
+		}
+		if(!FLAGREADEDFILE1 || !FLAGREADEDFILE2 || !FLAGREADEDFILE4 || (FLAGPREFILTER && !FLAGREADEDFILE5))	{
 			printf(" done\n");
 			fflush(stdout);
 		}	
-		if(!FLAGREADEDFILE3)	{
-			printf("[+] Sorting %lu elements... ",bsgs_m3);
-			fflush(stdout);
-			bsgs_sort(bPtable,bsgs_m3);
-			sha256((uint8_t*)bPtable, bytes,(uint8_t*) checksum);
-			memcpy(checksum_backup,checksum,32);
-			printf("Done!\n");
-			fflush(stdout);
+		if(FLAGHASHINDEX)	{
+			if(!FLAGREADEDFILE3)	{
+				sha256((uint8_t*)hashindex, bytes,(uint8_t*) checksum);
+				memcpy(checksum_backup,checksum,32);
+			}
+		}
+		else	{
+			if(!FLAGREADEDFILE3)	{
+				printf("[+] Sorting %lu elements... ",bsgs_m3);
+				fflush(stdout);
+				if(FLAGOUTOFCORE)	{
+					bsgs_sort_mapped();
+				}
+				else	{
+					bsgs_sort(bPtable,bsgs_m3);
+				}
+				sha256((uint8_t*)bPtable, bytes,(uint8_t*) checksum);
+				memcpy(checksum_backup,checksum,32);
+				printf("Done!\n");
+				fflush(stdout);
+				if(FLAGOUTOFCORE)	{
+					bsgs_sync_table();
+				}
+			}
+			bsgs_build_directory(bPtable,bsgs_m3);
 		}
 		if(FLAGSAVEREADFILE || FLAGUPDATEFILE1 )	{
 			if(!FLAGREADEDFILE1 || FLAGUPDATEFILE1)	{
-				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
-				
+				if(bloom_bP_shards == 256)	{
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 ".blm",bsgs_m);
+				}
+				else	{
+					snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_4_%" PRIu64 "_%" PRIu32 ".blm",bsgs_m,bloom_bP_shards);
+				}
 				if(FLAGUPDATEFILE1)	{
 					printf("[W] Updating old file into a new one\n");
 				}
-				
 				/* Writing file for 1st bloom filter */
-				
-				fd_aux1 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux1 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bP[i],sizeof(struct bloom),1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(bloom_bP[i].bf,bloom_bP[i].bytes,1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(&bloom_bP_checksums[i],sizeof(struct checksumsha256),1,fd_aux1);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux1);
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bP,bloom_bP_checksums,bloom_bP_shards,bsgs_m);
+			}
+			if(FLAGPREFILTER && !FLAGREADEDFILE5)	{
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_8_%" PRIu64 "_%" PRIu64 ".blm",bsgs_m,bloom_bP_pre.bytes);
+
+				/* Writing file for the first level filter */
+				bsgs_write_blooms(buffer_bloom_file,&bloom_bP_pre,&bloom_bP_pre_checksum,1,bsgs_m);
 			}
 			if(!FLAGREADEDFILE2  )	{
 				
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_6_%" PRIu64 ".blm",bsgs_m2);
 								
 				/* Writing file for 2nd bloom filter */
-				fd_aux2 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux2 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bPx2nd[i],sizeof(struct bloom),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(bloom_bPx2nd[i].bf,bloom_bPx2nd[i].bytes,1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(&bloom_bPx2nd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux2);	
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bPx2nd,bloom_bPx2nd_checksums,256,bsgs_m2);
 			}
 			
-			if(!FLAGREADEDFILE3)	{
+			if(FLAGHASHINDEX && !FLAGREADEDFILE3)	{
+				/* Writing file for the hash index */
+				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_9_%" PRIu64 ".tbl",bsgs_m3);
+				bsgs_write_hashindex(buffer_bloom_file);
+			}
+			if(!FLAGHASHINDEX && !FLAGOUTOFCORE && (!FLAGREADEDFILE3 || FLAGUPDATEFILE3))	{
 				/* Writing file for bPtable */
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_2_%" PRIu64 ".tbl",bsgs_m3);
-				fd_aux3 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux3 != NULL)	{
-					printf("[+] Writing bP Table to file %s .. ",buffer_bloom_file);
-					fflush(stdout);
-					readed = fwrite(bPtable,bytes,1,fd_aux3);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					readed = fwrite(checksum,32,1,fd_aux3);
-					if(readed != 1)	{
-						fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-						exit(EXIT_FAILURE);
-					}
-					printf("Done!\n");
-					fclose(fd_aux3);	
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
+				bsgs_write_table(buffer_bloom_file);
 			}
 			if(!FLAGREADEDFILE4)	{
 				snprintf(buffer_bloom_file,1024,"keyhunt_bsgs_7_%" PRIu64 ".blm",bsgs_m3);
 								
 				/* Writing file for 3rd bloom filter */
-				fd_aux2 = fopen(buffer_bloom_file,"wb");
-				if(fd_aux2 != NULL)	{
-					printf("[+] Writing bloom filter to file %s ",buffer_bloom_file);
-					fflush(stdout);
-					for(i = 0; i < 256;i++)	{
-						readed = fwrite(&bloom_bPx3rd[i],sizeof(struct bloom),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(bloom_bPx3rd[i].bf,bloom_bPx3rd[i].bytes,1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						readed = fwrite(&bloom_bPx3rd_checksums[i],sizeof(struct checksumsha256),1,fd_aux2);
-						if(readed != 1)	{
-							fprintf(stderr,"[E] Error writing the file %s please delete it\n",buffer_bloom_file);
-							exit(EXIT_FAILURE);
-						}
-						if(i % 64 == 0)	{
-							printf(".");
-							fflush(stdout);
-						}
-					}
-					printf(" Done!\n");
-					fclose(fd_aux2);
-				}
-				else	{
-					fprintf(stderr,"[E] Error can't create the file %s\n",buffer_bloom_file);
-					exit(EXIT_FAILURE);
-				}
+				bsgs_write_blooms(buffer_bloom_file,bloom_bPx3rd,bloom_bPx3rd_checksums,256,bsgs_m3);
 			}
 		}
-
+		if(shared_name != NULL)	{
+			bsgs_shared_create(shared_name);
+		}
+	}
+	if(FLAGMODE == MODE_BSGS)	{
 
 		i = 0;
 
-		steps = (uint64_t *) calloc(NTHREADS,sizeof(uint64_t));
-		checkpointer((void *)steps,__FILE__,"calloc","steps" ,__LINE__ -1 );
+		telemetry = new struct tier_counters[NTHREADS]();
 		ends = (unsigned int *) calloc(NTHREADS,sizeof(int));
 		checkpointer((void *)ends,__FILE__,"calloc","ends" ,__LINE__ -1 );
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -2049,6 +2324,7 @@ int main(int argc, char **argv)	{
 			switch(FLAGBSGSMODE)	{
 #if defined(_WIN64) && !defined(__CYGWIN__)
 				case 0:
+				case 5:
 					tid[i] = CreateThread(NULL, 0, thread_process_bsgs, (void*)tt, 0, &s);
 					break;
 				case 1:
@@ -2067,6 +2343,7 @@ int main(int argc, char **argv)	{
 #else
 
 				case 0:
+				case 5:
 					s = pthread_create(&tid[i],NULL,thread_process_bsgs,(void *)tt);
 				break;
 				case 1:
@@ -2098,8 +2375,33 @@ int main(int argc, char **argv)	{
 	}
 	if(FLAGMODE != MODE_BSGS)	{
 		//if(FLAGDEBUG) { printf("[D] File: %s Line %i\n",__FILE__,__LINE__); fflush(stdout); }
-		steps = (uint64_t *) calloc(NTHREADS,sizeof(uint64_t));
-		checkpointer((void *)steps,__FILE__,"calloc","steps" ,__LINE__ -1 );
+		int_aux.SetInt64(N_SEQUENTIAL_MAX);
+		work_cursor_init(&range_cursor,&n_range_start,&int_aux,WORK_LEASE_BLOCKS,NTHREADS);
+		if(!FLAGRANDOM && FLAGMODE != MODE_MINIKEYS)	{
+			checkpoint_cursor = &range_cursor;
+			snprintf(checkpoint_mode,sizeof(checkpoint_mode),"%s %s",modes[FLAGMODE],(FLAGBSGSMODE == 5) ? "permuted" : "sequential");
+		}
+		if(FLAGRESUME)	{
+			if(checkpoint_cursor == NULL)	{
+				fprintf(stderr,"[E] --resume only works with the sequential and permuted modes\n");
+				exit(EXIT_FAILURE);
+			}
+			if(work_cursor_resume(&range_cursor,&n_range_end,checkpoint_mode))	{
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(FLAGBSGSMODE == 5 && checkpoint_cursor != NULL)	{
+			random_bytes((unsigned char*)&permuted_seed,sizeof(permuted_seed));
+			if(work_cursor_permute(&range_cursor,&n_range_end,permuted_seed))	{
+				fprintf(stderr,"[E] -B permuted needs a range of less than 2^64 blocks of N keys, use -r or -b\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if(range_cursor.order.blocks != 0)	{
+			printf("[+] Permuted order of %" PRIu64 " blocks, seed %016" PRIx64 "\n",range_cursor.order.blocks,range_cursor.order.seed);
+		}
+		telemetry = new struct tier_counters[NTHREADS]();
+		telemetry_names[TIER_BP] = "bloom";
 		ends = (unsigned int *) calloc(NTHREADS,sizeof(int));
 		checkpointer((void *)ends,__FILE__,"calloc","ends" ,__LINE__ -1 );
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -2113,7 +2415,6 @@ int main(int argc, char **argv)	{
 			tt = (tothread*) malloc(sizeof(struct tothread));
 			checkpointer((void *)tt,__FILE__,"malloc","tt" ,__LINE__ -1 );
 			tt->nt = i;
-			steps[i] = 0;
 			s = 0;
 			switch(FLAGMODE)	{
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -2156,6 +2457,16 @@ int main(int argc, char **argv)	{
 			}
 		}
 	}
+#if !defined(_WIN64) || defined(__CYGWIN__)
+	if(metrics_port)	{
+		pthread_t metrics_tid;
+		if(pthread_create(&metrics_tid,NULL,thread_metrics,NULL) != 0)	{
+			fprintf(stderr,"[E] pthread_create thread_metrics\n");
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(metrics_tid);
+	}
+#endif
 	i = 0;
 	
 	while(i < 7)	{
@@ -2163,6 +2474,14 @@ int main(int argc, char **argv)	{
 		i++;
 	}
 	
+	if(checkpoint_fileName != NULL)	{
+		if(checkpoint_cursor == NULL)	{
+			fprintf(stderr,"[W] --checkpoint only works with the sequential and permuted modes, it is ignored\n");
+		}
+		else	{
+			printf("[+] Checkpoint every %i seconds in %s\n",CHECKPOINT_SECONDS,checkpoint_fileName);
+		}
+	}
 	continue_flag = 1;
 	total.SetInt32(0);
 	pretotal.SetInt32(0);
@@ -2171,6 +2490,10 @@ int main(int argc, char **argv)	{
 	do	{
 		sleep_ms(1000);
 		seconds.AddOne();
+		if(checkpoint_fileName != NULL && checkpoint_cursor != NULL && ++checkpoint_timer >= CHECKPOINT_SECONDS)	{
+			checkpoint_timer = 0;
+			work_cursor_save(checkpoint_cursor,&n_range_end,checkpoint_mode);
+		}
 		check_flag = 1;
 		for(i = 0; i <NTHREADS && check_flag; i++) {
 			check_flag &= ends[i];
@@ -2186,7 +2509,7 @@ int main(int argc, char **argv)	{
 				i = 0;
 				while(i < NTHREADS) {
 					pretotal.Set(&debugcount_mpz);
-					pretotal.Mult(steps[i]);					
+					pretotal.Mult(telemetry[i].steps);					
 					total.Add(&pretotal);
 					i++;
 				}
@@ -2205,23 +2528,19 @@ int main(int argc, char **argv)	{
 					}
 				}
 				
-#ifdef _WIN64
-				WaitForSingleObject(bsgs_thread, INFINITE);
-#else
-				pthread_mutex_lock(&bsgs_thread);
-#endif			
 				pretotal.Set(&total);
 				pretotal.Div(&seconds);
 				str_seconds = seconds.GetBase10();
 				str_pretotal = pretotal.GetBase10();
 				str_total = total.GetBase10();
+				telemetry_line(str_telemetry,sizeof(str_telemetry));
 				
 				if(pretotal.IsLower(&int_limits[0]))	{
 					if(FLAGMATRIX)	{
-						sprintf(buffer,"[+] Total %s keys in %s seconds: %s keys/s\n",str_total,str_seconds,str_pretotal);
+						sprintf(buffer,"[+] Total %s keys in %s seconds: %s keys/s%s\n",str_total,str_seconds,str_pretotal,str_telemetry);
 					}
 					else	{
-						sprintf(buffer,"\r[+] Total %s keys in %s seconds: %s keys/s\r",str_total,str_seconds,str_pretotal);
+						sprintf(buffer,"\r[+] Total %s keys in %s seconds: %s keys/s%s\r",str_total,str_seconds,str_pretotal,str_telemetry);
 					}
 				}
 				else	{
@@ -2240,14 +2559,14 @@ int main(int argc, char **argv)	{
 					div_pretotal.Div(&int_limits[salir ? i : i-1]);
 					str_divpretotal = div_pretotal.GetBase10();
 					if(FLAGMATRIX)	{
-						sprintf(buffer,"[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)\n",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal);
+						sprintf(buffer,"[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)%s\n",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal,str_telemetry);
 					}
 					else	{
 						if(THREADOUTPUT == 1)	{
-							sprintf(buffer,"\r[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)\r",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal);
+							sprintf(buffer,"\r[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)%s\r",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal,str_telemetry);
 						}
 						else	{
-							sprintf(buffer,"\r[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)\r",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal);
+							sprintf(buffer,"\r[+] Total %s keys in %s seconds: ~%s %s (%s keys/s)%s\r",str_total,str_seconds,str_divpretotal,str_limits_prefixs[salir ? i : i-1],str_pretotal,str_telemetry);
 						}
 					}
 					free(str_divpretotal);
@@ -2255,12 +2574,10 @@ int main(int argc, char **argv)	{
 				}
 				printf("%s",buffer);
 				fflush(stdout);
-				THREADOUTPUT = 0;			
-#ifdef _WIN64
-				ReleaseMutex(bsgs_thread);
-#else
-				pthread_mutex_unlock(&bsgs_thread);
-#endif
+				THREADOUTPUT = 0;
+				if(telemetry_file != NULL)	{
+					telemetry_dump(telemetry_file);
+				}			
 
 				free(str_seconds);
 				free(str_pretotal);
@@ -2268,6 +2585,9 @@ int main(int argc, char **argv)	{
 			}
 		}
 	}while(continue_flag);
+	if(checkpoint_fileName != NULL && checkpoint_cursor != NULL)	{
+		work_cursor_save(checkpoint_cursor,&n_range_end,checkpoint_mode);
+	}
 	printf("\nEnd\n");
 #ifdef _WIN64
 	CloseHandle(write_keys);
@@ -2326,29 +2646,71 @@ char *pubkeytopubaddress(char *pkey,int length)	{
 	return pubaddress;	// pubaddress need to be free by te caller funtion
 }
 
+/*
+	Same directory of bsgs_build_directory for the sorted addressTable
+*/
+void address_build_directory(struct address_value *buffer,int64_t array_length)	{
+	int64_t i = 0;
+	uint32_t p;
+	if(addressTable_directory == NULL)	{
+		addressTable_directory = (uint64_t*) malloc(sizeof(uint64_t)*(SEARCH_DIRECTORY_SIZE+1));
+		checkpointer((void *)addressTable_directory,__FILE__,"malloc","addressTable_directory" ,__LINE__ -1 );
+	}
+	for(p = 0; p < SEARCH_DIRECTORY_SIZE; p++)	{
+		while(i < array_length && search_prefix(buffer[i].value) < p)	{
+			i++;
+		}
+		addressTable_directory[p] = i;
+	}
+	addressTable_directory[SEARCH_DIRECTORY_SIZE] = array_length;
+}
+
+/*
+	Directory bucket and interpolation search, same as bsgs_searchbinary
+*/
 int searchbinary(struct address_value *buffer,char *data,int64_t array_length) {
-	int64_t half,min,max,current;
-	int r = 0,rcmp;
-	min = 0;
-	current = 0;
-	max = array_length;
-	half = array_length;
-	while(!r && half >= 1) {
-		half = (max - min)/2;
-		rcmp = memcmp(data,buffer[current+half].value,20);
+	int64_t min,max,current;
+	uint32_t key,low,high;
+	int r = 0,rcmp,probes = 0;
+	uint8_t *value = (uint8_t *)data;
+	if(addressTable_directory != NULL)	{
+		min = addressTable_directory[search_prefix(value)];
+		max = addressTable_directory[search_prefix(value)+1];
+	}
+	else	{
+		min = 0;
+		max = array_length;
+	}
+	key = search_key(value);
+	while(!r && min < max) {
+		current = min + (max - min)/2;
+		if(addressTable_directory != NULL && probes < SEARCH_INTERPOLATION_PROBES && max - min > 8)	{
+			low = search_key(buffer[min].value);
+			high = search_key(buffer[max-1].value);
+			if(key < low || key > high)	{
+				break;
+			}
+			if(low != high)	{
+				current = min + (int64_t)((double)(key - low) / (double)(high - low) * (double)(max - 1 - min));
+			}
+			probes++;
+		}
+		rcmp = memcmp(value,buffer[current].value,20);
 		if(rcmp == 0)	{
 			r = 1;	//Found!!
 		}
 		else	{
 			if(rcmp < 0) { //data < temp_read
-				max = (max-half);
+				max = current;
 			}
 			else	{ // data > temp_read
-				min = (min+half);
+				min = current + 1;
 			}
-			current = min;
 		}
 	}
+	thread_telemetry->probes[TIER_TABLE]++;
+	thread_telemetry->hits[TIER_TABLE] += r;
+	thread_telemetry->matches += r;
 	return r;
 }
 
@@ -2371,6 +2733,7 @@ void *thread_process_minikeys(void *vargp)	{
 	//Int counter;
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	//rawbuffer = (char*) &counter.bits64;
 	count_valid = 0;
@@ -2483,7 +2846,7 @@ void *thread_process_minikeys(void *vargp)	{
 					secp->GetHash160(P2PKH,false,publickey[0],publickey[1],publickey[2],publickey[3],(uint8_t*)publickeyhashrmd160_uncompress[0],(uint8_t*)publickeyhashrmd160_uncompress[1],(uint8_t*)publickeyhashrmd160_uncompress[2],(uint8_t*)publickeyhashrmd160_uncompress[3]);
 					
 					for(k = 0; k < 4; k++)	{
-						r = bloom_check(&bloom,publickeyhashrmd160_uncompress[k],20);
+						r = address_bloomcheck(publickeyhashrmd160_uncompress[k],20);
 						if(r) {
 							r = searchbinary(addressTable,publickeyhashrmd160_uncompress[k],N);
 							if(r) {
@@ -2515,7 +2878,7 @@ void *thread_process_minikeys(void *vargp)	{
 						}
 					}
 				}
-				steps[thread_number]++;
+				telemetry[thread_number].steps++;
 				count+=1024;
 			}while(count < N_SEQUENTIAL_MAX && continue_flag);
 		}
@@ -2563,6 +2926,7 @@ void *thread_process(void *vargp)	{
 	Int key_mpz,keyfound,temp_stride;
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	grp->Set(dx);
 
@@ -2571,20 +2935,8 @@ void *thread_process(void *vargp)	{
 			key_mpz.Rand(&n_range_start,&n_range_end);
 		}
 		else	{
-			if(n_range_start.IsLower(&n_range_end))	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-				WaitForSingleObject(write_random, INFINITE);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				ReleaseMutex(write_random);
-#else
-				pthread_mutex_lock(&write_random);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				pthread_mutex_unlock(&write_random);
-#endif
-			}
-			else	{
+			work_cursor_take(&range_cursor,thread_number,&key_mpz);
+			if(!key_mpz.IsLower(&n_range_end))	{
 				continue_flag = 0;
 			}
 		}
@@ -2813,7 +3165,7 @@ void *thread_process(void *vargp)	{
 									if(FLAGSEARCH == SEARCH_COMPRESS || FLAGSEARCH == SEARCH_BOTH){
 										if(FLAGENDOMORPHISM)	{
 											for(l = 0;l < 6; l++)	{
-												r = bloom_check(&bloom,publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
+												r = address_bloomcheck(publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
 												if(r) {
 													r = searchbinary(addressTable,publickeyhashrmd160_endomorphism[l][k],N);
 													if(r) {
@@ -2876,7 +3228,7 @@ void *thread_process(void *vargp)	{
 										}
 										else	{
 											for(l = 0;l < 2; l++)	{
-												r = bloom_check(&bloom,publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
+												r = address_bloomcheck(publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
 												if(r) {
 													r = searchbinary(addressTable,publickeyhashrmd160_endomorphism[l][k],N);
 													if(r) {
@@ -2900,7 +3252,7 @@ void *thread_process(void *vargp)	{
 									if(FLAGSEARCH == SEARCH_UNCOMPRESS || FLAGSEARCH == SEARCH_BOTH)	{
 										if(FLAGENDOMORPHISM)	{
 											for(l = 6;l < 12; l++)	{	//We check the array from 6 to 12(excluded) because we save the uncompressed information there
-												r = bloom_check(&bloom,publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);	//Check in Bloom filter
+												r = address_bloomcheck(publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);	//Check in Bloom filter
 												if(r) {
 													r = searchbinary(addressTable,publickeyhashrmd160_endomorphism[l][k],N);		//Check in Array using Binary search
 													if(r) {
@@ -2944,7 +3296,7 @@ void *thread_process(void *vargp)	{
 											}
 										}
 										else	{
-											r = bloom_check(&bloom,publickeyhashrmd160_uncompress[k],MAXLENGTHADDRESS);
+											r = address_bloomcheck(publickeyhashrmd160_uncompress[k],MAXLENGTHADDRESS);
 											if(r) {
 												r = searchbinary(addressTable,publickeyhashrmd160_uncompress[k],N);
 												if(r) {
@@ -2964,7 +3316,7 @@ void *thread_process(void *vargp)	{
 								if(FLAGENDOMORPHISM)	{
 									for(k = 0; k < 4;k++)	{
 										for(l = 0;l < 6; l++)	{
-											r = bloom_check(&bloom,publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
+											r = address_bloomcheck(publickeyhashrmd160_endomorphism[l][k],MAXLENGTHADDRESS);
 											if(r) {
 												r = searchbinary(addressTable,publickeyhashrmd160_endomorphism[l][k],N);
 												if(r) {												
@@ -3010,7 +3362,7 @@ void *thread_process(void *vargp)	{
 								}
 								else	{
 									for(k = 0; k < 4;k++)	{
-										r = bloom_check(&bloom,publickeyhashrmd160_uncompress[k],MAXLENGTHADDRESS);
+										r = address_bloomcheck(publickeyhashrmd160_uncompress[k],MAXLENGTHADDRESS);
 										if(r) {
 											r = searchbinary(addressTable,publickeyhashrmd160_uncompress[k],N);
 											if(r) {
@@ -3028,7 +3380,7 @@ void *thread_process(void *vargp)	{
 							for(k = 0; k < 4;k++)	{
 								if(FLAGENDOMORPHISM)	{
 									pts[(4*j)+k].x.Get32Bytes((unsigned char *)rawvalue);
-									r = bloom_check(&bloom,rawvalue,MAXLENGTHADDRESS);
+									r = address_bloomcheck(rawvalue,MAXLENGTHADDRESS);
 									if(r) {
 										r = searchbinary(addressTable,rawvalue,N);
 										if(r) {
@@ -3040,7 +3392,7 @@ void *thread_process(void *vargp)	{
 										}
 									}
 									endomorphism_beta[(j*4)+k].x.Get32Bytes((unsigned char *)rawvalue);
-									r = bloom_check(&bloom,rawvalue,MAXLENGTHADDRESS);
+									r = address_bloomcheck(rawvalue,MAXLENGTHADDRESS);
 									if(r) {
 										r = searchbinary(addressTable,rawvalue,N);
 										if(r) {
@@ -3054,7 +3406,7 @@ void *thread_process(void *vargp)	{
 									}
 									
 									endomorphism_beta2[(j*4)+k].x.Get32Bytes((unsigned char *)rawvalue);
-									r = bloom_check(&bloom,rawvalue,MAXLENGTHADDRESS);
+									r = address_bloomcheck(rawvalue,MAXLENGTHADDRESS);
 									if(r) {
 										r = searchbinary(addressTable,rawvalue,N);
 										if(r) {
@@ -3068,7 +3420,7 @@ void *thread_process(void *vargp)	{
 								}
 								else	{
 									pts[(4*j)+k].x.Get32Bytes((unsigned char *)rawvalue);
-									r = bloom_check(&bloom,rawvalue,MAXLENGTHADDRESS);
+									r = address_bloomcheck(rawvalue,MAXLENGTHADDRESS);
 									if(r) {
 										r = searchbinary(addressTable,rawvalue,N);
 										if(r) {
@@ -3089,7 +3441,7 @@ void *thread_process(void *vargp)	{
 					key_mpz.Add(&temp_stride);
 				}
 
-				steps[thread_number]++;
+				telemetry[thread_number].steps++;
 
 				// Next start point (startP + GRP_SIZE*G)
 				pp = startP;
@@ -3149,6 +3501,7 @@ void *thread_process_vanity(void *vargp)	{
 	Int key_mpz,temp_stride,keyfound;
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	grp->Set(dx);
 	
@@ -3175,20 +3528,8 @@ void *thread_process_vanity(void *vargp)	{
 			key_mpz.Rand(&n_range_start,&n_range_end);
 		}
 		else	{
-			if(n_range_start.IsLower(&n_range_end))	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-				WaitForSingleObject(write_random, INFINITE);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				ReleaseMutex(write_random);
-#else
-				pthread_mutex_lock(&write_random);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				pthread_mutex_unlock(&write_random);
-#endif
-			}
-			else	{
+			work_cursor_take(&range_cursor,thread_number,&key_mpz);
+			if(!key_mpz.IsLower(&n_range_end))	{
 				continue_flag = 0;
 			}
 		}
@@ -3608,7 +3949,7 @@ void *thread_process_vanity(void *vargp)	{
 					temp_stride.Mult(&stride);
 					key_mpz.Add(&temp_stride);
 				}
-				steps[thread_number]++;
+				telemetry[thread_number].steps++;
 
 				// Next start point (startP + GRP_SIZE*G)
 				pp = startP;
@@ -3641,8 +3982,20 @@ void _swap(struct address_value *a,struct address_value *b)	{
 }
 
 void _sort(struct address_value *arr,int64_t n)	{
-	uint32_t depthLimit = ((uint32_t) ceil(log(n))) * 2;
-	_introsort(arr,depthLimit,n);
+	if(n < RADIX_SORT_MIN || NTHREADS < 2)	{
+		_sort_bucket((uint8_t *)arr,n);
+	}
+	else	{
+		radix_sort((uint8_t *)arr,n,sizeof(struct address_value),_sort_bucket);
+	}
+}
+
+void _sort_bucket(uint8_t *arr,int64_t n)	{
+	uint32_t depthLimit;
+	if(n > 1)	{
+		depthLimit = ((uint32_t) ceil(log(n))) * 2;
+		_introsort((struct address_value *)arr,depthLimit,n);
+	}
 }
 
 void _introsort(struct address_value *arr,uint32_t depthLimit, int64_t n) {
@@ -3744,10 +4097,153 @@ void bsgs_swap(struct bsgs_xvalue *a,struct bsgs_xvalue *b)	{
 	*b =	t;
 }
 
-/*	OK	*/
+/*
+	Small tables are sorted with the introsort as always, the big ones are split
+	by the first 16 bits of X between all the threads, see radix_sort()
+*/
 void bsgs_sort(struct bsgs_xvalue *arr,int64_t n)	{
-	uint32_t depthLimit = ((uint32_t) ceil(log(n))) * 2;
-	bsgs_introsort(arr,depthLimit,n);
+	if(n < RADIX_SORT_MIN || NTHREADS < 2)	{
+		bsgs_sort_bucket((uint8_t *)arr,n);
+	}
+	else	{
+		radix_sort((uint8_t *)arr,n,sizeof(struct bsgs_xvalue),bsgs_sort_bucket);
+	}
+}
+
+void bsgs_sort_bucket(uint8_t *arr,int64_t n)	{
+	uint32_t depthLimit;
+	if(n > 1)	{
+		depthLimit = ((uint32_t) ceil(log(n))) * 2;
+		bsgs_introsort((struct bsgs_xvalue *)arr,depthLimit,n);
+	}
+}
+
+/*
+	Parallel MSD radix sort on the first 16 bits, the same buckets of the search directory.
+	Every thread counts the buckets of its part of the table, then it copies its elements
+	to the position of each bucket in a temporary table, and at the end every thread sort
+	with sort_bucket the buckets of its part of the temporary table and copy them back.
+	If there is no RAM for the temporary table everything is sorted with sort_bucket.
+*/
+void radix_sort(uint8_t *arr,int64_t n,size_t size,void (*sort_bucket)(uint8_t *arr,int64_t n))	{
+	struct radix_sort sort;
+	uint64_t offset;
+	uint32_t b;
+	int t;
+	sort.arr = arr;
+	sort.n = n;
+	sort.size = size;
+	sort.sort_bucket = sort_bucket;
+	sort.nthreads = NTHREADS;
+	sort.temp = (uint8_t*) malloc(n*size);
+	sort.counts = (uint64_t*) calloc((uint64_t)sort.nthreads * SEARCH_DIRECTORY_SIZE,sizeof(uint64_t));
+	sort.buckets = (uint64_t*) calloc(SEARCH_DIRECTORY_SIZE+1,sizeof(uint64_t));
+	if(sort.temp == NULL || sort.counts == NULL || sort.buckets == NULL)	{
+		fprintf(stderr,"[W] Not enough RAM for the parallel sort, using one thread\n");
+		free(sort.temp);
+		free(sort.counts);
+		free(sort.buckets);
+		sort_bucket(arr,n);
+		return;
+	}
+	radix_sort_phase(&sort,0);
+	offset = 0;
+	for(b = 0; b < SEARCH_DIRECTORY_SIZE; b++)	{
+		sort.buckets[b] = offset;
+		for(t = 0; t < sort.nthreads; t++)	{
+			uint64_t count = sort.counts[(uint64_t)t * SEARCH_DIRECTORY_SIZE + b];
+			sort.counts[(uint64_t)t * SEARCH_DIRECTORY_SIZE + b] = offset;
+			offset += count;
+		}
+	}
+	sort.buckets[SEARCH_DIRECTORY_SIZE] = offset;
+	radix_sort_phase(&sort,1);
+	radix_sort_phase(&sort,2);
+	free(sort.temp);
+	free(sort.counts);
+	free(sort.buckets);
+}
+
+/*
+	Run one phase of the radix_sort in all the threads and wait for them
+*/
+void radix_sort_phase(struct radix_sort *sort,int phase)	{
+#if defined(_WIN64) && !defined(__CYGWIN__)
+	HANDLE *threads = (HANDLE*) calloc(sort->nthreads,sizeof(HANDLE));
+	DWORD s;
+#else
+	pthread_t *threads = (pthread_t*) calloc(sort->nthreads,sizeof(pthread_t));
+	int s;
+#endif
+	struct radix_sort_thread *args = (struct radix_sort_thread*) calloc(sort->nthreads,sizeof(struct radix_sort_thread));
+	int i;
+	checkpointer((void *)threads,__FILE__,"calloc","threads" ,__LINE__ -1 );
+	checkpointer((void *)args,__FILE__,"calloc","args" ,__LINE__ -1 );
+	for(i = 0; i < sort->nthreads; i++)	{
+		args[i].sort = sort;
+		args[i].threadid = i;
+		args[i].phase = phase;
+#if defined(_WIN64) && !defined(__CYGWIN__)
+		threads[i] = CreateThread(NULL, 0, thread_radix_sort, (void*) &args[i], 0, &s);
+		if(threads[i] == NULL)	{
+#else
+		s = pthread_create(&threads[i],NULL,thread_radix_sort,(void*) &args[i]);
+		if(s != 0)	{
+#endif
+			fprintf(stderr,"[E] thread_radix_sort\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for(i = 0; i < sort->nthreads; i++)	{
+#if defined(_WIN64) && !defined(__CYGWIN__)
+		WaitForSingleObject(threads[i],INFINITE);
+		CloseHandle(threads[i]);
+#else
+		pthread_join(threads[i],NULL);
+#endif
+	}
+	free(threads);
+	free(args);
+}
+
+#if defined(_WIN64) && !defined(__CYGWIN__)
+DWORD WINAPI thread_radix_sort(LPVOID vargp) {
+#else
+void *thread_radix_sort(void *vargp)	{
+#endif
+	struct radix_sort_thread *tt = (struct radix_sort_thread *)vargp;
+	struct radix_sort *sort = tt->sort;
+	uint64_t *counts = &sort->counts[(uint64_t)tt->threadid * SEARCH_DIRECTORY_SIZE];
+	int64_t from = sort->n / sort->nthreads * tt->threadid;
+	int64_t to = (tt->threadid == sort->nthreads - 1) ? sort->n : sort->n / sort->nthreads * (tt->threadid + 1);
+	int64_t i;
+	uint32_t b,prefix;
+	uint8_t *element;
+	switch(tt->phase)	{
+		case 0:	/* Histogram */
+			for(i = from; i < to; i++)	{
+				counts[search_prefix(sort->arr + i*sort->size)]++;
+			}
+		break;
+		case 1:	/* Scatter, stable inside of every bucket */
+			for(i = from; i < to; i++)	{
+				element = sort->arr + i*sort->size;
+				prefix = search_prefix(element);
+				memcpy(sort->temp + counts[prefix]*sort->size,element,sort->size);
+				counts[prefix]++;
+			}
+		break;
+		case 2:	/* The buckets that start in our part of the table */
+			for(b = 0; b < SEARCH_DIRECTORY_SIZE; b++)	{
+				if((int64_t)sort->buckets[b] >= from && (int64_t)sort->buckets[b] < to && sort->buckets[b+1] > sort->buckets[b])	{
+					element = sort->temp + sort->buckets[b]*sort->size;
+					sort->sort_bucket(element,sort->buckets[b+1] - sort->buckets[b]);
+					memcpy(sort->arr + sort->buckets[b]*sort->size,element,(sort->buckets[b+1] - sort->buckets[b])*sort->size);
+				}
+			}
+		break;
+	}
+	return 0;
 }
 
 /*	OK	*/
@@ -3843,291 +4339,1293 @@ void bsgs_myheapsort(struct bsgs_xvalue	*arr, int64_t n)	{
 	}
 }
 
+/*
+	bPtable_directory[p] is the first entry of the sorted bPtable with the 16 bits prefix p,
+	so a search only looks at the entries of one prefix, about bsgs_m3/65536 of them.
+*/
+void bsgs_build_directory(struct bsgs_xvalue *buffer,int64_t array_length)	{
+	int64_t i = 0;
+	uint32_t p;
+	if(bPtable_directory == NULL)	{
+		bPtable_directory = (uint64_t*) malloc(sizeof(uint64_t)*(SEARCH_DIRECTORY_SIZE+1));
+		checkpointer((void *)bPtable_directory,__FILE__,"malloc","bPtable_directory" ,__LINE__ -1 );
+	}
+	for(p = 0; p < SEARCH_DIRECTORY_SIZE; p++)	{
+		while(i < array_length && search_prefix(buffer[i].value) < p)	{
+			i++;
+		}
+		bPtable_directory[p] = i;
+	}
+	bPtable_directory[SEARCH_DIRECTORY_SIZE] = array_length;
+}
+
+/*
+	The X values are uniformly distributed, so inside of the prefix bucket the next 32 bits
+	give a good guess of the position, usually found in one or two probes.
+	After SEARCH_INTERPOLATION_PROBES guesses, or if all the keys of the bucket are
+	the same, it goes on with a regular binary search.
+*/
 int bsgs_searchbinary(struct bsgs_xvalue *buffer,char *data,int64_t array_length,uint64_t *r_value) {
-	int64_t min,max,half,current;
-	int r = 0,rcmp;
-	min = 0;
-	current = 0;
-	max = array_length;
-	half = array_length;
-	while(!r && half >= 1) {
-		half = (max - min)/2;
-		rcmp = memcmp(data+16,buffer[current+half].value,BSGS_XVALUE_RAM);
+	int64_t min,max,current;
+	uint32_t key,low,high;
+	int r = 0,rcmp,probes = 0;
+	uint8_t *xvalue = (uint8_t *)data + 16;
+	if(bPtable_directory != NULL)	{
+		min = bPtable_directory[search_prefix(xvalue)];
+		max = bPtable_directory[search_prefix(xvalue)+1];
+	}
+	else	{
+		min = 0;
+		max = array_length;
+	}
+	key = search_key(xvalue);
+	while(!r && min < max) {
+		current = min + (max - min)/2;
+		if(bPtable_directory != NULL && probes < SEARCH_INTERPOLATION_PROBES && max - min > 8)	{
+			low = search_key(buffer[min].value);
+			high = search_key(buffer[max-1].value);
+			if(key < low || key > high)	{
+				break;
+			}
+			if(low != high)	{
+				current = min + (int64_t)((double)(key - low) / (double)(high - low) * (double)(max - 1 - min));
+			}
+			probes++;
+		}
+		rcmp = memcmp(xvalue,buffer[current].value,BSGS_XVALUE_RAM);
 		if(rcmp == 0)	{
-			*r_value = buffer[current+half].index;
+			*r_value = bsgs_xvalue_index(&buffer[current]);
 			r = 1;
 		}
 		else	{
 			if(rcmp < 0) {
-				max = (max-half);
+				max = current;
 			}
 			else	{
-				min = (min+half);
+				min = current + 1;
 			}
-			current = min;
 		}
 	}
 	return r;
 }
 
-#if defined(_WIN64) && !defined(__CYGWIN__)
-DWORD WINAPI thread_process_bsgs(LPVOID vargp) {
-#else
-void *thread_process_bsgs(void *vargp)	{
-#endif
+uint64_t bsgs_xvalue_index(struct bsgs_xvalue *xvalue)	{
+	return (uint64_t)xvalue->index[0] | ((uint64_t)xvalue->index[1] << 8) | ((uint64_t)xvalue->index[2] << 16) | ((uint64_t)xvalue->index[3] << 24) | ((uint64_t)xvalue->index[4] << 32);
+}
 
-	FILE *filekey;
-	struct tothread *tt;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound;
-	Point base_point,point_aux,point_found;
-	uint32_t j,k,l,r,salir,thread_number, cycles;
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int i,hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
+void bsgs_xvalue_setindex(struct bsgs_xvalue *xvalue,uint64_t index)	{
+	xvalue->index[0] = (uint8_t)index;
+	xvalue->index[1] = (uint8_t)(index >> 8);
+	xvalue->index[2] = (uint8_t)(index >> 16);
+	xvalue->index[3] = (uint8_t)(index >> 24);
+	xvalue->index[4] = (uint8_t)(index >> 32);
+}
 
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
-	Int km,intaux;
-	Point pp;
-	Point pn;
-	grp->Set(dx);
+/*
+	Read the bP table file into bPtable and its sha256 into checksum, return 1 if the file
+	was readed and 0 if the file doesn't exist or it was made with other parameters.
+	Files made before the packed format have 16 bytes entries without header, they are
+	converted and FLAGUPDATEFILE3 is set to write them again in the new format.
+*/
+int bsgs_read_table(const char *filename)	{
+	struct bsgs_file_header header;
+	struct bsgs_xvalue_old *oldformat_table;
+	uint64_t i,oldformat_bytes;
+	int readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1 && memcmp(header.magic,BSGS_TABLE_MAGIC,8) == 0)	{
+		if(header.version != BSGS_FILE_VERSION || header.shards != sizeof(struct bsgs_xvalue) || header.items != bsgs_m3)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+			fclose(fd);
+			return 0;
+		}
+		printf("[+] Reading bP Table from file %s .",filename);
+		fflush(stdout);
+		readed = fread(bPtable,bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	else	{
+		/* 16 bytes entries, the sha256 of the file is over that layout */
+		printf("[+] Reading bP Table from file %s (old format) .",filename);
+		fflush(stdout);
+		fseek(fd,0,SEEK_SET);
+		oldformat_bytes = bsgs_m3 * sizeof(struct bsgs_xvalue_old);
+		oldformat_table = (struct bsgs_xvalue_old*) malloc(oldformat_bytes);
+		checkpointer((void *)oldformat_table,__FILE__,"malloc","oldformat_table" ,__LINE__ -1 );
+		readed = fread(oldformat_table,oldformat_bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		readed = fread(checksum,32,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)oldformat_table,oldformat_bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(EXIT_FAILURE);
+			}
+		}
+		for(i = 0; i < bsgs_m3; i++)	{
+			memcpy(bPtable[i].value,oldformat_table[i].value,BSGS_XVALUE_RAM);
+			bsgs_xvalue_setindex(&bPtable[i],oldformat_table[i].index);
+		}
+		free(oldformat_table);
+		FLAGUPDATEFILE3 = 1;
+	}
+	if(FLAGUPDATEFILE3)	{
+		sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum);
+		memcpy(checksum_backup,checksum,32);
+	}
+	else	{
+		readed = fread(checksum,32,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	printf("... Done!\n");
+	fclose(fd);
+	return 1;
+}
 
-	
-	tt = (struct tothread *)vargp;
-	thread_number = tt->nt;
-	free(tt);
-	
-	cycles = bsgs_aux / 1024;
-	if(bsgs_aux % 1024 != 0)	{
-		cycles++;
+void bsgs_write_table(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(EXIT_FAILURE);
 	}
-	
-	intaux.Set(&BSGS_M_double);
-	intaux.Mult(CPU_GRP_SIZE/2);
-	intaux.Add(&BSGS_M);
-	
-	do	{
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_TABLE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct bsgs_xvalue);
+	header.items = bsgs_m3;
+	printf("[+] Writing bP Table to file %s .. ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1)	{
+		readed = fwrite(bPtable,bytes,1,fd);
+	}
+	if(readed == 1)	{
+		readed = fwrite(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	printf("Done!\n");
+	fclose(fd);
+}
 
-	/*
-		We do this in an atomic pthread_mutex operation to not affect others threads
-		so BSGS_CURRENT is never the same between threads
-	*/
 #if defined(_WIN64) && !defined(__CYGWIN__)
-		WaitForSingleObject(bsgs_thread, INFINITE);
+/*
+	Option -O is not available in Windows, FLAGOUTOFCORE is never set
+*/
+int bsgs_map_table(const char *filename)	{
+	return 0;
+}
+
+void bsgs_sync_table()	{
+}
+
+void bsgs_sort_mapped()	{
+}
 #else
-		pthread_mutex_lock(&bsgs_thread);
+/*
+	Option -O, the bP table is the keyhunt_bsgs_2_*.tbl file mapped in memory instead of
+	a malloc, so the RAM of the table is saved (the bloom filters still are in RAM). Only the prefix directory stays in RAM,
+	every search reads one prefix bucket of the file and the page cache keeps the used ones.
+	Return 1 if the file already has the sorted table, 0 if it was created to build it.
+*/
+int bsgs_map_table(const char *filename)	{
+	struct bsgs_file_header header;
+	struct stat st;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	int fd,readed = 0;
+	snprintf(bPtable_map_name,1024,"%s",filename);
+	fd = open(filename,O_RDWR | O_CREAT,0644);
+	if(fd < 0)	{
+		fprintf(stderr,"[E] Error can't open the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	if(fstat(fd,&st) != 0)	{
+		st.st_size = 0;
+	}
+	if((uint64_t)st.st_size == filesize && pread(fd,&header,sizeof(struct bsgs_file_header),0) == sizeof(struct bsgs_file_header))	{
+		readed = memcmp(header.magic,BSGS_TABLE_MAGIC,8) == 0 && header.version == BSGS_FILE_VERSION && header.shards == sizeof(struct bsgs_xvalue) && header.items == bsgs_m3;
+	}
+	if(!readed)	{
+		if(st.st_size != 0)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		}
+		/* The header stays in zero until bsgs_sync_table, an interrupted build is never readed */
+		if(ftruncate(fd,0) != 0 || ftruncate(fd,filesize) != 0)	{
+			fprintf(stderr,"[E] Error can't resize the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	bPtable_map = (uint8_t*) mmap(NULL,filesize,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(bPtable_map == MAP_FAILED)	{
+		fprintf(stderr,"[E] Error mapping the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	bPtable = (struct bsgs_xvalue*)(bPtable_map + sizeof(struct bsgs_file_header));
+	if(readed)	{
+		printf("[+] Mapping bP Table from file %s .",filename);
+		fflush(stdout);
+		memcpy(checksum,bPtable_map + sizeof(struct bsgs_file_header) + bytes,32);
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)bPtable,bytes,(uint8_t*)checksum_backup);
+			if(memcmp(checksum,checksum_backup,32) != 0)	{
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(EXIT_FAILURE);
+			}
+		}
+		madvise(bPtable_map,filesize,MADV_RANDOM);
+		printf("... Done!\n");
+	}
+	else	{
+		printf("[+] Mapping %.2f MB for %" PRIu64 " bP Points in file %s\n",(double)(bytes/1048576),bsgs_m3,filename);
+	}
+	return readed;
+}
+
+/*
+	Write the header and the checksum of the sorted table to the mapped file
+*/
+void bsgs_sync_table()	{
+	struct bsgs_file_header header;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_TABLE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct bsgs_xvalue);
+	header.items = bsgs_m3;
+	memcpy(bPtable_map + sizeof(struct bsgs_file_header) + bytes,checksum,32);
+	if(msync(bPtable_map,filesize,MS_SYNC) != 0)	{
+		fprintf(stderr,"[E] Error writing the bP Table file\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(bPtable_map,&header,sizeof(struct bsgs_file_header));
+	if(msync(bPtable_map,sizeof(struct bsgs_file_header),MS_SYNC) != 0)	{
+		fprintf(stderr,"[E] Error writing the bP Table file\n");
+		exit(EXIT_FAILURE);
+	}
+	madvise(bPtable_map,filesize,MADV_RANDOM);
+}
+
+/*
+	Move down the run r of the min heap of bsgs_sort_mapped, the runs are compared by the
+	element in their current position
+*/
+void bsgs_merge_sift(uint64_t *heap,uint64_t *pos,uint64_t runs,uint64_t r)	{
+	uint64_t child,t;
+	while((child = 2*r + 1) < runs)	{
+		if(child + 1 < runs && memcmp(bPtable[pos[heap[child+1]]].value,bPtable[pos[heap[child]]].value,BSGS_XVALUE_RAM) < 0)	{
+			child++;
+		}
+		if(memcmp(bPtable[pos[heap[child]]].value,bPtable[pos[heap[r]]].value,BSGS_XVALUE_RAM) >= 0)	{
+			break;
+		}
+		t = heap[r];
+		heap[r] = heap[child];
+		heap[child] = t;
+		r = child;
+	}
+}
+
+/*
+	Sort of the mapped bP table, the table is sorted with bsgs_sort in runs of a quarter of
+	the free RAM (the radix sort needs other copy of the run), and then the sorted runs are
+	merged in the new file <name>.tmp that replaces the table file, so the disk needs space
+	for two tables while it is sorted.
+*/
+void bsgs_sort_mapped()	{
+	struct bsgs_xvalue *run_buffer,*merged;
+	uint64_t filesize = sizeof(struct bsgs_file_header) + bytes + 32;
+	uint64_t run,runs,r,i,from,to,*pos,*end,*heap;
+	uint8_t *map;
+	char tmpname[1040];
+	int fd;
+	run = (uint64_t)sysconf(_SC_AVPHYS_PAGES) * (uint64_t)sysconf(_SC_PAGESIZE) / 4 / sizeof(struct bsgs_xvalue);
+	if(run < RADIX_SORT_MIN)	{
+		run = RADIX_SORT_MIN;
+	}
+	if(run > bsgs_m3)	{
+		run = bsgs_m3;
+	}
+	runs = (bsgs_m3 + run - 1) / run;
+	run_buffer = (struct bsgs_xvalue*) malloc(run * sizeof(struct bsgs_xvalue));
+	checkpointer((void *)run_buffer,__FILE__,"malloc","run_buffer" ,__LINE__ -1 );
+	madvise(bPtable_map,filesize,MADV_SEQUENTIAL);
+	for(r = 0; r < runs; r++)	{
+		from = r * run;
+		to = (from + run < bsgs_m3) ? from + run : bsgs_m3;
+		memcpy(run_buffer,&bPtable[from],(to - from) * sizeof(struct bsgs_xvalue));
+		bsgs_sort(run_buffer,to - from);
+		memcpy(&bPtable[from],run_buffer,(to - from) * sizeof(struct bsgs_xvalue));
+	}
+	free(run_buffer);
+	if(runs == 1)	{
+		return;
+	}
+	snprintf(tmpname,1040,"%s.tmp",bPtable_map_name);
+	fd = open(tmpname,O_RDWR | O_CREAT | O_TRUNC,0644);
+	if(fd < 0 || ftruncate(fd,filesize) != 0)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",tmpname);
+		exit(EXIT_FAILURE);
+	}
+	map = (uint8_t*) mmap(NULL,filesize,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[E] Error mapping the file %s\n",tmpname);
+		exit(EXIT_FAILURE);
+	}
+	madvise(map,filesize,MADV_SEQUENTIAL);
+	merged = (struct bsgs_xvalue*)(map + sizeof(struct bsgs_file_header));
+	/* Min heap of the runs by their current element */
+	pos = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	end = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	heap = (uint64_t*) malloc(runs * sizeof(uint64_t));
+	checkpointer((void *)pos,__FILE__,"malloc","pos" ,__LINE__ -3 );
+	checkpointer((void *)end,__FILE__,"malloc","end" ,__LINE__ -3 );
+	checkpointer((void *)heap,__FILE__,"malloc","heap" ,__LINE__ -3 );
+	for(r = 0; r < runs; r++)	{
+		pos[r] = r * run;
+		end[r] = (pos[r] + run < bsgs_m3) ? pos[r] + run : bsgs_m3;
+		heap[r] = r;
+	}
+	for(r = runs / 2; r > 0; r--)	{
+		bsgs_merge_sift(heap,pos,runs,r - 1);
+	}
+	for(i = 0; i < bsgs_m3; i++)	{
+		r = heap[0];
+		merged[i] = bPtable[pos[r]++];
+		if(pos[r] == end[r])	{
+			heap[0] = heap[--runs];
+		}
+		bsgs_merge_sift(heap,pos,runs,0);
+	}
+	free(pos);
+	free(end);
+	free(heap);
+	munmap(bPtable_map,filesize);
+	/* The header of the new file is still in zero, an interrupted sort is never readed */
+	if(rename(tmpname,bPtable_map_name) != 0)	{
+		fprintf(stderr,"[E] Error can't rename the file %s\n",tmpname);
+		exit(EXIT_FAILURE);
+	}
+	bPtable_map = map;
+	bPtable = merged;
+}
 #endif
 
-		base_key.Set(&BSGS_CURRENT);	/* we need to set our base_key to the current BSGS_CURRENT value*/
-		BSGS_CURRENT.Add(&BSGS_N_double);		/*Then add 2*BSGS_N to BSGS_CURRENT*/
-		/*
-		BSGS_CURRENT.Add(&BSGS_N);		//Then add BSGS_N to BSGS_CURRENT
-		BSGS_CURRENT.Add(&BSGS_N);		//Then add BSGS_N to BSGS_CURRENT
-		*/
-		
+/*
+	Allocate the empty hash index for bsgs_m3 entries, bytes is left with its size
+*/
+void bsgs_hashindex_init()	{
+	hashindex_buckets = bsgs_m3 / HASHINDEX_LOAD + 1;
+	bytes = hashindex_buckets * (uint64_t) sizeof(struct hashindex_bucket);
+	printf("[+] Allocating %.2f MB for the hash index of %" PRIu64 " bP Points\n",(double)bytes/1048576,bsgs_m3);
 #if defined(_WIN64) && !defined(__CYGWIN__)
-		ReleaseMutex(bsgs_thread);
+	hashindex = (struct hashindex_bucket*) _aligned_malloc(bytes,64);
 #else
-		pthread_mutex_unlock(&bsgs_thread);
+	hashindex = (struct hashindex_bucket*) aligned_alloc(64,bytes);
 #endif
+	checkpointer((void *)hashindex,__FILE__,"aligned_alloc","hashindex" ,__LINE__ -1 );
+	memset(hashindex,0,bytes);
+}
 
-		if(base_key.IsGreaterOrEqual(&n_range_end))
-			break;
-
+/*
+	X is already uniformly distributed, the bytes 8 to 15 are scaled to the number of buckets
+*/
+static inline uint64_t bsgs_hashindex_bucket(char *data)	{
+	uint64_t key;
+	memcpy(&key,data + 8,sizeof(uint64_t));
+	return (uint64_t)(((unsigned __int128)key * hashindex_buckets) >> 64);
+}
 
-		if(FLAGMATRIX)	{
-			aux_c = base_key.GetBase16();
-			printf("[+] Thread 0x%s \n",aux_c);
-			fflush(stdout);
-			free(aux_c);
-		}
-		else	{
-			if(FLAGQUIET == 0){
-				aux_c = base_key.GetBase16();
-				printf("\r[+] Thread 0x%s   \r",aux_c);
-				fflush(stdout);
-				free(aux_c);
-				THREADOUTPUT = 1;
+/*
+	Called from all the bP threads at the same time, every slot is reserved with a
+	compare and swap of the count so the bucket never goes over HASHINDEX_SLOTS
+*/
+void bsgs_hashindex_add(char *data,uint64_t index)	{
+	struct hashindex_bucket *bucket;
+	uint64_t b = bsgs_hashindex_bucket(data);
+	uint8_t count;
+	int k;
+	while(1)	{
+		bucket = &hashindex[b];
+		count = __atomic_load_n(&bucket->count,__ATOMIC_RELAXED);
+		while(count < HASHINDEX_SLOTS && !__atomic_compare_exchange_n(&bucket->count,&count,count + 1,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+		if(count < HASHINDEX_SLOTS)	{
+			memcpy(bucket->slot[count].value,data + 16,HASHINDEX_VALUE);
+			for(k = 0; k < 5; k++)	{
+				bucket->slot[count].index[k] = (uint8_t)(index >> (8*k));
 			}
+			return;
 		}
-		
-		base_point = secp->ComputePublicKey(&base_key);
+		b = (b + 1 == hashindex_buckets) ? 0 : b + 1;
+	}
+}
 
-		km.Set(&base_key);
-		km.Neg();
-		
-		km.Add(&secp->order);
-		km.Sub(&intaux);
-		point_aux = secp->ComputePublicKey(&km);
-		
-		for(k = 0; k < bsgs_point_number ; k++)	{
-			if(bsgs_found[k] == 0)	{
-				startP  = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
-				j = 0;
-				while( j < cycles && bsgs_found[k]== 0 )	{
-					
-					for(i = 0; i < hLength; i++) {
-						dx[i].ModSub(&GSn[i].x,&startP.x);
-					}
-					dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-					dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
+/*
+	Same result as bsgs_searchbinary, usually with only one cache line read
+*/
+int bsgs_hashindex_search(char *data,uint64_t *r_value)	{
+	struct hashindex_bucket *bucket;
+	uint64_t b = bsgs_hashindex_bucket(data);
+	int k,l;
+	do	{
+		bucket = &hashindex[b];
+		for(k = 0; k < bucket->count; k++)	{
+			if(memcmp(bucket->slot[k].value,data + 16,HASHINDEX_VALUE) == 0)	{
+				*r_value = 0;
+				for(l = 4; l >= 0; l--)	{
+					*r_value = (*r_value << 8) | bucket->slot[k].index[l];
+				}
+				return 1;
+			}
+		}
+		b = (b + 1 == hashindex_buckets) ? 0 : b + 1;
+	}while(bucket->count == HASHINDEX_SLOTS);
+	return 0;
+}
 
-					// Grouped ModInv
-					grp->ModInv();
-					
-					/*
-					We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-					We compute key in the positive and negative way from the center of the group
-					*/
+/*
+	Same layout of the bP table files: header, all the buckets and their sha256
+*/
+int bsgs_read_hashindex(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1 || memcmp(header.magic,BSGS_HASHINDEX_MAGIC,8) != 0 || header.version != BSGS_FILE_VERSION || header.shards != sizeof(struct hashindex_bucket) || header.items != bsgs_m3)	{
+		fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	printf("[+] Reading hash index from file %s .",filename);
+	fflush(stdout);
+	readed = fread(hashindex,bytes,1,fd);
+	if(readed == 1)	{
+		readed = fread(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error reading the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	if(FLAGSKIPCHECKSUM == 0)	{
+		sha256((uint8_t*)hashindex,bytes,(uint8_t*)checksum_backup);
+		if(memcmp(checksum,checksum_backup,32) != 0)	{
+			fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	printf("... Done!\n");
+	fclose(fd);
+	return 1;
+}
 
-					// center point
-					pts[CPU_GRP_SIZE / 2] = startP;
-					
-					for(i = 0; i<hLength; i++) {
+void bsgs_write_hashindex(const char *filename)	{
+	struct bsgs_file_header header;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_HASHINDEX_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = sizeof(struct hashindex_bucket);
+	header.items = bsgs_m3;
+	printf("[+] Writing hash index to file %s .. ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed == 1)	{
+		readed = fwrite(hashindex,bytes,1,fd);
+	}
+	if(readed == 1)	{
+		readed = fwrite(checksum,32,1,fd);
+	}
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	printf("Done!\n");
+	fclose(fd);
+}
 
-						pp = startP;
-						pn = startP;
+#if defined(_WIN64) && !defined(__CYGWIN__)
+/*
+	Option -T is not available in Windows, shared_name is never set
+*/
+int bsgs_shared_attach(const char *name)	{
+	return 0;
+}
 
-						// P = startP + i*G
-						dy.ModSub(&GSn[i].y,&pp.y);
+void bsgs_shared_create(const char *name)	{
+}
+#else
+/*
+	A path inside a mount point is a file of that mount (hugetlbfs), any other name
+	is a POSIX shared memory segment in /dev/shm
+*/
+int bsgs_shared_open(const char *name,int flags)	{
+	if(name[0] == '/' && strchr(name + 1,'/') != NULL)	{
+		return open(name,flags,0644);
+	}
+	return shm_open(name,flags,0644);
+}
 
-						_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
+void bsgs_shared_unlink(const char *name)	{
+	if(name[0] == '/' && strchr(name + 1,'/') != NULL)	{
+		unlink(name);
+	}
+	else	{
+		shm_unlink(name);
+	}
+}
 
-						pp.x.ModNeg();
-						pp.x.ModAdd(&_p);
-						pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-						
-#if 0
-  pp.y.ModSub(&GSn[i].x,&pp.x);
-  pp.y.ModMulK1(&_s);
-  pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
+uint64_t bsgs_shared_align(uint64_t offset)	{
+	return (offset + 63) & ~(uint64_t)63;
+}
+
+/*
+	Blooms of the tables in the order of the segment
+*/
+void bsgs_shared_blooms(std::vector<struct bloom*> &list)	{
+	uint32_t i;
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		list.push_back(&bloom_bP[i]);
+	}
+	for(i = 0; i < 256; i++)	{
+		list.push_back(&bloom_bPx2nd[i]);
+	}
+	if(!FLAGHASHINDEX)	{
+		for(i = 0; i < 256; i++)	{
+			list.push_back(&bloom_bPx3rd[i]);
+		}
+	}
+	if(FLAGPREFILTER)	{
+		list.push_back(&bloom_bP_pre);
+	}
+}
+
+/*
+	Use the tables of the segment if it was filled by other process with the same
+	-n, -k, -F, -H and -L. Only the struct bloom arrays are allocated, the bit fields
+	and the tables stay in the segment. Returns 0 if there is no segment to use.
+*/
+int bsgs_shared_attach(const char *name)	{
+	struct bsgs_shared_header *header;
+	std::vector<struct bloom*> list;
+	struct bloom *blooms;
+	struct stat st;
+	uint8_t *map;
+	uint32_t i;
+	int fd;
+	fd = bsgs_shared_open(name,O_RDONLY);
+	if(fd < 0)	{
+		return 0;
+	}
+	if(fstat(fd,&st) != 0 || (uint64_t)st.st_size < sizeof(struct bsgs_shared_header))	{
+		close(fd);
+		return 0;
+	}
+	map = (uint8_t*) mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[W] Error mapping the shared tables %s\n",name);
+		return 0;
+	}
+	header = (struct bsgs_shared_header*) map;
+	if(memcmp(header->magic,BSGS_SHARED_MAGIC,8) != 0 || header->version != BSGS_SHARED_VERSION || __atomic_load_n(&header->ready,__ATOMIC_ACQUIRE) != 1 || header->length > (uint64_t)st.st_size || header->bloom_size != sizeof(struct bloom) || header->xvalue_size != sizeof(struct bsgs_xvalue))	{
+		fprintf(stderr,"[W] The shared tables %s are not ready or from other version\n",name);
+		munmap(map,st.st_size);
+		return 0;
+	}
+	if(header->m != bsgs_m || header->m2 != bsgs_m2 || header->m3 != bsgs_m3 || header->shards != bloom_bP_shards || ((header->flags & BSGS_SHARED_HASHINDEX) != 0) != (FLAGHASHINDEX != 0) || header->pre_bytes != (FLAGPREFILTER ? bloom_bP_pre_bytes : 0))	{
+		fprintf(stderr,"[W] The shared tables %s were made with other -n, -k, -F, -H or -L\n",name);
+		munmap(map,st.st_size);
+		return 0;
+	}
+	if(!(header->flags & BSGS_SHARED_PREFILTER))	{
+		FLAGPREFILTER = 0;	/* It was too small for the process that made the segment */
+	}
+	bloom_bP = (struct bloom*)calloc(bloom_bP_shards,sizeof(struct bloom));
+	checkpointer((void *)bloom_bP,__FILE__,"calloc","bloom_bP" ,__LINE__ -1 );
+	bloom_bPx2nd = (struct bloom*)calloc(256,sizeof(struct bloom));
+	checkpointer((void *)bloom_bPx2nd,__FILE__,"calloc","bloom_bPx2nd" ,__LINE__ -1 );
+	if(!FLAGHASHINDEX)	{
+		bloom_bPx3rd = (struct bloom*)calloc(256,sizeof(struct bloom));
+		checkpointer((void *)bloom_bPx3rd,__FILE__,"calloc","bloom_bPx3rd" ,__LINE__ -1 );
+		bPtable = (struct bsgs_xvalue*)(map + header->table);
+		bPtable_directory = (uint64_t*)(map + header->directory);
+	}
+	else	{
+		hashindex = (struct hashindex_bucket*)(map + header->table);
+		hashindex_buckets = header->hashindex_buckets;
+	}
+	bsgs_shared_blooms(list);
+	blooms = (struct bloom*)(map + header->blooms);
+	for(i = 0; i < list.size(); i++)	{
+		*list[i] = blooms[i];
+		list[i]->bf = map + (uint64_t)(uintptr_t)blooms[i].bf;
+	}
+	bloom_bP_totalbytes = 0;
+	for(i = 0; i < bloom_bP_shards; i++)	{
+		bloom_bP_totalbytes += bloom_bP[i].bytes;
+	}
+	bloom_bP2_totalbytes = 0;
+	bloom_bP3_totalbytes = 0;
+	for(i = 0; i < 256; i++)	{
+		bloom_bP2_totalbytes += bloom_bPx2nd[i].bytes;
+		if(!FLAGHASHINDEX)	{
+			bloom_bP3_totalbytes += bloom_bPx3rd[i].bytes;
+		}
+	}
+	shared_map = map;
+	shared_length = st.st_size;
+	printf("[+] Using the shared tables %s, %.2f MB\n",name,(double)header->length/1048576);
+	return 1;
+}
+
+/*
+	Copy the tables of this process to a new segment and use them from there, the
+	memory of the private copies is freed. If the segment already exists (other
+	parameters or a process that didn't end to fill it) the tables stay private.
+*/
+void bsgs_shared_create(const char *name)	{
+	struct bsgs_shared_header header;
+	std::vector<struct bloom*> list;
+	std::vector<uint64_t> offsets;
+	struct bloom *blooms;
+	struct statfs sf;
+	uint64_t offset,bytes_table,bytes_directory;
+	uint8_t *map,*table;
+	uint32_t i;
+	int fd;
+	bsgs_shared_blooms(list);
+	memset(&header,0,sizeof(struct bsgs_shared_header));
+	memcpy(header.magic,BSGS_SHARED_MAGIC,8);
+	header.version = BSGS_SHARED_VERSION;
+	header.m = bsgs_m;
+	header.m2 = bsgs_m2;
+	header.m3 = bsgs_m3;
+	header.pre_bytes = bloom_bP_pre_bytes;
+	header.shards = bloom_bP_shards;
+	header.flags = (FLAGHASHINDEX ? BSGS_SHARED_HASHINDEX : 0) | (FLAGPREFILTER ? BSGS_SHARED_PREFILTER : 0);
+	header.bloom_size = sizeof(struct bloom);
+	header.xvalue_size = sizeof(struct bsgs_xvalue);
+	header.hashindex_buckets = hashindex_buckets;
+
+	header.blooms = bsgs_shared_align(sizeof(struct bsgs_shared_header));
+	offset = bsgs_shared_align(header.blooms + list.size() * sizeof(struct bloom));
+	for(i = 0; i < list.size(); i++)	{
+		offsets.push_back(offset);
+		offset = bsgs_shared_align(offset + list[i]->bytes);
+	}
+	if(FLAGHASHINDEX)	{
+		table = (uint8_t*)hashindex;
+		bytes_table = hashindex_buckets * (uint64_t)sizeof(struct hashindex_bucket);
+		bytes_directory = 0;
+	}
+	else	{
+		table = (uint8_t*)bPtable;
+		bytes_table = bsgs_m3 * (uint64_t)sizeof(struct bsgs_xvalue);
+		bytes_directory = (SEARCH_DIRECTORY_SIZE + 1) * sizeof(uint64_t);
+	}
+	header.table = offset;
+	header.directory = bsgs_shared_align(header.table + bytes_table);
+	header.length = header.directory + bytes_directory;
+
+	fd = bsgs_shared_open(name,O_RDWR | O_CREAT | O_EXCL);
+	if(fd < 0)	{
+		if(errno == EEXIST)	{
+			fprintf(stderr,"[W] The shared tables %s already exist with other parameters, remove them to share these ones\n",name);
+		}
+		else	{
+			fprintf(stderr,"[W] Can't create the shared tables %s: %s\n",name,strerror(errno));
+		}
+		return;
+	}
+	/* The size of a hugetlbfs file must be a multiple of its page size */
+	shared_length = header.length;
+	if(fstatfs(fd,&sf) == 0 && sf.f_bsize > 0)	{
+		shared_length = (shared_length + sf.f_bsize - 1) / sf.f_bsize * sf.f_bsize;
+	}
+	map = (uint8_t*) MAP_FAILED;
+	if(ftruncate(fd,shared_length) == 0)	{
+		map = (uint8_t*) mmap(NULL,shared_length,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	}
+	close(fd);
+	if(map == MAP_FAILED)	{
+		fprintf(stderr,"[W] Can't allocate %.2f MB for the shared tables %s\n",(double)shared_length/1048576,name);
+		bsgs_shared_unlink(name);
+		shared_length = 0;
+		return;
+	}
+	printf("[+] Copying the tables to the shared segment %s .. ",name);
+	fflush(stdout);
+	blooms = (struct bloom*)(map + header.blooms);
+	for(i = 0; i < list.size(); i++)	{
+		memcpy(map + offsets[i],list[i]->bf,list[i]->bytes);
+		blooms[i] = *list[i];
+		blooms[i].bf = (uint8_t*)(uintptr_t)offsets[i];
+		free(list[i]->bf);
+		list[i]->bf = map + offsets[i];
+	}
+	memcpy(map + header.table,table,bytes_table);
+	free(table);
+	if(FLAGHASHINDEX)	{
+		hashindex = (struct hashindex_bucket*)(map + header.table);
+	}
+	else	{
+		bPtable = (struct bsgs_xvalue*)(map + header.table);
+		memcpy(map + header.directory,bPtable_directory,bytes_directory);
+		free(bPtable_directory);
+		bPtable_directory = (uint64_t*)(map + header.directory);
+	}
+	memcpy(map,&header,sizeof(struct bsgs_shared_header));
+	__atomic_store_n(&((struct bsgs_shared_header*)map)->ready,1,__ATOMIC_RELEASE);
+	mprotect(map,shared_length,PROT_READ);
+	shared_map = map;
+	printf("Done! %.2f MB\n",(double)header.length/1048576);
+}
 #endif
 
-						// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-						dyn.Set(&GSn[i].y);
-						dyn.ModNeg();
-						dyn.ModSub(&pn.y);
+void work_cursor_init(struct work_cursor *cursor,Int *base,Int *block,uint64_t lease,uint32_t threads)	{
+	cursor->base.Set(base);
+	cursor->block.Set(block);
+	cursor->lease = lease;
+	cursor->order.blocks = 0;
+	cursor->leases = (struct work_lease *) calloc(threads,sizeof(struct work_lease));
+	checkpointer((void *)cursor->leases,__FILE__,"calloc","leases" ,__LINE__ -1 );
+	cursor->pending = NULL;
+	cursor->pending_count = 0;
+	cursor->pending_next = 0;
+	__atomic_store_n(&cursor->next,0,__ATOMIC_RELAXED);
+}
 
-						_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
+/*
+	Visit the blocks of the cursor up to end in the order of a permutation keyed by seed.
+	Returns 1 if the range has 2^64 blocks or more.
+*/
+int work_cursor_permute(struct work_cursor *cursor,Int *end,uint64_t seed)	{
+	Int blocks,remainder;
+	blocks.Set(end);
+	blocks.Sub(&cursor->base);
+	remainder.Set(&blocks);
+	remainder.Mod(&cursor->block);
+	blocks.Div(&cursor->block);
+	if(!remainder.IsZero())	{
+		blocks.AddOne();
+	}
+	if(blocks.GetBitLength() > 64)	{
+		return 1;
+	}
+	feistel_init(&cursor->order,blocks.GetInt64(),seed);
+	return 0;
+}
 
-						pn.x.ModNeg();
-						pn.x.ModAdd(&_p);
-						pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
+void feistel_init(struct feistel *f,uint64_t blocks,uint64_t seed)	{
+	uint64_t bits = 0,state = seed;
+	int i;
+	while(bits < 64 && (blocks - 1) >> bits)	{
+		bits++;
+	}
+	f->blocks = blocks;
+	f->seed = seed;
+	f->half = (bits + 1) / 2;
+	if(f->half == 0)	{
+		f->half = 1;
+	}
+	f->mask = (f->half == 32) ? 0xFFFFFFFF : (((uint64_t)1 << f->half) - 1);
+	for(i = 0; i < FEISTEL_ROUNDS; i++)	{
+		/* splitmix64 sequence */
+		state += 0x9E3779B97F4A7C15;
+		f->keys[i] = state;
+		f->keys[i] = (f->keys[i] ^ (f->keys[i] >> 30)) * 0xBF58476D1CE4E5B9;
+		f->keys[i] = (f->keys[i] ^ (f->keys[i] >> 27)) * 0x94D049BB133111EB;
+		f->keys[i] ^= f->keys[i] >> 31;
+	}
+}
 
-#if 0
-  pn.y.ModSub(&GSn[i].x,&pn.x);
-  pn.y.ModMulK1(&_s);
-  pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
+/*
+	Block visited in the position index, index must be lower than f->blocks. The domain of
+	the network is less than 4 times blocks, so on average there are less than 4 passes.
+*/
+uint64_t feistel_permute(struct feistel *f,uint64_t index)	{
+	uint64_t left,right,aux;
+	int i;
+	do	{
+		left = index >> f->half;
+		right = index & f->mask;
+		for(i = 0; i < FEISTEL_ROUNDS; i++)	{
+			/* round function: murmur3 fmix64 of the right half with the round key */
+			aux = right ^ f->keys[i];
+			aux = (aux ^ (aux >> 33)) * 0xFF51AFD7ED558CCD;
+			aux = (aux ^ (aux >> 33)) * 0xC4CEB9FE1A85EC53;
+			aux ^= aux >> 33;
+			aux = left ^ (aux & f->mask);
+			left = right;
+			right = aux;
+		}
+		index = (left << f->half) | right;
+	}while(index >= f->blocks);
+	return index;
+}
+
+/*
+	Start of the next block of this thread, the block of the previous call is finished.
+	A new lease is taken only when the current one is used, first from the pending
+	leases of --resume and then from the block counter. The change of the lease is
+	inside the odd sequence, so work_cursor_save never sees a lease out of both places.
+*/
+void work_cursor_take(struct work_cursor *cursor,uint32_t thread,Int *start)	{
+	struct work_lease *lease = &cursor->leases[thread];
+	uint64_t next = lease->next,end = lease->end,index;
+	uint32_t p;
+	if(next < end)	{
+		next++;
+	}
+	__atomic_store_n(&lease->sequence,lease->sequence + 1,__ATOMIC_SEQ_CST);
+	if(next == end)	{
+		p = cursor->pending_count;
+		if(__atomic_load_n(&cursor->pending_next,__ATOMIC_SEQ_CST) < cursor->pending_count)	{
+			p = __atomic_fetch_add(&cursor->pending_next,1,__ATOMIC_SEQ_CST);
+		}
+		if(p < cursor->pending_count)	{
+			next = cursor->pending[p].next;
+			end = cursor->pending[p].end;
+		}
+		else	{
+			next = __atomic_fetch_add(&cursor->next,cursor->lease,__ATOMIC_SEQ_CST);
+			end = next + cursor->lease;
+		}
+	}
+	__atomic_store_n(&lease->next,next,__ATOMIC_SEQ_CST);
+	__atomic_store_n(&lease->end,end,__ATOMIC_SEQ_CST);
+	__atomic_store_n(&lease->sequence,lease->sequence + 1,__ATOMIC_SEQ_CST);
+	index = next;
+	if(index < cursor->order.blocks)	{
+		index = feistel_permute(&cursor->order,index);
+	}
+	start->Set(&cursor->block);
+	start->Mult(index);
+	start->Add(&cursor->base);
+}
+
+/*
+	Write the state of the cursor to checkpoint_fileName: all the blocks lower than next
+	are finished except the pending leases. The file is written to a temporary name and
+	renamed, so a kill in the middle leaves the previous checkpoint.
+*/
+void work_cursor_save(struct work_cursor *cursor,Int *end,const char *mode)	{
+	char tmp_fileName[256];
+	char *hex_base,*hex_block,*hex_end;
+	uint64_t next,lease_next,lease_end;
+	uint32_t p,sequence;
+	int i;
+	FILE *fd;
+	next = __atomic_load_n(&cursor->next,__ATOMIC_SEQ_CST);
+	p = __atomic_load_n(&cursor->pending_next,__ATOMIC_SEQ_CST);
+	snprintf(tmp_fileName,sizeof(tmp_fileName),"%s.tmp",checkpoint_fileName);
+	fd = fopen(tmp_fileName,"w");
+	if(fd == NULL)	{
+		fprintf(stderr,"[W] Can't write the checkpoint %s\n",tmp_fileName);
+		return;
+	}
+	hex_base = cursor->base.GetBase16();
+	hex_block = cursor->block.GetBase16();
+	hex_end = end->GetBase16();
+	fprintf(fd,"keyhunt checkpoint 1\n");
+	fprintf(fd,"mode %s\n",mode);
+	fprintf(fd,"base %s\n",hex_base);
+	fprintf(fd,"block %s\n",hex_block);
+	fprintf(fd,"end %s\n",hex_end);
+	fprintf(fd,"seed %016" PRIx64 "\n",cursor->order.seed);
+	fprintf(fd,"blocks %" PRIu64 "\n",cursor->order.blocks);
+	fprintf(fd,"next %" PRIu64 "\n",next);
+	free(hex_base);
+	free(hex_block);
+	free(hex_end);
+	for(; p < cursor->pending_count; p++)	{
+		fprintf(fd,"pending %" PRIu64 " %" PRIu64 "\n",cursor->pending[p].next,cursor->pending[p].end);
+	}
+	for(i = 0; i < NTHREADS; i++)	{
+		do	{
+			sequence = __atomic_load_n(&cursor->leases[i].sequence,__ATOMIC_SEQ_CST);
+			lease_next = __atomic_load_n(&cursor->leases[i].next,__ATOMIC_SEQ_CST);
+			lease_end = __atomic_load_n(&cursor->leases[i].end,__ATOMIC_SEQ_CST);
+		}while((sequence & 1) || sequence != __atomic_load_n(&cursor->leases[i].sequence,__ATOMIC_SEQ_CST));
+		if(lease_end > next)	{	//Leased after next was read, those blocks are after next in the file
+			lease_end = next;
+		}
+		if(lease_next < lease_end)	{
+			fprintf(fd,"pending %" PRIu64 " %" PRIu64 "\n",lease_next,lease_end);
+		}
+	}
+	fflush(fd);
+#if defined(_WIN64) && !defined(__CYGWIN__)
+	fclose(fd);
+	if(!MoveFileExA(tmp_fileName,checkpoint_fileName,MOVEFILE_REPLACE_EXISTING))	{
+#else
+	fsync(fileno(fd));
+	fclose(fd);
+	if(rename(tmp_fileName,checkpoint_fileName) != 0)	{
 #endif
+		fprintf(stderr,"[W] Can't rename the checkpoint %s\n",tmp_fileName);
+	}
+}
 
+/*
+	Load the state of work_cursor_save, the mode, range and block size must be the same
+	as the ones of this run. The pending leases are scanned first by the threads.
+*/
+int work_cursor_resume(struct work_cursor *cursor,Int *end,const char *mode)	{
+	char line[1024];
+	uint64_t seed = 0,blocks = 0,next = 0,lease_next,lease_end;
+	int version = 0,matches = 0;
+	Int value;
+	FILE *fd;
+	fd = fopen(checkpoint_fileName,"r");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Can't open the checkpoint %s\n",checkpoint_fileName);
+		return 1;
+	}
+	while(fgets(line,sizeof(line),fd) != NULL)	{
+		line[strcspn(line,"\r\n")] = 0;
+		if(sscanf(line,"keyhunt checkpoint %i",&version) == 1)	{
+			continue;
+		}
+		if(strncmp(line,"mode ",5) == 0)	{
+			if(strcmp(line+5,mode) == 0)	{
+				matches |= 1;
+			}
+		}
+		else if(strncmp(line,"base ",5) == 0)	{
+			value.SetBase16(line+5);
+			if(value.IsEqual(&cursor->base))	{
+				matches |= 2;
+			}
+		}
+		else if(strncmp(line,"block ",6) == 0)	{
+			value.SetBase16(line+6);
+			if(value.IsEqual(&cursor->block))	{
+				matches |= 4;
+			}
+		}
+		else if(strncmp(line,"end ",4) == 0)	{
+			value.SetBase16(line+4);
+			if(value.IsEqual(end))	{
+				matches |= 8;
+			}
+		}
+		else if(sscanf(line,"seed %" SCNx64,&seed) == 1 || sscanf(line,"blocks %" SCNu64,&blocks) == 1 || sscanf(line,"next %" SCNu64,&next) == 1)	{
+			continue;
+		}
+		else if(sscanf(line,"pending %" SCNu64 " %" SCNu64,&lease_next,&lease_end) == 2)	{
+			cursor->pending = (struct work_lease *) realloc(cursor->pending,(cursor->pending_count + 1) * sizeof(struct work_lease));
+			checkpointer((void *)cursor->pending,__FILE__,"realloc","pending" ,__LINE__ -1 );
+			cursor->pending[cursor->pending_count].next = lease_next;
+			cursor->pending[cursor->pending_count].end = lease_end;
+			cursor->pending_count++;
+		}
+	}
+	fclose(fd);
+	if(version != 1 || matches != 15)	{
+		fprintf(stderr,"[E] The checkpoint %s is not for this mode, range and N\n",checkpoint_fileName);
+		return 1;
+	}
+	if(blocks != 0)	{
+		feistel_init(&cursor->order,blocks,seed);
+	}
+	cursor->next = next;
+	printf("[+] Resuming at block %" PRIu64 " with %u pending leases\n",next,cursor->pending_count);
+	return 0;
+}
 
-						pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
-						pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
+/*
+	Giant steps from base_key for all the targets not found yet. Up to BSGS_WALK_TARGETS
+	targets walk together: the dx of all of them are in the same IntGroup, so there is only
+	one modular inversion for every 1024 points of all those targets, then the points of each
+	target are checked in the bloom filters as before.
+	grp is an IntGroup of BSGS_WALK_TARGETS * BSGS_WALK_GROUP elements set to dx.
+*/
+void bsgs_walk_targets(Int *base_key,Point &point_aux,uint32_t cycles,IntGroup *grp,Int *dx)	{
+	FILE *filekey;
+	char xpoint_raw[32],*aux_c,*hextemp;
+	uint32_t targets[BSGS_WALK_TARGETS];
+	Point startP[BSGS_WALK_TARGETS];
+	Point pts[CPU_GRP_SIZE];
+	Point pp,pn,point_found;
+	Int dy,dyn,_s,_p,keyfound;
+	Int *d;
+	uint32_t j,k,k_index,l,n,t,r,salir;
+	int i,hLength = (CPU_GRP_SIZE / 2 - 1);
 
-					}
+	k = 0;
+	while(k < bsgs_point_number)	{
+		n = 0;
+		while(k < bsgs_point_number && n < BSGS_WALK_TARGETS)	{
+			if(bsgs_found[k] == 0)	{
+				targets[n] = k;
+				startP[n] = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
+				n++;
+			}
+			k++;
+		}
+		j = 0;
+		while(j < cycles && n > 0)	{
+			for(t = 0; t < n; t++)	{
+				d = &dx[t * BSGS_WALK_GROUP];
+				for(i = 0; i < hLength; i++) {
+					d[i].ModSub(&GSn[i].x,&startP[t].x);
+				}
+				d[i].ModSub(&GSn[i].x,&startP[t].x);  // For the first point
+				d[i+1].ModSub(&_2GSn.x,&startP[t].x); // For the next center point
+			}
+			for(i = n * BSGS_WALK_GROUP; i < BSGS_WALK_TARGETS * BSGS_WALK_GROUP; i++)	{
+				dx[i].SetInt32(1);	/* Unused places of the group when there are less targets */
+			}
 
-					// First point (startP - (GRP_SZIE/2)*G)
-					pn = startP;
+			// Grouped ModInv of all the targets
+			grp->ModInv();
+
+			for(t = 0; t < n; t++)	{
+				d = &dx[t * BSGS_WALK_GROUP];
+				k_index = targets[t];
+
+				/*
+				We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
+				We compute key in the positive and negative way from the center of the group
+				*/
+
+				// center point
+				pts[CPU_GRP_SIZE / 2] = startP[t];
+
+				for(i = 0; i<hLength; i++) {
+					pp = startP[t];
+					pn = startP[t];
+
+					// P = startP + i*G
+					dy.ModSub(&GSn[i].y,&pp.y);
+
+					_s.ModMulK1(&dy,&d[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+					_p.ModSquareK1(&_s);            // _p = pow2(s)
+
+					pp.x.ModNeg();
+					pp.x.ModAdd(&_p);
+					pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
+
+					// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
 					dyn.Set(&GSn[i].y);
 					dyn.ModNeg();
 					dyn.ModSub(&pn.y);
 
-					_s.ModMulK1(&dyn,&dx[i]);
-					_p.ModSquareK1(&_s);
+					_s.ModMulK1(&dyn,&d[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+					_p.ModSquareK1(&_s);            // _p = pow2(s)
 
 					pn.x.ModNeg();
 					pn.x.ModAdd(&_p);
-					pn.x.ModSub(&GSn[i].x);
+					pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
 
-#if 0
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
+					pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
+					pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
+				}
+
+				// First point (startP - (GRP_SZIE/2)*G)
+				pn = startP[t];
+				dyn.Set(&GSn[i].y);
+				dyn.ModNeg();
+				dyn.ModSub(&pn.y);
+
+				_s.ModMulK1(&dyn,&d[i]);
+				_p.ModSquareK1(&_s);
+
+				pn.x.ModNeg();
+				pn.x.ModAdd(&_p);
+				pn.x.ModSub(&GSn[i].x);
+
+				pts[0] = pn;
+
+				for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k_index]== 0; i++) {
+					pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
+					r = bsgs_firstcheck(xpoint_raw);
+					if(r) {
+						if(FLAGDEBUG)	{
+							hextemp = tohex(xpoint_raw,32);
+							aux_c = base_key->GetBase16();
+							printf("[D] %s pass the bloom filter check %4i %i, base %s\n",hextemp,i,j,aux_c);
+							free(hextemp);
+							free(aux_c);
+						}
+						r = bsgs_secondcheck(base_key,((j*1024) + i),k_index,&keyfound);
+						if(r)	{
+							hextemp = keyfound.GetBase16();
+							printf("[+] Thread Key found privkey %s   \n",hextemp);
+							point_found = secp->ComputePublicKey(&keyfound);
+							aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k_index],point_found);
+							printf("[+] Publickey %s\n",aux_c);
+#if defined(_WIN64) && !defined(__CYGWIN__)
+							WaitForSingleObject(write_keys, INFINITE);
+#else
+							pthread_mutex_lock(&write_keys);
 #endif
 
-					pts[0] = pn;
-					
-					for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k]== 0; i++) {
-						pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-						r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-						if(r) {
-							if(FLAGDEBUG)	{
-								hextemp = tohex(xpoint_raw,32);
-								aux_c = base_key.GetBase16();
-								printf("[D] %s pass the bloom filter check %4i %i, base %s\n",hextemp,i,j,aux_c);
-								free(hextemp);
-								free(aux_c);
+							filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
+							if(filekey != NULL)	{
+								fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
+								fclose(filekey);
 							}
-							r = bsgs_secondcheck(&base_key,((j*1024) + i),k,&keyfound);
-							if(r)	{
-								hextemp = keyfound.GetBase16();
-								printf("[+] Thread Key found privkey %s   \n",hextemp);
-								point_found = secp->ComputePublicKey(&keyfound);
-								aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k],point_found);
-								printf("[+] Publickey %s\n",aux_c);
+							free(hextemp);
+							free(aux_c);
 #if defined(_WIN64) && !defined(__CYGWIN__)
-								WaitForSingleObject(write_keys, INFINITE);
+							ReleaseMutex(write_keys);
 #else
-								pthread_mutex_lock(&write_keys);
+							pthread_mutex_unlock(&write_keys);
 #endif
+							bsgs_found[k_index] = 1;
+							salir = 1;
+							for(l = 0; l < bsgs_point_number && salir; l++)	{
+								salir &= bsgs_found[l];
+							}
+							if(salir)	{
+								printf("All points were found\n");
+								exit(EXIT_FAILURE);
+							}
+						} //End if second check
+					}//End if first check
+				}// For for pts variable
+
+				// Next start point (startP += (bsSize*GRP_SIZE).G)
+				pp = startP[t];
+				dy.ModSub(&_2GSn.y,&pp.y);
+
+				_s.ModMulK1(&dy,&d[i + 1]);
+				_p.ModSquareK1(&_s);
+
+				pp.x.ModNeg();
+				pp.x.ModAdd(&_p);
+				pp.x.ModSub(&_2GSn.x);
+
+				pp.y.ModSub(&_2GSn.x,&pp.x);
+				pp.y.ModMulK1(&_s);
+				pp.y.ModSub(&_2GSn.y);
+				startP[t] = pp;
+			}
+
+			/* The targets found in this cycle leave the walk */
+			l = 0;
+			for(t = 0; t < n; t++)	{
+				if(bsgs_found[targets[t]] == 0)	{
+					targets[l] = targets[t];
+					startP[l] = startP[t];
+					l++;
+				}
+			}
+			n = l;
+			j++;
+		}
+	}
+}
 
-								filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-								if(filekey != NULL)	{
-									fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-									fclose(filekey);
-								}
-								free(hextemp);
-								free(aux_c);
 #if defined(_WIN64) && !defined(__CYGWIN__)
-				ReleaseMutex(write_keys);
+DWORD WINAPI thread_process_bsgs(LPVOID vargp) {
 #else
-				pthread_mutex_unlock(&write_keys);
+void *thread_process_bsgs(void *vargp)	{
 #endif
-								bsgs_found[k] = 1;
-								salir = 1;
-								for(l = 0; l < bsgs_point_number && salir; l++)	{
-									salir &= bsgs_found[l];
-								}
-								if(salir)	{
-									printf("All points were found\n");
-									exit(EXIT_FAILURE);
-								}
-							} //End if second check
-						}//End if first check
-						
-					}// For for pts variable
-					
-					// Next start point (startP += (bsSize*GRP_SIZE).G)
-					
-					pp = startP;
-					dy.ModSub(&_2GSn.y,&pp.y);
 
-					_s.ModMulK1(&dy,&dx[i + 1]);
-					_p.ModSquareK1(&_s);
+	struct tothread *tt;
+	char *aux_c;
+	Int base_key;
+	Point base_point,point_aux;
+	uint32_t thread_number, cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
+	Int km,intaux;
+	grp->Set(dx);
 
-					pp.x.ModNeg();
-					pp.x.ModAdd(&_p);
-					pp.x.ModSub(&_2GSn.x);
+	
+	tt = (struct tothread *)vargp;
+	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
+	free(tt);
+	
+	cycles = bsgs_aux / 1024;
+	if(bsgs_aux % 1024 != 0)	{
+		cycles++;
+	}
+	
+	intaux.Set(&BSGS_M_double);
+	intaux.Mult(CPU_GRP_SIZE/2);
+	intaux.Add(&BSGS_M);
+	
+	do	{
 
-					pp.y.ModSub(&_2GSn.x,&pp.x);
-					pp.y.ModMulK1(&_s);
-					pp.y.ModSub(&_2GSn.y);
-					startP = pp;
-					
-					j++;
-				} //while all the aMP points
-			}// End if 
+	/*
+		The next block of 2*BSGS_N keys comes from the atomic block counter,
+		so base_key is never the same between threads and there is no lock here
+	*/
+		work_cursor_take(&bsgs_cursor,thread_number,&base_key);
+
+		if(base_key.IsGreaterOrEqual(&n_range_end))
+			break;
+
+
+		if(FLAGMATRIX)	{
+			aux_c = base_key.GetBase16();
+			printf("[+] Thread 0x%s \n",aux_c);
+			fflush(stdout);
+			free(aux_c);
 		}
-		steps[thread_number]+=2;
+		else	{
+			if(FLAGQUIET == 0){
+				aux_c = base_key.GetBase16();
+				printf("\r[+] Thread 0x%s   \r",aux_c);
+				fflush(stdout);
+				free(aux_c);
+				THREADOUTPUT = 1;
+			}
+		}
+		
+		base_point = secp->ComputePublicKey(&base_key);
+
+		km.Set(&base_key);
+		km.Neg();
+		
+		km.Add(&secp->order);
+		km.Sub(&intaux);
+		point_aux = secp->ComputePublicKey(&km);
+		
+		bsgs_walk_targets(&base_key,point_aux,cycles,grp,dx);
+		telemetry[thread_number].steps+=2;
 	}while(1);
 	ends[thread_number] = 1;
 	return NULL;
@@ -4139,33 +5637,20 @@ DWORD WINAPI thread_process_bsgs_random(LPVOID vargp) {
 void *thread_process_bsgs_random(void *vargp)	{
 #endif
 
-	FILE *filekey;
 	struct tothread *tt;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound,n_range_random;
-	Point base_point,point_aux,point_found;
-	uint32_t k,l,r,salir,thread_number,cycles;
-	
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
-
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
+	char *aux_c;
+	Int base_key,n_range_random;
+	Point base_point,point_aux;
+	uint32_t thread_number,cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
 	Int km,intaux;
-	Point pp;
-	Point pn;
 	grp->Set(dx);
 
 
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	
 	cycles = bsgs_aux / 1024;
@@ -4227,169 +5712,208 @@ void *thread_process_bsgs_random(void *vargp)	{
 		point_aux = secp->ComputePublicKey(&km);
 
 
-		/* We need to test individually every point in BSGS_Q */
-		for(k = 0; k < bsgs_point_number ; k++)	{
-			if(bsgs_found[k] == 0)	{			
-				startP  = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
-				uint32_t j = 0;
-				while( j < cycles && bsgs_found[k]== 0 )	{
-				
-					int i;
-					for(i = 0; i < hLength; i++) {
-						dx[i].ModSub(&GSn[i].x,&startP.x);
-					}
-					dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-					dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
-
-					// Grouped ModInv
-					grp->ModInv();
-					
-					/*
-					We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-					We compute key in the positive and negative way from the center of the group
-					*/
-
-					// center point
-					pts[CPU_GRP_SIZE / 2] = startP;
-					
-					for(i = 0; i<hLength; i++) {
-
-						pp = startP;
-						pn = startP;
-
-						// P = startP + i*G
-						dy.ModSub(&GSn[i].y,&pp.y);
-
-						_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pp.x.ModNeg();
-						pp.x.ModAdd(&_p);
-						pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-						
-#if 0
-  pp.y.ModSub(&GSn[i].x,&pp.x);
-  pp.y.ModMulK1(&_s);
-  pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-						// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-						dyn.Set(&GSn[i].y);
-						dyn.ModNeg();
-						dyn.ModSub(&pn.y);
-
-						_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pn.x.ModNeg();
-						pn.x.ModAdd(&_p);
-						pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
-
-#if 0
-  pn.y.ModSub(&GSn[i].x,&pn.x);
-  pn.y.ModMulK1(&_s);
-  pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-
-						pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
-						pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
-
-					}
-
-					// First point (startP - (GRP_SZIE/2)*G)
-					pn = startP;
-					dyn.Set(&GSn[i].y);
-					dyn.ModNeg();
-					dyn.ModSub(&pn.y);
-
-					_s.ModMulK1(&dyn,&dx[i]);
-					_p.ModSquareK1(&_s);
-
-					pn.x.ModNeg();
-					pn.x.ModAdd(&_p);
-					pn.x.ModSub(&GSn[i].x);
-
-#if 0
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
-#endif
-
-					pts[0] = pn;
-					
-					for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k]== 0; i++) {
-						pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-						r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-						if(r) {
-							r = bsgs_secondcheck(&base_key,((j*1024) + i),k,&keyfound);
-							if(r)	{
-								hextemp = keyfound.GetBase16();
-								printf("[+] Thread Key found privkey %s    \n",hextemp);
-								point_found = secp->ComputePublicKey(&keyfound);
-								aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k],point_found);
-								printf("[+] Publickey %s\n",aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								WaitForSingleObject(write_keys, INFINITE);
-#else
-								pthread_mutex_lock(&write_keys);
-#endif
+		bsgs_walk_targets(&base_key,point_aux,cycles,grp,dx);
+		telemetry[thread_number].steps+=2;
+	}while(1);
+	ends[thread_number] = 1;
+	return NULL;
+}
 
-								filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-								if(filekey != NULL)	{
-									fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-									fclose(filekey);
-								}
-								free(hextemp);
-								free(aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								ReleaseMutex(write_keys);
-#else
-								pthread_mutex_unlock(&write_keys);
-#endif
+/*
+	The bsgs_firstcheck function is the first tier check of every giant step point.
+	If the first level filter (-L) is enabled it discards most of the points before
+	the big bloom_bP filter, that one is usually on RAM and each probe is a cache miss.
+*/
+int bsgs_firstcheck(char *xpoint_raw)	{
+	int r;
+	if(FLAGPREFILTER)	{
+		thread_telemetry->probes[TIER_PRE]++;
+		if(!bloom_check_blocked(&bloom_bP_pre,xpoint_raw,32))	{
+			return 0;
+		}
+		thread_telemetry->hits[TIER_PRE]++;
+	}
+	thread_telemetry->probes[TIER_BP]++;
+	r = bloom_check(&bloom_bP[bsgs_shard(xpoint_raw)],xpoint_raw,32);
+	thread_telemetry->hits[TIER_BP] += (r == 1);
+	return r;
+}
 
-								bsgs_found[k] = 1;
-								salir = 1;
-								for(l = 0; l < bsgs_point_number && salir; l++)	{
-									salir &= bsgs_found[l];
-								}
-								if(salir)	{
-									printf("All points were found\n");
-									exit(EXIT_FAILURE);
-								}
-							} //End if second check
-						}//End if first check
-						
-					}// For for pts variable
-					
-					// Next start point (startP += (bsSize*GRP_SIZE).G)
-					
-					pp = startP;
-					dy.ModSub(&_2GSn.y,&pp.y);
+/*
+	Same as bsgs_firstcheck for the address, rmd160, xpoint and minikeys modes,
+	the bloom filter check counted as the first tier
+*/
+int address_bloomcheck(char *data,int length)	{
+	int r = bloom_check(&bloom,data,length);
+	thread_telemetry->probes[TIER_BP]++;
+	thread_telemetry->hits[TIER_BP] += (r == 1);
+	return r;
+}
 
-					_s.ModMulK1(&dy,&dx[i + 1]);
-					_p.ModSquareK1(&_s);
+/*
+	The bloom_bP shard of one point is taken from the first bits of the X value,
+	with 256 shards this is the first byte as it always was
+*/
+uint32_t bsgs_shard(char *xpoint_raw)	{
+	return (((uint32_t)(uint8_t)xpoint_raw[0] << 8) | (uint8_t)xpoint_raw[1]) >> (16 - bloom_bP_shard_bits);
+}
 
-					pp.x.ModNeg();
-					pp.x.ModAdd(&_p);
-					pp.x.ModSub(&_2GSn.x);
+/*
+	Read one of the sharded bloom files, return 1 if the file was readed and 0 if the file
+	doesn't exist or it was made with other parameters, so it need to be created again.
+	Files made before bsgs_file_header existed are only valid for 256 shards.
+*/
+int bsgs_read_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items)	{
+	struct bsgs_file_header header;
+	struct bloom oldformat_bloom;
+	char rawvalue[32];
+	uint32_t i;
+	int oldformat = 0,readed;
+	FILE *fd = fopen(filename,"rb");
+	if(fd == NULL)	{
+		return 0;
+	}
+	readed = fread(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error reading the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	if(memcmp(header.magic,BSGS_FILE_MAGIC,8) != 0)	{
+		oldformat = 1;
+		fseek(fd,0,SEEK_SET);
+	}
+	if((oldformat && shards != 256) || (!oldformat && (header.version != BSGS_FILE_VERSION || header.shards != shards || header.items != items)))	{
+		fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+		fclose(fd);
+		return 0;
+	}
+	printf("[+] Reading bloom filter from file %s ",filename);
+	fflush(stdout);
+	for(i = 0; i < shards; i++)	{
+		if(oldformat)	{
+			readed = fread(&oldformat_bloom,sizeof(struct bloom),1,fd);
+			if(readed == 1 && oldformat_bloom.bytes != blooms[i].bytes)	{
+				readed = 2;
+			}
+			else if(readed == 1)	{
+				oldformat_bloom.bf = blooms[i].bf;	/* Keeping our bf pointer*/
+				memcpy(&blooms[i],&oldformat_bloom,sizeof(struct bloom));
+			}
+		}
+		else	{
+			readed = bloom_load_header(&blooms[i],fd);
+			readed = (readed == 0) ? 1 : readed;
+		}
+		if(readed == 2)	{
+			fprintf(stderr,"[W] The file %s was made with other parameters, it will be created again\n",filename);
+			fclose(fd);
+			return 0;
+		}
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		readed = fread(blooms[i].bf,blooms[i].bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		readed = fread(&checksums[i],sizeof(struct checksumsha256),1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error reading the file %s\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		if(FLAGSKIPCHECKSUM == 0)	{
+			sha256((uint8_t*)blooms[i].bf,blooms[i].bytes,(uint8_t*)rawvalue);
+			if(memcmp(checksums[i].data,rawvalue,32) != 0 || memcmp(checksums[i].backup,rawvalue,32) != 0 )	{	/* Verification */
+				fprintf(stderr,"[E] Error checksum file mismatch! %s\n",filename);
+				exit(EXIT_FAILURE);
+			}
+		}
+		if(i % (shards > 4 ? shards / 4 : 1) == 0)	{
+			printf(".");
+			fflush(stdout);
+		}
+	}
+	printf(" Done!\n");
+	fclose(fd);
+	return 1;
+}
 
-					pp.y.ModSub(&_2GSn.x,&pp.x);
-					pp.y.ModMulK1(&_s);
-					pp.y.ModSub(&_2GSn.y);
-					startP = pp;
-					
-					j++;
-					
-				}	//End While
-				
-			}	//End if
-		} // End for with k bsgs_point_number
+void bsgs_write_blooms(const char *filename,struct bloom *blooms,struct checksumsha256 *checksums,uint32_t shards,uint64_t items)	{
+	struct bsgs_file_header header;
+	uint32_t i;
+	int readed;
+	FILE *fd = fopen(filename,"wb");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Error can't create the file %s\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	memset(&header,0,sizeof(struct bsgs_file_header));
+	memcpy(header.magic,BSGS_FILE_MAGIC,8);
+	header.version = BSGS_FILE_VERSION;
+	header.shards = shards;
+	header.items = items;
+	printf("[+] Writing bloom filter to file %s ",filename);
+	fflush(stdout);
+	readed = fwrite(&header,sizeof(struct bsgs_file_header),1,fd);
+	if(readed != 1)	{
+		fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0; i < shards; i++)	{
+		if(bloom_save_header(&blooms[i],fd) != 0)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		readed = fwrite(blooms[i].bf,blooms[i].bytes,1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		readed = fwrite(&checksums[i],sizeof(struct checksumsha256),1,fd);
+		if(readed != 1)	{
+			fprintf(stderr,"[E] Error writing the file %s please delete it\n",filename);
+			exit(EXIT_FAILURE);
+		}
+		if(i % (shards > 4 ? shards / 4 : 1) == 0)	{
+			printf(".");
+			fflush(stdout);
+		}
+	}
+	printf(" Done!\n");
+	fclose(fd);
+}
 
-		steps[thread_number]+=2;
-	}while(1);
-	ends[thread_number] = 1;
-	return NULL;
+/*
+	X of base + points[i] for the 32 points of BSGS_AMP2 or BSGS_AMP3, the same values of
+	32 secp->AddDirect(base,points[i]) but with only one modular inversion for all of them.
+	If base is the negated of one point there is no valid sum, its dx is changed to 1 so the
+	inversion of the others is not broken, bsgs_thirdcheck has its own check for that case.
+*/
+void bsgs_batch_x(Point &base,std::vector<Point> &points,char xpoint_raw[][32])	{
+	IntGroup grp(32);
+	Int dx[32];
+	Int dy,_s,_p,x;
+	int i;
+	for(i = 0; i < 32; i++)	{
+		if(base.x.IsEqual(&points[i].x))	{
+			dx[i].SetInt32(1);
+		}
+		else	{
+			dx[i].ModSub(&points[i].x,&base.x);
+		}
+	}
+	grp.Set(dx);
+	grp.ModInv();
+	for(i = 0; i < 32; i++)	{
+		dy.ModSub(&points[i].y,&base.y);
+		_s.ModMulK1(&dy,&dx[i]);
+		_p.ModSquareK1(&_s);
+		x.ModSub(&_p,&base.x);
+		x.ModSub(&points[i].x);
+		x.Get32Bytes((unsigned char *)xpoint_raw[i]);
+	}
 }
 
 /*
@@ -4400,8 +5924,8 @@ int bsgs_secondcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privateke
 	int i = 0,found = 0,r = 0;
 	Int base_key;
 	Point base_point,point_aux;
-	Point BSGS_Q, BSGS_S,BSGS_Q_AMP;
-	char xpoint_raw[32];
+	Point BSGS_Q, BSGS_S;
+	char xpoint_raw[32][32];
 
 
 	base_key.Set(&BSGS_M_double);
@@ -4418,11 +5942,11 @@ int bsgs_secondcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privateke
 	*/
 	BSGS_S = secp->AddDirect(OriginalPointsBSGS[k_index],point_aux);
 	BSGS_Q.Set(BSGS_S);
+	bsgs_batch_x(BSGS_Q,BSGS_AMP2,xpoint_raw);
 	do {
-		BSGS_Q_AMP = secp->AddDirect(BSGS_Q,BSGS_AMP2[i]);
-		BSGS_S.Set(BSGS_Q_AMP);
-		BSGS_S.x.Get32Bytes((unsigned char *) xpoint_raw);
-		r = bloom_check(&bloom_bPx2nd[(uint8_t) xpoint_raw[0]],xpoint_raw,32);
+		r = bloom_check(&bloom_bPx2nd[(uint8_t) xpoint_raw[i][0]],xpoint_raw[i],32);
+		thread_telemetry->probes[TIER_2ND]++;
+		thread_telemetry->hits[TIER_2ND] += (r == 1);
 		if(r)	{
 			found = bsgs_thirdcheck(&base_key,i,k_index,privatekey);
 		}
@@ -4436,8 +5960,8 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey
 	int i = 0,found = 0,r = 0;
 	Int base_key,calculatedkey;
 	Point base_point,point_aux;
-	Point BSGS_Q, BSGS_S,BSGS_Q_AMP;
-	char xpoint_raw[32];
+	Point BSGS_Q, BSGS_S;
+	char xpoint_raw[32][32];
 
 	base_key.SetInt32(a);
 	base_key.Mult(&BSGS_M2_double);
@@ -4449,13 +5973,25 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey
 	BSGS_S = secp->AddDirect(OriginalPointsBSGS[k_index],point_aux);
 	BSGS_Q.Set(BSGS_S);
 	
+	bsgs_batch_x(BSGS_Q,BSGS_AMP3,xpoint_raw);
 	do {
-		BSGS_Q_AMP = secp->AddDirect(BSGS_Q,BSGS_AMP3[i]);
-		BSGS_S.Set(BSGS_Q_AMP);
-		BSGS_S.x.Get32Bytes((unsigned char *)xpoint_raw);
-		r = bloom_check(&bloom_bPx3rd[(uint8_t)xpoint_raw[0]],xpoint_raw,32);
+		if(FLAGHASHINDEX)	{
+			r = 1;	/* The hash index answer membership and index in the same lookup */
+		}
+		else	{
+			r = bloom_check(&bloom_bPx3rd[(uint8_t)xpoint_raw[i][0]],xpoint_raw[i],32);
+			thread_telemetry->probes[TIER_3RD]++;
+			thread_telemetry->hits[TIER_3RD] += (r == 1);
+		}
 		if(r)	{
-			r = bsgs_searchbinary(bPtable,xpoint_raw,bsgs_m3,&j);
+			if(FLAGHASHINDEX)	{
+				r = bsgs_hashindex_search(xpoint_raw[i],&j);
+			}
+			else	{
+				r = bsgs_searchbinary(bPtable,xpoint_raw[i],bsgs_m3,&j);
+			}
+			thread_telemetry->probes[TIER_TABLE]++;
+			thread_telemetry->hits[TIER_TABLE] += r;
 			if(r)	{
 				calcualteindex(i,&calculatedkey);
 				privatekey->Set(&calculatedkey);
@@ -4477,11 +6013,12 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey
 				}
 			}
 		}
-		else	{
+		if(!found)	{
 			/*
 				For some reason the AddDirect don't return 000000... value when the publickeys are the negated values from each other
 				Why JLP?
 				This is is an special case
+				With -H there is no third bloom filter, so it is checked after the miss of the table too
 			*/
 			if(BSGS_Q.x.IsEqual(&BSGS_AMP3[i].x))	{
 				calcualteindex(i,&calculatedkey);
@@ -4492,9 +6029,520 @@ int bsgs_thirdcheck(Int *start_range,uint32_t a,uint32_t k_index,Int *privatekey
 		}
 		i++;
 	}while(i < 32 && !found);
+	thread_telemetry->matches += found;
 	return found;
 }
 
+/*
+	Keys of one step of the per thread counters, the same total of the stats line
+*/
+double metrics_keys_per_step()	{
+	double keys = (double)BSGS_N.GetInt64();
+	if(FLAGENDOMORPHISM)	{
+		keys *= (FLAGMODE == MODE_XPOINT) ? 3 : 6;
+	}
+	else if(FLAGSEARCH == SEARCH_COMPRESS)	{
+		keys *= 2;
+	}
+	return keys;
+}
+
+#if !defined(_WIN64) || defined(__CYGWIN__)
+void metrics_printf(int fd,const char *format,...)	{
+	char buffer[512];
+	va_list args;
+	int length;
+	va_start(args,format);
+	length = vsnprintf(buffer,sizeof(buffer),format,args);
+	va_end(args);
+	if(send(fd,buffer,length < (int)sizeof(buffer) ? length : (int)sizeof(buffer) - 1,MSG_NOSIGNAL) < 0)	{
+		/* The scraper is gone, the connection is closed by thread_metrics */
+	}
+}
+
+/*
+	Prometheus text format of the -W port. The per thread counters are only read, never
+	written here, so a scrape doesn't touch the hot path. There is no speed gauge, the
+	scrapers get it from the counters with rate(), each one with its own window.
+*/
+void metrics_reply(int fd)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches,steps,total_steps = 0;
+	double keys;
+	int i;
+	keys = metrics_keys_per_step();
+	metrics_printf(fd,"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+	metrics_printf(fd,"# HELP keyhunt_thread_keys_total Keys checked by each thread\n# TYPE keyhunt_thread_keys_total counter\n");
+	for(i = 0; i < NTHREADS; i++)	{
+		steps = telemetry[i].steps;
+		metrics_printf(fd,"keyhunt_thread_keys_total{thread=\"%i\"} %.0f\n",i,(double)steps * keys);
+		total_steps += steps;
+	}
+	metrics_printf(fd,"# HELP keyhunt_keys_total Keys checked by all the threads\n# TYPE keyhunt_keys_total counter\nkeyhunt_keys_total %.0f\n",(double)total_steps * keys);
+	metrics_printf(fd,"# HELP keyhunt_blocks_total Blocks of N keys completed, giant step blocks in bsgs\n# TYPE keyhunt_blocks_total counter\nkeyhunt_blocks_total %" PRIu64 "\n",total_steps);
+
+	telemetry_totals(probes,hits,&matches);
+	metrics_printf(fd,"# HELP keyhunt_bloom_probes_total Checks of each filter tier\n# TYPE keyhunt_bloom_probes_total counter\n");
+	for(i = 0; i < TELEMETRY_TIERS; i++)	{
+		metrics_printf(fd,"keyhunt_bloom_probes_total{tier=\"%s\"} %" PRIu64 "\n",telemetry_names[i],probes[i]);
+	}
+	metrics_printf(fd,"# HELP keyhunt_bloom_hits_total Positive checks of each filter tier\n# TYPE keyhunt_bloom_hits_total counter\n");
+	for(i = 0; i < TELEMETRY_TIERS; i++)	{
+		metrics_printf(fd,"keyhunt_bloom_hits_total{tier=\"%s\"} %" PRIu64 "\n",telemetry_names[i],hits[i]);
+	}
+
+	metrics_printf(fd,"# HELP keyhunt_table_bytes Memory of the bloom filters and the tables\n# TYPE keyhunt_table_bytes gauge\n");
+	if(FLAGMODE == MODE_BSGS)	{
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"pre\"} %" PRIu64 "\n",FLAGPREFILTER ? bloom_bP_pre.bytes : 0);
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"bP\"} %" PRIu64 "\n",bloom_bP_totalbytes);
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"2nd\"} %" PRIu64 "\n",bloom_bP2_totalbytes);
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"3rd\"} %" PRIu64 "\n",bloom_bP3_totalbytes);
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"%s\"} %" PRIu64 "\n",FLAGHASHINDEX ? "hashindex" : "bPtable",FLAGHASHINDEX ? hashindex_buckets * (uint64_t)sizeof(struct hashindex_bucket) : bsgs_m3 * (uint64_t)sizeof(struct bsgs_xvalue));
+	}
+	else	{
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"bloom\"} %" PRIu64 "\n",bloom.bytes);
+		metrics_printf(fd,"keyhunt_table_bytes{table=\"addresses\"} %" PRIu64 "\n",N * (uint64_t)sizeof(struct address_value));
+	}
+}
+
+/*
+	-W listener, one scrape at the time with blocking sockets, it only reads the counters
+*/
+void *thread_metrics(void *vargp)	{
+	struct sockaddr_in address;
+	struct timeval timeout;
+	char request[4096];
+	int server_fd,fd,opt = 1,length,bytes;
+	if((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))	{
+		fprintf(stderr,"[E] metrics socket failed\n");
+		return NULL;
+	}
+	memset(&address,0,sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = inet_addr("127.0.0.1");
+	address.sin_port = htons(metrics_port);
+	if(bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(server_fd, 16) < 0)	{
+		fprintf(stderr,"[E] metrics bind failed on port %i\n",metrics_port);
+		close(server_fd);
+		return NULL;
+	}
+	printf("[+] Metrics in http://127.0.0.1:%i/metrics\n",metrics_port);
+	timeout.tv_sec = 2;
+	timeout.tv_usec = 0;
+	while(1)	{
+		if((fd = accept(server_fd,NULL,NULL)) < 0)	{
+			continue;
+		}
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		length = 0;
+		do	{
+			bytes = recv(fd,request + length,sizeof(request) - 1 - length,0);
+			if(bytes > 0)	{
+				length += bytes;
+				request[length] = '\0';
+			}
+		}while(bytes > 0 && length < (int)sizeof(request) - 1 && strstr(request,"\r\n\r\n") == NULL);
+		if(length > 0)	{
+			if(strncmp(request,"GET /metrics ",13) == 0 || strncmp(request,"GET / ",6) == 0)	{
+				metrics_reply(fd);
+			}
+			else	{
+				metrics_printf(fd,"HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n404 Not Found\n");
+			}
+		}
+		close(fd);
+	}
+	return NULL;
+}
+#endif
+
+/*
+	Sum the per thread counters, the values can be a bit behind of the threads
+	that are still running, it is the same for the steps counters.
+*/
+void telemetry_totals(uint64_t *probes,uint64_t *hits,uint64_t *matches)	{
+	int i,j;
+	memset(probes,0,sizeof(uint64_t)*TELEMETRY_TIERS);
+	memset(hits,0,sizeof(uint64_t)*TELEMETRY_TIERS);
+	*matches = 0;
+	if(telemetry == NULL)	{
+		return;
+	}
+	for(i = 0; i < NTHREADS; i++)	{
+		for(j = 0; j < TELEMETRY_TIERS; j++)	{
+			probes[j] += telemetry[i].probes[j];
+			hits[j] += telemetry[i].hits[j];
+		}
+		*matches += telemetry[i].matches;
+	}
+}
+
+/*
+	Observed false positive rate of one tier, the points of the keys found are real
+	hits on every tier so they are not counted as false positives.
+*/
+double telemetry_observed(uint64_t probes,uint64_t hits,uint64_t matches)	{
+	if(probes == 0)	{
+		return 0;
+	}
+	return (double)((hits > matches) ? hits - matches : 0) / (double)probes;
+}
+
+/*
+	Theoretical false positive rate of each tier with the number of items that each
+	shard really holds, the real bits and hashes of the filter.
+*/
+double telemetry_expected(int tier)	{
+	switch(tier)	{
+		case TIER_PRE:
+			return FLAGPREFILTER ? (double)bloom_bP_pre.error : 0;
+		case TIER_BP:
+			if(FLAGMODE != MODE_BSGS)	{
+				return bloom_expected_error(&bloom,N);
+			}
+			return (bloom_bP != NULL) ? bloom_expected_error(&bloom_bP[0],bsgs_m/bloom_bP_shards) : 0;
+		case TIER_2ND:
+			return (bloom_bPx2nd != NULL) ? bloom_expected_error(&bloom_bPx2nd[0],bsgs_m2/256) : 0;
+		case TIER_3RD:
+			return (bloom_bPx3rd != NULL) ? bloom_expected_error(&bloom_bPx3rd[0],bsgs_m3/256) : 0;
+	}
+	return 0;
+}
+
+/*
+	Short observed/expected false positive rate of every tier with probes, for the stats line
+*/
+char *telemetry_line(char *line,size_t length)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches;
+	size_t len = 0;
+	int j;
+	line[0] = '\0';
+	telemetry_totals(probes,hits,&matches);
+	for(j = 0; j < TIER_TABLE && len < length; j++)	{
+		if(probes[j])	{
+			len += snprintf(line + len,length - len," %s %.2e/%.2e",telemetry_names[j],telemetry_observed(probes[j],hits[j],matches),telemetry_expected(j));
+		}
+	}
+	if(probes[TIER_TABLE] && len < length)	{
+		snprintf(line + len,length - len," table %" PRIu64 "/%" PRIu64,hits[TIER_TABLE],probes[TIER_TABLE]);
+	}
+	return line;
+}
+
+/*
+	Write all the counters as JSON, first to a temporary file and then renamed so any
+	external reader never see a half written file.
+*/
+void telemetry_dump(const char *filename)	{
+	uint64_t probes[TELEMETRY_TIERS],hits[TELEMETRY_TIERS],matches;
+	char tempname[1024];
+	FILE *fd;
+	int j;
+	telemetry_totals(probes,hits,&matches);
+	snprintf(tempname,sizeof(tempname),"%s.tmp",filename);
+	fd = fopen(tempname,"w");
+	if(fd == NULL)	{
+		fprintf(stderr,"[E] Can't open the file %s\n",tempname);
+		return;
+	}
+	fprintf(fd,"{\"threads\":%i,\"tiers\":[",NTHREADS);
+	for(j = 0; j < TELEMETRY_TIERS; j++)	{
+		fprintf(fd,"%s{\"name\":\"%s\",\"probes\":%" PRIu64 ",\"hits\":%" PRIu64 ",\"observed\":%.6e,\"expected\":%.6e}",(j > 0) ? "," : "",telemetry_names[j],probes[j],hits[j],telemetry_observed(probes[j],hits[j],matches),telemetry_expected(j));
+	}
+	fprintf(fd,"],\"matches\":%" PRIu64 "}\n",matches);
+	fclose(fd);
+	if(rename(tempname,filename) != 0)	{
+		fprintf(stderr,"[E] Can't rename %s to %s\n",tempname,filename);
+	}
+}
+/*
+	Quick calibration for the -P planner: one thread compute some groups of giant step
+	points exactly as the bsgs threads do, and probe a big bloom filter and a small
+	blocked one. The filters are filled with a 50% bit pattern like a full filter.
+*/
+void plan_calibrate(struct plan_calibration *cal)	{
+	struct timespec start,end;
+	std::vector<Point> gs(CPU_GRP_SIZE/2);
+	Point _2gs,startP,pp,pn;
+	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
+	Int dx[CPU_GRP_SIZE / 2 + 1];
+	Int dy,dyn,_s,_p,key,min,max;
+	struct bloom big,small;
+	uint64_t count,probes,aux[4],big_bytes;
+	unsigned char xpoint_raw[32];
+	int i,hLength = (CPU_GRP_SIZE / 2 - 1);
+	double seconds;
+
+	grp->Set(dx);
+	gs[0] = secp->G;
+	gs[1] = secp->DoubleDirect(secp->G);
+	for(i = 2; i < CPU_GRP_SIZE / 2; i++)	{
+		gs[i] = secp->AddDirect(gs[i-1],secp->G);
+	}
+	_2gs = secp->DoubleDirect(gs[CPU_GRP_SIZE / 2 - 1]);
+	min.SetInt32(1);
+	max.Set(&secp->order);
+	key.Rand(&min,&max);
+	startP = secp->ComputePublicKey(&key);
+
+	count = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	do	{
+		for(i = 0; i < hLength; i++)	{
+			dx[i].ModSub(&gs[i].x,&startP.x);
+		}
+		dx[i].ModSub(&gs[i].x,&startP.x);
+		dx[i+1].ModSub(&_2gs.x,&startP.x);
+		grp->ModInv();
+		for(i = 0; i < hLength; i++)	{
+			pp = startP;
+			pn = startP;
+			dy.ModSub(&gs[i].y,&pp.y);
+			_s.ModMulK1(&dy,&dx[i]);
+			_p.ModSquareK1(&_s);
+			pp.x.ModNeg();
+			pp.x.ModAdd(&_p);
+			pp.x.ModSub(&gs[i].x);
+			pp.x.Get32Bytes(xpoint_raw);
+			dyn.Set(&gs[i].y);
+			dyn.ModNeg();
+			dyn.ModSub(&pn.y);
+			_s.ModMulK1(&dyn,&dx[i]);
+			_p.ModSquareK1(&_s);
+			pn.x.ModNeg();
+			pn.x.ModAdd(&_p);
+			pn.x.ModSub(&gs[i].x);
+			pn.x.Get32Bytes(xpoint_raw);
+		}
+		pp = startP;
+		dy.ModSub(&_2gs.y,&pp.y);
+		_s.ModMulK1(&dy,&dx[i + 1]);
+		_p.ModSquareK1(&_s);
+		pp.x.ModNeg();
+		pp.x.ModAdd(&_p);
+		pp.x.ModSub(&_2gs.x);
+		pp.y.ModSub(&_2gs.x,&pp.x);
+		pp.y.ModMulK1(&_s);
+		pp.y.ModSub(&_2gs.y);
+		startP = pp;
+		count += CPU_GRP_SIZE;
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	}while(seconds < 0.3);
+	cal->point_ns = seconds * 1e9 / (double)count;
+	delete grp;
+
+	/* 256 MB or a quarter of the RAM, enough to miss every cache level */
+	big_bytes = (plan_ram / 4 < 268435456) ? plan_ram / 4 : 268435456;
+	if(bloom_init2(&big,(uint64_t)((double)big_bytes * 8 / 28.7552),0.000001) == 1 || bloom_init_blocked(&small,65536,4194304) == 1)	{
+		fprintf(stderr,"[E] error bloom_init for the calibration\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(big.bf,0x55,big.bytes);
+	memset(small.bf,0x55,small.bytes);
+	probes = 2000000;
+	memset(aux,0,sizeof(aux));
+	count = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for(aux[0] = 0; aux[0] < probes; aux[0]++)	{
+		count += bloom_check(&big,aux,sizeof(aux));
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	cal->probe_ns = ((double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec)) / (double)probes;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for(aux[0] = 0; aux[0] < probes; aux[0]++)	{
+		count += bloom_check_blocked(&small,aux,sizeof(aux));
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	cal->preprobe_ns = ((double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec)) / (double)probes;
+	if(count == 0)	{	/* Keep the compiler from dropping the loops */
+		cal->probe_ns += 0;
+	}
+	bloom_free(&big);
+	bloom_free(&small);
+}
+
+/*
+	RAM of the three bloom tiers, the bP table and the first level filter for one M value,
+	the same sizes that main() computes before allocating
+*/
+uint64_t plan_memory(uint64_t m,uint64_t prefilter_bytes)	{
+	uint64_t m2,m3,items,total;
+	m2 = m / 32 + ((m % 32) ? 1 : 0);
+	m3 = m2 / 32 + ((m2 % 32) ? 1 : 0);
+	items = (m / bloom_bP_shards > 1000) ? m / bloom_bP_shards + ((m % bloom_bP_shards) ? 1 : 0) : 1000;
+	total = bloom_estimate_bytes(items,0.000001) * bloom_bP_shards;
+	items = (m2 / 256 > 1000) ? m2 / 256 + ((m2 % 256) ? 1 : 0) : 1000;
+	total += bloom_estimate_bytes(items,0.000001) * 256;
+	items = (m3 / 256 > 1000) ? m3 / 256 + ((m3 % 256) ? 1 : 0) : 1000;
+	total += bloom_estimate_bytes(items,0.000001) * 256;
+	total += m3 * sizeof(struct bsgs_xvalue);
+	return total + prefilter_bytes;
+}
+
+void plan_time(double seconds,char *dst,size_t length)	{
+	if(seconds < 120)	{
+		snprintf(dst,length,"%.1f seconds",seconds);
+	}
+	else if(seconds < 7200)	{
+		snprintf(dst,length,"%.1f minutes",seconds/60);
+	}
+	else if(seconds < 172800)	{
+		snprintf(dst,length,"%.1f hours",seconds/3600);
+	}
+	else if(seconds < 63072000)	{
+		snprintf(dst,length,"%.1f days",seconds/86400);
+	}
+	else	{
+		snprintf(dst,length,"%.3g years",seconds/31557600);
+	}
+}
+
+/*
+	The -P planner: for every -n from 2^40 to 2^64 take the biggest -k that fit
+	in the given RAM, with and without a first level filter of half of the L3 cache.
+	Speed and build time come from plan_calibrate() and assume linear scaling with threads.
+	The filters are sized for the fixed 0.000001 error of main(), so the error is not a choice.
+*/
+void plan_run(uint64_t targets,double range_bits)	{
+	struct plan_calibration cal;
+	uint64_t m,k,step,memory,prefilter_bytes,best_k = 0,best_prefilter = 0;
+	double hashes,bpe,pass,cost,speed,build,best_speed = 0;
+	char str_build[64],str_range[64],str_n[24],str_prefilter[16],best_n[24];
+	long cache = 0;
+	int e,f;
+
+	printf("[+] Planning for %.2f GB of RAM, %" PRIu64 " target%s, %i thread%s",(double)plan_ram/1073741824.0,targets,(targets > 1) ? "s" : "",NTHREADS,(NTHREADS > 1) ? "s" : "");
+	if(range_bits > 0)	{
+		printf(", range 2^%.1f",range_bits);
+	}
+	printf("\n");
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+	cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+	if(cache <= 0)	{
+		cache = 8388608;
+	}
+	prefilter_bytes = 1048576;
+	while(prefilter_bytes * 4 <= (uint64_t)cache)	{
+		prefilter_bytes *= 2;
+	}
+	plan_calibrate(&cal);
+	printf("[+] Calibration: %.1f ns per point, %.1f ns per bloom probe, %.1f ns per first level probe\n",cal.point_ns,cal.probe_ns,cal.preprobe_ns);
+	printf("[+]   -n                  -k      -L       RAM MB  Build time           Keys/s  Range time\n");
+	for(e = 40; e <= 64; e += 4)	{
+		if(range_bits > 0 && (double)e > range_bits)	{
+			break;
+		}
+		if(plan_memory((uint64_t)1 << (e/2),0) > plan_ram)	{
+			continue;
+		}
+		/* Biggest -k that fit in the RAM, the memory grows with M = sqrt(n) * k */
+		k = 1;
+		step = 1048576;
+		while(step > 0)	{
+			if(plan_memory(((uint64_t)1 << (e/2)) * (k + step),0) <= plan_ram)	{
+				k += step;
+			}
+			step /= 2;
+		}
+		m = ((uint64_t)1 << (e/2)) * k;
+		/* -n is 2^e, a one followed by e/4 hexadecimal zeros */
+		snprintf(str_n,sizeof(str_n),"0x1%0*d",e/4,0);
+		for(f = 0; f < 2; f++)	{
+			/* Same math as bloom_init_blocked for the first level filter */
+			bpe = (double)prefilter_bytes * 8 / (double)m;
+			hashes = round(0.693147180559945 * bpe);
+			hashes = (hashes < 1) ? 1 : ((hashes > 16) ? 16 : hashes);
+			pass = pow(1 - exp(-hashes / bpe),hashes);
+			if(f == 1 && pass > 0.5)	{
+				continue;
+			}
+			memory = plan_memory(m,f ? prefilter_bytes : 0);
+			if(memory > plan_ram)	{
+				continue;
+			}
+			cost = cal.point_ns + (f ? cal.preprobe_ns + pass * cal.probe_ns : cal.probe_ns);
+			speed = 2 * (double)m * 1e9 / cost * (double)NTHREADS / (double)targets;
+			build = (double)m * (cal.point_ns + cal.probe_ns) / 1e9 / (double)NTHREADS;
+			plan_time(build,str_build,sizeof(str_build));
+			if(range_bits > 0)	{
+				plan_time(pow(2,range_bits) / speed,str_range,sizeof(str_range));
+			}
+			else	{
+				snprintf(str_range,sizeof(str_range),"-");
+			}
+			snprintf(str_prefilter,sizeof(str_prefilter),f ? "%" PRIu64 : "-",prefilter_bytes/1048576);
+			printf("[+]   %-19s %-7" PRIu64 " %-4s %10.1f  %-14s %12.4g  %s\n",str_n,k,str_prefilter,(double)memory/1048576,str_build,speed,str_range);
+			if(speed > best_speed)	{
+				best_speed = speed;
+				best_k = k;
+				best_prefilter = f ? prefilter_bytes : 0;
+				snprintf(best_n,sizeof(best_n),"%s",str_n);
+			}
+		}
+	}
+	if(best_k == 0)	{
+		fprintf(stderr,"[E] There is not enough RAM for any -n and -k value\n");
+		return;
+	}
+	printf("[+] Recommended flags: -n %s -k %" PRIu64,best_n,best_k);
+	if(best_prefilter)	{
+		printf(" -L %" PRIu64,best_prefilter/1048576);
+	}
+	printf("\n");
+}
+/*
+	Number of targets for the -P planner, the non empty lines of the -f file
+*/
+uint64_t plan_targets(const char *filename)	{
+	FILE *fd;
+	char line[1024];
+	uint64_t targets = 0;
+	fd = fopen(filename,"r");
+	if(fd == NULL)	{
+		fprintf(stderr,"[W] Can't open the file %s, planning for one target\n",filename);
+		return 1;
+	}
+	while(fgets(line,sizeof(line),fd) != NULL)	{
+		trim(line," \t\n\r");
+		if(strlen(line) > 0)	{
+			targets++;
+		}
+	}
+	fclose(fd);
+	return (targets > 0) ? targets : 1;
+}
+
+/*
+	Size in bits of the range for the -P planner, from -P ram:bits, -b or -r
+*/
+double plan_range()	{
+	Int start,end;
+	if(plan_bits > 0)	{
+		return plan_bits;
+	}
+	if(FLAGBITRANGE)	{
+		return (double)(bitrange - 1);
+	}
+	if(FLAGRANGE)	{
+		start.SetBase16(range_start);
+		end.SetBase16(range_end);
+		end.Sub(&start);
+		return (double)end.GetBitLength();
+	}
+	return 0;
+}
+
+/*
+	Bytes of the RNG of the system, the secp256k1 Random.cpp only has the seeded rnd()
+*/
+int random_bytes(unsigned char *buffer,int bytes)	{
+#if defined(_WIN64) && !defined(__CYGWIN__)
+	return BCryptGenRandom(NULL,buffer,bytes,BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0 ? bytes : -1;
+#else
+	return getrandom(buffer,bytes,GRND_NONBLOCK);
+#endif
+}
 
 void sleep_ms(int milliseconds)	{ // cross-platform sleep function
 #if defined(_WIN64) && !defined(__CYGWIN__)
@@ -4529,25 +6577,14 @@ void *thread_pub2rmd(void *vargp)	{
 	limit = 0xFFFFFFFF;
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	do {
 		if(FLAGRANDOM){
 			key_mpz.Rand(&n_range_start,&n_range_diff);
 		}
 		else	{
-			if(n_range_start.IsLower(&n_range_end))	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-				WaitForSingleObject(write_random, INFINITE);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				ReleaseMutex(write_random);
-#else
-				pthread_mutex_lock(&write_random);
-				key_mpz.Set(&n_range_start);
-				n_range_start.Add(N_SEQUENTIAL_MAX);
-				pthread_mutex_lock(&write_random);
-#endif
-			}
-			else	{
+			work_cursor_take(&range_cursor,thread_number,&key_mpz);
+			if(!key_mpz.IsLower(&n_range_end))	{
 				pub2rmd_continue = 0;
 			}
 		}
@@ -4574,7 +6611,7 @@ void *thread_pub2rmd(void *vargp)	{
 				pub.parity = 0x02;
 				sha256((uint8_t*)&pub, 33, (uint8_t*)digest256);
 				rmd160((const unsigned char*)digest256,32,(unsigned char*) digest160);
-				r = bloom_check(&bloom,digest160,MAXLENGTHADDRESS);
+				r = address_bloomcheck(digest160,MAXLENGTHADDRESS);
 				if(r)  {
 					r = searchbinary(addressTable,digest160,N);
 					if(r)	{
@@ -4604,7 +6641,7 @@ void *thread_pub2rmd(void *vargp)	{
 				pub.parity = 0x03;
 				sha256((uint8_t*)&pub, 33,(uint8_t*) digest256);
 				rmd160((const unsigned char*)digest256,32,(unsigned char*) digest160);
-				r = bloom_check(&bloom,digest160,MAXLENGTHADDRESS);
+				r = address_bloomcheck(digest160,MAXLENGTHADDRESS);
 				if(r)  {
 					r = searchbinary(addressTable,digest160,N);
 					if(r)  {
@@ -4634,7 +6671,7 @@ void *thread_pub2rmd(void *vargp)	{
 				}
 				pub.X.data32[7]++;
 				if(pub.X.data32[7] % DEBUGCOUNT == 0)  {
-					steps[thread_number]++;
+					telemetry[thread_number].steps++;
 				}
 			}	
 		}	
@@ -4776,42 +6813,26 @@ void *thread_bPload(void *vargp)	{
 			bloom_bP_index = (uint8_t)rawvalue[0];
 			if(i_counter < bsgs_m3)	{
 				if(!FLAGREADEDFILE3)	{
-					memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
-					bPtable[i_counter].index = i_counter;
+					if(FLAGHASHINDEX)	{
+						bsgs_hashindex_add(rawvalue,i_counter);
+					}
+					else	{
+						memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
+						bsgs_xvalue_setindex(&bPtable[i_counter],i_counter);
+					}
 				}
 				if(!FLAGREADEDFILE4)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-					WaitForSingleObject(bloom_bPx3rd_mutex[bloom_bP_index], INFINITE);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					ReleaseMutex(bloom_bPx3rd_mutex[bloom_bP_index]);
-#else
-					pthread_mutex_lock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					pthread_mutex_unlock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-#endif
+					bloom_add_atomic(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 				}
 			}
 			if(i_counter < bsgs_m2 && !FLAGREADEDFILE2)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-				WaitForSingleObject(bloom_bPx2nd_mutex[bloom_bP_index], INFINITE);
-				bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-				ReleaseMutex(bloom_bPx2nd_mutex[bloom_bP_index]);
-#else
-				pthread_mutex_lock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-				bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-				pthread_mutex_unlock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-#endif	
+				bloom_add_atomic(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 			}
 			if(i_counter < to && !FLAGREADEDFILE1 )	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-				WaitForSingleObject(bloom_bP_mutex[bloom_bP_index], INFINITE);
-				bloom_add(&bloom_bP[bloom_bP_index], rawvalue ,BSGS_BUFFERXPOINTLENGTH);
-				ReleaseMutex(bloom_bP_mutex[bloom_bP_index);
-#else
-				pthread_mutex_lock(&bloom_bP_mutex[bloom_bP_index]);
-				bloom_add(&bloom_bP[bloom_bP_index], rawvalue ,BSGS_BUFFERXPOINTLENGTH);
-				pthread_mutex_unlock(&bloom_bP_mutex[bloom_bP_index]);
-#endif
+				bloom_add_atomic(&bloom_bP[bsgs_shard(rawvalue)], rawvalue ,BSGS_BUFFERXPOINTLENGTH);
+			}
+			if(i_counter < to && FLAGPREFILTER && !FLAGREADEDFILE5 )	{
+				bloom_add_blocked_atomic(&bloom_bP_pre, rawvalue ,BSGS_BUFFERXPOINTLENGTH);
 			}
 			i_counter++;
 		}
@@ -4958,31 +6979,20 @@ void *thread_bPload_2blooms(void *vargp)	{
 			bloom_bP_index = (uint8_t)rawvalue[0];
 			if(i_counter < bsgs_m3)	{
 				if(!FLAGREADEDFILE3)	{
-					memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
-					bPtable[i_counter].index = i_counter;
+					if(FLAGHASHINDEX)	{
+						bsgs_hashindex_add(rawvalue,i_counter);
+					}
+					else	{
+						memcpy(bPtable[i_counter].value,rawvalue+16,BSGS_XVALUE_RAM);
+						bsgs_xvalue_setindex(&bPtable[i_counter],i_counter);
+					}
 				}
 				if(!FLAGREADEDFILE4)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-					WaitForSingleObject(bloom_bPx3rd_mutex[bloom_bP_index], INFINITE);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					ReleaseMutex(bloom_bPx3rd_mutex[bloom_bP_index]);
-#else
-					pthread_mutex_lock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-					bloom_add(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					pthread_mutex_unlock(&bloom_bPx3rd_mutex[bloom_bP_index]);
-#endif
+					bloom_add_atomic(&bloom_bPx3rd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 				}
 			}
 			if(i_counter < bsgs_m2 && !FLAGREADEDFILE2)	{
-#if defined(_WIN64) && !defined(__CYGWIN__)
-					WaitForSingleObject(bloom_bPx2nd_mutex[bloom_bP_index], INFINITE);
-					bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					ReleaseMutex(bloom_bPx2nd_mutex[bloom_bP_index]);
-#else
-					pthread_mutex_lock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-					bloom_add(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
-					pthread_mutex_unlock(&bloom_bPx2nd_mutex[bloom_bP_index]);
-#endif			
+					bloom_add_atomic(&bloom_bPx2nd[bloom_bP_index], rawvalue, BSGS_BUFFERXPOINTLENGTH);
 			}
 			i_counter++;
 		}
@@ -5042,39 +7052,26 @@ void generate_binaddress_eth(Point &publickey,unsigned char *dst_address)	{
 	memcpy(dst_address,bin_publickey+12,20);	
 }
 
-#if defined(_WIN64) && !defined(__CYGWIN__)
-DWORD WINAPI thread_process_bsgs_dance(LPVOID vargp) {
-#else
-void *thread_process_bsgs_dance(void *vargp)	{
-#endif
-
-	FILE *filekey;
-	struct tothread *tt;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound;
-	Point base_point,point_aux,point_found;
-	uint32_t k,l,r,salir,thread_number,entrar,cycles;
-	
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
+#if defined(_WIN64) && !defined(__CYGWIN__)
+DWORD WINAPI thread_process_bsgs_dance(LPVOID vargp) {
+#else
+void *thread_process_bsgs_dance(void *vargp)	{
+#endif
 
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
+	struct tothread *tt;
+	char *aux_c;
+	Int base_key;
+	Point base_point,point_aux;
+	uint32_t r,thread_number,entrar,cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
 	Int km,intaux;
-	Point pp;
-	Point pn;
 	grp->Set(dx);
 
 	
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	
 	cycles = bsgs_aux / 1024;
@@ -5169,161 +7166,8 @@ void *thread_process_bsgs_dance(void *vargp)	{
 		km.Sub(&intaux);
 		point_aux = secp->ComputePublicKey(&km);
 		
-		for(k = 0; k < bsgs_point_number ; k++)	{
-			if(bsgs_found[k] == 0)	{
-				startP  = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
-				uint32_t j = 0;
-				while( j < cycles && bsgs_found[k]== 0 )	{
-					int i;
-					for(i = 0; i < hLength; i++) {
-						dx[i].ModSub(&GSn[i].x,&startP.x);
-					}
-					dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-					dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
-
-					// Grouped ModInv
-					grp->ModInv();
-					
-					/*
-					We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-					We compute key in the positive and negative way from the center of the group
-					*/
-
-					// center point
-					pts[CPU_GRP_SIZE / 2] = startP;
-					
-					for(i = 0; i<hLength; i++) {
-
-						pp = startP;
-						pn = startP;
-
-						// P = startP + i*G
-						dy.ModSub(&GSn[i].y,&pp.y);
-
-						_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pp.x.ModNeg();
-						pp.x.ModAdd(&_p);
-						pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-						
-#if 0
-  pp.y.ModSub(&GSn[i].x,&pp.x);
-  pp.y.ModMulK1(&_s);
-  pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-						// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-						dyn.Set(&GSn[i].y);
-						dyn.ModNeg();
-						dyn.ModSub(&pn.y);
-
-						_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pn.x.ModNeg();
-						pn.x.ModAdd(&_p);
-						pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
-
-#if 0
-  pn.y.ModSub(&GSn[i].x,&pn.x);
-  pn.y.ModMulK1(&_s);
-  pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-
-						pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
-						pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
-
-					}
-
-					// First point (startP - (GRP_SZIE/2)*G)
-					pn = startP;
-					dyn.Set(&GSn[i].y);
-					dyn.ModNeg();
-					dyn.ModSub(&pn.y);
-
-					_s.ModMulK1(&dyn,&dx[i]);
-					_p.ModSquareK1(&_s);
-
-					pn.x.ModNeg();
-					pn.x.ModAdd(&_p);
-					pn.x.ModSub(&GSn[i].x);
-
-#if 0
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
-#endif
-
-					pts[0] = pn;
-					
-					for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k]== 0; i++) {
-						pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-						r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-						if(r) {
-							r = bsgs_secondcheck(&base_key,((j*1024) + i),k,&keyfound);
-							if(r)	{
-								hextemp = keyfound.GetBase16();
-								printf("[+] Thread Key found privkey %s   \n",hextemp);
-								point_found = secp->ComputePublicKey(&keyfound);
-								aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k],point_found);
-								printf("[+] Publickey %s\n",aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								WaitForSingleObject(write_keys, INFINITE);
-#else
-								pthread_mutex_lock(&write_keys);
-#endif
-
-								filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-								if(filekey != NULL)	{
-									fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-									fclose(filekey);
-								}
-								free(hextemp);
-								free(aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								ReleaseMutex(write_keys);
-#else
-								pthread_mutex_unlock(&write_keys);
-#endif
-
-								bsgs_found[k] = 1;
-								salir = 1;
-								for(l = 0; l < bsgs_point_number && salir; l++)	{
-									salir &= bsgs_found[l];
-								}
-								if(salir)	{
-									printf("All points were found\n");
-									exit(EXIT_FAILURE);
-								}
-							} //End if second check
-						}//End if first check
-						
-					}// For for pts variable
-					
-					// Next start point (startP += (bsSize*GRP_SIZE).G)
-					
-					pp = startP;
-					dy.ModSub(&_2GSn.y,&pp.y);
-
-					_s.ModMulK1(&dy,&dx[i + 1]);
-					_p.ModSquareK1(&_s);
-
-					pp.x.ModNeg();
-					pp.x.ModAdd(&_p);
-					pp.x.ModSub(&_2GSn.x);
-
-					pp.y.ModSub(&_2GSn.x,&pp.x);
-					pp.y.ModMulK1(&_s);
-					pp.y.ModSub(&_2GSn.y);
-					startP = pp;
-					
-					j++;
-				}//while all the aMP points
-			}// End if 
-		}
-		steps[thread_number]+=2;
+		bsgs_walk_targets(&base_key,point_aux,cycles,grp,dx);
+		telemetry[thread_number].steps+=2;
 	}while(1);
 	ends[thread_number] = 1;
 	return NULL;
@@ -5334,32 +7178,20 @@ DWORD WINAPI thread_process_bsgs_backward(LPVOID vargp) {
 #else
 void *thread_process_bsgs_backward(void *vargp)	{
 #endif
-	FILE *filekey;
-	struct tothread *tt;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound;
-	Point base_point,point_aux,point_found;
-	uint32_t k,l,r,salir,thread_number,entrar,cycles;
-	
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
 
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
+	struct tothread *tt;
+	char *aux_c;
+	Int base_key;
+	Point base_point,point_aux;
+	uint32_t thread_number,entrar,cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
 	Int km,intaux;
-	Point pp;
-	Point pn;
 	grp->Set(dx);
 	
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 
 	cycles = bsgs_aux / 1024;
@@ -5427,160 +7259,8 @@ void *thread_process_bsgs_backward(void *vargp)	{
 		km.Sub(&intaux);
 		point_aux = secp->ComputePublicKey(&km);
 		
-		for(k = 0; k < bsgs_point_number ; k++)	{
-			if(bsgs_found[k] == 0)	{
-				startP  = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
-				uint32_t j = 0;
-				while( j < cycles && bsgs_found[k]== 0 )	{	
-					int i;				
-					for(i = 0; i < hLength; i++) {
-						dx[i].ModSub(&GSn[i].x,&startP.x);
-					}
-					dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-					dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
-
-					// Grouped ModInv
-					grp->ModInv();
-					
-					/*
-					We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-					We compute key in the positive and negative way from the center of the group
-					*/
-
-					// center point
-					pts[CPU_GRP_SIZE / 2] = startP;
-					
-					for(i = 0; i<hLength; i++) {
-
-						pp = startP;
-						pn = startP;
-
-						// P = startP + i*G
-						dy.ModSub(&GSn[i].y,&pp.y);
-
-						_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pp.x.ModNeg();
-						pp.x.ModAdd(&_p);
-						pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-						
-#if 0
-  pp.y.ModSub(&GSn[i].x,&pp.x);
-  pp.y.ModMulK1(&_s);
-  pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-						// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-						dyn.Set(&GSn[i].y);
-						dyn.ModNeg();
-						dyn.ModSub(&pn.y);
-
-						_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pn.x.ModNeg();
-						pn.x.ModAdd(&_p);
-						pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
-
-#if 0
-  pn.y.ModSub(&GSn[i].x,&pn.x);
-  pn.y.ModMulK1(&_s);
-  pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-
-						pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
-						pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
-
-					}
-
-					// First point (startP - (GRP_SZIE/2)*G)
-					pn = startP;
-					dyn.Set(&GSn[i].y);
-					dyn.ModNeg();
-					dyn.ModSub(&pn.y);
-
-					_s.ModMulK1(&dyn,&dx[i]);
-					_p.ModSquareK1(&_s);
-
-					pn.x.ModNeg();
-					pn.x.ModAdd(&_p);
-					pn.x.ModSub(&GSn[i].x);
-
-#if 0
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
-#endif
-
-					pts[0] = pn;
-					
-					for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k]== 0; i++) {
-						pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-						r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-						if(r) {
-							r = bsgs_secondcheck(&base_key,((j*1024) + i),k,&keyfound);
-							if(r)	{
-								hextemp = keyfound.GetBase16();
-								printf("[+] Thread Key found privkey %s   \n",hextemp);
-								point_found = secp->ComputePublicKey(&keyfound);
-								aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k],point_found);
-								printf("[+] Publickey %s\n",aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								WaitForSingleObject(write_keys, INFINITE);
-#else
-								pthread_mutex_lock(&write_keys);
-#endif
-
-								filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-								if(filekey != NULL)	{
-									fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-									fclose(filekey);
-								}
-								free(hextemp);
-								free(aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								ReleaseMutex(write_keys);
-#else
-								pthread_mutex_unlock(&write_keys);
-#endif
-
-								bsgs_found[k] = 1;
-								salir = 1;
-								for(l = 0; l < bsgs_point_number && salir; l++)	{
-									salir &= bsgs_found[l];
-								}
-								if(salir)	{
-									printf("All points were found\n");
-									exit(EXIT_FAILURE);
-								}
-							} //End if second check
-						}//End if first check
-						
-					}// For for pts variable
-					
-					// Next start point (startP += (bsSize*GRP_SIZE).G)
-					
-					pp = startP;
-					dy.ModSub(&_2GSn.y,&pp.y);
-
-					_s.ModMulK1(&dy,&dx[i + 1]);
-					_p.ModSquareK1(&_s);
-
-					pp.x.ModNeg();
-					pp.x.ModAdd(&_p);
-					pp.x.ModSub(&_2GSn.x);
-
-					pp.y.ModSub(&_2GSn.x,&pp.x);
-					pp.y.ModMulK1(&_s);
-					pp.y.ModSub(&_2GSn.y);
-					startP = pp;
-					j++;
-				}//while all the aMP points
-			}// End if 
-		}
-		steps[thread_number]+=2;
+		bsgs_walk_targets(&base_key,point_aux,cycles,grp,dx);
+		telemetry[thread_number].steps+=2;
 	}while(1);
 	ends[thread_number] = 1;
 	return NULL;
@@ -5592,33 +7272,21 @@ DWORD WINAPI thread_process_bsgs_both(LPVOID vargp) {
 #else
 void *thread_process_bsgs_both(void *vargp)	{
 #endif
-	FILE *filekey;
-	struct tothread *tt;
-	char xpoint_raw[32],*aux_c,*hextemp;
-	Int base_key,keyfound;
-	Point base_point,point_aux,point_found;
-	uint32_t k,l,r,salir,thread_number,entrar,cycles;
-	
-	IntGroup *grp = new IntGroup(CPU_GRP_SIZE / 2 + 1);
-	Point startP;
-	
-	int hLength = (CPU_GRP_SIZE / 2 - 1);
-	
-	Int dx[CPU_GRP_SIZE / 2 + 1];
-	Point pts[CPU_GRP_SIZE];
 
-	Int dy;
-	Int dyn;
-	Int _s;
-	Int _p;
+	struct tothread *tt;
+	char *aux_c;
+	Int base_key;
+	Point base_point,point_aux;
+	uint32_t r,thread_number,entrar,cycles;
+	IntGroup *grp = new IntGroup(BSGS_WALK_TARGETS * BSGS_WALK_GROUP);
+	Int *dx = new Int[BSGS_WALK_TARGETS * BSGS_WALK_GROUP];
 	Int km,intaux;
-	Point pp;
-	Point pn;
 	grp->Set(dx);
 
 	
 	tt = (struct tothread *)vargp;
 	thread_number = tt->nt;
+	thread_telemetry = &telemetry[thread_number];
 	free(tt);
 	
 	cycles = bsgs_aux / 1024;
@@ -5710,162 +7378,8 @@ void *thread_process_bsgs_both(void *vargp)	{
 		km.Sub(&intaux);
 		point_aux = secp->ComputePublicKey(&km);
 		
-		for(k = 0; k < bsgs_point_number ; k++)	{
-			if(bsgs_found[k] == 0)	{
-				startP  = secp->AddDirect(OriginalPointsBSGS[k],point_aux);
-				uint32_t j = 0;
-				while( j < cycles && bsgs_found[k]== 0 )	{
-					int i;
-					for(i = 0; i < hLength; i++) {
-						dx[i].ModSub(&GSn[i].x,&startP.x);
-					}
-					dx[i].ModSub(&GSn[i].x,&startP.x);  // For the first point
-					dx[i+1].ModSub(&_2GSn.x,&startP.x); // For the next center point
-
-					// Grouped ModInv
-					grp->ModInv();
-					
-					/*
-					We use the fact that P + i*G and P - i*G has the same deltax, so the same inverse
-					We compute key in the positive and negative way from the center of the group
-					*/
-
-					// center point
-					pts[CPU_GRP_SIZE / 2] = startP;
-					
-					for(i = 0; i<hLength; i++) {
-
-						pp = startP;
-						pn = startP;
-
-						// P = startP + i*G
-						dy.ModSub(&GSn[i].y,&pp.y);
-
-						_s.ModMulK1(&dy,&dx[i]);        // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pp.x.ModNeg();
-						pp.x.ModAdd(&_p);
-						pp.x.ModSub(&GSn[i].x);           // rx = pow2(s) - p1.x - p2.x;
-						
-#if 0
-  pp.y.ModSub(&GSn[i].x,&pp.x);
-  pp.y.ModMulK1(&_s);
-  pp.y.ModSub(&GSn[i].y);           // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-						// P = startP - i*G  , if (x,y) = i*G then (x,-y) = -i*G
-						dyn.Set(&GSn[i].y);
-						dyn.ModNeg();
-						dyn.ModSub(&pn.y);
-
-						_s.ModMulK1(&dyn,&dx[i]);       // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
-						_p.ModSquareK1(&_s);            // _p = pow2(s)
-
-						pn.x.ModNeg();
-						pn.x.ModAdd(&_p);
-						pn.x.ModSub(&GSn[i].x);          // rx = pow2(s) - p1.x - p2.x;
-
-#if 0
-  pn.y.ModSub(&GSn[i].x,&pn.x);
-  pn.y.ModMulK1(&_s);
-  pn.y.ModAdd(&GSn[i].y);          // ry = - p2.y - s*(ret.x-p2.x);  
-#endif
-
-
-						pts[CPU_GRP_SIZE / 2 + (i + 1)] = pp;
-						pts[CPU_GRP_SIZE / 2 - (i + 1)] = pn;
-
-					}
-
-					// First point (startP - (GRP_SZIE/2)*G)
-					pn = startP;
-					dyn.Set(&GSn[i].y);
-					dyn.ModNeg();
-					dyn.ModSub(&pn.y);
-
-					_s.ModMulK1(&dyn,&dx[i]);
-					_p.ModSquareK1(&_s);
-
-					pn.x.ModNeg();
-					pn.x.ModAdd(&_p);
-					pn.x.ModSub(&GSn[i].x);
-
-#if 0
-pn.y.ModSub(&GSn[i].x,&pn.x);
-pn.y.ModMulK1(&_s);
-pn.y.ModAdd(&GSn[i].y);
-#endif
-
-					pts[0] = pn;
-					
-					for(int i = 0; i<CPU_GRP_SIZE && bsgs_found[k]== 0; i++) {
-						pts[i].x.Get32Bytes((unsigned char*)xpoint_raw);
-						r = bloom_check(&bloom_bP[((unsigned char)xpoint_raw[0])],xpoint_raw,32);
-						if(r) {
-							r = bsgs_secondcheck(&base_key,((j*1024) + i),k,&keyfound);
-							if(r)	{
-								hextemp = keyfound.GetBase16();
-								printf("[+] Thread Key found privkey %s   \n",hextemp);
-								point_found = secp->ComputePublicKey(&keyfound);
-								aux_c = secp->GetPublicKeyHex(OriginalPointsBSGScompressed[k],point_found);
-								printf("[+] Publickey %s\n",aux_c);
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								WaitForSingleObject(write_keys, INFINITE);
-#else
-								pthread_mutex_lock(&write_keys);
-#endif
-
-								filekey = fopen("KEYFOUNDKEYFOUND.txt","a");
-								if(filekey != NULL)	{
-									fprintf(filekey,"Key found privkey %s\nPublickey %s\n",hextemp,aux_c);
-									fclose(filekey);
-								}
-
-#if defined(_WIN64) && !defined(__CYGWIN__)
-								ReleaseMutex(write_keys);
-#else
-								pthread_mutex_unlock(&write_keys);
-#endif
-
-								free(hextemp);
-								free(aux_c);
-								bsgs_found[k] = 1;
-								salir = 1;
-								for(l = 0; l < bsgs_point_number && salir; l++)	{
-									salir &= bsgs_found[l];
-								}
-								if(salir)	{
-									printf("All points were found\n");
-									exit(EXIT_FAILURE);
-								}
-							} //End if second check
-						}//End if first check
-						
-					}// For for pts variable
-					
-					// Next start point (startP += (bsSize*GRP_SIZE).G)
-					
-					pp = startP;
-					dy.ModSub(&_2GSn.y,&pp.y);
-
-					_s.ModMulK1(&dy,&dx[i + 1]);
-					_p.ModSquareK1(&_s);
-
-					pp.x.ModNeg();
-					pp.x.ModAdd(&_p);
-					pp.x.ModSub(&_2GSn.x);
-
-					pp.y.ModSub(&_2GSn.x,&pp.x);
-					pp.y.ModMulK1(&_s);
-					pp.y.ModSub(&_2GSn.y);
-					startP = pp;
-					
-					j++;
-				}//while all the aMP points
-			}// End if 
-		}
-		steps[thread_number]+=2;
+		bsgs_walk_targets(&base_key,point_aux,cycles,grp,dx);
+		telemetry[thread_number].steps+=2;
 	}while(1);
 	ends[thread_number] = 1;
 	return NULL;
@@ -5996,28 +7510,41 @@ void sha256sse_23(uint8_t *src0, uint8_t *src1, uint8_t *src2, uint8_t *src3, ui
 void menu() {
 	printf("\nUsage:\n");
 	printf("-h          show this help\n");
-	printf("-B Mode     BSGS now have some modes <sequential, backward, both, random, dance>\n");
+	printf("-B Mode     BSGS now have some modes <sequential, backward, both, random, dance, permuted>\n");
+	printf("            permuted: every block of the range once in random order, also for address, rmd160, xpoint and vanity\n");
 	printf("-b bits     For some puzzles you only need some numbers of bits in the test keys.\n");
 	printf("-c crypto   Search for specific crypto. <btc, eth> valid only w/ -m address\n");
 	printf("-C mini     Set the minikey Base only 22 character minikeys, ex: SRPqx8QiwnW4WNWnTVa2W5\n");
 	printf("-8 alpha    Set the bas58 alphabet for minikeys\n");
 	printf("-e          Enable endomorphism search (Only for address, rmd160 and vanity)\n");
 	printf("-f file     Specify file name with addresses or xpoints or uncompressed public keys\n");
+	printf("-F shards   Number of shards of the first bsgs bloom filter, power of two from 256 to 65536, default 256\n");
+	printf("-H          Hash index in place of the third bloom filter and the sorted bP table, only for bsgs\n");
 	printf("-I stride   Stride for xpoint, rmd160 and address, this option don't work with bsgs\n");
+	printf("-J file     Write the bloom filter telemetry as JSON to this file with every stats line\n");
 	printf("-k value    Use this only with bsgs mode, k value is factor for M, more speed but more RAM use wisely\n");
 	printf("-l look     What type of address/hash160 are you looking for <compress, uncompress, both> Only for rmd160 and address\n");
+	printf("-L size     First level filter size in MB (K suffix for KB), checked before the big bloom filter, only for bsgs\n");
 	printf("-m mode     mode of search for cryptos. (bsgs, xpoint, rmd160, address, vanity) default: address\n");
 	printf("-M          Matrix screen, feel like a h4x0r, but performance will dropped\n");
+	printf("-O          Use the bP table of the third check from the file keyhunt_bsgs_2_*.tbl mapped in memory\n");
+	printf("            It saves only the RAM of that table (less than 1% of the total), the bloom filters stay in RAM, only for bsgs\n");
 	printf("-n number   Check for N sequential numbers before the random chosen, this only works with -R option\n");
 	printf("            Use -n to set the N for the BSGS process. Bigger N more RAM needed\n");
+	printf("-P ram[:bits] Print the recommended -n, -k and -L values for this RAM in GB (M suffix for MB), the range is\n");
+	printf("            taken from bits, -b or -r and the targets from -f, nothing is built, only for bsgs\n");
 	printf("-q          Quiet the thread output\n");
 	printf("-r SR:EN    StarRange:EndRange, the end range can be omitted for search from start range to N-1 ECC value\n");
 	printf("-R          Random, this is the default behavior\n");
 	printf("-s ns       Number of seconds for the stats output, 0 to omit output.\n");
 	printf("-S          S is for SAVING in files BSGS data (Bloom filters and bPtable)\n");
 	printf("-t tn       Threads number, must be a positive integer\n");
+	printf("-T name     BSGS tables shared with other processes in this POSIX shared memory name or hugetlbfs file\n");
 	printf("-v value    Search for vanity Address, only with -m address and rmd160\n");
+	printf("-W port     HTTP port in 127.0.0.1 for the Prometheus metrics (GET /metrics), not in Windows\n");
 	printf("-z value    Bloom size multiplier, only address,rmd160,vanity, xpoint, value >= 1\n");
+	printf("--checkpoint file  Save a sequential or permuted scan in this file every minute and at the end\n");
+	printf("--resume    Continue the scan from the file of --checkpoint\n");
 	printf("\nExample:\n\n");
 	printf("./keyhunt -m rmd160 -f tests/unsolvedpuzzles.rmd -b 66 -l compress -R -q -t 8\n\n");
 	printf("This line runs the program with 8 threads from the range 20000000000000000 to 40000000000000000 without stats output\n\n");
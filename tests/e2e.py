@@ -0,0 +1,336 @@
+#!/usr/bin/env python3
+# End to end checks with known keys for the search paths of keyhunt_legacy and bsgsd.
+# Run it from the root of the repository after make legacy and make bsgsd, or with make test:
+#
+#   python3 tests/e2e.py [keyhunt_legacy] [bsgsd]
+#
+# A missing binary fails the run. The table and KEYFOUND files are written in a
+# temporary directory, the servers listen one after the other on the port 8080 (8081 for -W).
+
+import os
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+LEGACY = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else 'keyhunt_legacy')
+BSGSD = os.path.abspath(sys.argv[2] if len(sys.argv) > 2 else 'bsgsd')
+TESTS = os.path.dirname(os.path.abspath(__file__))
+PORT = 8080
+
+P = 2**256 - 2**32 - 977
+G = (0x79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798,
+     0x483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8)
+
+# Private keys of the puzzles 1 to 16, the ones of tests/1to32.rmd and tests/1to32.txt below 0x10000
+PUZZLES = [0x1, 0x3, 0x7, 0x8, 0x15, 0x31, 0x4c, 0xe0, 0x1d3, 0x202, 0x483, 0xa7b, 0x1460, 0x2930, 0x68f3, 0xc936]
+
+failed = 0
+
+
+def point_add(a, b):
+    if a is None:
+        return b
+    if b is None:
+        return a
+    if a[0] == b[0]:
+        if (a[1] + b[1]) % P == 0:
+            return None
+        l = 3 * a[0] * a[0] * pow(2 * a[1], P - 2, P) % P
+    else:
+        l = (b[1] - a[1]) * pow(b[0] - a[0], P - 2, P) % P
+    x = (l * l - a[0] - b[0]) % P
+    return (x, (l * (a[0] - x) - a[1]) % P)
+
+
+def publickey(k):
+    r = None
+    q = G
+    while k:
+        if k & 1:
+            r = point_add(r, q)
+        q = point_add(q, q)
+        k >>= 1
+    return ('02' if r[1] % 2 == 0 else '03') + '%064x' % r[0]
+
+
+def check(name, ok, output=''):
+    global failed
+    print('[%s] %s' % ('+' if ok else 'E', name))
+    if not ok:
+        failed += 1
+        if output:
+            print(output)
+
+
+def legacy(args, work):
+    try:
+        r = subprocess.run([LEGACY, '-q', '-s', '0'] + args, cwd=work, stdout=subprocess.PIPE,
+                           stderr=subprocess.STDOUT, timeout=120)
+        return r.stdout.decode(errors='replace')
+    except subprocess.TimeoutExpired as e:
+        return (e.stdout or b'').decode(errors='replace') + '\ntimeout'
+
+
+def legacy_bsgs(keys, args, work):
+    with open(os.path.join(work, 'bsgs.txt'), 'w') as f:
+        f.write('\n'.join(publickey(k) for k in keys) + '\n')
+    out = legacy(['-m', 'bsgs', '-f', 'bsgs.txt', '-n', '0x100000', '-k', '1', '-t', '2'] + args, work)
+    return out, all('privkey %x ' % k in out for k in keys)
+
+
+def legacy_checks(work):
+    for mode, name in (('rmd160', '1to32.rmd'), ('address', '1to32.txt')):
+        out = legacy(['-m', mode, '-f', os.path.join(TESTS, name), '-r', '1:10000', '-n', '0x10000', '-t', '1'], work)
+        found = set(int(line.split()[-1], 16) for line in out.splitlines() if 'Private Key:' in line)
+        check('legacy %s puzzles 1 to 16' % mode, found == set(PUZZLES), out)
+
+    out, ok = legacy_bsgs([0x1234567], ['-r', '1000000:2000000'], work)
+    check('legacy bsgs', ok, out)
+
+    # Keys a few baby steps after the start of a giant step, some of them only match the negated point
+    out, ok = legacy_bsgs([0x800004, 0x80000c, 0x801004], ['-r', '800000:900000', '-H'], work)
+    check('legacy bsgs -H', ok, out)
+
+    # Twice, the second run maps the table file made by the first one
+    for i in range(2):
+        out, ok = legacy_bsgs([0x1234567], ['-r', '1000000:2000000', '-k', '512', '-O'], work)
+        check('legacy bsgs -O', ok, out)
+
+    out, ok = legacy_bsgs([0x123456, 0x2345678], ['-r', '100000:3000000'], work)
+    check('legacy bsgs sequential with several keys', ok and 'All points were found' in out, out)
+
+    # Nothing is saved without --checkpoint, with it the scan is saved at the end and --resume continues it
+    files = set(os.listdir(work))
+    out, ok = legacy_bsgs([0x2345678], ['-r', '100000:1000000'], work)
+    check('legacy no checkpoint without --checkpoint', 'End' in out and set(os.listdir(work)) == files, out)
+    out, ok = legacy_bsgs([0x2345678], ['-r', '100000:1000000', '--checkpoint', 'scan.chk'], work)
+    check('legacy --checkpoint', os.path.exists(os.path.join(work, 'scan.chk')), out)
+    out, ok = legacy_bsgs([0x2345678], ['-r', '100000:1000000', '--checkpoint', 'scan.chk', '--resume'], work)
+    check('legacy --resume', 'End' in out and '[E]' not in out, out)
+
+
+def connect():
+    s = socket.create_connection(('127.0.0.1', PORT), timeout=60)
+    return s, s.makefile('rb')
+
+
+def read_line(f):
+    return f.readline().decode().rstrip('\n')
+
+
+def send(s, data):
+    try:
+        s.sendall(data)
+    except OSError:
+        pass
+
+
+def query(line):
+    s = socket.create_connection(('127.0.0.1', PORT), timeout=60)
+    s.sendall((line + '\n').encode())
+    data = b''
+    while True:
+        chunk = s.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    return data.decode().strip()
+
+
+def bsgsd_start(work, args):
+    try:
+        socket.create_connection(('127.0.0.1', PORT), timeout=1).close()
+        check('bsgsd port %d free' % PORT, False, 'Other server is already listening on the port %d' % PORT)
+        return None
+    except OSError:
+        pass
+    log = open(os.path.join(work, 'bsgsd.log'), 'a')
+    server = subprocess.Popen([BSGSD, '-n', '0x1000000', '-k', '1', '-t', '2', '-p', str(PORT)] + args,
+                              cwd=work, stdout=log, stderr=subprocess.STDOUT)
+    for i in range(240):
+        try:
+            socket.create_connection(('127.0.0.1', PORT), timeout=1).close()
+            return server
+        except OSError:
+            if server.poll() is not None:
+                break
+            time.sleep(0.5)
+    server.kill()
+    server.wait()
+    check('bsgsd started with %s' % ' '.join(args), False)
+    return None
+
+
+def bsgsd_stop(server):
+    server.kill()
+    server.wait()
+
+
+def bsgsd_checks(work):
+    server = bsgsd_start(work, [])
+    if server is None:
+        return
+    key = publickey(0x1234567abc)
+    other = publickey(0x2345678abc)
+    try:
+        r = query('%s 1000000000:2000000000' % key)
+        check('bsgsd single key', r == '1234567abc', r)
+
+        r = query('%s,%s 1000000000:2000000000' % (key, other)).splitlines()
+        check('bsgsd several keys', sorted(r) == sorted(['%s 1234567abc' % key, '%s 404 Not Found' % other]), r)
+
+        r = query('nothex 1:2')
+        check('bsgsd bad request', r == '400 Bad Request', r)
+
+        s, f = connect()
+        s.sendall(('KEEPALIVE\n%s 1000000000:2000000000\n%s 4000000000:4000100000\n' % (key, other)).encode())
+        r = [read_line(f) for i in range(3)]
+        check('bsgsd KEEPALIVE', r == ['200 OK', '1234567abc', '404 Not Found'], r)
+        s.close()
+
+        # More pipelined lines than the length limit of one request, the server is stopped
+        # while they are sent so all of them are waiting in the socket, all are replied
+        s, f = connect()
+        server.send_signal(signal.SIGSTOP)
+        sender = threading.Thread(target=send, args=(s, b'KEEPALIVE\n' + b'PROGRESS\n' * 130000))
+        sender.start()
+        time.sleep(1)
+        server.send_signal(signal.SIGCONT)
+        try:
+            r = [read_line(f) for i in range(130001)]
+        except OSError as e:
+            r = [str(e)]
+        sender.join()
+        check('bsgsd pipelined requests', r.count('PROGRESS END') == 130000 and '200 OK' in r, r[:3])
+        s.close()
+
+        s, f = connect()
+        s.sendall(b'KEEPALIVE\nPROGRESS\nCANCEL 999999\n')
+        r = [read_line(f) for i in range(3)]
+        # PROGRESS and CANCEL are replied at once, before the 200 OK that waits its turn
+        check('bsgsd PROGRESS and CANCEL', sorted(r) == ['200 OK', 'CANCEL 999999 404 Not Found', 'PROGRESS END'], r)
+        s.close()
+
+        # PROGRESS and CANCEL of other connection don't see the job
+        s, f = connect()
+        s.sendall(('KEEPALIVE\n%s 100000000000:ffffffffffff\nPROGRESS\n' % other).encode())
+        r = [read_line(f) for i in range(3)]
+        # The 200 OK of KEEPALIVE can come after the PROGRESS lines that are replied at once
+        lines = [line for line in r if line.startswith('PROGRESS ') and line != 'PROGRESS END']
+        job = lines[0].split()[1] if len(lines) == 1 else '0'
+        s2, f2 = connect()
+        s2.sendall(('KEEPALIVE\nPROGRESS %s\nCANCEL %s\n' % (job, job)).encode())
+        r2 = sorted(read_line(f2) for i in range(3))
+        s2.close()
+        s.sendall(('CANCEL %s\n' % job).encode())
+        r.append(read_line(f))
+        check('bsgsd PROGRESS and CANCEL of other connection', job != '0' and r2 == ['200 OK', 'CANCEL %s 404 Not Found' % job, 'PROGRESS %s 404 Not Found' % job] and
+              r[3] == 'CANCEL %s 200 OK' % job, (r, r2))
+        s.close()
+
+        # A range long enough to get some PROGRESS line, closing the connection cancels it
+        s, f = connect()
+        s.sendall(('KEEPALIVE\nWATCH 1\n%s 100000000000:ffffffffffff\n' % other).encode())
+        r = [read_line(f) for i in range(3)]
+        check('bsgsd WATCH', r[:2] == ['200 OK', '200 OK'] and r[2].startswith('PROGRESS '), r)
+        s.close()
+
+        r = query('%s 0:10' % publickey(5))
+        check('bsgsd range from 0', r == '5', r)
+
+        r = query('%s 3000000000:3001000000' % other)
+        check('bsgsd not found', r == '404 Not Found', r)
+        r = query('%s 3000000000:3001000000' % other)
+        check('bsgsd searched range skipped', r == '404 Not Found skipped 1000000', r)
+
+        # The key is out of the first blocks, the 404 of 1:10 must not hide the rest of 1:10000000
+        r = query('%s 1:10' % publickey(0x5000000))
+        r2 = query('%s 1:10000000' % publickey(0x5000000))
+        check('bsgsd unsearched part of a recorded range', r == '404 Not Found' and r2 == '5000000', (r, r2))
+
+        s, f = connect()
+        s.sendall(b'KEEPALIVE\nRELOAD\n')
+        r = [read_line(f) for i in range(3)]
+        check('bsgsd RELOAD', sorted(r[:2]) == ['200 OK', 'RELOAD 202 Accepted'] and r[2] == 'RELOAD 200 OK', r)
+        s.close()
+        r = query('%s 1000000000:2000000000' % key)
+        check('bsgsd search after RELOAD', r == '1234567abc', r)
+
+        # A long job keeps the old tables, the RELOAD ends and the new jobs use the new ones at once
+        s, f = connect()
+        s.sendall(('KEEPALIVE\n%s 100000000000:ffffffffffff\nPROGRESS\n' % other).encode())
+        r = [read_line(f) for i in range(3)]
+        lines = [line for line in r if line.startswith('PROGRESS ') and line != 'PROGRESS END']
+        job = lines[0].split()[1] if len(lines) == 1 else '0'
+        s2, f2 = connect()
+        s2.settimeout(20)
+        s2.sendall(b'KEEPALIVE\nRELOAD 2\n')
+        try:
+            r2 = [read_line(f2) for i in range(3)]
+        except OSError as e:
+            r2 = [str(e)]
+        s2.close()
+        try:
+            r3 = query('%s 1000000000:2000000000' % publickey(0x1334567abc))
+        except OSError as e:
+            r3 = str(e)
+        s.sendall(('PROGRESS %s\nCANCEL %s\n' % (job, job)).encode())
+        r.extend(read_line(f) for i in range(3))
+        check('bsgsd RELOAD with a running job', job != '0' and r2[-1:] == ['RELOAD 200 OK'] and r3 == '1334567abc' and
+              r[3].startswith('PROGRESS %s ' % job) and r[4] == 'CANCEL %s 200 OK' % job and r[5] == '410 Cancelled', (r, r2, r3))
+        s.close()
+        r = query('%s 1000000000:2000000000' % publickey(0x1434567abc))
+        check('bsgsd search after the old tables are freed', r == '1434567abc', r)
+
+        s, f = connect()
+        body = (0x1000000000).to_bytes(32, 'big') + (0x2000000000).to_bytes(32, 'big') + bytes.fromhex(key) + bytes.fromhex(other)
+        s.sendall(bytes([0xB5, 1, 0, 0]) + struct.pack('>I', len(body)) + body)
+        header = f.read(8)
+        records = f.read(struct.unpack('>I', header[4:8])[0]) if len(header) == 8 else b''
+        ok = (len(header) == 8 and header[0] == 0xB5 and (header[2] << 8 | header[3]) == 200 and len(records) == 66 and
+              records[0] == 1 and int.from_bytes(records[1:33], 'big') == 0x1234567abc and records[33] == 0)
+        check('bsgsd binary frame', ok, (header, records))
+        s.close()
+    finally:
+        bsgsd_stop(server)
+
+    # Keys a few baby steps after the start of a giant step, some of them only match the negated point
+    server = bsgsd_start(work, ['-H', '-W', str(PORT + 1)])
+    if server is None:
+        return
+    try:
+        for k in (0x800004, 0x80000c, 0x800014, 0x80004c, 0x801004, 0x80100c, 0x800005, 0x800064):
+            r = query('%s 800000:900000' % publickey(k))
+            check('bsgsd -H key %x' % k, r == '%x' % k, r)
+
+        # Only counters for the speed, the scraper applies rate() with its own window
+        s = socket.create_connection(('127.0.0.1', PORT + 1), timeout=60)
+        s.sendall(b'GET /metrics HTTP/1.0\r\n\r\n')
+        r = s.makefile('rb').read().decode()
+        s.close()
+        check('bsgsd metrics', '# TYPE bsgsd_keys_total counter' in r and 'per_second' not in r, r)
+    finally:
+        bsgsd_stop(server)
+
+
+def main():
+    with tempfile.TemporaryDirectory() as work:
+        for binary, checks in ((LEGACY, legacy_checks), (BSGSD, bsgsd_checks)):
+            if os.path.exists(binary):
+                checks(work)
+            else:
+                check('%s found' % binary, False, 'Build it first, its checks were not run')
+    if failed:
+        print('[E] %d checks failed' % failed)
+        sys.exit(1)
+    print('[+] All checks passed')
+
+
+if __name__ == '__main__':
+    main()
@@ -64,14 +64,20 @@ int hasMoreTokens(Tokenizer *t)	{
 	return (t->current < t->n);
 }
 
+/*
+	Same as strtok(data," \t:") but without its static state, bsgsd calls this from
+	several client threads at the same time.
+*/
 void stringtokenizer(char *data,Tokenizer *t)	{
 	char *token;
+	size_t length;
 	t->tokens = NULL;
 	t->n = 0;
 	t->current = 0;
 	trim(data,"\t\n\r :");
-	token = strtok(data," \t:");
-	while(token != NULL)	{
+	token = data + strspn(data," \t:");
+	while(*token != '\0')	{
+		length = strcspn(token," \t:");
 		t->n++;
 		t->tokens = (char**) realloc(t->tokens,sizeof(char*)*t->n);
 		if(t->tokens == NULL)	{
@@ -79,7 +85,12 @@ void stringtokenizer(char *data,Tokenizer *t)	{
 			exit(0);
 		}
 		t->tokens[t->n - 1] = token;
-		token = strtok(NULL," \t:");
+		token += length;
+		if(*token != '\0')	{
+			*token = '\0';
+			token++;
+			token += strspn(token," \t:");
+		}
 	}
 }
 